@@ -0,0 +1,63 @@
+// Deterministic test images for the benchmarks. The same seed and size always
+// give the same pixels, so results can be compared between releases.
+
+const jpg = require("..");
+
+// xorshift32, seeded so that every run generates the same corpus
+function random(seed) {
+  let state = seed >>> 0 || 1;
+  return function () {
+    state ^= state << 13;
+    state >>>= 0;
+    state ^= state >>> 17;
+    state ^= state << 5;
+    state >>>= 0;
+    return state / 4294967296;
+  };
+}
+
+// Smooth gradients with some noise, which compress roughly like photos do.
+// Pure noise or flat color would make the encoder look much slower or faster.
+function generateRaw(width, height, seed) {
+  const next = random(seed);
+  const data = Buffer.alloc(width * height * 3);
+  const fx = 1 + next() * 4;
+  const fy = 1 + next() * 4;
+  let i = 0;
+  for (let y = 0; y < height; y++) {
+    for (let x = 0; x < width; x++) {
+      const u = x / width;
+      const v = y / height;
+      const noise = (next() - 0.5) * 24;
+      data[i++] = clamp(128 + 100 * Math.sin(u * fx * Math.PI) + noise);
+      data[i++] = clamp(128 + 100 * Math.cos(v * fy * Math.PI) + noise);
+      data[i++] = clamp(255 * u * v + noise);
+    }
+  }
+  return data;
+}
+
+function clamp(value) {
+  return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+// One entry per size: the raw RGB pixels and a baseline JPEG of them. There is
+// no progressive variant, since compress only writes baseline images.
+function generateCorpus(sizes, seed) {
+  return sizes.map((size, index) => {
+    const width = size;
+    const height = Math.round(size * 3 / 4);
+    const raw = generateRaw(width, height, seed + index);
+    const options = { format: jpg.FORMAT_RGB, width: width, height: height, quality: 85, subsampling: jpg.SAMP_420 };
+    return {
+      name: width + "x" + height,
+      width: width,
+      height: height,
+      raw: raw,
+      options: options,
+      jpeg: jpg.compressSync(raw, options),
+    };
+  });
+}
+
+module.exports = { generateRaw, generateCorpus };
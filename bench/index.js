@@ -0,0 +1,328 @@
+// Load test for the async API: runs each operation over a deterministic corpus
+// at several concurrency levels, closed-loop (N callers, each waiting for its
+// previous call) and open-loop (calls arrive at a fixed rate whether or not
+// earlier ones have finished), and reports throughput, latency percentiles and
+// memory growth.
+//
+//   npm run bench -- --ops decompress --sizes 512,2048 --concurrency 1,4,16
+//   UV_THREADPOOL_SIZE=16 npm run bench -- --json bench_output.json
+//
+// Async calls run on the libuv thread pool, so UV_THREADPOOL_SIZE (4 by
+// default) caps the useful concurrency. It must be set before the process
+// starts.
+
+const fs = require("fs");
+const os = require("os");
+const jpg = require("..");
+const { generateCorpus } = require("./corpus");
+const { Latencies, MemorySampler } = require("./stats");
+
+const OPERATIONS = {
+  compress: {
+    run: (image) => jpg.compress(image.raw, image.options),
+    bytes: (image) => image.raw.length,
+  },
+  decompress: {
+    run: (image) => jpg.decompress(image.jpeg, { format: jpg.FORMAT_RGB }),
+    bytes: (image) => image.raw.length,
+  },
+  readDCT: {
+    run: (image) => jpg.readDCT(image.jpeg),
+    bytes: (image) => image.jpeg.length,
+  },
+};
+
+const DEFAULTS = {
+  ops: Object.keys(OPERATIONS),
+  sizes: [256, 1024, 2048],
+  concurrency: [1, 2, 4, 8, 16],
+  mode: "both",
+  duration: 3,
+  warmup: 0.5,
+  rate: 0,
+  maxInFlight: 256,
+  seed: 1,
+  json: null,
+};
+
+function parseArgs(argv) {
+  const args = Object.assign({}, DEFAULTS);
+  const list = (value) => value.split(",").filter((item) => item !== "");
+  for (let i = 0; i < argv.length; i++) {
+    const name = argv[i].replace(/^--/, "");
+    const value = argv[++i];
+    if (value === undefined) {
+      throw new Error("Missing value for --" + name);
+    }
+    switch (name) {
+      case "ops":
+        args.ops = list(value);
+        for (const op of args.ops) {
+          if (!OPERATIONS[op]) {
+            throw new Error("Unknown operation " + op);
+          }
+        }
+        break;
+      case "sizes":
+        args.sizes = list(value).map(Number);
+        break;
+      case "concurrency":
+        args.concurrency = list(value).map(Number);
+        break;
+      case "mode":
+        if (!["closed", "open", "both"].includes(value)) {
+          throw new Error("Invalid mode " + value);
+        }
+        args.mode = value;
+        break;
+      case "duration":
+      case "warmup":
+      case "rate":
+      case "maxInFlight":
+      case "seed":
+        args[name] = Number(value);
+        break;
+      case "json":
+        args.json = value;
+        break;
+      default:
+        throw new Error("Unknown option --" + name);
+    }
+  }
+  return args;
+}
+
+const now = () => Number(process.hrtime.bigint()) / 1e6;
+
+// Cycles through the corpus so that every caller sees the same sequence
+function picker(corpus) {
+  let index = 0;
+  return () => corpus[index++ % corpus.length];
+}
+
+async function warmUp(op, corpus, seconds) {
+  const end = now() + seconds * 1000;
+  const next = picker(corpus);
+  while (now() < end) {
+    await op.run(next());
+  }
+}
+
+// `concurrency` callers, each starting its next call once the previous one is
+// done. Measures the best throughput, but hides queueing delay.
+async function closedLoop(op, corpus, concurrency, seconds) {
+  const latencies = new Latencies();
+  const next = picker(corpus);
+  let bytes = 0;
+  const start = now();
+  const end = start + seconds * 1000;
+
+  async function caller() {
+    while (now() < end) {
+      const image = next();
+      const t0 = now();
+      await op.run(image);
+      latencies.add(now() - t0);
+      bytes += op.bytes(image);
+    }
+  }
+
+  const callers = [];
+  for (let i = 0; i < concurrency; i++) {
+    callers.push(caller());
+  }
+  await Promise.all(callers);
+  return { latencies, bytes, elapsed: now() - start, dropped: 0 };
+}
+
+// Calls start at a fixed rate regardless of how many are outstanding. Latency
+// is measured from when a call was due, not when it actually started, so a
+// stalled event loop shows up in the numbers instead of being hidden
+// (coordinated omission). Calls due while `maxInFlight` are outstanding are
+// dropped and counted.
+function openLoop(op, corpus, rate, seconds, maxInFlight) {
+  return new Promise((resolve, reject) => {
+    const latencies = new Latencies();
+    const next = picker(corpus);
+    const interval = 1000 / rate;
+    const start = now();
+    const end = start + seconds * 1000;
+    let bytes = 0;
+    let issued = 0;
+    let inFlight = 0;
+    let dropped = 0;
+    let failed = false;
+
+    function finish() {
+      if (inFlight === 0 && now() >= end) {
+        resolve({ latencies, bytes, elapsed: now() - start, dropped });
+      }
+    }
+
+    function tick() {
+      if (failed) {
+        return;
+      }
+      const t = now();
+      // Issue every call that has become due since the last tick
+      while (issued * interval <= t - start && start + issued * interval < end) {
+        const due = start + issued * interval;
+        issued++;
+        if (inFlight >= maxInFlight) {
+          dropped++;
+          continue;
+        }
+        const image = next();
+        inFlight++;
+        op.run(image).then(() => {
+          latencies.add(now() - due);
+          bytes += op.bytes(image);
+          inFlight--;
+          finish();
+        }, (err) => {
+          failed = true;
+          reject(err);
+        });
+      }
+      if (t < end) {
+        setTimeout(tick, Math.max(0, Math.min(interval, start + issued * interval - now())));
+      } else {
+        finish();
+      }
+    }
+
+    tick();
+  });
+}
+
+function report(op, image, mode, concurrency, rate, run, memory) {
+  const seconds = run.elapsed / 1000;
+  return {
+    op: op,
+    image: image,
+    mode: mode,
+    concurrency: concurrency,
+    rate: rate,
+    ops: run.latencies.count,
+    dropped: run.dropped,
+    opsPerSec: run.latencies.count / seconds,
+    mbPerSec: run.bytes / seconds / 1e6,
+    latencyMs: run.latencies.summary(),
+    memory: memory,
+  };
+}
+
+function formatRow(result) {
+  const l = result.latencyMs;
+  const mb = (bytes) => (bytes < 0 ? "" : "+") + (bytes / 1048576).toFixed(1);
+  const fixed = (value, digits) => value.toFixed(digits).padStart(9);
+  return [
+    result.op.padEnd(11),
+    result.image.padEnd(10),
+    result.mode.padEnd(6),
+    String(result.mode === "open" ? result.rate.toFixed(0) + "/s" : result.concurrency).padStart(7),
+    fixed(result.opsPerSec, 1),
+    fixed(result.mbPerSec, 1),
+    fixed(l.p50, 2),
+    fixed(l.p90, 2),
+    fixed(l.p99, 2),
+    fixed(l.max, 2),
+    String(result.dropped).padStart(7),
+    mb(result.memory.rssEnd - result.memory.rssStart).padStart(8),
+    mb(result.memory.externalEnd - result.memory.externalStart).padStart(8),
+  ].join(" ");
+}
+
+const HEADER = [
+  "op".padEnd(11),
+  "image".padEnd(10),
+  "mode".padEnd(6),
+  "load".padStart(7),
+  "ops/s".padStart(9),
+  "MB/s".padStart(9),
+  "p50 ms".padStart(9),
+  "p90 ms".padStart(9),
+  "p99 ms".padStart(9),
+  "max ms".padStart(9),
+  "dropped".padStart(7),
+  "rss MB".padStart(8),
+  "ext MB".padStart(8),
+].join(" ");
+
+async function measure(fn) {
+  if (global.gc) {
+    global.gc();
+  }
+  const sampler = new MemorySampler(50);
+  const run = await fn();
+  return { run, memory: sampler.stop() };
+}
+
+async function main() {
+  const args = parseArgs(process.argv.slice(2));
+  const corpus = generateCorpus(args.sizes, args.seed);
+  const threadPoolSize = Number(process.env.UV_THREADPOOL_SIZE) || 4;
+
+  console.log("node " + process.version + ", " + os.cpus().length + " cpus, UV_THREADPOOL_SIZE=" + threadPoolSize);
+  console.log(HEADER);
+
+  const results = [];
+  for (const name of args.ops) {
+    const op = OPERATIONS[name];
+    for (const image of corpus) {
+      await warmUp(op, [image], args.warmup);
+
+      let best = 0;
+      if (args.mode !== "open") {
+        for (const concurrency of args.concurrency) {
+          const { run, memory } = await measure(() => closedLoop(op, [image], concurrency, args.duration));
+          const result = report(name, image.name, "closed", concurrency, 0, run, memory);
+          best = Math.max(best, result.opsPerSec);
+          results.push(result);
+          console.log(formatRow(result));
+        }
+      }
+
+      if (args.mode !== "closed") {
+        // Without --rate, offer 50%, 80% and 95% of the best closed-loop
+        // throughput, where queueing starts to show in the tail latency
+        let rates = [args.rate];
+        if (!args.rate) {
+          if (!best) {
+            const { run } = await measure(() => closedLoop(op, [image], threadPoolSize, args.duration));
+            best = run.latencies.count / (run.elapsed / 1000);
+          }
+          rates = [0.5, 0.8, 0.95].map((load) => best * load);
+        }
+        for (const rate of rates) {
+          const { run, memory } = await measure(() => openLoop(op, [image], rate, args.duration, args.maxInFlight));
+          const result = report(name, image.name, "open", 0, rate, run, memory);
+          results.push(result);
+          console.log(formatRow(result));
+        }
+      }
+    }
+  }
+
+  if (args.json) {
+    const output = {
+      package: require("../package.json").version,
+      node: process.version,
+      platform: process.platform + "-" + process.arch,
+      cpus: os.cpus().length,
+      cpuModel: os.cpus()[0] ? os.cpus()[0].model : "",
+      threadPoolSize: threadPoolSize,
+      date: new Date().toISOString(),
+      options: args,
+      corpus: corpus.map((image) => ({ name: image.name, rawBytes: image.raw.length, jpegBytes: image.jpeg.length })),
+      results: results,
+    };
+    fs.writeFileSync(args.json, JSON.stringify(output, null, 2) + "\n");
+    console.log("Wrote " + args.json);
+  }
+}
+
+main().catch((err) => {
+  console.error(err.message);
+  process.exitCode = 1;
+});
@@ -0,0 +1,92 @@
+// Latency and memory statistics for the benchmarks
+
+// Latencies in milliseconds. Every sample is kept, which is fine for the
+// number of operations a benchmark run does, and gives exact percentiles.
+class Latencies {
+  constructor() {
+    this.samples = [];
+  }
+
+  add(ms) {
+    this.samples.push(ms);
+  }
+
+  get count() {
+    return this.samples.length;
+  }
+
+  summary() {
+    const sorted = Float64Array.from(this.samples).sort();
+    const at = (p) => sorted.length === 0 ? 0 : sorted[Math.min(sorted.length - 1, Math.floor(p / 100 * sorted.length))];
+    let sum = 0;
+    for (const value of sorted) {
+      sum += value;
+    }
+    return {
+      count: sorted.length,
+      mean: sorted.length === 0 ? 0 : sum / sorted.length,
+      min: sorted.length === 0 ? 0 : sorted[0],
+      p50: at(50),
+      p90: at(90),
+      p99: at(99),
+      p999: at(99.9),
+      max: sorted.length === 0 ? 0 : sorted[sorted.length - 1],
+      histogram: histogram(sorted),
+    };
+  }
+}
+
+// Counts per power-of-two bucket, from 1/64 ms up. Each bucket holds the
+// latencies below its upper bound `le` and at or above the previous one.
+function histogram(sorted) {
+  const buckets = [];
+  let bound = 1 / 64;
+  let index = 0;
+  while (index < sorted.length) {
+    let count = 0;
+    while (index < sorted.length && sorted[index] < bound) {
+      count++;
+      index++;
+    }
+    buckets.push({ le: bound, count: count });
+    bound *= 2;
+  }
+  // Leading empty buckets only add noise
+  while (buckets.length > 1 && buckets[0].count === 0) {
+    buckets.shift();
+  }
+  return buckets;
+}
+
+// Samples rss and external memory while a benchmark runs, to catch growth
+// (e.g. leaked Buffers) under load
+class MemorySampler {
+  constructor(intervalMs) {
+    this.start = process.memoryUsage();
+    this.peakRss = this.start.rss;
+    this.peakExternal = this.start.external;
+    this.timer = setInterval(() => this.sample(), intervalMs);
+  }
+
+  sample() {
+    const usage = process.memoryUsage();
+    this.peakRss = Math.max(this.peakRss, usage.rss);
+    this.peakExternal = Math.max(this.peakExternal, usage.external);
+    return usage;
+  }
+
+  stop() {
+    clearInterval(this.timer);
+    const end = this.sample();
+    return {
+      rssStart: this.start.rss,
+      rssEnd: end.rss,
+      rssPeak: this.peakRss,
+      externalStart: this.start.external,
+      externalEnd: end.external,
+      externalPeak: this.peakExternal,
+    };
+  }
+}
+
+module.exports = { Latencies, MemorySampler };
@@ -11,29 +11,303 @@ Object.keys(binding).forEach(function (key) {
   module.exports[key] = binding[key];
 });
 
+// Helper for converting the output of compress and compressSync. Encoding to a
+// target size also reports the chosen quality and whether it fitted, and
+// reportPsnr the PSNR.
+function compressOutputTransformer(out, optionalOutBuffer, options) {
+  var data = out.data.slice(0, out.size);
+  var opts = Buffer.isBuffer(optionalOutBuffer) ? options : optionalOutBuffer;
+  if (opts && (opts.targetBytes !== undefined || opts.reportPsnr)) {
+    var res = { data: data };
+    if (out.quality !== undefined) {
+      res.quality = out.quality;
+      res.fitted = out.fitted;
+    }
+    if (out.psnr !== undefined) {
+      res.psnr = out.psnr;
+    }
+    return res;
+  }
+  return data;
+}
+
 // Convenience wrapper for Buffer slicing.
 module.exports.compressSync = function (buffer, optionalOutBuffer, options) {
   var out = binding.compressSync(buffer, optionalOutBuffer, options);
-  return out.data.slice(0, out.size);
+  return compressOutputTransformer(out, optionalOutBuffer, options);
 };
 
 // Convenience wrapper for Buffer slicing.
 module.exports.compress = function (a, b, c) {
   return binding.compress(a, b, c).then((out) => {
-    return out.data.slice(0, out.size);
+    return compressOutputTransformer(out, b, c);
   });
 };
 
+// Signatures of the common metadata formats stored in APPn markers
+const markerSignatures = [
+  { marker: 0xe1, type: "exif", signature: Buffer.from("Exif\0\0", "latin1") },
+  { marker: 0xe1, type: "xmp", signature: Buffer.from("http://ns.adobe.com/xap/1.0/\0", "latin1") },
+  { marker: 0xe2, type: "icc", signature: Buffer.from("ICC_PROFILE\0", "latin1") },
+  { marker: 0xed, type: "iptc", signature: Buffer.from("Photoshop 3.0\0", "latin1") },
+];
+
+// Helper for converting marker locations into views of the source image.
+// The data is not copied.
+function markersOutputTransformer(image, markers) {
+  return markers.map((m) => {
+    var data = image.subarray(m.offset, m.offset + m.length);
+    var type = m.marker === 0xfe ? "comment" : null;
+    for (let s of markerSignatures) {
+      if (s.marker === m.marker && data.length >= s.signature.length &&
+          s.signature.equals(data.subarray(0, s.signature.length))) {
+        type = s.type;
+        break;
+      }
+    }
+    return { marker: m.marker, type: type, data: data };
+  });
+}
+
+// Helper for converting the output of decompress and decompressSync. The data
+// may be a Uint16Array, whose slice() would copy, so subarray() is used.
+function decompressOutputTransformer(image, out) {
+  out.data = out.data.subarray(0, out.size);
+  if (out.markers) {
+    out.markers = markersOutputTransformer(image, out.markers);
+  }
+  return out;
+}
+
 // Convenience wrapper for Buffer slicing.
 module.exports.decompressSync = function (buffer, optionalOutBuffer, options) {
   var out = binding.decompressSync(buffer, optionalOutBuffer, options);
-  out.data = out.data.slice(0, out.size);
-  return out;
+  return decompressOutputTransformer(buffer, out);
 };
 
 // Convenience wrapper for Buffer slicing.
 module.exports.decompress = function (a, b, c) {
   return binding.decompress(a, b, c).then((out) => {
+    return decompressOutputTransformer(a, out);
+  });
+};
+
+// Decode many images into one canvas. The tiles are decoded in parallel on the
+// thread pool, each straight into its own region of the canvas.
+module.exports.decompressTiles = function (canvas, tiles, options) {
+  if (!Array.isArray(tiles)) {
+    return Promise.reject(new TypeError("Invalid tiles"));
+  }
+  if (options === null || typeof options !== "object" || typeof options.pitch !== "number") {
+    return Promise.reject(new TypeError("Invalid pitch"));
+  }
+  return Promise.all(tiles.map((tile) => {
+    if (tile === null || typeof tile !== "object") {
+      return Promise.reject(new TypeError("Invalid tiles"));
+    }
+    const dstOffset = tile.dstOffset !== undefined ? tile.dstOffset : { x: tile.x, y: tile.y };
+    // Invalid arguments throw synchronously, which should reject instead
+    try {
+      return module.exports.decompress(tile.image, canvas, { ...options, dstOffset: dstOffset });
+    } catch (e) {
+      return Promise.reject(e);
+    }
+  }));
+};
+
+// Decode an image a strip at a time, handing each strip to onStrip before the
+// next one is decoded into the same buffer. onStrip may return a Promise, e.g.
+// to wait for a write to finish.
+module.exports.decompressStrips = async function (image, options, onStrip) {
+  if (typeof onStrip !== "function") {
+    throw new TypeError("Invalid callback");
+  }
+  const decoder = new binding.StripDecoder(image, options);
+  let warnings = { warnings: [], warningCount: 0 };
+  for (let strip = await decoder.next(); strip !== null; strip = await decoder.next()) {
+    strip.data = strip.data.subarray(0, strip.size);
+    warnings = strip;
+    await onStrip(strip);
+  }
+  return { width: decoder.width, height: decoder.height, warnings: warnings.warnings, warningCount: warnings.warningCount };
+};
+
+// Synchronous version of decompressStrips. onStrip can't be async.
+module.exports.decompressStripsSync = function (image, options, onStrip) {
+  if (typeof onStrip !== "function") {
+    throw new TypeError("Invalid callback");
+  }
+  const decoder = new binding.StripDecoder(image, options);
+  let warnings = { warnings: [], warningCount: 0 };
+  for (let strip = decoder.nextSync(); strip !== null; strip = decoder.nextSync()) {
+    strip.data = strip.data.subarray(0, strip.size);
+    warnings = strip;
+    onStrip(strip);
+  }
+  return { width: decoder.width, height: decoder.height, warnings: warnings.warnings, warningCount: warnings.warningCount };
+};
+
+// Set up a batch of images decoded into one [N, ...] tensor. Each image gets
+// its own region of the output, so they can be decoded in parallel.
+function tensorBatch(images, optionalOut, options) {
+  var out = optionalOut instanceof Float32Array ? optionalOut : undefined;
+  var opts = out ? options : optionalOut;
+  if (opts === null || typeof opts !== "object" || opts.size === null || typeof opts.size !== "object" ||
+      !Number.isInteger(opts.size.width) || !Number.isInteger(opts.size.height) ||
+      opts.size.width <= 0 || opts.size.height <= 0) {
+    throw new TypeError("Invalid size");
+  }
+  var channels = opts.format === binding.FORMAT_GRAY ? 1 : 3;
+  var imageSize = channels * opts.size.width * opts.size.height;
+  var base = opts.dstOffset || 0;
+  if (!out) {
+    out = new Float32Array(base + images.length * imageSize);
+  }
+  var shape = opts.layout === "NHWC"
+    ? [images.length, opts.size.height, opts.size.width, channels]
+    : [images.length, channels, opts.size.height, opts.size.width];
+  return {
+    out: out,
+    options: (i) => ({ ...opts, dstOffset: base + i * imageSize }),
+    result: (results) => ({
+      data: out.subarray(base, base + images.length * imageSize),
+      shape: shape,
+      warnings: [].concat(...results.map((r) => r.warnings)),
+      warningCount: results.reduce((count, r) => count + r.warningCount, 0),
+    }),
+  };
+}
+
+// Decode straight to a normalized Float32Array tensor. An array of images is
+// decoded into one tensor, in parallel on the thread pool.
+module.exports.decompressToTensor = function (image, optionalOut, options) {
+  if (!Array.isArray(image)) {
+    return binding.decompressToTensor(image, optionalOut, options);
+  }
+  try {
+    var batch = tensorBatch(image, optionalOut, options);
+    return Promise.all(image.map((img, i) => {
+      // Invalid arguments throw synchronously, which should reject instead
+      try {
+        return binding.decompressToTensor(img, batch.out, batch.options(i));
+      } catch (e) {
+        return Promise.reject(e);
+      }
+    })).then(batch.result);
+  } catch (e) {
+    return Promise.reject(e);
+  }
+};
+
+// Synchronous version of decompressToTensor
+module.exports.decompressToTensorSync = function (image, optionalOut, options) {
+  if (!Array.isArray(image)) {
+    return binding.decompressToTensorSync(image, optionalOut, options);
+  }
+  var batch = tensorBatch(image, optionalOut, options);
+  return batch.result(image.map((img, i) => binding.decompressToTensorSync(img, batch.out, batch.options(i))));
+};
+
+// Decode a progressive image with a full image after each requested scan (see
+// options.scans) and after the last one, handing each to onImage before the
+// next one is decoded into the same buffer. onImage may return false (or a
+// Promise of false) to stop without decoding the rest.
+module.exports.decompressProgressive = async function (image, options, onImage) {
+  if (typeof onImage !== "function") {
+    throw new TypeError("Invalid callback");
+  }
+  const decoder = new binding.ProgressiveDecoder(image, options);
+  let last = { warnings: [], warningCount: 0 };
+  let stopped = false;
+  for (let pass = await decoder.next(); pass !== null; pass = await decoder.next()) {
+    pass.data = pass.data.subarray(0, pass.size);
+    last = pass;
+    if ((await onImage(pass)) === false && !pass.final) {
+      decoder.stop();
+      stopped = true;
+      break;
+    }
+  }
+  return { width: decoder.width, height: decoder.height, progressive: decoder.progressive, stopped: stopped, warnings: last.warnings, warningCount: last.warningCount };
+};
+
+// Synchronous version of decompressProgressive. onImage can't be async.
+module.exports.decompressProgressiveSync = function (image, options, onImage) {
+  if (typeof onImage !== "function") {
+    throw new TypeError("Invalid callback");
+  }
+  const decoder = new binding.ProgressiveDecoder(image, options);
+  let last = { warnings: [], warningCount: 0 };
+  let stopped = false;
+  for (let pass = decoder.nextSync(); pass !== null; pass = decoder.nextSync()) {
+    pass.data = pass.data.subarray(0, pass.size);
+    last = pass;
+    if (onImage(pass) === false && !pass.final) {
+      decoder.stop();
+      stopped = true;
+      break;
+    }
+  }
+  return { width: decoder.width, height: decoder.height, progressive: decoder.progressive, stopped: stopped, warnings: last.warnings, warningCount: last.warningCount };
+};
+
+// The native encoder and decoder return their whole output buffer, like
+// compress and decompress do, so the results are converted the same way.
+function encoderOutputTransformer(out) {
+  var data = out.data.subarray(0, out.size);
+  if (out.quality !== undefined || out.psnr !== undefined) {
+    var res = { data: data };
+    if (out.quality !== undefined) {
+      res.quality = out.quality;
+      res.fitted = out.fitted;
+    }
+    if (out.psnr !== undefined) {
+      res.psnr = out.psnr;
+    }
+    return res;
+  }
+  return data;
+}
+
+module.exports.JpegEncoder = class JpegEncoder extends binding.JpegEncoder {
+  encodeSync(raw, out) {
+    return encoderOutputTransformer(super.encodeSync(raw, out));
+  }
+
+  encode(raw, out) {
+    return super.encode(raw, out).then(encoderOutputTransformer);
+  }
+};
+
+module.exports.JpegDecoder = class JpegDecoder extends binding.JpegDecoder {
+  decodeSync(image) {
+    return decompressOutputTransformer(image, super.decodeSync(image));
+  }
+
+  decode(image) {
+    return super.decode(image).then((out) => decompressOutputTransformer(image, out));
+  }
+};
+
+// Convenience wrapper for extracting markers.
+module.exports.readHeader = function (image, options) {
+  var out = binding.readHeader(image, options);
+  if (out.markers) {
+    out.markers = markersOutputTransformer(image, out.markers);
+  }
+  return out;
+};
+
+// Convenience wrapper for Buffer slicing.
+module.exports.readDCPreviewSync = function (a, b, c) {
+  var out = binding.readDCPreviewSync(a, b, c);
+  out.data = out.data.slice(0, out.size);
+  return out;
+};
+
+// Convenience wrapper for Buffer slicing.
+module.exports.readDCPreview = function (a, b, c) {
+  return binding.readDCPreview(a, b, c).then((out) => {
     out.data = out.data.slice(0, out.size);
     return out;
   });
@@ -70,6 +344,9 @@ function readDCTOutputTransformer(initial) {
       [8, 8])
   });
 
+  final.warnings = initial.warnings;
+  final.warningCount = initial.warningCount;
+
   return final;
 }
 
@@ -132,3 +409,37 @@ module.exports.writeDCT = function (a, b, c) {
   return binding.writeDCT(a, writeDCTInputTransformer(b), c);
 };
 
+
+// Helper for converting the options of requantize and requantizeSync
+function requantizeOptionsTransformer(initial) {
+  if (!initial || !Array.isArray(initial.quantTables)) {
+    return initial;
+  }
+
+  return Object.assign({}, initial, {
+    quantTables: initial.quantTables.map((qt) => {
+      if (!qt || !qt.shape) {
+        return qt;
+      }
+
+      assert.deepEqual(qt.shape, [8, 8], "Error: Passed in qt arrays must have shape 8x8");
+      const flat = new Uint16Array(64);
+      for (let i = 0; i < 8; i++) {
+        for (let j = 0; j < 8; j++) {
+          flat[i * 8 + j] = qt.get(i, j);
+        }
+      }
+      return flat;
+    })
+  });
+}
+
+// Convenience wrapper for accepting ndarray quantization tables.
+module.exports.requantizeSync = function (a, b) {
+  return binding.requantizeSync(a, requantizeOptionsTransformer(b));
+};
+
+// Convenience wrapper for accepting ndarray quantization tables.
+module.exports.requantize = function (a, b) {
+  return binding.requantize(a, requantizeOptionsTransformer(b));
+};
@@ -20,27 +20,100 @@ export const SAMP_420: SubSampling;
 export const SAMP_GRAY: SubSampling;
 export const SAMP_440: SubSampling;
 
+export interface LosslessOptions {
+  /** 1 to 7. Defaults to 1. */
+  predictor?: number;
+  /** 0 to precision - 1. Defaults to 0. */
+  pointTransform?: number;
+}
+
 export interface BufferSizeOptions {
   width: number;
   height: number;
   subsampling?: SubSampling;
+  /** Bits per sample. 16 requires lossless. Defaults to 8. */
+  precision?: 8 | 12 | 16;
+  lossless?: boolean | LosslessOptions;
+}
+
+export type MarkerType = "exif" | "xmp" | "icc" | "iptc" | "comment";
+
+export interface Marker {
+  /** The marker code, e.g. 0xE1 for APP1 or 0xFE for COM */
+  marker: number;
+  /** The payload, without the marker and length bytes */
+  data: Uint8Array;
+}
+
+export interface MarkerView extends Marker {
+  type: MarkerType | null;
+  data: Buffer;
 }
 
 export interface EncodeOptions extends BufferSizeOptions {
   format: Format;
   stride?: number;
   quality?: number;
+  markers?: Marker[];
+  /** Leave out the tables, see compressTables. 8-bit lossy only. */
+  abbreviated?: boolean;
+}
+
+export interface TargetSizeEncodeOptions extends EncodeOptions {
+  targetBytes: number;
+  minQuality?: number;
+  maxQuality?: number;
+  reportPsnr?: boolean;
+}
+
+export interface TargetSizeEncodeReturn {
+  data: Buffer;
+  quality: number;
+  /** false if even minQuality is over targetBytes */
+  fitted: boolean;
+  /** With reportPsnr */
+  psnr?: number;
+}
+
+export interface ReportPsnrEncodeOptions extends EncodeOptions {
+  /** Measure the PSNR of the decoded output against the source. 8-bit only. */
+  reportPsnr: true;
+}
+
+export interface ReportPsnrEncodeReturn {
+  data: Buffer;
+  psnr: number;
 }
 
 export function bufferSize(options: BufferSizeOptions): number;
 
-export function compressSync(raw: Buffer, options: EncodeOptions): Buffer;
-export function compressSync(raw: Buffer, preallocatedOut: Buffer, options: EncodeOptions): Buffer;
+/** The tables-only datastream for images compressed with options and abbreviated set */
+export function compressTables(options: EncodeOptions): Buffer;
+
+export function compressSync(raw: Buffer, options: TargetSizeEncodeOptions): TargetSizeEncodeReturn;
+export function compressSync(raw: Buffer, preallocatedOut: Buffer, options: TargetSizeEncodeOptions): TargetSizeEncodeReturn;
+
+export function compressSync(raw: Buffer, options: ReportPsnrEncodeOptions): ReportPsnrEncodeReturn;
+export function compressSync(raw: Buffer, preallocatedOut: Buffer, options: ReportPsnrEncodeOptions): ReportPsnrEncodeReturn;
+export function compressSync(raw: Buffer | Uint16Array, options: EncodeOptions): Buffer;
+export function compressSync(raw: Buffer | Uint16Array, preallocatedOut: Buffer, options: EncodeOptions): Buffer;
 
-export function compress(raw: Buffer, options: EncodeOptions): Promise<Buffer>;
+export function compress(raw: Buffer, options: TargetSizeEncodeOptions): Promise<TargetSizeEncodeReturn>;
 export function compress(
   raw: Buffer,
   preallocatedOut: Buffer,
+  options: TargetSizeEncodeOptions
+): Promise<TargetSizeEncodeReturn>;
+export function compress(raw: Buffer, options: ReportPsnrEncodeOptions): Promise<ReportPsnrEncodeReturn>;
+export function compress(
+  raw: Buffer,
+  preallocatedOut: Buffer,
+  options: ReportPsnrEncodeOptions
+): Promise<ReportPsnrEncodeReturn>;
+export function compress(raw: Buffer | Uint16Array, options: EncodeOptions): Promise<Buffer>;
+export function compress(
+  raw: Buffer | Uint16Array,
+  preallocatedOut: Buffer,
   options: EncodeOptions
 ): Promise<Buffer>;
 
@@ -48,30 +121,370 @@ export interface DecodeOptions {
   format: Format;
 }
 
+/** What to do with libjpeg warnings, e.g. for corrupt data */
+export type WarningMode = "collect" | "ignore" | "fatal";
+
+export interface WarningOptions {
+  warnings?: WarningMode;
+}
+
+export interface DecodeLimits {
+  maxPixels?: number;
+  maxDimension?: number;
+  maxScans?: number;
+  /** Bytes that libjpeg may allocate */
+  maxMemory?: number;
+}
+
+export interface LimitOptions {
+  limits?: DecodeLimits;
+}
+
+export interface ReadDCTOptions extends WarningOptions, LimitOptions {}
+
+export interface WarningsReturn {
+  /** The first 16 warning messages, unless warnings are ignored */
+  warnings: string[];
+  warningCount: number;
+}
+
+/** Thrown (or rejected) for libjpeg errors */
+export interface JPEGLibError extends Error, WarningsReturn {
+  /** The libjpeg message code, e.g. "JERR_BAD_HUFF_TABLE" */
+  code: string;
+}
+
+export interface DecompressOptions extends DecodeOptions, WarningOptions, LimitOptions {
+  markers?: boolean;
+  tolerant?: boolean;
+  /** Byte value for the rows that couldn't be decoded in tolerant mode */
+  fill?: number;
+  /** Elements (bytes for a Buffer) per row of the destination buffer */
+  pitch?: number;
+  /** Where the image starts, in elements of the destination buffer, or in pixels */
+  dstOffset?: number | { x: number; y: number };
+  /** DCT scaling: a multiple of 1/8 from 1/8 to 2 */
+  scale?: { num: number; denom: number };
+  /** Tables for abbreviated images, from compressTables */
+  tables?: Buffer;
+  /** Statistics to compute from the decoded pixels (8-bit images only) */
+  stats?: Array<"mean" | "histogram" | "minmax">;
+  /** Decode through the decode cache; the result is a copy of the cached pixels (decompress only) */
+  cache?: boolean;
+}
+
+export interface ImageStats {
+  pixels: number;
+  /** Per channel: R, G, B, or gray */
+  mean?: number[];
+  min?: number[];
+  max?: number[];
+  /** Pixel counts by luminance */
+  histogram?: Float64Array;
+}
+
+export interface DecompressTile {
+  image: Buffer;
+  x?: number;
+  y?: number;
+  dstOffset?: number | { x: number; y: number };
+}
+
+export interface DecompressTilesOptions extends DecompressOptions {
+  pitch: number;
+}
+
 export interface DecompressReturn {
-  data: Buffer;
+  /** A Uint16Array for images with more than 8 bits per sample */
+  data: Buffer | Uint16Array;
   width: number;
   height: number;
   size: number;
   format: any;
+  precision?: number;
+  markers?: MarkerView[];
+  warnings?: string[];
+  warningCount?: number;
+  /** Tolerant mode only */
+  rowsDecoded?: number;
+  truncated?: boolean;
+  error?: string;
+  stats?: ImageStats;
+  /** With cache, whether the image came from the cache */
+  cacheHit?: boolean;
+}
+
+export interface CacheOptions {
+  /** The byte budget. 0 disables caching. */
+  maxBytes: number;
+}
+
+export interface CacheStats {
+  entries: number;
+  bytes: number;
+  maxBytes: number;
+  hits: number;
+  misses: number;
+  evictions: number;
+}
+
+export function configureCache(options: CacheOptions): void;
+export function cacheStats(): CacheStats;
+/** Drops all cached images and resets the counters */
+export function clearCache(): void;
+
+export interface ReadHeaderOptions extends WarningOptions {
+  markers?: boolean;
 }
 
-export function decompressSync(image: Buffer, preallocatedOut: Buffer, options?: DecodeOptions): DecompressReturn;
-export function decompressSync(image: Buffer, options?: DecodeOptions): DecompressReturn;
+export interface ReadHeaderReturn extends WarningsReturn {
+  width: number;
+  height: number;
+  components: number;
+  /** -1 if the sampling factors don't match any SAMP_* value */
+  subsampling: SubSampling;
+  progressive: boolean;
+  precision: number;
+  markers?: MarkerView[];
+}
+
+/** Encodes images with the same options, reusing a compressor and output buffer */
+export class JpegEncoder {
+  constructor(options: EncodeOptions | TargetSizeEncodeOptions | ReportPsnrEncodeOptions);
+  /** Without out, the result is only valid until the next encode */
+  encodeSync(raw: Buffer | Uint16Array, out?: Buffer): Buffer | TargetSizeEncodeReturn | ReportPsnrEncodeReturn;
+  encode(raw: Buffer | Uint16Array, out?: Buffer): Promise<Buffer | TargetSizeEncodeReturn | ReportPsnrEncodeReturn>;
+}
+
+/** Decodes images with the same options, reusing a decompressor and output buffer */
+export class JpegDecoder {
+  constructor(options?: DecompressOptions);
+  /** The result's data is only valid until the next decode */
+  decodeSync(image: Buffer): DecompressReturn;
+  decode(image: Buffer): Promise<DecompressReturn>;
+}
+
+export function readHeader(image: Buffer, options?: ReadHeaderOptions): ReadHeaderReturn;
+
+export function decompressSync(image: Buffer, preallocatedOut: Buffer | Uint16Array, options?: DecompressOptions): DecompressReturn;
+export function decompressSync(image: Buffer, options?: DecompressOptions): DecompressReturn;
 
 export function decompress(
+  image: Buffer,
+  preallocatedOut: Buffer | Uint16Array,
+  options?: DecompressOptions
+): Promise<DecompressReturn>;
+export function decompress(image: Buffer, options?: DecompressOptions): Promise<DecompressReturn>;
+
+export interface DecompressStripsOptions extends WarningOptions, LimitOptions {
+  format?: any;
+  /** Defaults to 16 */
+  rowsPerStrip?: number;
+}
+
+export interface Strip extends WarningsReturn {
+  /** Reused for every strip. Only valid until onStrip returns. */
+  data: Buffer;
+  size: number;
+  /** The first row of the strip */
+  y: number;
+  rows: number;
+}
+
+export interface DecompressStripsReturn extends WarningsReturn {
+  width: number;
+  height: number;
+}
+
+export function decompressStrips(
+  image: Buffer,
+  options: DecompressStripsOptions,
+  onStrip: (strip: Strip) => void | Promise<void>
+): Promise<DecompressStripsReturn>;
+export function decompressStripsSync(
+  image: Buffer,
+  options: DecompressStripsOptions,
+  onStrip: (strip: Strip) => void
+): DecompressStripsReturn;
+
+export interface DecompressProgressiveOptions extends WarningOptions, LimitOptions {
+  format?: any;
+  /** Scans (from 1) to produce an image after. Defaults to every scan. */
+  scans?: number[];
+}
+
+export interface ProgressivePass extends WarningsReturn {
+  /** Reused for every image. Only valid until onImage returns. */
+  data: Buffer;
+  size: number;
+  /** The scan the image was produced after */
+  scan: number;
+  final: boolean;
+}
+
+export interface DecompressProgressiveReturn extends WarningsReturn {
+  width: number;
+  height: number;
+  progressive: boolean;
+  /** Whether onImage stopped the decode */
+  stopped: boolean;
+}
+
+export function decompressProgressive(
+  image: Buffer,
+  options: DecompressProgressiveOptions,
+  onImage: (pass: ProgressivePass) => void | boolean | Promise<void | boolean>
+): Promise<DecompressProgressiveReturn>;
+export function decompressProgressiveSync(
+  image: Buffer,
+  options: DecompressProgressiveOptions,
+  onImage: (pass: ProgressivePass) => void | boolean
+): DecompressProgressiveReturn;
+
+export interface DecompressTensorOptions extends WarningOptions, LimitOptions {
+  /** FORMAT_RGB (the default), FORMAT_BGR or FORMAT_GRAY */
+  format?: Format;
+  /** Defaults to NCHW */
+  layout?: "NCHW" | "NHWC";
+  /** Per channel, on the 0 to 1 scale: (sample / 255 - mean) / std */
+  mean?: number[];
+  std?: number[];
+  /** DCT scaling: a multiple of 1/8 from 1/8 to 2 */
+  scale?: { num: number; denom: number };
+  /** Resize to exactly this size. Required for batches. */
+  size?: { width: number; height: number };
+  /** Where the tensor starts in out, in elements */
+  dstOffset?: number;
+}
+
+export interface DecompressTensorReturn extends WarningsReturn {
+  data: Float32Array;
+  /** [N, C, H, W] or [N, H, W, C] */
+  shape: number[];
+  /** Single images only */
+  width?: number;
+  height?: number;
+}
+
+export function decompressToTensorSync(image: Buffer | Buffer[], out: Float32Array, options?: DecompressTensorOptions): DecompressTensorReturn;
+export function decompressToTensorSync(image: Buffer | Buffer[], options?: DecompressTensorOptions): DecompressTensorReturn;
+export function decompressToTensor(
+  image: Buffer | Buffer[],
+  out: Float32Array,
+  options?: DecompressTensorOptions
+): Promise<DecompressTensorReturn>;
+export function decompressToTensor(image: Buffer | Buffer[], options?: DecompressTensorOptions): Promise<DecompressTensorReturn>;
+
+export function decompressTiles(
+  canvas: Buffer | Uint16Array,
+  tiles: DecompressTile[],
+  options: DecompressTilesOptions
+): Promise<DecompressReturn[]>;
+
+export function readDCPreviewSync(image: Buffer, preallocatedOut: Buffer, options?: DecodeOptions): DecompressReturn;
+export function readDCPreviewSync(image: Buffer, options?: DecodeOptions): DecompressReturn;
+
+export function readDCPreview(
   image: Buffer,
   preallocatedOut: Buffer,
   options?: DecodeOptions
 ): Promise<DecompressReturn>;
-export function decompress(image: Buffer, options?: DecodeOptions): Promise<DecompressReturn>;
+export function readDCPreview(image: Buffer, options?: DecodeOptions): Promise<DecompressReturn>;
+
+export type FingerprintAlgorithm = "phash" | "dhash" | "dcmean";
+
+export interface FingerprintOptions {
+  algorithms?: FingerprintAlgorithm[];
+  bits?: 64 | 256;
+}
+
+export interface Fingerprint {
+  phash?: Buffer;
+  dhash?: Buffer;
+  dcmean?: Buffer;
+  error?: string;
+}
+
+export function fingerprintSync(image: Buffer, options?: FingerprintOptions): Fingerprint;
+export function fingerprintSync(images: Buffer[], options?: FingerprintOptions): Fingerprint[];
+export function fingerprint(image: Buffer, options?: FingerprintOptions): Promise<Fingerprint>;
+export function fingerprint(images: Buffer[], options?: FingerprintOptions): Promise<Fingerprint[]>;
+
+export type ValidationLevel = "markers" | "entropy";
+
+export interface ValidateOptions {
+  level?: ValidationLevel;
+  warnings?: WarningMode;
+  limits?: DecodeLimits;
+  tables?: Buffer;
+}
+
+export interface ValidateResult {
+  valid: boolean;
+  error?: string;
+  /** e.g. "JERR_BAD_HUFF_TABLE", "JWRN_JPEG_EOF" or "LIMIT_EXCEEDED" */
+  code?: string;
+  warnings: string[];
+  warningCount: number;
+}
+
+export function validateSync(image: Buffer, options?: ValidateOptions): ValidateResult;
+export function validateSync(images: Buffer[], options?: ValidateOptions): ValidateResult[];
+export function validate(image: Buffer, options?: ValidateOptions): Promise<ValidateResult>;
+export function validate(images: Buffer[], options?: ValidateOptions): Promise<ValidateResult[]>;
+
+export type QualityMetricName = "psnr" | "ssim" | "msssim";
+
+export interface CompareOptions {
+  /** The format of raw sources, and the one JPG sources are decoded to */
+  format: Format;
+  /** The size of raw sources. Defaults to the size of the JPG in the pair. */
+  width?: number;
+  height?: number;
+  /**
+   * The sides of each pair that are JPGs. Defaults to recognizing JPGs by
+   * their SOI marker without width and height, and to none with them.
+   */
+  jpeg?: ("reference" | "image")[];
+  /** Defaults to ["psnr", "ssim"] */
+  metrics?: QualityMetricName[];
+}
+
+export interface CompareResult {
+  width: number;
+  height: number;
+  psnr?: number;
+  ssim?: number;
+  msssim?: number;
+  /** Per channel (R, G, B, or gray) values of each requested metric */
+  channels: {
+    psnr?: number[];
+    ssim?: number[];
+    msssim?: number[];
+  };
+  error?: string;
+}
+
+export function compareSync(reference: Buffer, image: Buffer, options: CompareOptions): CompareResult;
+export function compareSync(pairs: [Buffer, Buffer][], options: CompareOptions): CompareResult[];
+export function compare(reference: Buffer, image: Buffer, options: CompareOptions): Promise<CompareResult>;
+export function compare(pairs: [Buffer, Buffer][], options: CompareOptions): Promise<CompareResult[]>;
+
+export interface SizeTarget {
+  maxDim: number;
+  quality?: number;
+  subsampling?: SubSampling;
+}
+
+export function generateSizesSync(image: Buffer, sizes: SizeTarget[]): Buffer[];
+export function generateSizes(image: Buffer, sizes: SizeTarget[]): Promise<Buffer[]>;
 
 export interface DCTComponent {
   data: NdArray<Int16Array>;
   qt_no: Number;
 }
 
-export interface DCTData {
+export interface DCTData extends WarningsReturn {
   Y: DCTComponent;
   Cb: DCTComponent;
   Cr: DCTComponent;
@@ -79,8 +492,35 @@ export interface DCTData {
   qts: Array<NdArray<Uint16Array>>;
 }
 
-export function readDCTSync(image: Buffer, preallocatedOut?: Buffer): DCTData;
-export function readDCT(image: Buffer, preallocatedOut?: Buffer): Promise<DCTData>;
+export function readDCTSync(image: Buffer, preallocatedOut: Buffer, options?: ReadDCTOptions): DCTData;
+export function readDCTSync(image: Buffer, options?: ReadDCTOptions): DCTData;
+export function readDCT(image: Buffer, preallocatedOut: Buffer, options?: ReadDCTOptions): Promise<DCTData>;
+export function readDCT(image: Buffer, options?: ReadDCTOptions): Promise<DCTData>;
+
+export interface RequantizeOptions {
+  quality?: number;
+  quantTables?: Array<NdArray<Uint16Array> | Uint16Array | number[] | null>;
+  optimizeHuffman?: boolean;
+}
+
+export function requantizeSync(image: Buffer, options: RequantizeOptions): Buffer;
+export function requantize(image: Buffer, options: RequantizeOptions): Promise<Buffer>;
+
+export interface MosaicTile {
+  image: Buffer;
+  /** In pixels, on MCU boundaries */
+  x: number;
+  y: number;
+}
+
+export interface MosaicOptions {
+  width: number;
+  height: number;
+  optimizeHuffman?: boolean;
+}
+
+export function mosaicSync(tiles: MosaicTile[], options: MosaicOptions): Buffer;
+export function mosaic(tiles: MosaicTile[], options: MosaicOptions): Promise<Buffer>;
 
 export function writeDCTSync(originalImage: Buffer, dctData: DCTData, preallocatedOut?: Buffer): Buffer;
 export function writeDCT(originalImage: Buffer, dctData: DCTData, preallocatedOut?: Buffer): Promise<Buffer>;
@@ -25,8 +25,8 @@ Napi::Value BufferSize(const Napi::CallbackInfo &info)
   }
 
   // Finally, calculate the buffer size
-  uint32_t dstLength = tjBufSize(parsedOptions.width, parsedOptions.height, parsedOptions.subsampling);
-  Napi::Number result = Napi::Number::New(env, dstLength);
+  std::size_t dstLength = JPEGBufferSize(parsedOptions);
+  Napi::Number result = Napi::Number::New(env, static_cast<double>(dstLength));
 
   return result;
 }
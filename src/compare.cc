@@ -0,0 +1,710 @@
+#include "compare.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+  // SSIM stabilizing constants for 8-bit samples
+  constexpr double SSIM_C1 = (0.01 * 255) * (0.01 * 255);
+  constexpr double SSIM_C2 = (0.03 * 255) * (0.03 * 255);
+
+  // Weights of the MS-SSIM scales, from the original paper
+  constexpr double MSSSIM_WEIGHTS[] = {0.0448, 0.2856, 0.3001, 0.2363, 0.1333};
+  constexpr int MSSSIM_SCALES = 5;
+
+  // One channel of an image. The kernels below work on planes so that their
+  // inner loops are simple runs over contiguous bytes, which the compiler can
+  // vectorize.
+  struct Plane
+  {
+    std::vector<uint8_t> data;
+    int width;
+    int height;
+  };
+
+  Plane ExtractChannel(ImageView const& image, int offset)
+  {
+    int bpp = BytesPerPixel(image.format);
+    Plane plane{std::vector<uint8_t>(static_cast<std::size_t>(image.width) * image.height), image.width, image.height};
+    for (int y = 0; y < image.height; y++)
+    {
+      uint8_t const* src = image.data + y * image.pitch + offset;
+      uint8_t* dst = plane.data.data() + static_cast<std::size_t>(y) * image.width;
+      for (int x = 0; x < image.width; x++)
+      {
+        dst[x] = src[x * bpp];
+      }
+    }
+    return plane;
+  }
+
+  uint64_t SquaredError(Plane const& a, Plane const& b)
+  {
+    uint64_t total = 0;
+    for (int y = 0; y < a.height; y++)
+    {
+      uint8_t const* pa = a.data.data() + static_cast<std::size_t>(y) * a.width;
+      uint8_t const* pb = b.data.data() + static_cast<std::size_t>(y) * b.width;
+      // At most 65535 * 255^2 per row, which fits
+      uint32_t row = 0;
+      for (int x = 0; x < a.width; x++)
+      {
+        int d = pa[x] - pb[x];
+        row += d * d;
+      }
+      total += row;
+    }
+    return total;
+  }
+
+  double PSNR(double meanSquaredError)
+  {
+    if (meanSquaredError == 0)
+    {
+      return std::numeric_limits<double>::infinity();
+    }
+    return 10 * std::log10(255.0 * 255.0 / meanSquaredError);
+  }
+
+  struct SsimValue
+  {
+    // Mean SSIM, and mean of its contrast-structure part
+    double ssim;
+    double cs;
+  };
+
+  // One window, from the sums of a, b, a^2 + b^2 and a * b over n pixels
+  void AddWindow(double s1, double s2, double ss, double s12, double n, SsimValue& total)
+  {
+    double mu1 = s1 / n;
+    double mu2 = s2 / n;
+    double variances = ss / n - mu1 * mu1 - mu2 * mu2;
+    double covariance = s12 / n - mu1 * mu2;
+    double l = (2 * mu1 * mu2 + SSIM_C1) / (mu1 * mu1 + mu2 * mu2 + SSIM_C1);
+    double cs = (2 * covariance + SSIM_C2) / (variances + SSIM_C2);
+    total.ssim += l * cs;
+    total.cs += cs;
+  }
+
+  // SSIM over 8x8 windows, 4 pixels apart, as x264 and libvpx compute it.
+  // Sums are taken over 4x4 blocks first, so each pixel is only read once.
+  // Planes smaller than a window are measured as a single window.
+  SsimValue PlaneSSIM(Plane const& a, Plane const& b)
+  {
+    SsimValue total{0, 0};
+    if (a.width < 8 || a.height < 8)
+    {
+      double s1 = 0, s2 = 0, ss = 0, s12 = 0;
+      for (std::size_t i = 0; i < a.data.size(); i++)
+      {
+        double va = a.data[i];
+        double vb = b.data[i];
+        s1 += va;
+        s2 += vb;
+        ss += va * va + vb * vb;
+        s12 += va * vb;
+      }
+      AddWindow(s1, s2, ss, s12, static_cast<double>(a.data.size()), total);
+      return total;
+    }
+
+    int blocksX = a.width / 4;
+    int blocksY = a.height / 4;
+    int columns = blocksX * 4;
+
+    // Column sums over the 4 rows of a block row, then block sums. Two block
+    // rows are kept, the previous and the current one.
+    std::vector<uint32_t> c1(columns), c2(columns), css(columns), c12(columns);
+    std::vector<uint32_t> blocks[2][4];
+    for (auto& row : blocks)
+    {
+      for (auto& sums : row)
+      {
+        sums.resize(blocksX);
+      }
+    }
+
+    std::size_t windows = 0;
+    for (int by = 0; by < blocksY; by++)
+    {
+      std::fill(c1.begin(), c1.end(), 0);
+      std::fill(c2.begin(), c2.end(), 0);
+      std::fill(css.begin(), css.end(), 0);
+      std::fill(c12.begin(), c12.end(), 0);
+      for (int y = by * 4; y < by * 4 + 4; y++)
+      {
+        uint8_t const* pa = a.data.data() + static_cast<std::size_t>(y) * a.width;
+        uint8_t const* pb = b.data.data() + static_cast<std::size_t>(y) * b.width;
+        for (int x = 0; x < columns; x++)
+        {
+          uint32_t va = pa[x];
+          uint32_t vb = pb[x];
+          c1[x] += va;
+          c2[x] += vb;
+          css[x] += va * va + vb * vb;
+          c12[x] += va * vb;
+        }
+      }
+
+      auto& current = blocks[by & 1];
+      for (int bx = 0; bx < blocksX; bx++)
+      {
+        int x = bx * 4;
+        current[0][bx] = c1[x] + c1[x + 1] + c1[x + 2] + c1[x + 3];
+        current[1][bx] = c2[x] + c2[x + 1] + c2[x + 2] + c2[x + 3];
+        current[2][bx] = css[x] + css[x + 1] + css[x + 2] + css[x + 3];
+        current[3][bx] = c12[x] + c12[x + 1] + c12[x + 2] + c12[x + 3];
+      }
+      if (by == 0)
+      {
+        continue;
+      }
+
+      auto& previous = blocks[(by - 1) & 1];
+      for (int bx = 0; bx + 1 < blocksX; bx++)
+      {
+        double sums[4];
+        for (int i = 0; i < 4; i++)
+        {
+          sums[i] = static_cast<double>(previous[i][bx]) + previous[i][bx + 1] + current[i][bx] + current[i][bx + 1];
+        }
+        AddWindow(sums[0], sums[1], sums[2], sums[3], 64, total);
+        windows++;
+      }
+    }
+
+    total.ssim /= windows;
+    total.cs /= windows;
+    return total;
+  }
+
+  // Halve the width and height, averaging 2x2 pixels
+  Plane Downsample(Plane const& plane)
+  {
+    Plane half{std::vector<uint8_t>(static_cast<std::size_t>(plane.width / 2) * (plane.height / 2)),
+      plane.width / 2, plane.height / 2};
+    for (int y = 0; y < half.height; y++)
+    {
+      uint8_t const* top = plane.data.data() + static_cast<std::size_t>(y * 2) * plane.width;
+      uint8_t const* bottom = top + plane.width;
+      uint8_t* dst = half.data.data() + static_cast<std::size_t>(y) * half.width;
+      for (int x = 0; x < half.width; x++)
+      {
+        dst[x] = static_cast<uint8_t>((top[x * 2] + top[x * 2 + 1] + bottom[x * 2] + bottom[x * 2 + 1] + 2) >> 2);
+      }
+    }
+    return half;
+  }
+
+  // The contrast-structure terms of the finer scales and the full SSIM of the
+  // coarsest. Small images use fewer scales, with the weights renormalized.
+  double PlaneMSSSIM(Plane a, Plane b)
+  {
+    int scales = 1;
+    for (int w = a.width / 2, h = a.height / 2; scales < MSSSIM_SCALES && w >= 8 && h >= 8; w /= 2, h /= 2)
+    {
+      scales++;
+    }
+    double weightSum = 0;
+    for (int i = 0; i < scales; i++)
+    {
+      weightSum += MSSSIM_WEIGHTS[i];
+    }
+
+    double result = 1;
+    for (int i = 0; i < scales; i++)
+    {
+      SsimValue value = PlaneSSIM(a, b);
+      double term = i + 1 < scales ? value.cs : value.ssim;
+      // Negative terms (anti-correlated images) have no real power
+      result *= std::pow(std::max(term, 0.0), MSSSIM_WEIGHTS[i] / weightSum);
+      if (i + 1 < scales)
+      {
+        a = Downsample(a);
+        b = Downsample(b);
+      }
+    }
+    return result;
+  }
+
+  struct CompareImage
+  {
+    uint8_t const* data;
+    std::size_t length;
+    bool jpeg;
+    // Decoded pixels, if the source is a JPEG
+    std::vector<uint8_t> pixels;
+  };
+
+  struct ComparePair
+  {
+    CompareImage reference;
+    CompareImage image;
+    int width;
+    int height;
+    QualityMetrics metrics;
+    std::string error;
+  };
+
+  struct CompareProps
+  {
+    uint32_t format;
+    int bpp;
+    // The size of raw sources. 0 to take it from the JPEG of the pair.
+    int width;
+    int height;
+    int metrics;
+    bool batch;
+    std::vector<ComparePair> pairs;
+  };
+
+  // Which sides of the pairs are JPEGs, see options.jpeg
+  constexpr int JPEG_REFERENCE = 1;
+  constexpr int JPEG_IMAGE = 2;
+
+  bool StartsWithSOI(CompareImage const& image)
+  {
+    return image.length >= 3 && image.data[0] == 0xFF && image.data[1] == 0xD8 && image.data[2] == 0xFF;
+  }
+
+  // Decode with libjpeg, the same way decompress does
+  void DecodeImage(CompareImage& image, uint32_t format, int& width, int& height)
+  {
+    JDecompressHandle handle = OpenDecompressHandle(image.data, image.length);
+    j_decompress_ptr cinfo = handle.cinfo();
+    if (cinfo->data_precision != 8)
+    {
+      throw std::runtime_error("Only 8-bit images can be compared");
+    }
+    cinfo->out_color_space = FormatColorSpace(format);
+    cinfo->dct_method = JDCT_IFAST;
+    jpeg_start_decompress(cinfo);
+
+    width = cinfo->output_width;
+    height = cinfo->output_height;
+    std::size_t rowSize = static_cast<std::size_t>(width) * cinfo->output_components;
+    image.pixels.resize(rowSize * height);
+    while (cinfo->output_scanline < cinfo->output_height)
+    {
+      JSAMPROW row = image.pixels.data() + cinfo->output_scanline * rowSize;
+      jpeg_read_scanlines(cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(cinfo);
+  }
+
+  // The pixels of one side of a pair. Raw sources are used in place.
+  ImageView PrepareImage(CompareImage& image, CompareProps const& props, int& width, int& height)
+  {
+    if (image.jpeg)
+    {
+      int decodedWidth = 0;
+      int decodedHeight = 0;
+      DecodeImage(image, props.format, decodedWidth, decodedHeight);
+      if (width != 0 && (decodedWidth != width || decodedHeight != height))
+      {
+        throw std::runtime_error("Images have different dimensions");
+      }
+      width = decodedWidth;
+      height = decodedHeight;
+      return ImageView{image.pixels.data(), static_cast<std::size_t>(width) * props.bpp, width, height, props.format};
+    }
+    return ImageView{image.data, 0, 0, 0, props.format};
+  }
+
+  void DoComparePair(ComparePair& pair, CompareProps const& props)
+  {
+    int width = props.width;
+    int height = props.height;
+    ImageView reference = PrepareImage(pair.reference, props, width, height);
+    ImageView image = PrepareImage(pair.image, props, width, height);
+    if (width == 0)
+    {
+      throw std::runtime_error("Invalid width");
+    }
+
+    // Raw sources take the size of the other side, and have to be big enough
+    for (auto* view : {&reference, &image})
+    {
+      if (view->width == 0)
+      {
+        CompareImage const& source = view == &reference ? pair.reference : pair.image;
+        if (source.length < static_cast<uint64_t>(width) * height * props.bpp)
+        {
+          throw std::runtime_error("Source data is not long enough");
+        }
+        *view = ImageView{source.data, static_cast<std::size_t>(width) * props.bpp, width, height, props.format};
+      }
+    }
+
+    pair.width = width;
+    pair.height = height;
+    pair.metrics = MeasureQuality(reference, image, props.metrics);
+  }
+
+  void DoCompare(CompareProps& props)
+  {
+    for (auto& pair : props.pairs)
+    {
+      if (!props.batch)
+      {
+        DoComparePair(pair, props);
+        continue;
+      }
+
+      // In batch mode one bad pair shouldn't fail the others
+      try {
+        DoComparePair(pair, props);
+      } catch (std::exception const& e) {
+        pair.error = e.what();
+      }
+    }
+  }
+
+  Napi::Object ComparePairResult(Napi::Env const& env, ComparePair const& pair, int metrics)
+  {
+    Napi::Object res = Napi::Object::New(env);
+    if (!pair.error.empty())
+    {
+      res.Set("error", pair.error);
+      return res;
+    }
+
+    res.Set("width", pair.width);
+    res.Set("height", pair.height);
+    Napi::Object channels = Napi::Object::New(env);
+    auto set = [&](char const* name, double all, std::array<double, 3> const& values) {
+      res.Set(name, all);
+      Napi::Array array = Napi::Array::New(env, pair.metrics.channels);
+      for (int c = 0; c < pair.metrics.channels; c++)
+      {
+        array.Set(c, values[c]);
+      }
+      channels.Set(name, array);
+    };
+    if (metrics & NJT_METRIC_PSNR)
+    {
+      set("psnr", pair.metrics.psnrAll, pair.metrics.psnr);
+    }
+    if (metrics & NJT_METRIC_SSIM)
+    {
+      set("ssim", pair.metrics.ssimAll, pair.metrics.ssim);
+    }
+    if (metrics & NJT_METRIC_MSSSIM)
+    {
+      set("msssim", pair.metrics.msssimAll, pair.metrics.msssim);
+    }
+    res.Set("channels", channels);
+    return res;
+  }
+
+  Napi::Value CompareResult(Napi::Env const& env, CompareProps const& props)
+  {
+    if (!props.batch)
+    {
+      return ComparePairResult(env, props.pairs[0], props.metrics);
+    }
+
+    auto res = Napi::Array::New(env, props.pairs.size());
+    for (std::size_t i = 0; i < props.pairs.size(); ++i)
+    {
+      res[i] = ComparePairResult(env, props.pairs[i], props.metrics);
+    }
+    return res;
+  }
+
+  class CompareWorker : public Napi::AsyncWorker
+  {
+  public:
+    CompareWorker(
+        Napi::Env const& env,
+        BufferReferences&& references,
+        CompareProps&& props)
+        : AsyncWorker(env),
+          deferred(Napi::Promise::Deferred::New(env)),
+          references(std::move(references)),
+          props(std::move(props))
+    {
+    }
+
+    void Execute()
+    {
+      try {
+        DoCompare(this->props);
+      } catch (JPEGLibError const& e) {
+        // JS values can't be created on this thread, so keep the code and
+        // warnings for OnError
+        this->jpegError.reset(new JPEGLibError(e));
+        SetError(e.what());
+      } catch (std::exception const& e) {
+        SetError(e.what());
+      }
+    }
+
+    void OnOK()
+    {
+      try {
+        deferred.Resolve(CompareResult(Env(), this->props));
+      } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(Env())
+    }
+
+    void OnError(Napi::Error const& error)
+    {
+      if (this->jpegError)
+      {
+        deferred.Reject(JPEGLibErrorToJS(Env(), *this->jpegError).Value());
+        return;
+      }
+      deferred.Reject(error.Value());
+    }
+
+    Napi::Promise GetPromise() const
+    {
+      return deferred.Promise();
+    }
+
+  private:
+    Napi::Promise::Deferred deferred;
+    BufferReferences references;
+    CompareProps props;
+    std::unique_ptr<JPEGLibError> jpegError;
+  };
+
+  CompareImage SourceImage(Napi::Env const& env, Napi::Value const& value, BufferReferences& references)
+  {
+    if (!value.IsBuffer())
+    {
+      throw Napi::TypeError::New(env, "Invalid source buffer");
+    }
+    auto buffer = value.As<Napi::Buffer<uint8_t>>();
+    references.Add(buffer);
+    return CompareImage{buffer.Data(), buffer.ByteLength(), false, {}};
+  }
+
+  int ParseDimension(Napi::Env const& env, Napi::Object const& options, char const* name)
+  {
+    Napi::Value value = options.Get(name);
+    if (value.IsUndefined())
+    {
+      return 0;
+    }
+    if (!value.IsNumber() || value.As<Napi::Number>().Int64Value() <= 0
+      || value.As<Napi::Number>().Int64Value() > 65535)
+    {
+      throw Napi::TypeError::New(env, std::string("Invalid ") + name);
+    }
+    return value.As<Napi::Number>().Int32Value();
+  }
+}
+
+QualityMetrics MeasureQuality(ImageView const& reference, ImageView const& image, int metrics)
+{
+  QualityMetrics result;
+  std::array<int, 3> offsets{};
+  if (reference.format == TJPF_GRAY)
+  {
+    result.channels = 1;
+  }
+  else
+  {
+    result.channels = 3;
+    offsets = {tjRedOffset[reference.format], tjGreenOffset[reference.format], tjBlueOffset[reference.format]};
+  }
+
+  double pixels = static_cast<double>(reference.width) * reference.height;
+  uint64_t totalError = 0;
+  for (int c = 0; c < result.channels; c++)
+  {
+    Plane a = ExtractChannel(reference, offsets[c]);
+    Plane b = ExtractChannel(image, offsets[c]);
+
+    if (metrics & NJT_METRIC_PSNR)
+    {
+      uint64_t error = SquaredError(a, b);
+      totalError += error;
+      result.psnr[c] = PSNR(error / pixels);
+    }
+    if (metrics & NJT_METRIC_SSIM)
+    {
+      result.ssim[c] = PlaneSSIM(a, b).ssim;
+      result.ssimAll += result.ssim[c] / result.channels;
+    }
+    if (metrics & NJT_METRIC_MSSSIM)
+    {
+      result.msssim[c] = PlaneMSSSIM(std::move(a), std::move(b));
+      result.msssimAll += result.msssim[c] / result.channels;
+    }
+  }
+  if (metrics & NJT_METRIC_PSNR)
+  {
+    result.psnrAll = PSNR(totalError / (pixels * result.channels));
+  }
+
+  return result;
+}
+
+Napi::Value CompareInner(Napi::CallbackInfo const& info, bool async)
+{
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1)
+  {
+    throw Napi::TypeError::New(env, "Not enough arguments");
+  }
+
+  CompareProps props = {};
+  props.batch = info[0].IsArray();
+
+  // compare(reference, image, options) or compare([[reference, image], ...], options)
+  std::size_t optionsIndex = props.batch ? 1 : 2;
+  BufferReferences references;
+  if (props.batch)
+  {
+    Napi::Array pairs = info[0].As<Napi::Array>();
+    for (uint32_t i = 0; i < pairs.Length(); ++i)
+    {
+      Napi::Value pair = pairs.Get(i);
+      if (!pair.IsArray() || pair.As<Napi::Array>().Length() != 2)
+      {
+        throw Napi::TypeError::New(env, "Invalid pairs");
+      }
+      Napi::Array array = pair.As<Napi::Array>();
+      props.pairs.push_back(ComparePair{SourceImage(env, array.Get(0u), references),
+        SourceImage(env, array.Get(1u), references), 0, 0, {}, {}});
+    }
+  }
+  else
+  {
+    if (info.Length() < 2)
+    {
+      throw Napi::TypeError::New(env, "Not enough arguments");
+    }
+    props.pairs.push_back(ComparePair{SourceImage(env, info[0], references),
+      SourceImage(env, info[1], references), 0, 0, {}, {}});
+  }
+
+  if (info.Length() <= optionsIndex || !info[optionsIndex].IsObject())
+  {
+    throw Napi::TypeError::New(env, "Invalid options");
+  }
+  Napi::Object options = info[optionsIndex].As<Napi::Object>();
+
+  Napi::Value tmpFormat = options.Get("format");
+  if (!tmpFormat.IsNumber())
+  {
+    throw Napi::TypeError::New(env, "Invalid format");
+  }
+  props.format = tmpFormat.As<Napi::Number>().Uint32Value();
+  props.bpp = BytesPerPixel(props.format);
+  if (props.bpp == 0)
+  {
+    throw Napi::TypeError::New(env, "Invalid format");
+  }
+
+  props.width = ParseDimension(env, options, "width");
+  props.height = ParseDimension(env, options, "height");
+  if ((props.width == 0) != (props.height == 0))
+  {
+    throw Napi::TypeError::New(env, props.width == 0 ? "Invalid width" : "Invalid height");
+  }
+
+  // Raw pixels can start like a JPEG, so sources are only recognized by their
+  // SOI marker when there is no raw size. Otherwise the JPEG sides have to be
+  // named.
+  Napi::Value tmpJpeg = options.Get("jpeg");
+  if (!tmpJpeg.IsUndefined())
+  {
+    if (!tmpJpeg.IsArray())
+    {
+      throw Napi::TypeError::New(env, "Invalid jpeg");
+    }
+    Napi::Array sides = tmpJpeg.As<Napi::Array>();
+    int jpegSides = 0;
+    for (uint32_t i = 0; i < sides.Length(); ++i)
+    {
+      Napi::Value side = sides.Get(i);
+      std::string name = side.IsString() ? side.As<Napi::String>().Utf8Value() : "";
+      if (name == "reference")
+      {
+        jpegSides |= JPEG_REFERENCE;
+      }
+      else if (name == "image")
+      {
+        jpegSides |= JPEG_IMAGE;
+      }
+      else
+      {
+        throw Napi::TypeError::New(env, "Invalid jpeg");
+      }
+    }
+    for (auto& pair : props.pairs)
+    {
+      pair.reference.jpeg = (jpegSides & JPEG_REFERENCE) != 0;
+      pair.image.jpeg = (jpegSides & JPEG_IMAGE) != 0;
+    }
+  }
+  else if (props.width == 0)
+  {
+    for (auto& pair : props.pairs)
+    {
+      pair.reference.jpeg = StartsWithSOI(pair.reference);
+      pair.image.jpeg = StartsWithSOI(pair.image);
+    }
+  }
+
+  props.metrics = NJT_METRIC_PSNR | NJT_METRIC_SSIM;
+  Napi::Value tmpMetrics = options.Get("metrics");
+  if (!tmpMetrics.IsUndefined())
+  {
+    if (!tmpMetrics.IsArray() || tmpMetrics.As<Napi::Array>().Length() == 0)
+    {
+      throw Napi::TypeError::New(env, "Invalid metrics");
+    }
+    Napi::Array metrics = tmpMetrics.As<Napi::Array>();
+
+    props.metrics = 0;
+    for (uint32_t i = 0; i < metrics.Length(); ++i)
+    {
+      Napi::Value metric = metrics.Get(i);
+      std::string name = metric.IsString() ? metric.As<Napi::String>().Utf8Value() : "";
+      if (name == "psnr")
+      {
+        props.metrics |= NJT_METRIC_PSNR;
+      }
+      else if (name == "ssim")
+      {
+        props.metrics |= NJT_METRIC_SSIM;
+      }
+      else if (name == "msssim")
+      {
+        props.metrics |= NJT_METRIC_MSSSIM;
+      }
+      else
+      {
+        throw Napi::TypeError::New(env, "Invalid metrics");
+      }
+    }
+  }
+
+  if (async)
+  {
+    auto* wk = new CompareWorker(env, std::move(references), std::move(props));
+    wk->Queue();
+    return wk->GetPromise();
+  }
+
+  try {
+    DoCompare(props);
+    return CompareResult(env, props);
+  } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(env)
+}
+
+Napi::Value CompareAsync(const Napi::CallbackInfo &info)
+{
+  return CompareInner(info, true);
+}
+
+Napi::Value CompareSync(const Napi::CallbackInfo &info)
+{
+  return CompareInner(info, false);
+}
@@ -0,0 +1,44 @@
+#ifndef NODE_JPEGTURBO_COMPARE_H
+#define NODE_JPEGTURBO_COMPARE_H
+
+#include "util.h"
+#include <array>
+
+enum QualityMetric
+{
+  NJT_METRIC_PSNR = 1 << 0,
+  NJT_METRIC_SSIM = 1 << 1,
+  NJT_METRIC_MSSSIM = 1 << 2,
+};
+
+// 8-bit pixels of a TJPF_* format, `pitch` bytes from one row to the next
+struct ImageView
+{
+  uint8_t const* data;
+  std::size_t pitch;
+  int width;
+  int height;
+  uint32_t format;
+};
+
+// Quality of one image against a reference, per channel (R, G, B or gray;
+// alpha and padding are ignored) and over all channels. PSNR is infinite for
+// identical images.
+struct QualityMetrics
+{
+  int channels = 0;
+  std::array<double, 3> psnr{};
+  std::array<double, 3> ssim{};
+  std::array<double, 3> msssim{};
+  double psnrAll = 0;
+  double ssimAll = 0;
+  double msssimAll = 0;
+};
+
+// Compute the requested NJT_METRIC_* of two images of the same size and format
+QualityMetrics MeasureQuality(ImageView const& reference, ImageView const& image, int metrics);
+
+Napi::Value CompareAsync(const Napi::CallbackInfo &info);
+Napi::Value CompareSync(const Napi::CallbackInfo &info);
+
+#endif
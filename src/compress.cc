@@ -1,54 +1,225 @@
 #include "compress.h"
+#include "compare.h"
+#include "requantize.h"
 
-struct CompressProps
+// Copy compressed data to the output, inserting the marker segments. The
+// source may overlap the output, as long as it starts at or after
+// resData + markers.size().
+void SpliceMarkers(CompressProps &props, unsigned char const *data, std::size_t size)
 {
-  unsigned char *srcData;
-  uint32_t format;
-  uint32_t width;
-  uint32_t stride;
-  uint32_t height;
-  uint32_t subsampling;
-  int quality;
-  int bpp;
-  int flags;
-  unsigned long resSize;
-  unsigned char *resData;
-};
+  std::size_t point = MarkerInsertionPoint(data, size);
+  std::size_t markersSize = props.markers.size();
+
+  memmove(props.resData, data, point);
+  memcpy(props.resData + point, props.markers.data(), markersSize);
+  memmove(props.resData + point + markersSize, data + point, size - point);
+  props.resSize = size + markersSize;
+}
+
+// Decode the output the way decompress does, and measure the PSNR over all
+// channels of the result against the source
+std::string MeasureOutputPSNR(CompressProps &props)
+{
+  try
+  {
+    JDecompressHandle handle = OpenDecompressHandle(props.resData, props.resSize);
+    j_decompress_ptr cinfo = handle.cinfo();
+    cinfo->out_color_space = FormatColorSpace(props.format);
+    cinfo->dct_method = JDCT_IFAST;
+    jpeg_start_decompress(cinfo);
+
+    std::size_t pitch = static_cast<std::size_t>(props.width) * props.bpp;
+    std::vector<uint8_t> decoded(pitch * props.height);
+    while (cinfo->output_scanline < cinfo->output_height)
+    {
+      JSAMPROW row = decoded.data() + cinfo->output_scanline * pitch;
+      jpeg_read_scanlines(cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(cinfo);
+
+    int width = static_cast<int>(props.width);
+    int height = static_cast<int>(props.height);
+    ImageView source{static_cast<uint8_t const *>(props.srcData), static_cast<std::size_t>(props.stride) * props.bpp,
+      width, height, props.format};
+    ImageView output{decoded.data(), pitch, width, height, props.format};
+    props.psnr = MeasureQuality(source, output, NJT_METRIC_PSNR).psnrAll;
+  }
+  catch (std::exception const &e)
+  {
+    return e.what();
+  }
+
+  return "";
+}
+
+void SetCompressParams(tjhandle handle, CompressProps const &props)
+{
+  tj3Set(handle, TJPARAM_QUALITY, props.quality);
+  tj3Set(handle, TJPARAM_SUBSAMP, props.subsampling);
+  tj3Set(handle, TJPARAM_FASTDCT, 1);
+  tj3Set(handle, TJPARAM_NOREALLOC, 1);
+  if (props.lossless)
+  {
+    tj3Set(handle, TJPARAM_LOSSLESS, 1);
+    tj3Set(handle, TJPARAM_LOSSLESSPSV, props.losslessPredictor);
+    tj3Set(handle, TJPARAM_LOSSLESSPT, props.losslessPointTransform);
+  }
+}
+
+std::string CompressWithHandle(tjhandle handle, CompressProps &props)
+{
+  // Leave room for the markers at the start of the output, so that they can
+  // be inserted by moving just the SOI and APP0 segments back
+  unsigned char *jpegData = props.resData + props.markers.size();
+  std::size_t jpegSize = props.resSize - props.markers.size();
+  // The pitch is in samples, not bytes
+  int pitch = props.stride * props.bpp;
+  int err;
+  switch (props.precision)
+  {
+  case 12:
+    err = tj3Compress12(handle, static_cast<short const *>(props.srcData), props.width, pitch,
+                        props.height, props.format, &jpegData, &jpegSize);
+    break;
+  case 16:
+    err = tj3Compress16(handle, static_cast<unsigned short const *>(props.srcData), props.width, pitch,
+                        props.height, props.format, &jpegData, &jpegSize);
+    break;
+  default:
+    err = tj3Compress8(handle, static_cast<unsigned char const *>(props.srcData), props.width, pitch,
+                       props.height, props.format, &jpegData, &jpegSize);
+    break;
+  }
+  // Encoding warnings don't affect the output
+  if (err != 0 && tj3GetErrorCode(handle) != TJERR_WARNING)
+  {
+    return tj3GetErrorStr(handle);
+  }
+  props.resSize = jpegSize;
+
+  if (jpegData == nullptr)
+  {
+    return "No output data";
+  }
+
+  if (props.abbreviated)
+  {
+    jpegSize = StripTableSegments(jpegData, jpegSize, nullptr);
+    props.resSize = jpegSize;
+  }
+
+  if (!props.markers.empty())
+  {
+    SpliceMarkers(props, jpegData, jpegSize);
+  }
+
+  if (props.reportPsnr)
+  {
+    return MeasureOutputPSNR(props);
+  }
+
+  return "";
+}
 
 std::string DoCompress(CompressProps &props)
 {
-  tjhandle handle = tjInitCompress();
+  tjhandle handle = tj3Init(TJINIT_COMPRESS);
   if (handle == nullptr)
   {
-    return tjGetErrorStr();
+    return tj3GetErrorStr(nullptr);
   }
 
-  int err = tjCompress2(handle,
-                        props.srcData,
-                        props.width,
-                        props.stride * props.bpp,
-                        props.height,
-                        props.format,
-                        &props.resData,
-                        &props.resSize,
-                        props.subsampling,
-                        props.quality,
-                        props.flags);
-  if (err != 0)
+  SetCompressParams(handle, props);
+  std::string errStr = CompressWithHandle(handle, props);
+  tj3Destroy(handle);
+  return errStr;
+}
+
+// Find the highest quality whose output fits in props.targetBytes. Color
+// conversion and the FDCT only run once: the image is encoded with all-ones
+// quantization tables, and each attempt just requantizes those coefficients
+// and entropy codes them.
+std::string DoCompressToTarget(CompressProps &props)
+{
+  tjhandle handle = tj3Init(TJINIT_COMPRESS);
+  if (handle == nullptr)
   {
-    tjDestroy(handle);
-    return tjGetErrorStr();
+    return tj3GetErrorStr(nullptr);
   }
 
-  err = tjDestroy(handle);
-  if (err != 0)
+  tj3Set(handle, TJPARAM_QUALITY, 100);
+  tj3Set(handle, TJPARAM_SUBSAMP, props.subsampling);
+  unsigned char *exactData = nullptr;
+  std::size_t exactSize = 0;
+  int err = tj3Compress8(handle, static_cast<unsigned char const *>(props.srcData), props.width,
+                         props.stride * props.bpp, props.height, props.format, &exactData, &exactSize);
+  std::unique_ptr<unsigned char, TJFreeDeleter> exact(exactData);
+  if (err != 0 && tj3GetErrorCode(handle) != TJERR_WARNING)
   {
-    return tjGetErrorStr();
+    std::string errStr = tj3GetErrorStr(handle);
+    tj3Destroy(handle);
+    return errStr;
   }
+  tj3Destroy(handle);
 
-  if (props.resData == nullptr)
+  try
   {
-    return "No output data";
+    JDecompressHandle coeffHandle = OpenDecompressHandle(exact.get(), exactSize);
+    jvirt_barray_ptr *coeffs = jpeg_read_coefficients(coeffHandle.cinfo());
+
+    auto attempt = [&](int quality, JMemDestination &dest) {
+      RequantizeOptions options = {};
+      options.quality = quality;
+      options.optimizeCoding = true;
+      WriteRequantized(coeffHandle.cinfo(), coeffs, options, dest);
+    };
+
+    // Binary search for the highest quality that fits. If none does, fall
+    // back to the smallest output.
+    JMemDestination best;
+    int bestQuality = 0;
+    int low = props.minQuality;
+    int high = props.maxQuality;
+    while (low <= high)
+    {
+      int mid = low + (high - low) / 2;
+      JMemDestination dest;
+      attempt(mid, dest);
+
+      if (dest.size <= props.targetBytes)
+      {
+        best = std::move(dest);
+        bestQuality = mid;
+        low = mid + 1;
+      }
+      else
+      {
+        high = mid - 1;
+      }
+    }
+
+    props.fitted = bestQuality != 0;
+    if (!props.fitted)
+    {
+      attempt(props.minQuality, best);
+      bestQuality = props.minQuality;
+    }
+
+    if (best.size + props.markers.size() > props.resSize)
+    {
+      return "Insufficient output buffer";
+    }
+    SpliceMarkers(props, best.data, best.size);
+    props.quality = bestQuality;
+  }
+  catch (std::exception const &e)
+  {
+    return e.what();
+  }
+
+  if (props.reportPsnr)
+  {
+    return MeasureOutputPSNR(props);
   }
 
   return "";
@@ -59,6 +230,15 @@ Napi::Object CompressResult(const Napi::Env &env, const Napi::Buffer<unsigned ch
   Napi::Object res = Napi::Object::New(env);
   res.Set("data", dstBuffer);
   res.Set("size", props.resSize);
+  if (props.targetBytes != 0)
+  {
+    res.Set("quality", props.quality);
+    res.Set("fitted", props.fitted);
+  }
+  if (props.reportPsnr)
+  {
+    res.Set("psnr", props.psnr);
+  }
 
   return res;
 }
@@ -68,12 +248,12 @@ class CompressWorker : public Napi::AsyncWorker
 public:
   CompressWorker(
       Napi::Env &env,
-      Napi::Buffer<unsigned char> &srcBuffer,
+      Napi::TypedArray &srcBuffer,
       Napi::Buffer<unsigned char> &dstBuffer,
       CompressProps &props)
       : AsyncWorker(env),
         deferred(Napi::Promise::Deferred::New(env)),
-        srcBuffer(Napi::Reference<Napi::Buffer<unsigned char>>::New(srcBuffer, 1)),
+        srcBuffer(Napi::Reference<Napi::TypedArray>::New(srcBuffer, 1)),
         dstBuffer(Napi::Reference<Napi::Buffer<unsigned char>>::New(dstBuffer, 1)),
         props(props)
   {
@@ -87,7 +267,9 @@ public:
 
   void Execute()
   {
-    std::string err = DoCompress(this->props);
+    std::string err = this->props.targetBytes != 0
+      ? DoCompressToTarget(this->props)
+      : DoCompress(this->props);
     if (!err.empty())
     {
       SetError(err);
@@ -111,95 +293,79 @@ public:
 
 private:
   Napi::Promise::Deferred deferred;
-  Napi::Reference<Napi::Buffer<unsigned char>> srcBuffer;
+  Napi::Reference<Napi::TypedArray> srcBuffer;
   Napi::Reference<Napi::Buffer<unsigned char>> dstBuffer;
   CompressProps props;
 };
 
-Napi::Value CompressInner(const Napi::CallbackInfo &info, bool async)
+bool ParseCompressOptions(const Napi::Env &env, const Napi::Object &options, CompressProps &props)
 {
-  Napi::Env env = info.Env();
-
-  if (info.Length() < 2)
+  BufferSizeOptions parsedOptions = ParseBufferSizeOptions(env, options);
+  if (!parsedOptions.valid)
   {
-    Napi::TypeError::New(env, "Not enough arguments")
-        .ThrowAsJavaScriptException();
-    return env.Null();
+    return false;
   }
 
-  if (!info[0].IsBuffer())
-  {
-    Napi::TypeError::New(env, "Invalid source buffer")
-        .ThrowAsJavaScriptException();
-    return env.Null();
-  }
-  Napi::Buffer<unsigned char> srcBuffer = info[0].As<Napi::Buffer<unsigned char>>();
+  props.width = parsedOptions.width;
+  props.height = parsedOptions.height;
+  props.subsampling = parsedOptions.subsampling;
+  props.precision = parsedOptions.precision;
+  props.lossless = parsedOptions.lossless;
 
-  unsigned int offset = 0;
-  Napi::Buffer<unsigned char> dstBuffer;
-  if (info[1].IsBuffer())
+  props.losslessPredictor = 1;
+  props.losslessPointTransform = 0;
+  Napi::Value tmpLossless = options.Get("lossless");
+  if (props.lossless && tmpLossless.IsObject())
   {
-    dstBuffer = info[1].As<Napi::Buffer<unsigned char>>();
-    offset++;
-    if (dstBuffer.Length() == 0)
+    Napi::Object lossless = tmpLossless.As<Napi::Object>();
+
+    Napi::Value tmpPredictor = lossless.Get("predictor");
+    if (!tmpPredictor.IsUndefined())
     {
-      Napi::TypeError::New(env, "Invalid destination buffer")
-          .ThrowAsJavaScriptException();
-      return env.Null();
+      if (!tmpPredictor.IsNumber())
+      {
+        Napi::TypeError::New(env, "Invalid predictor").ThrowAsJavaScriptException();
+        return false;
+      }
+      props.losslessPredictor = tmpPredictor.As<Napi::Number>().Int32Value();
+    }
+    if (props.losslessPredictor < 1 || props.losslessPredictor > 7)
+    {
+      Napi::TypeError::New(env, "Invalid predictor").ThrowAsJavaScriptException();
+      return false;
     }
-  }
-
-  if (info.Length() < offset + 2 || !info[offset + 1].IsObject())
-  {
-    Napi::TypeError::New(env, "Invalid options").ThrowAsJavaScriptException();
-    return env.Null();
-  }
-  Napi::Object options = info[offset + 1].As<Napi::Object>();
 
-  BufferSizeOptions parsedOptions = ParseBufferSizeOptions(env, options);
-  if (!parsedOptions.valid)
-  {
-    return env.Null();
+    Napi::Value tmpPointTransform = lossless.Get("pointTransform");
+    if (!tmpPointTransform.IsUndefined())
+    {
+      if (!tmpPointTransform.IsNumber())
+      {
+        Napi::TypeError::New(env, "Invalid pointTransform").ThrowAsJavaScriptException();
+        return false;
+      }
+      props.losslessPointTransform = tmpPointTransform.As<Napi::Number>().Int32Value();
+    }
+    if (props.losslessPointTransform < 0 || props.losslessPointTransform >= props.precision)
+    {
+      Napi::TypeError::New(env, "Invalid pointTransform").ThrowAsJavaScriptException();
+      return false;
+    }
   }
 
-  CompressProps props = {};
-  props.srcData = srcBuffer.Data();
-  props.width = parsedOptions.width;
-  props.height = parsedOptions.height;
-  props.subsampling = parsedOptions.subsampling;
-
   Napi::Value tmpFormat = options.Get("format");
   if (!tmpFormat.IsNumber())
   {
     Napi::TypeError::New(env, "Invalid format").ThrowAsJavaScriptException();
-    return env.Null();
+    return false;
   }
   props.format = tmpFormat.As<Napi::Number>().Uint32Value();
 
   // Figure out bpp from format (needed to calculate output buffer size)
-  props.bpp = 0;
-  switch (props.format)
+  props.bpp = BytesPerPixel(props.format);
+  if (props.bpp == 0)
   {
-  case TJPF_GRAY:
-    props.bpp = 1;
-    break;
-  case TJPF_RGB:
-  case TJPF_BGR:
-    props.bpp = 3;
-    break;
-  case TJPF_RGBX:
-  case TJPF_BGRX:
-  case TJPF_XRGB:
-  case TJPF_XBGR:
-  case TJPF_RGBA:
-  case TJPF_BGRA:
-  case TJPF_ABGR:
-  case TJPF_ARGB:
-    props.bpp = 4;
-    break;
-  default:
     Napi::TypeError::New(env, "Invalid input format").ThrowAsJavaScriptException();
-    return env.Null();
+    return false;
   }
 
   props.stride = parsedOptions.width;
@@ -209,7 +375,7 @@ Napi::Value CompressInner(const Napi::CallbackInfo &info, bool async)
     if (!tmpStride.IsNumber())
     {
       Napi::TypeError::New(env, "Invalid stride").ThrowAsJavaScriptException();
-      return env.Null();
+      return false;
     }
     props.stride = tmpStride.As<Napi::Number>().Uint32Value();
   }
@@ -221,23 +387,242 @@ Napi::Value CompressInner(const Napi::CallbackInfo &info, bool async)
     if (!tmpQuality.IsNumber())
     {
       Napi::TypeError::New(env, "Invalid quality").ThrowAsJavaScriptException();
-      return env.Null();
+      return false;
     }
     props.quality = tmpQuality.As<Napi::Number>().Uint32Value();
   }
   if (props.quality <= 0 || props.quality > 100)
   {
     Napi::TypeError::New(env, "Invalid quality").ThrowAsJavaScriptException();
+    return false;
+  }
+
+  Napi::Value tmpTargetBytes = options.Get("targetBytes");
+  if (!tmpTargetBytes.IsUndefined())
+  {
+    if (!tmpTargetBytes.IsNumber() || tmpTargetBytes.As<Napi::Number>().Int64Value() <= 0)
+    {
+      Napi::TypeError::New(env, "Invalid targetBytes").ThrowAsJavaScriptException();
+      return false;
+    }
+    props.targetBytes = tmpTargetBytes.As<Napi::Number>().Uint32Value();
+
+    // Rate control requantizes with the 8-bit libjpeg API
+    if (props.precision != 8 || props.lossless)
+    {
+      Napi::TypeError::New(env, "targetBytes is only supported for 8-bit lossy images").ThrowAsJavaScriptException();
+      return false;
+    }
+
+    props.minQuality = 1;
+    Napi::Value tmpMinQuality = options.Get("minQuality");
+    if (!tmpMinQuality.IsUndefined())
+    {
+      if (!tmpMinQuality.IsNumber())
+      {
+        Napi::TypeError::New(env, "Invalid minQuality").ThrowAsJavaScriptException();
+        return false;
+      }
+      props.minQuality = tmpMinQuality.As<Napi::Number>().Int32Value();
+    }
+
+    props.maxQuality = 100;
+    Napi::Value tmpMaxQuality = options.Get("maxQuality");
+    if (!tmpMaxQuality.IsUndefined())
+    {
+      if (!tmpMaxQuality.IsNumber())
+      {
+        Napi::TypeError::New(env, "Invalid maxQuality").ThrowAsJavaScriptException();
+        return false;
+      }
+      props.maxQuality = tmpMaxQuality.As<Napi::Number>().Int32Value();
+    }
+
+    if (props.minQuality <= 0 || props.minQuality > 100)
+    {
+      Napi::TypeError::New(env, "Invalid minQuality").ThrowAsJavaScriptException();
+      return false;
+    }
+    if (props.maxQuality < props.minQuality || props.maxQuality > 100)
+    {
+      Napi::TypeError::New(env, "Invalid maxQuality").ThrowAsJavaScriptException();
+      return false;
+    }
+  }
+
+  Napi::Value tmpMarkers = options.Get("markers");
+  if (!tmpMarkers.IsUndefined())
+  {
+    if (!ParseMarkers(env, tmpMarkers, props.markers))
+    {
+      return false;
+    }
+  }
+
+  Napi::Value tmpAbbreviated = options.Get("abbreviated");
+  if (!tmpAbbreviated.IsUndefined())
+  {
+    if (!tmpAbbreviated.IsBoolean())
+    {
+      Napi::TypeError::New(env, "Invalid abbreviated").ThrowAsJavaScriptException();
+      return false;
+    }
+    props.abbreviated = tmpAbbreviated.As<Napi::Boolean>().Value();
+
+    // Only the standard tables are the same for every image. Other precisions,
+    // and rate control, optimize the Huffman tables for each image.
+    if (props.abbreviated && (props.precision != 8 || props.lossless || props.targetBytes != 0))
+    {
+      Napi::TypeError::New(env, "abbreviated is only supported for 8-bit lossy images without targetBytes").ThrowAsJavaScriptException();
+      return false;
+    }
+  }
+
+  Napi::Value tmpReportPsnr = options.Get("reportPsnr");
+  if (!tmpReportPsnr.IsUndefined())
+  {
+    if (!tmpReportPsnr.IsBoolean())
+    {
+      Napi::TypeError::New(env, "Invalid reportPsnr").ThrowAsJavaScriptException();
+      return false;
+    }
+    props.reportPsnr = tmpReportPsnr.As<Napi::Boolean>().Value();
+
+    // The output of abbreviated images can't be decoded on its own
+    if (props.reportPsnr && (props.precision != 8 || props.abbreviated))
+    {
+      Napi::TypeError::New(env, "reportPsnr is only supported for 8-bit images that aren't abbreviated").ThrowAsJavaScriptException();
+      return false;
+    }
+  }
+
+  props.bufferSize = JPEGBufferSize(parsedOptions) + props.markers.size();
+
+  return true;
+}
+
+Napi::Value CompressTables(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsObject())
+  {
+    Napi::TypeError::New(env, "Invalid options").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  CompressProps props = {};
+  if (!ParseCompressOptions(env, info[0].As<Napi::Object>(), props))
+  {
+    return env.Null();
+  }
+  if (props.precision != 8 || props.lossless || props.targetBytes != 0)
+  {
+    Napi::TypeError::New(env, "abbreviated is only supported for 8-bit lossy images without targetBytes").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  // The tables only depend on the quality and subsampling, so take them from
+  // a tiny image encoded with the same parameters
+  constexpr uint32_t size = 16;
+  std::vector<uint8_t> pixels(size * size * 3);
+  props.srcData = pixels.data();
+  props.format = TJPF_RGB;
+  props.bpp = 3;
+  props.width = size;
+  props.height = size;
+  props.stride = size;
+  props.markers.clear();
+  props.abbreviated = false;
+  props.reportPsnr = false;
+  std::vector<uint8_t> image(tj3JPEGBufSize(size, size, props.subsampling));
+  props.resData = image.data();
+  props.resSize = image.size();
+
+  std::string errStr = DoCompress(props);
+  if (!errStr.empty())
+  {
+    Napi::TypeError::New(env, errStr).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::vector<uint8_t> tables = {0xFF, 0xD8};
+  StripTableSegments(image.data(), props.resSize, &tables);
+  tables.push_back(0xFF);
+  tables.push_back(0xD9);
+
+  return Napi::Buffer<uint8_t>::Copy(env, tables.data(), tables.size());
+}
+
+Napi::Value CompressInner(const Napi::CallbackInfo &info, bool async)
+{
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 2)
+  {
+    Napi::TypeError::New(env, "Not enough arguments")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  // A Buffer, or a Uint16Array for precision 12 and 16
+  if (!info[0].IsBuffer() && !(info[0].IsTypedArray()
+    && info[0].As<Napi::TypedArray>().TypedArrayType() == napi_uint16_array))
+  {
+    Napi::TypeError::New(env, "Invalid source buffer")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  Napi::TypedArray srcBuffer = info[0].As<Napi::TypedArray>();
+
+  unsigned int offset = 0;
+  Napi::Buffer<unsigned char> dstBuffer;
+  if (info[1].IsBuffer())
+  {
+    dstBuffer = info[1].As<Napi::Buffer<unsigned char>>();
+    offset++;
+    if (dstBuffer.Length() == 0)
+    {
+      Napi::TypeError::New(env, "Invalid destination buffer")
+          .ThrowAsJavaScriptException();
+      return env.Null();
+    }
+  }
+
+  if (info.Length() < offset + 2 || !info[offset + 1].IsObject())
+  {
+    Napi::TypeError::New(env, "Invalid options").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  Napi::Object options = info[offset + 1].As<Napi::Object>();
+
+  CompressProps props = {};
+  if (!ParseCompressOptions(env, options, props))
+  {
     return env.Null();
   }
 
-  if (srcBuffer.Length() < props.stride * props.height * props.bpp)
+  if ((props.precision == 8) != info[0].IsBuffer())
+  {
+    Napi::TypeError::New(env, "Invalid source buffer").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  props.srcData = static_cast<uint8_t *>(srcBuffer.ArrayBuffer().Data()) + srcBuffer.ByteOffset();
+
+  if (srcBuffer.ElementLength() < props.stride * props.height * props.bpp)
   {
     Napi::TypeError::New(env, "Source data is not long enough").ThrowAsJavaScriptException();
     return env.Null();
   }
 
-  uint32_t dstLength = tjBufSize(props.width, props.height, props.subsampling);
+  if (props.precision != 8 && !SamplesFitPrecision(static_cast<uint16_t const *>(props.srcData),
+    props.width * props.bpp, props.height, props.stride * props.bpp, props.precision))
+  {
+    Napi::TypeError::New(env, "Sample out of range for precision").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::size_t dstLength = props.bufferSize;
   if (dstBuffer.IsEmpty())
   {
     dstBuffer = Napi::Buffer<unsigned char>::New(env, dstLength);
@@ -249,7 +634,6 @@ Napi::Value CompressInner(const Napi::CallbackInfo &info, bool async)
     return env.Null();
   }
 
-  props.flags = TJFLAG_FASTDCT | TJFLAG_NOREALLOC;
   props.resSize = dstBuffer.Length();
   props.resData = dstBuffer.Data();
 
@@ -261,7 +645,9 @@ Napi::Value CompressInner(const Napi::CallbackInfo &info, bool async)
   }
   else
   {
-    std::string errStr = DoCompress(props);
+    std::string errStr = props.targetBytes != 0
+      ? DoCompressToTarget(props)
+      : DoCompress(props);
     if (!errStr.empty())
     {
       Napi::TypeError::New(env, errStr).ThrowAsJavaScriptException();
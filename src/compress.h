@@ -2,6 +2,69 @@
 #define NODE_JPEGTURBO_COMPRESS_H
 
 #include "util.h"
+#include "markers.h"
+
+struct CompressProps
+{
+  // 8-bit samples, or 16-bit samples for precision 12 and 16
+  void *srcData;
+  uint32_t format;
+  uint32_t width;
+  uint32_t stride;
+  uint32_t height;
+  uint32_t subsampling;
+  int quality;
+  int bpp;
+  std::size_t resSize;
+  unsigned char *resData;
+
+  int precision;
+  bool lossless;
+  int losslessPredictor;
+  int losslessPointTransform;
+
+  // Rate control, used when targetBytes is non-zero. fitted is false if even
+  // minQuality didn't fit.
+  uint32_t targetBytes;
+  int minQuality;
+  int maxQuality;
+  bool fitted;
+
+  // Complete marker segments to write after SOI (and JFIF APP0, if any)
+  std::vector<uint8_t> markers;
+
+  // Leave out the quantization and Huffman tables, which the decoder gets
+  // from the output of compressTables instead
+  bool abbreviated;
+
+  // Decode the output again and measure its PSNR against the source
+  bool reportPsnr;
+  double psnr;
+
+  // Worst case size of the output, including the markers
+  std::size_t bufferSize;
+};
+
+// Parse the options of a compress call into props. Returns false and throws a
+// JS exception if they are invalid.
+bool ParseCompressOptions(const Napi::Env &env, const Napi::Object &options, CompressProps &props);
+
+// Set the encoding parameters of props on a TurboJPEG compressor
+void SetCompressParams(tjhandle handle, CompressProps const &props);
+
+// Compress props.srcData into props.resData with a compressor set up by
+// SetCompressParams. Returns an error message, or an empty string.
+std::string CompressWithHandle(tjhandle handle, CompressProps &props);
+
+// Compress with a new compressor, or with rate control if targetBytes is set
+std::string DoCompress(CompressProps &props);
+std::string DoCompressToTarget(CompressProps &props);
+
+Napi::Object CompressResult(const Napi::Env &env, const Napi::Buffer<unsigned char> dstBuffer, const CompressProps &props);
+
+// compressTables(options): the tables-only datastream for images compressed
+// with the given options and abbreviated set
+Napi::Value CompressTables(const Napi::CallbackInfo &info);
 
 Napi::Value CompressAsync(const Napi::CallbackInfo &info);
 Napi::Value CompressSync(const Napi::CallbackInfo &info);
@@ -0,0 +1,246 @@
+#include "decode_cache.h"
+#include <cstring>
+
+namespace
+{
+  // The primes of xxHash64, whose round and merge steps are used here
+  constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+  constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+  constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+  constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+
+  inline uint64_t RotateLeft(uint64_t value, int bits)
+  {
+    return (value << bits) | (value >> (64 - bits));
+  }
+
+  inline uint64_t Read64(uint8_t const* data)
+  {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+  }
+
+  inline uint64_t Round(uint64_t acc, uint64_t input)
+  {
+    return RotateLeft(acc + input * PRIME2, 31) * PRIME1;
+  }
+
+  inline uint64_t Merge(uint64_t hash, uint64_t lane)
+  {
+    return (hash ^ Round(0, lane)) * PRIME1 + PRIME4;
+  }
+}
+
+bool DecodeCacheKey::operator==(DecodeCacheKey const& other) const
+{
+  return this->hash == other.hash
+    && this->format == other.format
+    && this->scaleNum == other.scaleNum
+    && this->scaleDenom == other.scaleDenom
+    && this->warningMode == other.warningMode;
+}
+
+std::size_t DecodeCacheKeyHash::operator()(DecodeCacheKey const& key) const
+{
+  uint64_t options = (static_cast<uint64_t>(key.format) << 32)
+    ^ (static_cast<uint64_t>(key.scaleNum) << 16)
+    ^ (static_cast<uint64_t>(key.scaleDenom) << 4)
+    ^ static_cast<uint64_t>(key.warningMode);
+  return static_cast<std::size_t>(key.hash ^ (options * PRIME3));
+}
+
+std::size_t DecodedImage::Bytes() const
+{
+  return sizeof(DecodedImage) + this->source.size() + this->tables.size() + this->data.size();
+}
+
+uint64_t HashBytes(uint8_t const* data, std::size_t length, uint64_t seed)
+{
+  uint8_t const* end = data + length;
+  uint64_t hash;
+
+  // Four independent lanes, so that the multiplies can overlap
+  if (length >= 32)
+  {
+    uint64_t v1 = seed + PRIME1 + PRIME2;
+    uint64_t v2 = seed + PRIME2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - PRIME1;
+    for (; data + 32 <= end; data += 32)
+    {
+      v1 = Round(v1, Read64(data));
+      v2 = Round(v2, Read64(data + 8));
+      v3 = Round(v3, Read64(data + 16));
+      v4 = Round(v4, Read64(data + 24));
+    }
+    hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+    hash = Merge(Merge(Merge(Merge(hash, v1), v2), v3), v4);
+  }
+  else
+  {
+    hash = seed + PRIME4;
+  }
+  hash += length;
+
+  for (; data + 8 <= end; data += 8)
+  {
+    hash = RotateLeft(hash ^ Round(0, Read64(data)), 27) * PRIME1 + PRIME4;
+  }
+  for (; data < end; data++)
+  {
+    hash = RotateLeft(hash ^ (*data * PRIME4), 11) * PRIME1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= PRIME2;
+  hash ^= hash >> 29;
+  hash *= PRIME3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+DecodeCache& DecodeCache::Instance()
+{
+  // Shared by all threads and Node environments of the process. Never
+  // destroyed, as external buffers may still hold images at exit.
+  static DecodeCache* cache = new DecodeCache();
+  return *cache;
+}
+
+std::shared_ptr<DecodedImage const> DecodeCache::Find(DecodeCacheKey const& key, uint8_t const* source,
+  std::size_t length, std::vector<uint8_t> const& tables)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+
+  auto found = this->index.find(key);
+  if (found == this->index.end()
+    || found->second->second->source.size() != length
+    || memcmp(found->second->second->source.data(), source, length) != 0
+    || found->second->second->tables != tables)
+  {
+    this->misses++;
+    return nullptr;
+  }
+
+  this->hits++;
+  this->entries.splice(this->entries.begin(), this->entries, found->second);
+  return found->second->second;
+}
+
+void DecodeCache::Insert(DecodeCacheKey const& key, std::shared_ptr<DecodedImage const> image)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+
+  std::size_t size = image->Bytes();
+  if (size > this->maxBytes)
+  {
+    return;
+  }
+
+  // Another call may have decoded the same image meanwhile, or the key may
+  // belong to a colliding source. The newer image wins either way.
+  auto found = this->index.find(key);
+  if (found != this->index.end())
+  {
+    this->bytes -= found->second->second->Bytes();
+    this->entries.erase(found->second);
+    this->index.erase(found);
+  }
+
+  this->Evict(this->maxBytes - size);
+  this->entries.emplace_front(key, std::move(image));
+  this->index.emplace(key, this->entries.begin());
+  this->bytes += size;
+}
+
+void DecodeCache::Evict(std::size_t maxBytes)
+{
+  while (this->bytes > maxBytes && !this->entries.empty())
+  {
+    Entry& last = this->entries.back();
+    this->bytes -= last.second->Bytes();
+    this->index.erase(last.first);
+    this->entries.pop_back();
+    this->evictions++;
+  }
+}
+
+void DecodeCache::Configure(std::size_t maxBytes)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->maxBytes = maxBytes;
+  this->Evict(maxBytes);
+}
+
+void DecodeCache::Clear()
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->entries.clear();
+  this->index.clear();
+  this->bytes = 0;
+  this->hits = 0;
+  this->misses = 0;
+  this->evictions = 0;
+}
+
+DecodeCacheStats DecodeCache::Stats()
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return DecodeCacheStats{this->entries.size(), this->bytes, this->maxBytes, this->hits, this->misses, this->evictions};
+}
+
+Napi::TypedArray CachedImageBuffer(Napi::Env const& env, std::shared_ptr<DecodedImage const> const& image)
+{
+  // JS has no read-only buffers, and the cached pixels are shared by every
+  // decode of the image (on any thread), so each result gets its own copy
+  if (image->precision > 8)
+  {
+    Napi::Uint16Array pixels = Napi::Uint16Array::New(env, image->size);
+    std::memcpy(pixels.Data(), image->data.data(), image->size * sizeof(uint16_t));
+    return pixels;
+  }
+  return Napi::Buffer<uint8_t>::Copy(env, image->data.data(), image->size);
+}
+
+Napi::Value ConfigureCache(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsObject())
+  {
+    throw Napi::TypeError::New(env, "Invalid options");
+  }
+  Napi::Object options = info[0].As<Napi::Object>();
+
+  Napi::Value tmpMaxBytes = options.Get("maxBytes");
+  if (!tmpMaxBytes.IsNumber() || tmpMaxBytes.As<Napi::Number>().DoubleValue() < 0
+    || tmpMaxBytes.As<Napi::Number>().DoubleValue() > static_cast<double>(SIZE_MAX))
+  {
+    throw Napi::TypeError::New(env, "Invalid maxBytes");
+  }
+  DecodeCache::Instance().Configure(static_cast<std::size_t>(tmpMaxBytes.As<Napi::Number>().DoubleValue()));
+
+  return env.Undefined();
+}
+
+Napi::Value CacheStats(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  DecodeCacheStats stats = DecodeCache::Instance().Stats();
+
+  Napi::Object res = Napi::Object::New(env);
+  res.Set("entries", static_cast<double>(stats.entries));
+  res.Set("bytes", static_cast<double>(stats.bytes));
+  res.Set("maxBytes", static_cast<double>(stats.maxBytes));
+  res.Set("hits", static_cast<double>(stats.hits));
+  res.Set("misses", static_cast<double>(stats.misses));
+  res.Set("evictions", static_cast<double>(stats.evictions));
+  return res;
+}
+
+Napi::Value ClearCache(const Napi::CallbackInfo &info)
+{
+  DecodeCache::Instance().Clear();
+  return info.Env().Undefined();
+}
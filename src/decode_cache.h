@@ -0,0 +1,109 @@
+#ifndef NODE_JPEGTURBO_DECODE_CACHE_H
+#define NODE_JPEGTURBO_DECODE_CACHE_H
+
+#include "util.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Everything besides the source that changes the decoded pixels
+struct DecodeCacheKey
+{
+  // Hash of the source and tables
+  uint64_t hash;
+  uint32_t format;
+  int scaleNum;
+  int scaleDenom;
+  WarningMode warningMode;
+
+  bool operator==(DecodeCacheKey const& other) const;
+};
+
+struct DecodeCacheKeyHash
+{
+  std::size_t operator()(DecodeCacheKey const& key) const;
+};
+
+// A decoded image. It is never modified once it is in the cache, so it can be
+// shared by any number of results, on any thread.
+struct DecodedImage
+{
+  // Copies of what was decoded. They are compared on lookup, so that a hash
+  // collision (accidental or crafted) can't return another image.
+  std::vector<uint8_t> source;
+  std::vector<uint8_t> tables;
+
+  // The pixels, with 16-bit samples for precisions over 8
+  std::vector<uint8_t> data;
+  int width;
+  int height;
+  int precision;
+  // In samples
+  std::size_t size;
+  JWarnings warnings;
+
+  // What the image counts against the budget of the cache
+  std::size_t Bytes() const;
+};
+
+struct DecodeCacheStats
+{
+  std::size_t entries;
+  std::size_t bytes;
+  std::size_t maxBytes;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+};
+
+// Process-wide LRU cache of decoded images, bounded by a byte budget. All
+// methods are thread safe.
+class DecodeCache
+{
+public:
+  static constexpr std::size_t DEFAULT_MAX_BYTES = 128 << 20;
+
+  static DecodeCache& Instance();
+
+  // The image decoded from source with key, or nullptr. Counts a hit or miss.
+  std::shared_ptr<DecodedImage const> Find(DecodeCacheKey const& key, uint8_t const* source, std::size_t length,
+    std::vector<uint8_t> const& tables);
+
+  // Add an image, evicting the least recently used ones to stay within the
+  // budget. Images bigger than the whole budget aren't kept.
+  void Insert(DecodeCacheKey const& key, std::shared_ptr<DecodedImage const> image);
+
+  void Configure(std::size_t maxBytes);
+  // Drop all images and reset the counters
+  void Clear();
+  DecodeCacheStats Stats();
+
+private:
+  using Entry = std::pair<DecodeCacheKey, std::shared_ptr<DecodedImage const>>;
+
+  void Evict(std::size_t maxBytes);
+
+  std::mutex mutex;
+  // Most recently used first
+  std::list<Entry> entries;
+  std::unordered_map<DecodeCacheKey, std::list<Entry>::iterator, DecodeCacheKeyHash> index;
+  std::size_t bytes = 0;
+  std::size_t maxBytes = DEFAULT_MAX_BYTES;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+};
+
+// Fast non-cryptographic 64-bit hash, reading 32 bytes per round
+uint64_t HashBytes(uint8_t const* data, std::size_t length, uint64_t seed);
+
+// A Buffer (or a Uint16Array, for precisions over 8) with a copy of the pixels
+// of a cached image
+Napi::TypedArray CachedImageBuffer(Napi::Env const& env, std::shared_ptr<DecodedImage const> const& image);
+
+Napi::Value ConfigureCache(const Napi::CallbackInfo &info);
+Napi::Value CacheStats(const Napi::CallbackInfo &info);
+Napi::Value ClearCache(const Napi::CallbackInfo &info);
+
+#endif
@@ -1,45 +1,250 @@
-#include "compress.h"
-
-struct DecompressProps
+#include "decompress.h"
+#include <algorithm>
+#include <cstring>
+
+// Handle a failed TurboJPEG call. Warnings (e.g. corrupt data that libjpeg
+// could skip over) are recorded, and false is returned if the call should be
+// treated as fatal. TurboJPEG only keeps the last message.
+bool TJRecordWarning(DecompressProps &props)
 {
-  tjhandle handle;
-  unsigned char *srcData;
-  uint32_t srcLength;
-  uint32_t format;
-  int bpp;
-  int resWidth;
-  int resHeight;
-  unsigned long resSize;
-  unsigned char *resData;
-};
+  if (tj3GetErrorCode(props.handle) != TJERR_WARNING || props.warningMode == WarningMode::Fatal)
+  {
+    return false;
+  }
+
+  props.warnings.count++;
+  if (props.warningMode == WarningMode::Collect && props.warnings.messages.size() < JWarnings::MAX_MESSAGES)
+  {
+    props.warnings.messages.emplace_back(tj3GetErrorStr(props.handle));
+  }
+  return true;
+}
 
 std::string DoDecompress(DecompressProps &props)
 {
+  tj3Set(props.handle, TJPARAM_FASTDCT, 1);
+  tj3Set(props.handle, TJPARAM_STOPONWARNING, props.warningMode == WarningMode::Fatal);
+  if (props.limits.maxScans > 0)
+  {
+    tj3Set(props.handle, TJPARAM_SCANLIMIT, props.limits.maxScans);
+  }
+  if (props.limits.maxMemory > 0)
+  {
+    // TurboJPEG takes megabytes
+    uint64_t megabytes = (props.limits.maxMemory + (1 << 20) - 1) >> 20;
+    tj3Set(props.handle, TJPARAM_MAXMEMORY, static_cast<int>(std::min<uint64_t>(megabytes, INT32_MAX)));
+  }
 
-  int err = tjDecompress2(props.handle, props.srcData, props.srcLength, props.resData, props.resWidth, 0, props.resHeight, props.format, TJFLAG_FASTDCT);
-  if (err != 0)
+  // Lossless images can have any precision from 2 to 16 bits
+  int err;
+  if (props.precision <= 8)
   {
-    tjDestroy(props.handle);
-    return tjGetErrorStr();
+    err = tj3Decompress8(props.handle, props.srcData, props.srcLength,
+                         props.resData, static_cast<int>(props.pitch), props.format);
+  }
+  else if (props.precision <= 12)
+  {
+    err = tj3Decompress12(props.handle, props.srcData, props.srcLength,
+                          reinterpret_cast<short *>(props.resData), static_cast<int>(props.pitch), props.format);
+  }
+  else
+  {
+    err = tj3Decompress16(props.handle, props.srcData, props.srcLength,
+                          reinterpret_cast<unsigned short *>(props.resData), static_cast<int>(props.pitch), props.format);
+  }
+  if (err != 0 && !TJRecordWarning(props))
+  {
+    return tj3GetErrorStr(props.handle);
   }
 
-  err = tjDestroy(props.handle);
-  if (err != 0)
+  // TurboJPEG has no way to look at rows as they are decoded, so this is a
+  // separate pass, but still on this thread
+  if (props.stats.Requested())
   {
-    return tjGetErrorStr();
+    props.stats.Start(props.format);
+    props.stats.AddRows(props.resData, props.pitch, props.resWidth, props.resHeight);
   }
 
   return "";
 }
 
-Napi::Object DecompressResult(const Napi::Env &env, const Napi::Buffer<unsigned char> dstBuffer, const DecompressProps &props)
+// Decode with libjpeg, a few rows at a time, so that the rows decoded before
+// the data ran out or an error stopped the decode can be kept.
+std::string DoDecompressTolerant(DecompressProps &props)
+{
+  std::size_t pitch = props.pitch;
+  bool withStats = props.stats.Requested();
+  if (withStats)
+  {
+    props.stats.Start(props.format);
+  }
+  bool started = false;
+  JDIMENSION rowsBefore = 0;
+  try
+  {
+    JDecompressHandle handle = OpenDecompressHandle(props.srcData, props.srcLength, props.warningMode,
+      props.tables.empty() ? nullptr : props.tables.data(), props.tables.size());
+    ApplyDecodeLimits(handle, props.limits);
+    j_decompress_ptr cinfo = handle.cinfo();
+    JErrorManager *jerr = handle.jerr();
+
+    cinfo->out_color_space = FormatColorSpace(props.format);
+    cinfo->dct_method = JDCT_IFAST;
+    cinfo->scale_num = props.scale.num;
+    cinfo->scale_denom = props.scale.denom;
+
+    // Multi-scan (e.g. progressive) images are buffered in full by
+    // jpeg_start_decompress, so every row gets whatever data there was
+    bool multiScan = jpeg_has_multiple_scans(cinfo);
+    jpeg_start_decompress(cinfo);
+    started = true;
+
+    std::vector<JSAMPROW> rows(cinfo->rec_outbuf_height);
+    while (cinfo->output_scanline < cinfo->output_height)
+    {
+      rowsBefore = cinfo->output_scanline;
+      JDIMENSION count = std::min<JDIMENSION>(cinfo->rec_outbuf_height, cinfo->output_height - rowsBefore);
+      for (JDIMENSION i = 0; i < count; i++)
+      {
+        rows[i] = props.resData + (rowsBefore + i) * pitch;
+      }
+      jpeg_read_scanlines(cinfo, rows.data(), count);
+
+      // Past this point libjpeg only makes up data
+      if (jerr->endOfInput && !multiScan)
+      {
+        props.truncated = true;
+        break;
+      }
+
+      // While the rows are still in cache. Only rows that are kept count.
+      if (withStats)
+      {
+        props.stats.AddRows(rows[0], pitch, props.resWidth, count);
+      }
+    }
+
+    if (props.truncated)
+    {
+      props.rowsDecoded = rowsBefore;
+    }
+    else
+    {
+      props.rowsDecoded = cinfo->output_scanline;
+      props.truncated = jerr->endOfInput;
+      jpeg_finish_decompress(cinfo);
+    }
+    props.warnings = jerr->warnings;
+  }
+  catch (JPEGLibError const &e)
+  {
+    // Nothing was decoded
+    if (!started)
+    {
+      return e.what();
+    }
+
+    props.rowsDecoded = rowsBefore;
+    props.truncated = true;
+    props.error = e.what();
+    props.warnings = e.warnings();
+  }
+  catch (std::exception const &e)
+  {
+    return e.what();
+  }
+
+  if (props.fill >= 0)
+  {
+    // Only the image's own pixels, in case it was decoded into a larger buffer
+    std::size_t rowSize = static_cast<std::size_t>(props.resWidth) * props.bpp;
+    for (int row = props.rowsDecoded; row < props.resHeight; row++)
+    {
+      memset(props.resData + row * pitch, props.fill, rowSize);
+    }
+  }
+
+  return "";
+}
+
+// Look the image up in the cache, or decode it and add it. Only the source
+// and tables are hashed; the copies in the entry rule out collisions.
+std::string DoDecompressCached(DecompressProps &props)
+{
+  DecodeCache &cache = DecodeCache::Instance();
+  DecodeCacheKey key = {};
+  key.hash = HashBytes(props.srcData, props.srcLength, HashBytes(props.tables.data(), props.tables.size(), 0));
+  key.format = props.format;
+  key.scaleNum = props.scale.num;
+  key.scaleDenom = props.scale.denom;
+  key.warningMode = props.warningMode;
+
+  props.cached = cache.Find(key, props.srcData, props.srcLength, props.tables);
+  props.cacheHit = props.cached != nullptr;
+  if (props.cacheHit)
+  {
+    props.warnings = props.cached->warnings;
+    if (props.stats.Requested())
+    {
+      props.stats.Start(props.format);
+      props.stats.AddRows(props.cached->data.data(), props.pitch, props.resWidth, props.resHeight);
+    }
+    return "";
+  }
+
+  auto image = std::make_shared<DecodedImage>();
+  image->source.assign(props.srcData, props.srcData + props.srcLength);
+  image->tables = props.tables;
+  image->data.resize(props.resSize * (props.precision > 8 ? sizeof(uint16_t) : 1));
+  props.resData = image->data.data();
+
+  std::string errStr = DoDecompress(props);
+  if (!errStr.empty())
+  {
+    return errStr;
+  }
+
+  image->width = props.resWidth;
+  image->height = props.resHeight;
+  image->precision = props.precision;
+  image->size = props.resSize;
+  image->warnings = props.warnings;
+  cache.Insert(key, image);
+  props.cached = std::move(image);
+  return "";
+}
+
+Napi::Object DecompressResult(const Napi::Env &env, const Napi::TypedArray dstBuffer, const DecompressProps &props)
 {
   Napi::Object res = Napi::Object::New(env);
-  res.Set("data", dstBuffer);
+  res.Set("data", props.cached ? CachedImageBuffer(env, props.cached) : dstBuffer);
   res.Set("size", props.resSize);
   res.Set("width", props.resWidth);
   res.Set("height", props.resHeight);
   res.Set("format", props.format);
+  res.Set("precision", props.precision);
+  if (props.withMarkers)
+  {
+    res.Set("markers", MarkerLocationsResult(env, props.markers));
+  }
+  SetWarnings(env, res, props.warnings);
+  if (props.stats.Requested())
+  {
+    res.Set("stats", props.stats.ToJS(env));
+  }
+  if (props.tolerant)
+  {
+    res.Set("rowsDecoded", props.rowsDecoded);
+    res.Set("truncated", props.truncated);
+    if (!props.error.empty())
+    {
+      res.Set("error", props.error);
+    }
+  }
+  if (props.cache)
+  {
+    res.Set("cacheHit", props.cacheHit);
+  }
 
   return res;
 }
@@ -50,25 +255,34 @@ public:
   DecompressWorker(
       Napi::Env &env,
       Napi::Buffer<unsigned char> &srcBuffer,
-      Napi::Buffer<unsigned char> &dstBuffer,
+      Napi::TypedArray &dstBuffer,
       DecompressProps &props)
       : AsyncWorker(env),
         deferred(Napi::Promise::Deferred::New(env)),
         srcBuffer(Napi::Reference<Napi::Buffer<unsigned char>>::New(srcBuffer, 1)),
-        dstBuffer(Napi::Reference<Napi::Buffer<unsigned char>>::New(dstBuffer, 1)),
         props(props)
   {
+    // Cached decodes have no destination buffer until they are done
+    if (!dstBuffer.IsEmpty())
+    {
+      this->dstBuffer = Napi::Reference<Napi::TypedArray>::New(dstBuffer, 1);
+    }
   }
 
   ~DecompressWorker()
   {
+    tj3Destroy(this->props.handle);
     this->srcBuffer.Reset();
     this->dstBuffer.Reset();
   }
 
   void Execute()
   {
-    std::string err = DoDecompress(this->props);
+    std::string err = this->props.cache
+      ? DoDecompressCached(this->props)
+      : this->props.tolerant
+      ? DoDecompressTolerant(this->props)
+      : DoDecompress(this->props);
     if (!err.empty())
     {
       SetError(err);
@@ -77,7 +291,8 @@ public:
 
   void OnOK()
   {
-    deferred.Resolve(DecompressResult(Env(), this->dstBuffer.Value(), this->props));
+    deferred.Resolve(DecompressResult(Env(),
+      this->dstBuffer.IsEmpty() ? Napi::TypedArray() : this->dstBuffer.Value(), this->props));
   }
 
   void OnError(Napi::Error const &error)
@@ -93,10 +308,193 @@ public:
 private:
   Napi::Promise::Deferred deferred;
   Napi::Reference<Napi::Buffer<unsigned char>> srcBuffer;
-  Napi::Reference<Napi::Buffer<unsigned char>> dstBuffer;
+  Napi::Reference<Napi::TypedArray> dstBuffer;
   DecompressProps props;
 };
 
+// Find a scaling factor that TurboJPEG supports, in lowest terms
+bool FindScalingFactor(int num, int denom, tjscalingfactor &scale)
+{
+  int count = 0;
+  tjscalingfactor *factors = tj3GetScalingFactors(&count);
+  for (int i = 0; i < count; i++)
+  {
+    if (static_cast<int64_t>(factors[i].num) * denom == static_cast<int64_t>(num) * factors[i].denom)
+    {
+      scale = factors[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ParseDecompressOptions(const Napi::Env &env, const Napi::Object &options, DecompressProps &props)
+{
+  props.fill = -1;
+  props.scale = TJUNSCALED;
+
+  if (!options.IsEmpty())
+  {
+    Napi::Value tmpFormat = options.Get("format");
+    if (!tmpFormat.IsNumber())
+    {
+      Napi::TypeError::New(env, "Invalid format").ThrowAsJavaScriptException();
+      return false;
+    }
+    props.format = tmpFormat.As<Napi::Number>().Uint32Value();
+
+    Napi::Value tmpMarkers = options.Get("markers");
+    if (!tmpMarkers.IsUndefined())
+    {
+      if (!tmpMarkers.IsBoolean())
+      {
+        Napi::TypeError::New(env, "Invalid markers").ThrowAsJavaScriptException();
+        return false;
+      }
+      props.withMarkers = tmpMarkers.As<Napi::Boolean>().Value();
+    }
+
+    props.warningMode = ParseWarningMode(env, options);
+    props.limits = ParseDecodeLimits(env, options);
+    props.stats = ParseImageStats(env, options);
+
+    Napi::Value tmpTolerant = options.Get("tolerant");
+    if (!tmpTolerant.IsUndefined())
+    {
+      if (!tmpTolerant.IsBoolean())
+      {
+        Napi::TypeError::New(env, "Invalid tolerant").ThrowAsJavaScriptException();
+        return false;
+      }
+      props.tolerant = tmpTolerant.As<Napi::Boolean>().Value();
+    }
+
+    Napi::Value tmpTables = options.Get("tables");
+    if (!tmpTables.IsUndefined())
+    {
+      if (!tmpTables.IsBuffer() || tmpTables.As<Napi::Buffer<uint8_t>>().Length() == 0)
+      {
+        Napi::TypeError::New(env, "Invalid tables").ThrowAsJavaScriptException();
+        return false;
+      }
+      Napi::Buffer<uint8_t> tables = tmpTables.As<Napi::Buffer<uint8_t>>();
+      props.tables.assign(tables.Data(), tables.Data() + tables.Length());
+    }
+
+    Napi::Value tmpScale = options.Get("scale");
+    if (!tmpScale.IsUndefined())
+    {
+      Napi::Value tmpNum = tmpScale.IsObject() ? tmpScale.As<Napi::Object>().Get("num") : env.Undefined();
+      Napi::Value tmpDenom = tmpScale.IsObject() ? tmpScale.As<Napi::Object>().Get("denom") : env.Undefined();
+      if (!tmpNum.IsNumber() || !tmpDenom.IsNumber()
+        || tmpNum.As<Napi::Number>().Int32Value() <= 0 || tmpDenom.As<Napi::Number>().Int32Value() <= 0
+        || !FindScalingFactor(tmpNum.As<Napi::Number>().Int32Value(), tmpDenom.As<Napi::Number>().Int32Value(), props.scale))
+      {
+        Napi::TypeError::New(env, "Invalid scale").ThrowAsJavaScriptException();
+        return false;
+      }
+    }
+
+    Napi::Value tmpFill = options.Get("fill");
+    if (!tmpFill.IsUndefined())
+    {
+      if (!tmpFill.IsNumber())
+      {
+        Napi::TypeError::New(env, "Invalid fill").ThrowAsJavaScriptException();
+        return false;
+      }
+      props.fill = tmpFill.As<Napi::Number>().Int32Value();
+      if (props.fill < 0 || props.fill > 255)
+      {
+        Napi::TypeError::New(env, "Invalid fill").ThrowAsJavaScriptException();
+        return false;
+      }
+    }
+  }
+
+  // Figure out bpp from format (needed to calculate output buffer size)
+  props.bpp = BytesPerPixel(props.format);
+  if (props.bpp == 0)
+  {
+    Napi::TypeError::New(env, "Invalid output format").ThrowAsJavaScriptException();
+    return false;
+  }
+
+  return true;
+}
+
+bool ReadDecompressHeader(const Napi::Env &env, DecompressProps &props)
+{
+  if (props.withMarkers)
+  {
+    // Only the segment headers are visited, and payloads aren't copied, so
+    // this is cheap enough to do up front. TurboJPEG parses the header below.
+    ReadMarkerLocations(props.srcData, props.srcLength, props.markers);
+  }
+
+  // TurboJPEG keeps the tables of a tables-only datastream for the images
+  // decoded after it with the same handle
+  if (!props.tables.empty()
+    && tj3DecompressHeader(props.handle, props.tables.data(), props.tables.size()) != 0
+    && tj3GetErrorCode(props.handle) != TJERR_WARNING)
+  {
+    Napi::TypeError::New(env, tj3GetErrorStr(props.handle)).ThrowAsJavaScriptException();
+    return false;
+  }
+
+  // Warnings in the header are reported by the decompress call, which reads
+  // it again
+  int err = tj3DecompressHeader(props.handle, props.srcData, props.srcLength);
+  if (err != 0 && (tj3GetErrorCode(props.handle) != TJERR_WARNING || props.warningMode == WarningMode::Fatal))
+  {
+    Napi::TypeError::New(env, tj3GetErrorStr(props.handle)).ThrowAsJavaScriptException();
+    return false;
+  }
+  props.resWidth = tj3Get(props.handle, TJPARAM_JPEGWIDTH);
+  props.resHeight = tj3Get(props.handle, TJPARAM_JPEGHEIGHT);
+  props.precision = tj3Get(props.handle, TJPARAM_PRECISION);
+
+  // Before anything is allocated for the image
+  try
+  {
+    CheckImageLimits(props.limits, props.resWidth, props.resHeight);
+  }
+  catch (JPEGLibError const &e)
+  {
+    JPEGLibErrorToJS(env, e).ThrowAsJavaScriptException();
+    return false;
+  }
+
+  // The factor is kept by the handle, so it is set even when unscaled for
+  // handles that are reused. Lossless images have no DCT to scale with.
+  bool scaled = props.scale.num != props.scale.denom;
+  if (scaled && tj3Get(props.handle, TJPARAM_LOSSLESS) == 1)
+  {
+    Napi::TypeError::New(env, "Lossless images can't be scaled").ThrowAsJavaScriptException();
+    return false;
+  }
+  if (tj3SetScalingFactor(props.handle, props.scale) != 0)
+  {
+    Napi::TypeError::New(env, tj3GetErrorStr(props.handle)).ThrowAsJavaScriptException();
+    return false;
+  }
+  props.resWidth = TJSCALED(props.resWidth, props.scale);
+  props.resHeight = TJSCALED(props.resHeight, props.scale);
+
+  if (props.tolerant && props.precision != 8)
+  {
+    Napi::TypeError::New(env, "Tolerant decoding only supports 8-bit images").ThrowAsJavaScriptException();
+    return false;
+  }
+  if (props.stats.Requested() && props.precision != 8)
+  {
+    Napi::TypeError::New(env, "Image statistics only support 8-bit images").ThrowAsJavaScriptException();
+    return false;
+  }
+
+  return true;
+}
+
 Napi::Value DecompressInner(const Napi::CallbackInfo &info, bool async)
 {
   Napi::Env env = info.Env();
@@ -116,13 +514,15 @@ Napi::Value DecompressInner(const Napi::CallbackInfo &info, bool async)
   }
   Napi::Buffer<unsigned char> srcBuffer = info[0].As<Napi::Buffer<unsigned char>>();
 
+  // A Buffer, or a Uint16Array for images with more than 8 bits per sample
   unsigned int offset = 0;
-  Napi::Buffer<unsigned char> dstBuffer;
-  if (info[1].IsBuffer())
+  Napi::TypedArray dstBuffer;
+  if (info[1].IsBuffer() || (info[1].IsTypedArray()
+    && info[1].As<Napi::TypedArray>().TypedArrayType() == napi_uint16_array))
   {
-    dstBuffer = info[1].As<Napi::Buffer<unsigned char>>();
+    dstBuffer = info[1].As<Napi::TypedArray>();
     offset++;
-    if (dstBuffer.Length() == 0)
+    if (dstBuffer.ElementLength() == 0)
     {
       Napi::TypeError::New(env, "Invalid destination buffer")
           .ThrowAsJavaScriptException();
@@ -134,6 +534,7 @@ Napi::Value DecompressInner(const Napi::CallbackInfo &info, bool async)
   props.srcData = srcBuffer.Data();
   props.srcLength = srcBuffer.Length();
 
+  Napi::Object options;
   if (info.Length() >= offset + 2)
   {
     if (!info[offset + 1].IsObject())
@@ -141,77 +542,184 @@ Napi::Value DecompressInner(const Napi::CallbackInfo &info, bool async)
       Napi::TypeError::New(env, "Invalid options").ThrowAsJavaScriptException();
       return env.Null();
     }
-    Napi::Object options = info[offset + 1].As<Napi::Object>();
+    options = info[offset + 1].As<Napi::Object>();
+  }
+  if (!ParseDecompressOptions(env, options, props))
+  {
+    return env.Null();
+  }
 
-    Napi::Value tmpFormat = options.Get("format");
-    if (!tmpFormat.IsNumber())
+  // Where the image goes in the destination buffer. The pitch and a numeric
+  // dstOffset are in elements of the buffer (bytes for a Buffer), an {x, y}
+  // dstOffset is in pixels and is resolved once the pitch is known.
+  int64_t pitch = 0;
+  int64_t dstOffset = 0;
+  int64_t dstX = -1;
+  int64_t dstY = -1;
+  if (!options.IsEmpty())
+  {
+    Napi::Value tmpPitch = options.Get("pitch");
+    if (!tmpPitch.IsUndefined())
     {
-      Napi::TypeError::New(env, "Invalid format").ThrowAsJavaScriptException();
+      if (!tmpPitch.IsNumber())
+      {
+        Napi::TypeError::New(env, "Invalid pitch").ThrowAsJavaScriptException();
+        return env.Null();
+      }
+      pitch = tmpPitch.As<Napi::Number>().Int64Value();
+      if (pitch <= 0 || pitch > INT32_MAX)
+      {
+        Napi::TypeError::New(env, "Invalid pitch").ThrowAsJavaScriptException();
+        return env.Null();
+      }
+    }
+
+    Napi::Value tmpDstOffset = options.Get("dstOffset");
+    if (tmpDstOffset.IsNumber())
+    {
+      dstOffset = tmpDstOffset.As<Napi::Number>().Int64Value();
+      if (dstOffset < 0)
+      {
+        Napi::TypeError::New(env, "Invalid dstOffset").ThrowAsJavaScriptException();
+        return env.Null();
+      }
+    }
+    else if (tmpDstOffset.IsObject())
+    {
+      Napi::Object position = tmpDstOffset.As<Napi::Object>();
+      Napi::Value tmpX = position.Get("x");
+      Napi::Value tmpY = position.Get("y");
+      if (!tmpX.IsNumber() || !tmpY.IsNumber())
+      {
+        Napi::TypeError::New(env, "Invalid dstOffset").ThrowAsJavaScriptException();
+        return env.Null();
+      }
+      dstX = tmpX.As<Napi::Number>().Int64Value();
+      dstY = tmpY.As<Napi::Number>().Int64Value();
+      if (dstX < 0 || dstY < 0)
+      {
+        Napi::TypeError::New(env, "Invalid dstOffset").ThrowAsJavaScriptException();
+        return env.Null();
+      }
+    }
+    else if (!tmpDstOffset.IsUndefined())
+    {
+      Napi::TypeError::New(env, "Invalid dstOffset").ThrowAsJavaScriptException();
       return env.Null();
     }
-    props.format = tmpFormat.As<Napi::Number>().Uint32Value();
+
+    Napi::Value tmpCache = options.Get("cache");
+    if (!tmpCache.IsUndefined())
+    {
+      if (!tmpCache.IsBoolean())
+      {
+        Napi::TypeError::New(env, "Invalid cache").ThrowAsJavaScriptException();
+        return env.Null();
+      }
+      props.cache = tmpCache.As<Napi::Boolean>().Value();
+    }
   }
 
-  // Figure out bpp from format (needed to calculate output buffer size)
-  props.bpp = 0;
-  switch (props.format)
-  {
-  case TJPF_GRAY:
-    props.bpp = 1;
-    break;
-  case TJPF_RGB:
-  case TJPF_BGR:
-    props.bpp = 3;
-    break;
-  case TJPF_RGBX:
-  case TJPF_BGRX:
-  case TJPF_XRGB:
-  case TJPF_XBGR:
-  case TJPF_RGBA:
-  case TJPF_BGRA:
-  case TJPF_ABGR:
-  case TJPF_ARGB:
-    props.bpp = 4;
-    break;
-  default:
-    Napi::TypeError::New(env, "Invalid output format").ThrowAsJavaScriptException();
+  // Cached images are shared, so they can't be written into other buffers
+  if (props.cache && (!dstBuffer.IsEmpty() || pitch != 0 || dstOffset != 0 || dstX >= 0 || props.tolerant))
+  {
+    Napi::TypeError::New(env, "cache can't be used with an output buffer, pitch, dstOffset or tolerant").ThrowAsJavaScriptException();
     return env.Null();
   }
 
-  tjhandle handle = tjInitDecompress();
+  tjhandle handle = tj3Init(TJINIT_DECOMPRESS);
   if (handle == nullptr)
   {
-    Napi::TypeError::New(env, tjGetErrorStr()).ThrowAsJavaScriptException();
+    Napi::TypeError::New(env, tj3GetErrorStr(nullptr)).ThrowAsJavaScriptException();
     return env.Null();
   }
 
   props.handle = handle;
 
-  int err = tjDecompressHeader(handle, props.srcData, props.srcLength, &props.resWidth, &props.resHeight);
-  if (err != 0)
+  if (!ReadDecompressHeader(env, props))
   {
-    tjDestroy(handle);
-
-    Napi::TypeError::New(env, tjGetErrorStr()).ThrowAsJavaScriptException();
+    tj3Destroy(handle);
     return env.Null();
   }
 
-  auto targetSize = props.resWidth * props.resHeight * props.bpp;
-  if (dstBuffer.IsEmpty())
+  // The image's rows have to fit in the pitch, and a pixel position has to
+  // leave room for a whole row
+  uint64_t rowSize = static_cast<uint64_t>(props.resWidth) * props.bpp;
+  if (pitch == 0)
   {
-    dstBuffer = Napi::Buffer<unsigned char>::New(env, targetSize);
+    pitch = rowSize;
   }
+  if (static_cast<uint64_t>(pitch) < rowSize)
+  {
+    tj3Destroy(handle);
 
-  props.resSize = targetSize;
-  props.resData = dstBuffer.Data();
+    Napi::TypeError::New(env, "Invalid pitch").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  if (dstX >= 0)
+  {
+    if (static_cast<uint64_t>(dstX) * props.bpp + rowSize > static_cast<uint64_t>(pitch))
+    {
+      tj3Destroy(handle);
 
-  if (targetSize > dstBuffer.Length())
+      Napi::TypeError::New(env, "dstOffset is out of bounds").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+    // The row offset is checked before multiplying so that it can't overflow.
+    // dstX leaves less than a pitch, so the sum fits as well.
+    if (dstY > (INT64_MAX - pitch) / pitch)
+    {
+      tj3Destroy(handle);
+
+      Napi::TypeError::New(env, "Insufficient output buffer").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+    dstOffset = dstY * pitch + dstX * props.bpp;
+  }
+
+  // Everything up to the end of the image's last row. Computed in 64 bits so
+  // that large offsets can't wrap around.
+  bool wideSamples = props.precision > 8;
+  uint64_t targetSize = static_cast<uint64_t>(dstOffset)
+    + static_cast<uint64_t>(props.resHeight - 1) * pitch + rowSize;
+  if (targetSize > SIZE_MAX)
   {
-    tjDestroy(handle);
+    tj3Destroy(handle);
 
     Napi::TypeError::New(env, "Insufficient output buffer").ThrowAsJavaScriptException();
     return env.Null();
   }
+  props.resSize = targetSize;
+  props.pitch = pitch;
+
+  // Cached decodes get their buffer from the cache
+  if (!props.cache)
+  {
+    if (dstBuffer.IsEmpty())
+    {
+      dstBuffer = wideSamples
+        ? Napi::TypedArray(Napi::Uint16Array::New(env, targetSize))
+        : Napi::TypedArray(Napi::Buffer<unsigned char>::New(env, targetSize));
+    }
+    else if (wideSamples != (dstBuffer.TypedArrayType() == napi_uint16_array))
+    {
+      tj3Destroy(handle);
+
+      Napi::TypeError::New(env, "Invalid destination buffer").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+
+    props.resData = static_cast<unsigned char *>(dstBuffer.ArrayBuffer().Data()) + dstBuffer.ByteOffset()
+      + dstOffset * (wideSamples ? sizeof(uint16_t) : 1);
+
+    if (targetSize > dstBuffer.ElementLength())
+    {
+      tj3Destroy(handle);
+
+      Napi::TypeError::New(env, "Insufficient output buffer").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+  }
 
   if (async)
   {
@@ -221,7 +729,12 @@ Napi::Value DecompressInner(const Napi::CallbackInfo &info, bool async)
   }
   else
   {
-    std::string errStr = DoDecompress(props);
+    std::string errStr = props.cache
+      ? DoDecompressCached(props)
+      : props.tolerant
+      ? DoDecompressTolerant(props)
+      : DoDecompress(props);
+    tj3Destroy(handle);
     if (!errStr.empty())
     {
       Napi::TypeError::New(env, errStr).ThrowAsJavaScriptException();
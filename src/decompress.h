@@ -2,6 +2,79 @@
 #define NODE_JPEGTURBO_DECOMPRESS_H
 
 #include "util.h"
+#include "markers.h"
+#include "image_stats.h"
+#include "decode_cache.h"
+
+struct DecompressProps
+{
+  tjhandle handle;
+  unsigned char *srcData;
+  uint32_t srcLength;
+  uint32_t format;
+  int bpp;
+  int resWidth;
+  int resHeight;
+  // DCT scaling, e.g. 1/2 to decode at half the width and height.
+  // resWidth and resHeight are the scaled dimensions.
+  tjscalingfactor scale;
+  // Images with more than 8 bits per sample are decoded to 16-bit samples.
+  // resSize and pitch are in samples. resData points at the first pixel of
+  // the image, which may be inside a larger destination buffer.
+  int precision;
+  std::size_t resSize;
+  std::size_t pitch;
+  unsigned char *resData;
+
+  // Quantization and Huffman tables for abbreviated images, as a tables-only
+  // datastream. Copied, as they are small.
+  std::vector<uint8_t> tables;
+
+  // Locations of the APPn/COM markers in the source, if requested
+  bool withMarkers;
+  std::vector<MarkerLocation> markers;
+
+  WarningMode warningMode;
+  JWarnings warnings;
+  DecodeLimits limits;
+
+  // Tolerant decoding keeps what could be decoded of truncated or corrupt
+  // images. fill is the byte value for the rows after rowsDecoded, or -1.
+  bool tolerant;
+  int fill;
+  int rowsDecoded;
+  bool truncated;
+  std::string error;
+
+  // Statistics of the decoded pixels, if any were requested
+  ImageStats stats;
+
+  // Decode through the DecodeCache. The result is a copy of the pixels of
+  // the cached image, made by CachedImageBuffer, instead of resData.
+  bool cache;
+  bool cacheHit;
+  std::shared_ptr<DecodedImage const> cached;
+};
+
+// Find a scaling factor that TurboJPEG supports, in lowest terms. Returns
+// false if there is none.
+bool FindScalingFactor(int num, int denom, tjscalingfactor &scale);
+
+// Parse the options of a decompress call into props. options may be empty.
+// Returns false and throws a JS exception if they are invalid.
+bool ParseDecompressOptions(const Napi::Env &env, const Napi::Object &options, DecompressProps &props);
+
+// Read the header of props.srcData with props.handle, and check it against
+// the limits. Returns false and throws a JS exception on failure.
+bool ReadDecompressHeader(const Napi::Env &env, DecompressProps &props);
+
+// Decode into props.resData. The TurboJPEG handle stays owned by the caller.
+// Returns an error message, or an empty string.
+std::string DoDecompress(DecompressProps &props);
+std::string DoDecompressTolerant(DecompressProps &props);
+std::string DoDecompressCached(DecompressProps &props);
+
+Napi::Object DecompressResult(const Napi::Env &env, const Napi::TypedArray dstBuffer, const DecompressProps &props);
 
 Napi::Value DecompressAsync(const Napi::CallbackInfo &info);
 Napi::Value DecompressSync(const Napi::CallbackInfo &info);
@@ -0,0 +1,377 @@
+#include "decompress_progressive.h"
+#include <algorithm>
+
+namespace
+{
+  class PassWorker : public Napi::AsyncWorker
+  {
+  public:
+    PassWorker(Napi::Env const& env, ProgressiveDecoder* decoder, Napi::Object self)
+        : AsyncWorker(env),
+          deferred(Napi::Promise::Deferred::New(env)),
+          decoder(decoder),
+          self(Napi::Persistent(self))
+    {
+    }
+
+    ~PassWorker()
+    {
+      this->self.Reset();
+    }
+
+    void Execute()
+    {
+      try {
+        this->decoder->DecodePass();
+      }
+      catch (JPEGLibError const& e)
+      {
+        // JS values can't be created on this thread, so keep the code and
+        // warnings for OnError
+        this->jpegError.reset(new JPEGLibError(e));
+        SetError(e.what());
+      }
+    }
+
+    void OnOK()
+    {
+      this->decoder->Release(false);
+      try {
+        deferred.Resolve(this->decoder->PassResult(Env()));
+      } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(Env())
+    }
+
+    void OnError(Napi::Error const& error)
+    {
+      this->decoder->Release(true);
+      if (this->jpegError)
+      {
+        deferred.Reject(JPEGLibErrorToJS(Env(), *this->jpegError).Value());
+        return;
+      }
+      deferred.Reject(error.Value());
+    }
+
+    Napi::Promise GetPromise() const
+    {
+      return deferred.Promise();
+    }
+
+  private:
+    Napi::Promise::Deferred deferred;
+    ProgressiveDecoder* decoder;
+    // Keeps the decoder (and so its buffers) alive while the pass is decoded
+    Napi::ObjectReference self;
+    std::unique_ptr<JPEGLibError> jpegError;
+  };
+}
+
+Napi::Function ProgressiveDecoder::Init(Napi::Env env)
+{
+  return DefineClass(env, "ProgressiveDecoder", {
+    InstanceMethod("next", &ProgressiveDecoder::Next),
+    InstanceMethod("nextSync", &ProgressiveDecoder::NextSync),
+    InstanceMethod("stop", &ProgressiveDecoder::Stop),
+    InstanceAccessor("width", &ProgressiveDecoder::GetWidth, nullptr),
+    InstanceAccessor("height", &ProgressiveDecoder::GetHeight, nullptr),
+    InstanceAccessor("progressive", &ProgressiveDecoder::GetProgressive, nullptr),
+  });
+}
+
+ProgressiveDecoder::ProgressiveDecoder(Napi::CallbackInfo const& info)
+    : Napi::ObjectWrap<ProgressiveDecoder>(info),
+      format(NJT_DEFAULT_FORMAT),
+      bpp(0),
+      width(0),
+      height(0),
+      progressive(false),
+      started(false),
+      done(false),
+      failed(false),
+      busy(false),
+      outData(nullptr),
+      produced(false),
+      passScan(0),
+      passFinal(false)
+{
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsBuffer())
+  {
+    throw Napi::TypeError::New(env, "Invalid source buffer");
+  }
+  Napi::Buffer<uint8_t> src = info[0].As<Napi::Buffer<uint8_t>>();
+
+  WarningMode warningMode = WarningMode::Collect;
+  DecodeLimits limits;
+  if (info.Length() >= 2 && !info[1].IsUndefined())
+  {
+    if (!info[1].IsObject())
+    {
+      throw Napi::TypeError::New(env, "Invalid options");
+    }
+    Napi::Object options = info[1].As<Napi::Object>();
+
+    Napi::Value tmpFormat = options.Get("format");
+    if (!tmpFormat.IsUndefined())
+    {
+      if (!tmpFormat.IsNumber())
+      {
+        throw Napi::TypeError::New(env, "Invalid format");
+      }
+      this->format = tmpFormat.As<Napi::Number>().Uint32Value();
+    }
+
+    Napi::Value tmpScans = options.Get("scans");
+    if (!tmpScans.IsUndefined())
+    {
+      if (!tmpScans.IsArray())
+      {
+        throw Napi::TypeError::New(env, "Invalid scans");
+      }
+      Napi::Array scans = tmpScans.As<Napi::Array>();
+      for (uint32_t i = 0; i < scans.Length(); i++)
+      {
+        Napi::Value scan = scans.Get(i);
+        if (!scan.IsNumber() || scan.As<Napi::Number>().Int64Value() < 1
+          || scan.As<Napi::Number>().Int64Value() > INT32_MAX)
+        {
+          throw Napi::TypeError::New(env, "Invalid scans");
+        }
+        this->scans.push_back(scan.As<Napi::Number>().Int32Value());
+      }
+      // An empty list means only the final image, rather than every scan
+      if (this->scans.empty())
+      {
+        this->scans.push_back(INT32_MAX);
+      }
+    }
+
+    warningMode = ParseWarningMode(env, options);
+    limits = ParseDecodeLimits(env, options);
+  }
+
+  this->bpp = BytesPerPixel(this->format);
+  if (this->bpp == 0)
+  {
+    throw Napi::TypeError::New(env, "Invalid output format");
+  }
+
+  try {
+    this->handle = OpenDecompressHandle(src.Data(), src.ByteLength(), warningMode);
+    ApplyDecodeLimits(this->handle, limits);
+  } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(env)
+
+  j_decompress_ptr cinfo = this->handle.cinfo();
+  this->progressive = jpeg_has_multiple_scans(cinfo);
+  cinfo->buffered_image = this->progressive;
+  cinfo->out_color_space = FormatColorSpace(this->format);
+  cinfo->dct_method = JDCT_IFAST;
+  jpeg_calc_output_dimensions(cinfo);
+  this->width = cinfo->output_width;
+  this->height = cinfo->output_height;
+
+  std::size_t size = static_cast<std::size_t>(this->width) * this->bpp * this->height;
+  this->srcBuffer = Napi::Reference<Napi::Buffer<uint8_t>>::New(src, 1);
+  this->outBuffer = Napi::Reference<Napi::Buffer<uint8_t>>::New(
+    Napi::Buffer<uint8_t>::New(env, size), 1);
+}
+
+ProgressiveDecoder::~ProgressiveDecoder()
+{
+  this->srcBuffer.Reset();
+  this->outBuffer.Reset();
+}
+
+bool ProgressiveDecoder::Wanted(int scan) const
+{
+  return this->scans.empty()
+    || std::find(this->scans.begin(), this->scans.end(), scan) != this->scans.end();
+}
+
+void ProgressiveDecoder::ReadImage()
+{
+  j_decompress_ptr cinfo = this->handle.cinfo();
+  std::size_t rowSize = static_cast<std::size_t>(this->width) * this->bpp;
+
+  std::vector<JSAMPROW> rows(this->height);
+  for (JDIMENSION i = 0; i < this->height; i++)
+  {
+    rows[i] = this->outData + i * rowSize;
+  }
+  while (cinfo->output_scanline < cinfo->output_height)
+  {
+    JDIMENSION read = cinfo->output_scanline;
+    jpeg_read_scanlines(cinfo, rows.data() + read, this->height - read);
+  }
+}
+
+void ProgressiveDecoder::DecodePass()
+{
+  this->produced = false;
+  if (this->done)
+  {
+    return;
+  }
+
+  j_decompress_ptr cinfo = this->handle.cinfo();
+  if (!this->started)
+  {
+    // In buffered-image mode this doesn't read any of the scans yet
+    jpeg_start_decompress(cinfo);
+    this->started = true;
+  }
+
+  if (!this->progressive)
+  {
+    this->ReadImage();
+    jpeg_finish_decompress(cinfo);
+    this->passScan = 1;
+    this->passFinal = true;
+  }
+  else
+  {
+    // Absorb input until a requested scan or the whole image is complete.
+    // The progress monitor isn't called by jpeg_consume_input, so call it
+    // here for the scan limit.
+    bool final = false;
+    for (;;)
+    {
+      int status = jpeg_consume_input(cinfo);
+      if (cinfo->progress != nullptr)
+      {
+        (*cinfo->progress->progress_monitor)(asJCommon(cinfo));
+      }
+      if (status == JPEG_REACHED_EOI)
+      {
+        final = true;
+        break;
+      }
+      if (status == JPEG_SCAN_COMPLETED && this->Wanted(cinfo->input_scan_number))
+      {
+        // Read up to the next scan's header, so that the last scan is
+        // reported as final rather than produced twice
+        int scan = cinfo->input_scan_number;
+        final = jpeg_consume_input(cinfo) == JPEG_REACHED_EOI;
+        this->passScan = scan;
+        break;
+      }
+    }
+    if (final)
+    {
+      this->passScan = cinfo->input_scan_number;
+    }
+
+    // Only the coefficients of scans up to passScan have been read, so this
+    // is the image as of that scan
+    jpeg_start_output(cinfo, this->passScan);
+    this->ReadImage();
+    jpeg_finish_output(cinfo);
+    if (final)
+    {
+      jpeg_finish_decompress(cinfo);
+    }
+    this->passFinal = final;
+  }
+
+  this->done = this->passFinal;
+  this->produced = true;
+  this->warnings = this->handle.jerr()->warnings;
+}
+
+Napi::Value ProgressiveDecoder::PassResult(Napi::Env const& env)
+{
+  if (!this->produced)
+  {
+    return env.Null();
+  }
+
+  Napi::Object res = Napi::Object::New(env);
+  res.Set("data", this->outBuffer.Value());
+  res.Set("size", static_cast<std::size_t>(this->width) * this->bpp * this->height);
+  res.Set("scan", this->passScan);
+  res.Set("final", this->passFinal);
+  SetWarnings(env, res, this->warnings);
+
+  return res;
+}
+
+void ProgressiveDecoder::Acquire(Napi::Env const& env)
+{
+  if (this->busy)
+  {
+    throw Napi::Error::New(env, "Decoder is busy");
+  }
+  if (this->failed)
+  {
+    throw Napi::Error::New(env, "Decoder has failed");
+  }
+  this->busy = true;
+}
+
+void ProgressiveDecoder::Release(bool failed)
+{
+  this->busy = false;
+  if (failed)
+  {
+    this->failed = true;
+  }
+}
+
+Napi::Value ProgressiveDecoder::Next(Napi::CallbackInfo const& info)
+{
+  this->Acquire(info.Env());
+  this->outData = this->outBuffer.Value().Data();
+
+  auto* wk = new PassWorker(info.Env(), this, info.This().As<Napi::Object>());
+  wk->Queue();
+  return wk->GetPromise();
+}
+
+Napi::Value ProgressiveDecoder::NextSync(Napi::CallbackInfo const& info)
+{
+  this->Acquire(info.Env());
+  this->outData = this->outBuffer.Value().Data();
+
+  try {
+    this->DecodePass();
+  }
+  catch (...)
+  {
+    this->Release(true);
+    try {
+      throw;
+    } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(info.Env())
+  }
+  this->Release(false);
+
+  return this->PassResult(info.Env());
+}
+
+// Give up on the rest of the image. The libjpeg state is freed now rather
+// than when the decoder is garbage collected.
+Napi::Value ProgressiveDecoder::Stop(Napi::CallbackInfo const& info)
+{
+  if (this->busy)
+  {
+    throw Napi::Error::New(info.Env(), "Decoder is busy");
+  }
+  this->handle = JDecompressHandle();
+  this->done = true;
+  return info.Env().Undefined();
+}
+
+Napi::Value ProgressiveDecoder::GetWidth(Napi::CallbackInfo const& info)
+{
+  return Napi::Number::New(info.Env(), this->width);
+}
+
+Napi::Value ProgressiveDecoder::GetHeight(Napi::CallbackInfo const& info)
+{
+  return Napi::Number::New(info.Env(), this->height);
+}
+
+Napi::Value ProgressiveDecoder::GetProgressive(Napi::CallbackInfo const& info)
+{
+  return Napi::Boolean::New(info.Env(), this->progressive);
+}
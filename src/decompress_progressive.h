@@ -0,0 +1,76 @@
+#ifndef NODE_JPEGTURBO_DECOMPRESS_PROGRESSIVE_H
+#define NODE_JPEGTURBO_DECOMPRESS_PROGRESSIVE_H
+
+#include "util.h"
+
+// Decodes a progressive JPEG with libjpeg's buffered-image mode, producing the
+// whole image after selected scans as well as after the last one, so that a
+// low quality version is available early without decoding twice. Images with
+// a single scan (e.g. baseline) produce just the final image.
+//
+// new ProgressiveDecoder(image, {format, scans, warnings, limits})
+// next() -> Promise<pass | null>, nextSync() -> pass | null, stop()
+//
+// A pass is {data, size, scan, final, warnings, warningCount}. data is the
+// shared output buffer, so it is only valid until the next call.
+class ProgressiveDecoder : public Napi::ObjectWrap<ProgressiveDecoder>
+{
+public:
+  static Napi::Function Init(Napi::Env env);
+
+  ProgressiveDecoder(Napi::CallbackInfo const& info);
+  ~ProgressiveDecoder();
+
+  // Decode up to and including the next requested scan. Runs on the worker
+  // thread for next().
+  void DecodePass();
+
+  // The result for the last decoded pass, or null once the image is done
+  Napi::Value PassResult(Napi::Env const& env);
+
+  // Called when a call to next() finishes
+  void Release(bool failed);
+
+private:
+  Napi::Value Next(Napi::CallbackInfo const& info);
+  Napi::Value NextSync(Napi::CallbackInfo const& info);
+  Napi::Value Stop(Napi::CallbackInfo const& info);
+  Napi::Value GetWidth(Napi::CallbackInfo const& info);
+  Napi::Value GetHeight(Napi::CallbackInfo const& info);
+  Napi::Value GetProgressive(Napi::CallbackInfo const& info);
+
+  // Throws if the decoder can't take another call
+  void Acquire(Napi::Env const& env);
+
+  // Whether to produce an image after the given scan (1-based)
+  bool Wanted(int scan) const;
+
+  // Decode the output pass that has been started into the output buffer
+  void ReadImage();
+
+  Napi::Reference<Napi::Buffer<uint8_t>> srcBuffer;
+  Napi::Reference<Napi::Buffer<uint8_t>> outBuffer;
+  JDecompressHandle handle;
+  uint32_t format;
+  int bpp;
+  JDIMENSION width;
+  JDIMENSION height;
+  bool progressive;
+  // The scans to produce an image after. Empty for every scan.
+  std::vector<int> scans;
+
+  bool started;
+  bool done;
+  // A decode error leaves the handle unusable
+  bool failed;
+  // A next() is in flight, and the handle belongs to the worker thread
+  bool busy;
+  // The output buffer's data, looked up on the main thread
+  uint8_t* outData;
+  bool produced;
+  int passScan;
+  bool passFinal;
+  JWarnings warnings;
+};
+
+#endif
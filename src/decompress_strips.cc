@@ -0,0 +1,293 @@
+#include "decompress_strips.h"
+#include <algorithm>
+
+namespace
+{
+  class StripWorker : public Napi::AsyncWorker
+  {
+  public:
+    StripWorker(Napi::Env const& env, StripDecoder* decoder, Napi::Object self)
+        : AsyncWorker(env),
+          deferred(Napi::Promise::Deferred::New(env)),
+          decoder(decoder),
+          self(Napi::Persistent(self))
+    {
+    }
+
+    ~StripWorker()
+    {
+      this->self.Reset();
+    }
+
+    void Execute()
+    {
+      try {
+        this->decoder->DecodeStrip();
+      }
+      catch (JPEGLibError const& e)
+      {
+        // JS values can't be created on this thread, so keep the code and
+        // warnings for OnError
+        this->jpegError.reset(new JPEGLibError(e));
+        SetError(e.what());
+      }
+    }
+
+    void OnOK()
+    {
+      this->decoder->Release(false);
+      try {
+        deferred.Resolve(this->decoder->StripResult(Env()));
+      } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(Env())
+    }
+
+    void OnError(Napi::Error const& error)
+    {
+      this->decoder->Release(true);
+      if (this->jpegError)
+      {
+        deferred.Reject(JPEGLibErrorToJS(Env(), *this->jpegError).Value());
+        return;
+      }
+      deferred.Reject(error.Value());
+    }
+
+    Napi::Promise GetPromise() const
+    {
+      return deferred.Promise();
+    }
+
+  private:
+    Napi::Promise::Deferred deferred;
+    StripDecoder* decoder;
+    // Keeps the decoder (and so its buffers) alive while the strip is decoded
+    Napi::ObjectReference self;
+    std::unique_ptr<JPEGLibError> jpegError;
+  };
+}
+
+Napi::Function StripDecoder::Init(Napi::Env env)
+{
+  return DefineClass(env, "StripDecoder", {
+    InstanceMethod("next", &StripDecoder::Next),
+    InstanceMethod("nextSync", &StripDecoder::NextSync),
+    InstanceAccessor("width", &StripDecoder::GetWidth, nullptr),
+    InstanceAccessor("height", &StripDecoder::GetHeight, nullptr),
+  });
+}
+
+StripDecoder::StripDecoder(Napi::CallbackInfo const& info)
+    : Napi::ObjectWrap<StripDecoder>(info),
+      format(NJT_DEFAULT_FORMAT),
+      bpp(0),
+      width(0),
+      height(0),
+      rowsPerStrip(16),
+      started(false),
+      done(false),
+      failed(false),
+      busy(false),
+      stripData(nullptr),
+      stripY(0),
+      stripRows(0)
+{
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsBuffer())
+  {
+    throw Napi::TypeError::New(env, "Invalid source buffer");
+  }
+  Napi::Buffer<uint8_t> src = info[0].As<Napi::Buffer<uint8_t>>();
+
+  WarningMode warningMode = WarningMode::Collect;
+  DecodeLimits limits;
+  int64_t rows = this->rowsPerStrip;
+  if (info.Length() >= 2 && !info[1].IsUndefined())
+  {
+    if (!info[1].IsObject())
+    {
+      throw Napi::TypeError::New(env, "Invalid options");
+    }
+    Napi::Object options = info[1].As<Napi::Object>();
+
+    Napi::Value tmpFormat = options.Get("format");
+    if (!tmpFormat.IsUndefined())
+    {
+      if (!tmpFormat.IsNumber())
+      {
+        throw Napi::TypeError::New(env, "Invalid format");
+      }
+      this->format = tmpFormat.As<Napi::Number>().Uint32Value();
+    }
+
+    Napi::Value tmpRows = options.Get("rowsPerStrip");
+    if (!tmpRows.IsUndefined())
+    {
+      if (!tmpRows.IsNumber())
+      {
+        throw Napi::TypeError::New(env, "Invalid rowsPerStrip");
+      }
+      rows = tmpRows.As<Napi::Number>().Int64Value();
+    }
+
+    warningMode = ParseWarningMode(env, options);
+    limits = ParseDecodeLimits(env, options);
+  }
+
+  this->bpp = BytesPerPixel(this->format);
+  if (this->bpp == 0)
+  {
+    throw Napi::TypeError::New(env, "Invalid output format");
+  }
+
+  try {
+    this->handle = OpenDecompressHandle(src.Data(), src.ByteLength(), warningMode);
+    ApplyDecodeLimits(this->handle, limits);
+  } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(env)
+
+  // Only the header has been read. The (possibly slow) start of the decode
+  // happens with the first strip, off the main thread for next().
+  j_decompress_ptr cinfo = this->handle.cinfo();
+  cinfo->out_color_space = FormatColorSpace(this->format);
+  cinfo->dct_method = JDCT_IFAST;
+  jpeg_calc_output_dimensions(cinfo);
+  this->width = cinfo->output_width;
+  this->height = cinfo->output_height;
+
+  if (rows < 1)
+  {
+    throw Napi::TypeError::New(env, "Invalid rowsPerStrip");
+  }
+  // A strip never needs more rows than the image has
+  this->rowsPerStrip = static_cast<JDIMENSION>(std::min(rows, static_cast<int64_t>(this->height)));
+
+  std::size_t stripSize = static_cast<std::size_t>(this->width) * this->bpp * this->rowsPerStrip;
+  this->srcBuffer = Napi::Reference<Napi::Buffer<uint8_t>>::New(src, 1);
+  this->stripBuffer = Napi::Reference<Napi::Buffer<uint8_t>>::New(
+    Napi::Buffer<uint8_t>::New(env, stripSize), 1);
+}
+
+StripDecoder::~StripDecoder()
+{
+  this->srcBuffer.Reset();
+  this->stripBuffer.Reset();
+}
+
+void StripDecoder::DecodeStrip()
+{
+  this->stripRows = 0;
+  if (this->done)
+  {
+    return;
+  }
+
+  j_decompress_ptr cinfo = this->handle.cinfo();
+  if (!this->started)
+  {
+    // Buffers the whole image for multi-scan (e.g. progressive) images
+    jpeg_start_decompress(cinfo);
+    this->started = true;
+  }
+
+  this->stripY = cinfo->output_scanline;
+  JDIMENSION count = std::min(this->rowsPerStrip, cinfo->output_height - this->stripY);
+  std::size_t rowSize = static_cast<std::size_t>(this->width) * this->bpp;
+
+  std::vector<JSAMPROW> rows(count);
+  for (JDIMENSION i = 0; i < count; i++)
+  {
+    rows[i] = this->stripData + i * rowSize;
+  }
+  while (cinfo->output_scanline < this->stripY + count)
+  {
+    JDIMENSION read = cinfo->output_scanline - this->stripY;
+    jpeg_read_scanlines(cinfo, rows.data() + read, count - read);
+  }
+  this->stripRows = count;
+
+  if (cinfo->output_scanline == cinfo->output_height)
+  {
+    jpeg_finish_decompress(cinfo);
+    this->done = true;
+  }
+  this->warnings = this->handle.jerr()->warnings;
+}
+
+Napi::Value StripDecoder::StripResult(Napi::Env const& env)
+{
+  if (this->stripRows == 0)
+  {
+    return env.Null();
+  }
+
+  Napi::Object res = Napi::Object::New(env);
+  res.Set("data", this->stripBuffer.Value());
+  res.Set("size", static_cast<std::size_t>(this->width) * this->bpp * this->stripRows);
+  res.Set("y", this->stripY);
+  res.Set("rows", this->stripRows);
+  SetWarnings(env, res, this->warnings);
+
+  return res;
+}
+
+void StripDecoder::Acquire(Napi::Env const& env)
+{
+  if (this->busy)
+  {
+    throw Napi::Error::New(env, "Decoder is busy");
+  }
+  if (this->failed)
+  {
+    throw Napi::Error::New(env, "Decoder has failed");
+  }
+  this->busy = true;
+}
+
+void StripDecoder::Release(bool failed)
+{
+  this->busy = false;
+  if (failed)
+  {
+    this->failed = true;
+  }
+}
+
+Napi::Value StripDecoder::Next(Napi::CallbackInfo const& info)
+{
+  this->Acquire(info.Env());
+  this->stripData = this->stripBuffer.Value().Data();
+
+  auto* wk = new StripWorker(info.Env(), this, info.This().As<Napi::Object>());
+  wk->Queue();
+  return wk->GetPromise();
+}
+
+Napi::Value StripDecoder::NextSync(Napi::CallbackInfo const& info)
+{
+  this->Acquire(info.Env());
+  this->stripData = this->stripBuffer.Value().Data();
+
+  try {
+    this->DecodeStrip();
+  }
+  catch (...)
+  {
+    this->Release(true);
+    try {
+      throw;
+    } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(info.Env())
+  }
+  this->Release(false);
+
+  return this->StripResult(info.Env());
+}
+
+Napi::Value StripDecoder::GetWidth(Napi::CallbackInfo const& info)
+{
+  return Napi::Number::New(info.Env(), this->width);
+}
+
+Napi::Value StripDecoder::GetHeight(Napi::CallbackInfo const& info)
+{
+  return Napi::Number::New(info.Env(), this->height);
+}
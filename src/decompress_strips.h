@@ -0,0 +1,63 @@
+#ifndef NODE_JPEGTURBO_DECOMPRESS_STRIPS_H
+#define NODE_JPEGTURBO_DECOMPRESS_STRIPS_H
+
+#include "util.h"
+
+// Decodes a JPEG a strip of rows at a time into one reused buffer, so memory
+// use is bounded by the width of the image and the strip height rather than
+// the size of the whole image.
+//
+// new StripDecoder(image, {format, rowsPerStrip, warnings})
+// next() -> Promise<strip | null>, nextSync() -> strip | null
+//
+// A strip is {data, size, y, rows, warnings, warningCount}. data is the
+// shared strip buffer, so it is only valid until the next call.
+class StripDecoder : public Napi::ObjectWrap<StripDecoder>
+{
+public:
+  static Napi::Function Init(Napi::Env env);
+
+  StripDecoder(Napi::CallbackInfo const& info);
+  ~StripDecoder();
+
+  // Decode the next strip. Runs on the worker thread for next().
+  void DecodeStrip();
+
+  // The result for the last decoded strip, or null at the end of the image
+  Napi::Value StripResult(Napi::Env const& env);
+
+  // Called when a call to next() finishes
+  void Release(bool failed);
+
+private:
+  Napi::Value Next(Napi::CallbackInfo const& info);
+  Napi::Value NextSync(Napi::CallbackInfo const& info);
+  Napi::Value GetWidth(Napi::CallbackInfo const& info);
+  Napi::Value GetHeight(Napi::CallbackInfo const& info);
+
+  // Throws if the decoder can't take another call
+  void Acquire(Napi::Env const& env);
+
+  Napi::Reference<Napi::Buffer<uint8_t>> srcBuffer;
+  Napi::Reference<Napi::Buffer<uint8_t>> stripBuffer;
+  JDecompressHandle handle;
+  uint32_t format;
+  int bpp;
+  JDIMENSION width;
+  JDIMENSION height;
+  JDIMENSION rowsPerStrip;
+
+  bool started;
+  bool done;
+  // A decode error leaves the handle unusable
+  bool failed;
+  // A next() is in flight, and the handle belongs to the worker thread
+  bool busy;
+  // The strip buffer's data, looked up on the main thread
+  uint8_t* stripData;
+  JDIMENSION stripY;
+  JDIMENSION stripRows;
+  JWarnings warnings;
+};
+
+#endif
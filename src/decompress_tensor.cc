@@ -0,0 +1,479 @@
+#include "decompress_tensor.h"
+#include "decompress.h"
+#include "resample.h"
+#include <array>
+#include <cmath>
+
+namespace
+{
+  enum class TensorLayout
+  {
+    NCHW,
+    NHWC,
+  };
+
+  struct DecompressTensorProps
+  {
+    JDecompressHandle handle;
+    int channels;
+    TensorLayout layout;
+    // Each sample becomes sample * multiplier + bias, i.e.
+    // (sample / 255 - mean) / std, per channel
+    std::array<float, 3> multiplier;
+    std::array<float, 3> bias;
+    // The size of the tensor, which differs from the decoded size when
+    // resizing
+    int resWidth;
+    int resHeight;
+    // In elements
+    std::size_t resSize;
+    float* resData;
+    JWarnings warnings;
+  };
+
+  // Convert one decoded row. The loops are plain multiply-adds over
+  // contiguous samples, which the compiler vectorizes.
+  template<int CHANNELS>
+  void ConvertRow(DecompressTensorProps const& props, TensorLayout layout, uint8_t const* src,
+    float* dst, int width, int height, int y)
+  {
+    if (layout == TensorLayout::NHWC)
+    {
+      float* out = dst + static_cast<std::size_t>(y) * width * CHANNELS;
+      for (int x = 0; x < width; x++)
+      {
+        for (int c = 0; c < CHANNELS; c++)
+        {
+          out[x * CHANNELS + c] = src[x * CHANNELS + c] * props.multiplier[c] + props.bias[c];
+        }
+      }
+      return;
+    }
+
+    std::size_t planeSize = static_cast<std::size_t>(width) * height;
+    for (int c = 0; c < CHANNELS; c++)
+    {
+      float* out = dst + c * planeSize + static_cast<std::size_t>(y) * width;
+      float multiplier = props.multiplier[c];
+      float bias = props.bias[c];
+      for (int x = 0; x < width; x++)
+      {
+        out[x] = src[x * CHANNELS + c] * multiplier + bias;
+      }
+    }
+  }
+
+  void DoDecompressToTensor(DecompressTensorProps& props)
+  {
+    j_decompress_ptr cinfo = props.handle.cinfo();
+    jpeg_start_decompress(cinfo);
+
+    int width = cinfo->output_width;
+    int height = cinfo->output_height;
+    int channels = props.channels;
+
+    // Resizing converts to planes of the decoded size first, and resamples
+    // those into the tensor. Normalizing is linear, so it can come first.
+    bool resize = width != props.resWidth || height != props.resHeight;
+    std::vector<float> planes;
+    if (resize)
+    {
+      planes.resize(static_cast<std::size_t>(width) * height * channels);
+    }
+    float* target = resize ? planes.data() : props.resData;
+    TensorLayout layout = resize ? TensorLayout::NCHW : props.layout;
+
+    std::size_t rowSize = static_cast<std::size_t>(width) * channels;
+    int batchRows = cinfo->rec_outbuf_height;
+    std::vector<uint8_t> rows(rowSize * batchRows);
+    std::vector<JSAMPROW> rowPointers(batchRows);
+    for (int i = 0; i < batchRows; i++)
+    {
+      rowPointers[i] = rows.data() + i * rowSize;
+    }
+
+    while (cinfo->output_scanline < cinfo->output_height)
+    {
+      int y = cinfo->output_scanline;
+      int count = jpeg_read_scanlines(cinfo, rowPointers.data(), batchRows);
+      for (int i = 0; i < count; i++)
+      {
+        if (channels == 1)
+        {
+          ConvertRow<1>(props, layout, rowPointers[i], target, width, height, y + i);
+        }
+        else
+        {
+          ConvertRow<3>(props, layout, rowPointers[i], target, width, height, y + i);
+        }
+      }
+    }
+    jpeg_finish_decompress(cinfo);
+    props.warnings = props.handle.jerr()->warnings;
+
+    if (!resize)
+    {
+      return;
+    }
+
+    std::size_t planeSize = static_cast<std::size_t>(width) * height;
+    std::size_t resPlaneSize = static_cast<std::size_t>(props.resWidth) * props.resHeight;
+    std::vector<float> resized(props.layout == TensorLayout::NHWC ? resPlaneSize : 0);
+    for (int c = 0; c < channels; c++)
+    {
+      if (props.layout == TensorLayout::NCHW)
+      {
+        ResampleArea(planes.data() + c * planeSize, width, height,
+          props.resData + c * resPlaneSize, props.resWidth, props.resHeight);
+        continue;
+      }
+
+      ResampleArea(planes.data() + c * planeSize, width, height,
+        resized.data(), props.resWidth, props.resHeight);
+      for (std::size_t i = 0; i < resPlaneSize; i++)
+      {
+        props.resData[i * channels + c] = resized[i];
+      }
+    }
+  }
+
+  Napi::Object DecompressTensorResult(Napi::Env const& env, Napi::Float32Array const& dstBuffer,
+    std::size_t dstOffset, DecompressTensorProps const& props)
+  {
+    Napi::Object res = Napi::Object::New(env);
+    res.Set("data", Napi::Float32Array::New(env, props.resSize, dstBuffer.ArrayBuffer(),
+      dstBuffer.ByteOffset() + dstOffset * sizeof(float)));
+    Napi::Array shape = Napi::Array::New(env, 4);
+    shape.Set(0u, 1);
+    if (props.layout == TensorLayout::NCHW)
+    {
+      shape.Set(1u, props.channels);
+      shape.Set(2u, props.resHeight);
+      shape.Set(3u, props.resWidth);
+    }
+    else
+    {
+      shape.Set(1u, props.resHeight);
+      shape.Set(2u, props.resWidth);
+      shape.Set(3u, props.channels);
+    }
+    res.Set("shape", shape);
+    res.Set("width", props.resWidth);
+    res.Set("height", props.resHeight);
+    SetWarnings(env, res, props.warnings);
+
+    return res;
+  }
+
+  class DecompressTensorWorker : public Napi::AsyncWorker
+  {
+  public:
+    DecompressTensorWorker(
+        Napi::Env const& env,
+        Napi::Buffer<uint8_t>& srcBuffer,
+        Napi::Float32Array& dstBuffer,
+        std::size_t dstOffset,
+        DecompressTensorProps&& props)
+        : AsyncWorker(env),
+          deferred(Napi::Promise::Deferred::New(env)),
+          srcBuffer(Napi::Reference<Napi::Buffer<uint8_t>>::New(srcBuffer, 1)),
+          dstBuffer(Napi::Reference<Napi::Float32Array>::New(dstBuffer, 1)),
+          dstOffset(dstOffset),
+          props(std::move(props))
+    {
+    }
+
+    ~DecompressTensorWorker()
+    {
+      this->srcBuffer.Reset();
+      this->dstBuffer.Reset();
+    }
+
+    void Execute()
+    {
+      try {
+        DoDecompressToTensor(this->props);
+      } catch (JPEGLibError const& e) {
+        // JS values can't be created on this thread, so keep the code and
+        // warnings for OnError
+        this->jpegError.reset(new JPEGLibError(e));
+        SetError(e.what());
+      } catch (std::exception const& e) {
+        SetError(e.what());
+      }
+    }
+
+    void OnOK()
+    {
+      try {
+        deferred.Resolve(DecompressTensorResult(Env(), this->dstBuffer.Value(), this->dstOffset, this->props));
+      } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(Env())
+    }
+
+    void OnError(Napi::Error const& error)
+    {
+      if (this->jpegError)
+      {
+        deferred.Reject(JPEGLibErrorToJS(Env(), *this->jpegError).Value());
+        return;
+      }
+      deferred.Reject(error.Value());
+    }
+
+    Napi::Promise GetPromise() const
+    {
+      return deferred.Promise();
+    }
+
+  private:
+    Napi::Promise::Deferred deferred;
+    Napi::Reference<Napi::Buffer<uint8_t>> srcBuffer;
+    Napi::Reference<Napi::Float32Array> dstBuffer;
+    std::size_t dstOffset;
+    DecompressTensorProps props;
+    std::unique_ptr<JPEGLibError> jpegError;
+  };
+
+  // An array of one number per channel, or the default for each
+  std::array<float, 3> ParseChannelValues(Napi::Env const& env, Napi::Object const& options, char const* name,
+    int channels, float defaultValue)
+  {
+    std::array<float, 3> values;
+    values.fill(defaultValue);
+
+    Napi::Value tmpValues = options.Get(name);
+    if (tmpValues.IsUndefined())
+    {
+      return values;
+    }
+    if (!tmpValues.IsArray() || tmpValues.As<Napi::Array>().Length() != static_cast<uint32_t>(channels))
+    {
+      throw Napi::TypeError::New(env, std::string("Invalid ") + name);
+    }
+    Napi::Array array = tmpValues.As<Napi::Array>();
+    for (int c = 0; c < channels; c++)
+    {
+      Napi::Value value = array.Get(static_cast<uint32_t>(c));
+      if (!value.IsNumber() || !std::isfinite(value.As<Napi::Number>().DoubleValue()))
+      {
+        throw Napi::TypeError::New(env, std::string("Invalid ") + name);
+      }
+      values[c] = value.As<Napi::Number>().FloatValue();
+    }
+    return values;
+  }
+}
+
+Napi::Value DecompressToTensorInner(Napi::CallbackInfo const& info, bool async)
+{
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1)
+  {
+    throw Napi::TypeError::New(env, "Not enough arguments");
+  }
+
+  if (!info[0].IsBuffer())
+  {
+    throw Napi::TypeError::New(env, "Invalid source buffer");
+  }
+  Napi::Buffer<uint8_t> srcBuffer = info[0].As<Napi::Buffer<uint8_t>>();
+
+  unsigned int offset = 0;
+  Napi::Float32Array dstBuffer;
+  if (info.Length() > 1 && info[1].IsTypedArray()
+    && info[1].As<Napi::TypedArray>().TypedArrayType() == napi_float32_array)
+  {
+    dstBuffer = info[1].As<Napi::Float32Array>();
+    offset++;
+  }
+
+  DecompressTensorProps props = {};
+  uint32_t format = TJPF_RGB;
+  props.layout = TensorLayout::NCHW;
+  tjscalingfactor scale = TJUNSCALED;
+  bool scaled = false;
+  int sizeWidth = 0;
+  int sizeHeight = 0;
+  std::size_t dstOffset = 0;
+  WarningMode warningMode = WarningMode::Collect;
+  DecodeLimits limits;
+
+  Napi::Object options;
+  if (info.Length() >= offset + 2 && !info[offset + 1].IsUndefined())
+  {
+    if (!info[offset + 1].IsObject())
+    {
+      throw Napi::TypeError::New(env, "Invalid options");
+    }
+    options = info[offset + 1].As<Napi::Object>();
+  }
+
+  if (!options.IsEmpty())
+  {
+    Napi::Value tmpFormat = options.Get("format");
+    if (!tmpFormat.IsUndefined())
+    {
+      if (!tmpFormat.IsNumber())
+      {
+        throw Napi::TypeError::New(env, "Invalid format");
+      }
+      format = tmpFormat.As<Napi::Number>().Uint32Value();
+    }
+
+    Napi::Value tmpLayout = options.Get("layout");
+    if (!tmpLayout.IsUndefined())
+    {
+      std::string layout = tmpLayout.IsString() ? tmpLayout.As<Napi::String>().Utf8Value() : "";
+      if (layout == "NCHW")
+      {
+        props.layout = TensorLayout::NCHW;
+      }
+      else if (layout == "NHWC")
+      {
+        props.layout = TensorLayout::NHWC;
+      }
+      else
+      {
+        throw Napi::TypeError::New(env, "Invalid layout");
+      }
+    }
+
+    Napi::Value tmpScale = options.Get("scale");
+    if (!tmpScale.IsUndefined())
+    {
+      Napi::Value tmpNum = tmpScale.IsObject() ? tmpScale.As<Napi::Object>().Get("num") : env.Undefined();
+      Napi::Value tmpDenom = tmpScale.IsObject() ? tmpScale.As<Napi::Object>().Get("denom") : env.Undefined();
+      if (!tmpNum.IsNumber() || !tmpDenom.IsNumber()
+        || tmpNum.As<Napi::Number>().Int32Value() <= 0 || tmpDenom.As<Napi::Number>().Int32Value() <= 0
+        || !FindScalingFactor(tmpNum.As<Napi::Number>().Int32Value(), tmpDenom.As<Napi::Number>().Int32Value(), scale))
+      {
+        throw Napi::TypeError::New(env, "Invalid scale");
+      }
+      scaled = true;
+    }
+
+    Napi::Value tmpSize = options.Get("size");
+    if (!tmpSize.IsUndefined())
+    {
+      Napi::Value tmpWidth = tmpSize.IsObject() ? tmpSize.As<Napi::Object>().Get("width") : env.Undefined();
+      Napi::Value tmpHeight = tmpSize.IsObject() ? tmpSize.As<Napi::Object>().Get("height") : env.Undefined();
+      if (!tmpWidth.IsNumber() || !tmpHeight.IsNumber()
+        || tmpWidth.As<Napi::Number>().Int64Value() <= 0 || tmpWidth.As<Napi::Number>().Int64Value() > 65535
+        || tmpHeight.As<Napi::Number>().Int64Value() <= 0 || tmpHeight.As<Napi::Number>().Int64Value() > 65535)
+      {
+        throw Napi::TypeError::New(env, "Invalid size");
+      }
+      sizeWidth = tmpWidth.As<Napi::Number>().Int32Value();
+      sizeHeight = tmpHeight.As<Napi::Number>().Int32Value();
+    }
+
+    Napi::Value tmpDstOffset = options.Get("dstOffset");
+    if (!tmpDstOffset.IsUndefined())
+    {
+      if (!tmpDstOffset.IsNumber() || tmpDstOffset.As<Napi::Number>().Int64Value() < 0)
+      {
+        throw Napi::TypeError::New(env, "Invalid dstOffset");
+      }
+      dstOffset = static_cast<std::size_t>(tmpDstOffset.As<Napi::Number>().Int64Value());
+    }
+
+    warningMode = ParseWarningMode(env, options);
+    limits = ParseDecodeLimits(env, options);
+  }
+
+  // Tensors are RGB, BGR or gray
+  if (format != TJPF_RGB && format != TJPF_BGR && format != TJPF_GRAY)
+  {
+    throw Napi::TypeError::New(env, "Invalid format");
+  }
+  props.channels = format == TJPF_GRAY ? 1 : 3;
+
+  std::array<float, 3> mean = options.IsEmpty() ? std::array<float, 3>{0, 0, 0}
+    : ParseChannelValues(env, options, "mean", props.channels, 0);
+  std::array<float, 3> deviation = options.IsEmpty() ? std::array<float, 3>{1, 1, 1}
+    : ParseChannelValues(env, options, "std", props.channels, 1);
+  for (int c = 0; c < props.channels; c++)
+  {
+    if (deviation[c] == 0)
+    {
+      throw Napi::TypeError::New(env, "Invalid std");
+    }
+    props.multiplier[c] = 1.0f / (255.0f * deviation[c]);
+    props.bias[c] = -mean[c] / deviation[c];
+  }
+
+  props.handle = OpenDecompressHandle(srcBuffer.Data(), srcBuffer.ByteLength(), warningMode);
+  ApplyDecodeLimits(props.handle, limits);
+  j_decompress_ptr cinfo = props.handle.cinfo();
+  if (cinfo->data_precision != 8)
+  {
+    throw Napi::TypeError::New(env, "Only 8-bit images can be decoded to tensors");
+  }
+  cinfo->out_color_space = FormatColorSpace(format);
+  cinfo->dct_method = JDCT_IFAST;
+
+  // Without a scale, resizing decodes at the smallest DCT scale that still
+  // covers the size, so that most of the shrinking is done by the IDCT
+  if (scaled)
+  {
+    cinfo->scale_num = scale.num;
+    cinfo->scale_denom = scale.denom;
+  }
+  else if (sizeWidth != 0)
+  {
+    cinfo->scale_denom = 8;
+    for (cinfo->scale_num = 1; cinfo->scale_num < 8; cinfo->scale_num++)
+    {
+      jpeg_calc_output_dimensions(cinfo);
+      if (cinfo->output_width >= static_cast<JDIMENSION>(sizeWidth)
+        && cinfo->output_height >= static_cast<JDIMENSION>(sizeHeight))
+      {
+        break;
+      }
+    }
+  }
+  jpeg_calc_output_dimensions(cinfo);
+
+  props.resWidth = sizeWidth != 0 ? sizeWidth : cinfo->output_width;
+  props.resHeight = sizeHeight != 0 ? sizeHeight : cinfo->output_height;
+  props.resSize = static_cast<std::size_t>(props.resWidth) * props.resHeight * props.channels;
+
+  if (dstBuffer.IsEmpty())
+  {
+    if (dstOffset != 0)
+    {
+      throw Napi::TypeError::New(env, "Invalid dstOffset");
+    }
+    dstBuffer = Napi::Float32Array::New(env, props.resSize);
+  }
+  else if (dstBuffer.ElementLength() < props.resSize || dstBuffer.ElementLength() - props.resSize < dstOffset)
+  {
+    throw Napi::TypeError::New(env, "Insufficient output buffer");
+  }
+  props.resData = dstBuffer.Data() + dstOffset;
+
+  if (async)
+  {
+    auto* wk = new DecompressTensorWorker(env, srcBuffer, dstBuffer, dstOffset, std::move(props));
+    wk->Queue();
+    return wk->GetPromise();
+  }
+
+  DoDecompressToTensor(props);
+  return DecompressTensorResult(env, dstBuffer, dstOffset, props);
+}
+
+Napi::Value DecompressToTensorAsync(const Napi::CallbackInfo &info)
+{
+  try {
+    return DecompressToTensorInner(info, true);
+  } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(info.Env())
+}
+
+Napi::Value DecompressToTensorSync(const Napi::CallbackInfo &info)
+{
+  try {
+    return DecompressToTensorInner(info, false);
+  } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(info.Env())
+}
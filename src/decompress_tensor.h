@@ -0,0 +1,9 @@
+#ifndef NODE_JPEGTURBO_DECOMPRESS_TENSOR_H
+#define NODE_JPEGTURBO_DECOMPRESS_TENSOR_H
+
+#include "util.h"
+
+Napi::Value DecompressToTensorAsync(const Napi::CallbackInfo &info);
+Napi::Value DecompressToTensorSync(const Napi::CallbackInfo &info);
+
+#endif
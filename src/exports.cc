@@ -1,9 +1,23 @@
 #include "util.h"
 #include "enums.h"
 #include "buffersize.h"
+#include "compare.h"
 #include "compress.h"
+#include "decode_cache.h"
 #include "decompress.h"
+#include "decompress_progressive.h"
+#include "decompress_strips.h"
+#include "decompress_tensor.h"
+#include "fingerprint.h"
+#include "generate_sizes.h"
+#include "jpeg_decoder.h"
+#include "jpeg_encoder.h"
+#include "mosaic.h"
+#include "read_dc_preview.h"
+#include "read_header.h"
 #include "read_dct.h"
+#include "requantize.h"
+#include "validate.h"
 #include "write_dct.h"
 
 Napi::Object Init(Napi::Env env, Napi::Object exports)
@@ -14,12 +28,37 @@ Napi::Object Init(Napi::Env env, Napi::Object exports)
   // exports.Set("FreeTypeVersion", version);
 
   exports.Set("bufferSize", Napi::Function::New(env, BufferSize));
+  exports.Set("cacheStats", Napi::Function::New(env, CacheStats));
+  exports.Set("clearCache", Napi::Function::New(env, ClearCache));
+  exports.Set("compare", Napi::Function::New(env, CompareAsync));
+  exports.Set("compareSync", Napi::Function::New(env, CompareSync));
   exports.Set("compress", Napi::Function::New(env, CompressAsync));
   exports.Set("compressSync", Napi::Function::New(env, CompressSync));
+  exports.Set("compressTables", Napi::Function::New(env, CompressTables));
+  exports.Set("configureCache", Napi::Function::New(env, ConfigureCache));
   exports.Set("decompress", Napi::Function::New(env, DecompressAsync));
   exports.Set("decompressSync", Napi::Function::New(env, DecompressSync));
+  exports.Set("decompressToTensor", Napi::Function::New(env, DecompressToTensorAsync));
+  exports.Set("decompressToTensorSync", Napi::Function::New(env, DecompressToTensorSync));
+  exports.Set("fingerprint", Napi::Function::New(env, FingerprintAsync));
+  exports.Set("fingerprintSync", Napi::Function::New(env, FingerprintSync));
+  exports.Set("generateSizes", Napi::Function::New(env, GenerateSizesAsync));
+  exports.Set("generateSizesSync", Napi::Function::New(env, GenerateSizesSync));
+  exports.Set("JpegDecoder", JpegDecoder::Init(env));
+  exports.Set("JpegEncoder", JpegEncoder::Init(env));
+  exports.Set("mosaic", Napi::Function::New(env, MosaicAsync));
+  exports.Set("mosaicSync", Napi::Function::New(env, MosaicSync));
+  exports.Set("ProgressiveDecoder", ProgressiveDecoder::Init(env));
+  exports.Set("readDCPreview", Napi::Function::New(env, ReadDCPreviewAsync));
+  exports.Set("readDCPreviewSync", Napi::Function::New(env, ReadDCPreviewSync));
+  exports.Set("readHeader", Napi::Function::New(env, ReadHeader));
   exports.Set("readDCT", Napi::Function::New(env, ReadDCTAsync));
   exports.Set("readDCTSync", Napi::Function::New(env, ReadDCTSync));
+  exports.Set("requantize", Napi::Function::New(env, RequantizeAsync));
+  exports.Set("requantizeSync", Napi::Function::New(env, RequantizeSync));
+  exports.Set("StripDecoder", StripDecoder::Init(env));
+  exports.Set("validate", Napi::Function::New(env, ValidateAsync));
+  exports.Set("validateSync", Napi::Function::New(env, ValidateSync));
   exports.Set("writeDCT", Napi::Function::New(env, WriteDCTAsync));
   exports.Set("writeDCTSync", Napi::Function::New(env, WriteDCTSync));
 
@@ -0,0 +1,438 @@
+#include "fingerprint.h"
+#include "resample.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum FingerprintAlgorithm
+{
+  NJT_HASH_PHASH = 1 << 0,
+  NJT_HASH_DHASH = 1 << 1,
+  NJT_HASH_DCMEAN = 1 << 2,
+};
+
+struct FingerprintImage
+{
+  uint8_t const* srcData;
+  std::size_t srcLength;
+
+  std::vector<uint8_t> phash;
+  std::vector<uint8_t> dhash;
+  std::vector<uint8_t> dcmean;
+  std::string error;
+};
+
+struct FingerprintProps
+{
+  int algorithms;
+  // Hashes are hashSize x hashSize bits
+  int hashSize;
+  bool batch;
+  std::vector<FingerprintImage> images;
+};
+
+// Luma at 1/8 scale. With 1/8 DCT scaling libjpeg only uses the DC
+// coefficient of each block, and discards the AC coefficients as it reads
+// them instead of storing them.
+std::vector<float> ReadDCLuma(FingerprintImage const& image, int& width, int& height)
+{
+  JDecompressHandle handle = OpenDecompressHandle(image.srcData, image.srcLength);
+  auto& cinfo = *handle.cinfo();
+
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = 8;
+  cinfo.out_color_space = JCS_GRAYSCALE;
+  jpeg_start_decompress(&cinfo);
+
+  width = static_cast<int>(cinfo.output_width);
+  height = static_cast<int>(cinfo.output_height);
+  std::vector<uint8_t> row(width);
+  std::vector<float> luma(static_cast<std::size_t>(width) * height);
+
+  float* out = luma.data();
+  while (cinfo.output_scanline < cinfo.output_height)
+  {
+    JSAMPROW rowPtr = row.data();
+    jpeg_read_scanlines(&cinfo, &rowPtr, 1);
+    out = std::copy(row.begin(), row.end(), out);
+  }
+
+  jpeg_finish_decompress(&cinfo);
+  return luma;
+}
+
+// Pack bits into bytes, most significant bit first
+std::vector<uint8_t> PackBits(std::vector<bool> const& bits)
+{
+  std::vector<uint8_t> res((bits.size() + 7) / 8);
+  for (std::size_t i = 0; i < bits.size(); ++i)
+  {
+    if (bits[i])
+    {
+      res[i / 8] |= 0x80 >> (i % 8);
+    }
+  }
+  return res;
+}
+
+// Each bit is set if the sample is brighter than the mean
+std::vector<uint8_t> MeanHash(std::vector<float> const& luma, int width, int height, int size)
+{
+  std::vector<float> small(size * size);
+  ResampleArea(luma.data(), width, height, small.data(), size, size);
+
+  float mean = 0.0f;
+  for (float v : small)
+  {
+    mean += v;
+  }
+  mean /= small.size();
+
+  std::vector<bool> bits(small.size());
+  for (std::size_t i = 0; i < small.size(); ++i)
+  {
+    bits[i] = small[i] > mean;
+  }
+  return PackBits(bits);
+}
+
+// Each bit is set if the sample is darker than its right neighbour
+std::vector<uint8_t> DifferenceHash(std::vector<float> const& luma, int width, int height, int size)
+{
+  std::vector<float> small((size + 1) * size);
+  ResampleArea(luma.data(), width, height, small.data(), size + 1, size);
+
+  std::vector<bool> bits(size * size);
+  for (int y = 0; y < size; ++y)
+  {
+    for (int x = 0; x < size; ++x)
+    {
+      bits[y * size + x] = small[y * (size + 1) + x] < small[y * (size + 1) + x + 1];
+    }
+  }
+  return PackBits(bits);
+}
+
+// DCT of a 4x enlarged grid; each bit is set if a low frequency coefficient
+// is above the median. Like the original pHash, row and column 0 are left
+// out: the DC term only says how bright the image is, and would skew the
+// median.
+std::vector<uint8_t> PerceptualHash(std::vector<float> const& luma, int width, int height, int size)
+{
+  int n = size * 4;
+  std::vector<float> small(n * n);
+  ResampleArea(luma.data(), width, height, small.data(), n, n);
+
+  // Only frequencies 1 to size are needed
+  std::vector<float> cosines(size * n);
+  for (int u = 0; u < size; ++u)
+  {
+    for (int x = 0; x < n; ++x)
+    {
+      cosines[u * n + x] = static_cast<float>(std::cos(3.14159265358979323846 * (2 * x + 1) * (u + 1) / (2.0 * n)));
+    }
+  }
+
+  std::vector<float> rows(n * size);
+  for (int y = 0; y < n; ++y)
+  {
+    for (int u = 0; u < size; ++u)
+    {
+      float sum = 0.0f;
+      for (int x = 0; x < n; ++x)
+      {
+        sum += small[y * n + x] * cosines[u * n + x];
+      }
+      rows[y * size + u] = sum;
+    }
+  }
+
+  std::vector<float> freqs(size * size);
+  for (int v = 0; v < size; ++v)
+  {
+    for (int u = 0; u < size; ++u)
+    {
+      float sum = 0.0f;
+      for (int y = 0; y < n; ++y)
+      {
+        sum += rows[y * size + u] * cosines[v * n + y];
+      }
+      freqs[v * size + u] = sum;
+    }
+  }
+
+  std::vector<float> sorted(freqs);
+  std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+  float median = sorted[sorted.size() / 2];
+
+  std::vector<bool> bits(freqs.size());
+  for (std::size_t i = 0; i < freqs.size(); ++i)
+  {
+    bits[i] = freqs[i] > median;
+  }
+  return PackBits(bits);
+}
+
+void DoFingerprintImage(FingerprintImage& image, int algorithms, int hashSize)
+{
+  int width = 0;
+  int height = 0;
+  std::vector<float> luma = ReadDCLuma(image, width, height);
+
+  if (algorithms & NJT_HASH_PHASH)
+  {
+    image.phash = PerceptualHash(luma, width, height, hashSize);
+  }
+  if (algorithms & NJT_HASH_DHASH)
+  {
+    image.dhash = DifferenceHash(luma, width, height, hashSize);
+  }
+  if (algorithms & NJT_HASH_DCMEAN)
+  {
+    image.dcmean = MeanHash(luma, width, height, hashSize);
+  }
+}
+
+void DoFingerprint(FingerprintProps& props)
+{
+  for (auto& image : props.images)
+  {
+    if (!props.batch)
+    {
+      DoFingerprintImage(image, props.algorithms, props.hashSize);
+      continue;
+    }
+
+    // In batch mode one bad image shouldn't fail the others
+    try {
+      DoFingerprintImage(image, props.algorithms, props.hashSize);
+    } catch (std::exception const& e) {
+      image.error = e.what();
+    }
+  }
+}
+
+Napi::Object FingerprintImageResult(Napi::Env const& env, FingerprintImage const& image)
+{
+  Napi::Object res = Napi::Object::New(env);
+  if (!image.error.empty())
+  {
+    res.Set("error", image.error);
+    return res;
+  }
+
+  if (!image.phash.empty())
+  {
+    res.Set("phash", Napi::Buffer<uint8_t>::Copy(env, image.phash.data(), image.phash.size()));
+  }
+  if (!image.dhash.empty())
+  {
+    res.Set("dhash", Napi::Buffer<uint8_t>::Copy(env, image.dhash.data(), image.dhash.size()));
+  }
+  if (!image.dcmean.empty())
+  {
+    res.Set("dcmean", Napi::Buffer<uint8_t>::Copy(env, image.dcmean.data(), image.dcmean.size()));
+  }
+  return res;
+}
+
+Napi::Value FingerprintResult(Napi::Env const& env, FingerprintProps const& props)
+{
+  if (!props.batch)
+  {
+    return FingerprintImageResult(env, props.images[0]);
+  }
+
+  auto res = Napi::Array::New(env, props.images.size());
+  for (std::size_t i = 0; i < props.images.size(); ++i)
+  {
+    res[i] = FingerprintImageResult(env, props.images[i]);
+  }
+  return res;
+}
+
+class FingerprintWorker : public Napi::AsyncWorker
+{
+public:
+  FingerprintWorker(
+      Napi::Env const& env,
+      BufferReferences&& references,
+      FingerprintProps&& props)
+      : AsyncWorker(env),
+        deferred(Napi::Promise::Deferred::New(env)),
+        references(std::move(references)),
+        props(std::move(props))
+  {
+  }
+
+  void Execute()
+  {
+    try {
+      DoFingerprint(this->props);
+    } catch (JPEGLibError const& e) {
+      // JS values can't be created on this thread, so keep the code and
+      // warnings for OnError
+      this->jpegError.reset(new JPEGLibError(e));
+      SetError(e.what());
+    } catch (std::exception const& e) {
+      SetError(e.what());
+    }
+  }
+
+  void OnOK()
+  {
+    try {
+      deferred.Resolve(FingerprintResult(Env(), this->props));
+    } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(Env())
+  }
+
+  void OnError(Napi::Error const& error)
+  {
+    if (this->jpegError)
+    {
+      deferred.Reject(JPEGLibErrorToJS(Env(), *this->jpegError).Value());
+      return;
+    }
+    deferred.Reject(error.Value());
+  }
+
+  Napi::Promise GetPromise() const
+  {
+    return deferred.Promise();
+  }
+
+private:
+  Napi::Promise::Deferred deferred;
+  BufferReferences references;
+  FingerprintProps props;
+  std::unique_ptr<JPEGLibError> jpegError;
+};
+
+Napi::Value FingerprintInner(Napi::CallbackInfo const& info, bool async)
+{
+  if (info.Length() < 1)
+  {
+    throw Napi::TypeError::New(info.Env(), "Not enough arguments");
+  }
+
+  FingerprintProps props = {};
+  BufferReferences references;
+  props.batch = info[0].IsArray();
+
+  if (props.batch)
+  {
+    Napi::Array sources = info[0].As<Napi::Array>();
+    for (uint32_t i = 0; i < sources.Length(); ++i)
+    {
+      Napi::Value source = sources.Get(i);
+      if (!source.IsBuffer())
+      {
+        throw Napi::TypeError::New(info.Env(), "Invalid source buffer");
+      }
+      auto buffer = source.As<Napi::Buffer<uint8_t>>();
+      props.images.push_back(FingerprintImage{buffer.Data(), buffer.ByteLength()});
+      references.Add(buffer);
+    }
+  }
+  else
+  {
+    if (!info[0].IsBuffer())
+    {
+      throw Napi::TypeError::New(info.Env(), "Invalid source buffer");
+    }
+    auto buffer = info[0].As<Napi::Buffer<uint8_t>>();
+    props.images.push_back(FingerprintImage{buffer.Data(), buffer.ByteLength()});
+    references.Add(buffer);
+  }
+
+  props.algorithms = NJT_HASH_PHASH | NJT_HASH_DHASH | NJT_HASH_DCMEAN;
+  props.hashSize = 8;
+
+  if (info.Length() > 1 && !info[1].IsUndefined())
+  {
+    if (!info[1].IsObject())
+    {
+      throw Napi::TypeError::New(info.Env(), "Invalid options");
+    }
+    Napi::Object options = info[1].As<Napi::Object>();
+
+    Napi::Value tmpAlgorithms = options.Get("algorithms");
+    if (!tmpAlgorithms.IsUndefined())
+    {
+      if (!tmpAlgorithms.IsArray() || tmpAlgorithms.As<Napi::Array>().Length() == 0)
+      {
+        throw Napi::TypeError::New(info.Env(), "Invalid algorithms");
+      }
+      Napi::Array algorithms = tmpAlgorithms.As<Napi::Array>();
+
+      props.algorithms = 0;
+      for (uint32_t i = 0; i < algorithms.Length(); ++i)
+      {
+        Napi::Value algorithm = algorithms.Get(i);
+        std::string name = algorithm.IsString() ? algorithm.As<Napi::String>().Utf8Value() : "";
+        if (name == "phash")
+        {
+          props.algorithms |= NJT_HASH_PHASH;
+        }
+        else if (name == "dhash")
+        {
+          props.algorithms |= NJT_HASH_DHASH;
+        }
+        else if (name == "dcmean")
+        {
+          props.algorithms |= NJT_HASH_DCMEAN;
+        }
+        else
+        {
+          throw Napi::TypeError::New(info.Env(), "Invalid algorithms");
+        }
+      }
+    }
+
+    Napi::Value tmpBits = options.Get("bits");
+    if (!tmpBits.IsUndefined())
+    {
+      uint32_t bits = tmpBits.IsNumber() ? tmpBits.As<Napi::Number>().Uint32Value() : 0;
+      if (bits == 64)
+      {
+        props.hashSize = 8;
+      }
+      else if (bits == 256)
+      {
+        props.hashSize = 16;
+      }
+      else
+      {
+        throw Napi::TypeError::New(info.Env(), "Invalid bits");
+      }
+    }
+  }
+
+  if (async)
+  {
+    auto* wk = new FingerprintWorker(info.Env(), std::move(references), std::move(props));
+    wk->Queue();
+    return wk->GetPromise();
+  }
+  else
+  {
+    DoFingerprint(props);
+    return FingerprintResult(info.Env(), props);
+  }
+}
+
+Napi::Value FingerprintAsync(Napi::CallbackInfo const& info)
+{
+  try {
+    return FingerprintInner(info, true);
+  } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(info.Env())
+}
+
+Napi::Value FingerprintSync(Napi::CallbackInfo const& info)
+{
+  try {
+    return FingerprintInner(info, false);
+  } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(info.Env())
+}
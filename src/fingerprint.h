@@ -0,0 +1,9 @@
+#ifndef NODE_JPEGTURBO_FINGERPRINT_H
+#define NODE_JPEGTURBO_FINGERPRINT_H
+
+#include "util.h"
+
+Napi::Value FingerprintAsync(const Napi::CallbackInfo &info);
+Napi::Value FingerprintSync(const Napi::CallbackInfo &info);
+
+#endif
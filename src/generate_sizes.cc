@@ -0,0 +1,391 @@
+#include "generate_sizes.h"
+#include "resample.h"
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Joins the threads it holds when it goes out of scope, so that an exception
+// (e.g. from starting a thread) never destroys a joinable std::thread
+class ThreadJoiner
+{
+public:
+  explicit ThreadJoiner(std::vector<std::thread>& threads)
+      : threads(threads)
+  {
+  }
+
+  ~ThreadJoiner()
+  {
+    for (auto& thread : this->threads)
+    {
+      if (thread.joinable())
+      {
+        thread.join();
+      }
+    }
+  }
+
+private:
+  std::vector<std::thread>& threads;
+};
+
+struct SizeTarget
+{
+  uint32_t maxDim;
+  int quality;
+  int subsampling;
+
+  std::unique_ptr<unsigned char, TJFreeDeleter> resData;
+  std::size_t resSize;
+  int resWidth;
+  int resHeight;
+};
+
+struct GenerateSizesProps
+{
+  JDecompressHandle handle;
+  std::vector<SizeTarget> targets;
+};
+
+// A decoded image that one or more targets are encoded from. Levels are
+// produced largest first, each one downsampled from the previous level.
+struct Level
+{
+  std::vector<uint8_t> pixels;
+  int width;
+  int height;
+};
+
+void DoGenerateSizes(GenerateSizesProps& props)
+{
+  auto& cinfo = *props.handle.cinfo();
+
+  uint32_t longSide = std::max(cinfo.image_width, cinfo.image_height);
+  uint32_t largest = 0;
+  for (auto const& target : props.targets)
+  {
+    largest = std::max(largest, std::min(target.maxDim, longSide));
+  }
+
+  // Decode once, at the smallest DCT scale that still covers the largest target
+  cinfo.out_color_space = (cinfo.num_components == 1) ? JCS_GRAYSCALE : JCS_RGB;
+  cinfo.scale_denom = 8;
+  for (cinfo.scale_num = 1; cinfo.scale_num < 8; ++cinfo.scale_num)
+  {
+    jpeg_calc_output_dimensions(&cinfo);
+    if (std::max(cinfo.output_width, cinfo.output_height) >= largest)
+    {
+      break;
+    }
+  }
+
+  jpeg_start_decompress(&cinfo);
+
+  int channels = cinfo.output_components;
+  std::size_t decodedPitch = static_cast<std::size_t>(cinfo.output_width) * channels;
+
+  std::vector<Level> levels;
+  levels.reserve(props.targets.size() + 1);
+  levels.push_back(Level{
+    std::vector<uint8_t>(decodedPitch * cinfo.output_height),
+    static_cast<int>(cinfo.output_width),
+    static_cast<int>(cinfo.output_height)});
+
+  std::vector<JSAMPROW> rows(cinfo.output_height);
+  for (std::size_t y = 0; y < rows.size(); ++y)
+  {
+    rows[y] = levels[0].pixels.data() + y * decodedPitch;
+  }
+  while (cinfo.output_scanline < cinfo.output_height)
+  {
+    jpeg_read_scanlines(&cinfo, rows.data() + cinfo.output_scanline,
+      cinfo.output_height - cinfo.output_scanline);
+  }
+
+  jpeg_finish_decompress(&cinfo);
+
+  // Downsample progressively, largest target first
+  std::vector<std::size_t> order(props.targets.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+    return props.targets[a].maxDim > props.targets[b].maxDim;
+  });
+
+  std::vector<std::size_t> targetLevel(props.targets.size());
+  for (std::size_t idx : order)
+  {
+    SizeTarget& target = props.targets[idx];
+    Level const& prev = levels.back();
+
+    uint32_t targetLong = std::min(target.maxDim, longSide);
+    int width = static_cast<int>((static_cast<uint64_t>(cinfo.image_width) * targetLong + longSide / 2) / longSide);
+    int height = static_cast<int>((static_cast<uint64_t>(cinfo.image_height) * targetLong + longSide / 2) / longSide);
+    width = std::min(std::max(width, 1), prev.width);
+    height = std::min(std::max(height, 1), prev.height);
+
+    if (width != prev.width || height != prev.height)
+    {
+      Level next{std::vector<uint8_t>(static_cast<std::size_t>(width) * height * channels), width, height};
+      DownsampleArea(
+        prev.pixels.data(), prev.width, prev.height, static_cast<std::size_t>(prev.width) * channels,
+        next.pixels.data(), width, height, static_cast<std::size_t>(width) * channels,
+        channels);
+      levels.push_back(std::move(next));
+    }
+
+    targetLevel[idx] = levels.size() - 1;
+  }
+
+  // Encode every target in parallel
+  auto encodeTarget = [&](std::size_t idx) {
+    SizeTarget& target = props.targets[idx];
+    Level const& level = levels[targetLevel[idx]];
+
+    tjhandle handle = tj3Init(TJINIT_COMPRESS);
+    if (handle == nullptr)
+    {
+      throw std::runtime_error(tj3GetErrorStr(nullptr));
+    }
+
+    tj3Set(handle, TJPARAM_QUALITY, target.quality);
+    tj3Set(handle, TJPARAM_SUBSAMP, channels == 1 ? TJSAMP_GRAY : target.subsampling);
+    tj3Set(handle, TJPARAM_FASTDCT, 1);
+
+    unsigned char* data = nullptr;
+    std::size_t size = 0;
+    int err = tj3Compress8(handle,
+                           level.pixels.data(),
+                           level.width,
+                           level.width * channels,
+                           level.height,
+                           channels == 1 ? TJPF_GRAY : TJPF_RGB,
+                           &data,
+                           &size);
+    target.resData.reset(data);
+    // Encoding warnings don't affect the output
+    if (err != 0 && tj3GetErrorCode(handle) != TJERR_WARNING)
+    {
+      std::string message = tj3GetErrorStr(handle);
+      tj3Destroy(handle);
+      throw std::runtime_error(message);
+    }
+    tj3Destroy(handle);
+
+    target.resSize = size;
+    target.resWidth = level.width;
+    target.resHeight = level.height;
+  };
+
+  // Exceptions can't leave a thread, so each encode reports its error here
+  std::vector<std::string> errors(props.targets.size());
+  auto encode = [&](std::size_t idx) {
+    try {
+      encodeTarget(idx);
+    } catch (std::exception const& e) {
+      errors[idx] = e.what();
+    }
+  };
+
+  {
+    std::vector<std::thread> threads;
+    threads.reserve(props.targets.size() - 1);
+    ThreadJoiner joiner(threads);
+    for (std::size_t idx = 1; idx < props.targets.size(); ++idx)
+    {
+      threads.emplace_back(encode, idx);
+    }
+    encode(0);
+  }
+
+  for (auto const& err : errors)
+  {
+    if (!err.empty())
+    {
+      throw std::runtime_error(err);
+    }
+  }
+}
+
+Napi::Array GenerateSizesResult(Napi::Env const& env, GenerateSizesProps& props)
+{
+  auto res = Napi::Array::New(env, props.targets.size());
+  for (std::size_t i = 0; i < props.targets.size(); ++i)
+  {
+    SizeTarget& target = props.targets[i];
+    res[i] = Napi::Buffer<unsigned char>::New(env, target.resData.release(), target.resSize,
+      [](Napi::Env, unsigned char* data) { tj3Free(data); });
+  }
+
+  return res;
+}
+
+class GenerateSizesWorker : public Napi::AsyncWorker
+{
+public:
+  GenerateSizesWorker(
+      Napi::Env const& env,
+      Napi::Buffer<uint8_t>& srcBuffer,
+      GenerateSizesProps&& props)
+      : AsyncWorker(env),
+        deferred(Napi::Promise::Deferred::New(env)),
+        srcBuffer(Napi::Reference<Napi::Buffer<uint8_t>>::New(srcBuffer, 1)),
+        props(std::move(props))
+  {
+  }
+
+  ~GenerateSizesWorker()
+  {
+    this->srcBuffer.Reset();
+  }
+
+  void Execute()
+  {
+    try {
+      DoGenerateSizes(this->props);
+    } catch (JPEGLibError const& e) {
+      // JS values can't be created on this thread, so keep the code and
+      // warnings for OnError
+      this->jpegError.reset(new JPEGLibError(e));
+      SetError(e.what());
+    } catch (std::exception const& e) {
+      SetError(e.what());
+    }
+  }
+
+  void OnOK()
+  {
+    try {
+      deferred.Resolve(GenerateSizesResult(Env(), this->props));
+    } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(Env())
+  }
+
+  void OnError(Napi::Error const& error)
+  {
+    if (this->jpegError)
+    {
+      deferred.Reject(JPEGLibErrorToJS(Env(), *this->jpegError).Value());
+      return;
+    }
+    deferred.Reject(error.Value());
+  }
+
+  Napi::Promise GetPromise() const
+  {
+    return deferred.Promise();
+  }
+
+private:
+  Napi::Promise::Deferred deferred;
+  Napi::Reference<Napi::Buffer<uint8_t>> srcBuffer;
+  GenerateSizesProps props;
+  std::unique_ptr<JPEGLibError> jpegError;
+};
+
+Napi::Value GenerateSizesInner(Napi::CallbackInfo const& info, bool async)
+{
+  if (info.Length() < 2)
+  {
+    throw Napi::TypeError::New(info.Env(), "Not enough arguments");
+  }
+
+  if (!info[0].IsBuffer())
+  {
+    throw Napi::TypeError::New(info.Env(), "Invalid source buffer");
+  }
+  Napi::Buffer<uint8_t> srcBuffer = info[0].As<Napi::Buffer<uint8_t>>();
+
+  if (!info[1].IsArray() || info[1].As<Napi::Array>().Length() == 0)
+  {
+    throw Napi::TypeError::New(info.Env(), "Invalid sizes");
+  }
+  Napi::Array sizes = info[1].As<Napi::Array>();
+
+  GenerateSizesProps props = {};
+  props.targets.resize(sizes.Length());
+
+  for (uint32_t i = 0; i < sizes.Length(); ++i)
+  {
+    Napi::Value tmpSize = sizes.Get(i);
+    if (!tmpSize.IsObject())
+    {
+      throw Napi::TypeError::New(info.Env(), "Invalid sizes");
+    }
+    Napi::Object size = tmpSize.As<Napi::Object>();
+    SizeTarget& target = props.targets[i];
+
+    Napi::Value tmpMaxDim = size.Get("maxDim");
+    if (!tmpMaxDim.IsNumber() || tmpMaxDim.As<Napi::Number>().Int64Value() <= 0)
+    {
+      throw Napi::TypeError::New(info.Env(), "Invalid maxDim");
+    }
+    target.maxDim = tmpMaxDim.As<Napi::Number>().Uint32Value();
+
+    target.quality = NJT_DEFAULT_QUALITY;
+    Napi::Value tmpQuality = size.Get("quality");
+    if (!tmpQuality.IsUndefined())
+    {
+      if (!tmpQuality.IsNumber())
+      {
+        throw Napi::TypeError::New(info.Env(), "Invalid quality");
+      }
+      target.quality = tmpQuality.As<Napi::Number>().Int32Value();
+    }
+    if (target.quality <= 0 || target.quality > 100)
+    {
+      throw Napi::TypeError::New(info.Env(), "Invalid quality");
+    }
+
+    target.subsampling = NJT_DEFAULT_SUBSAMPLING;
+    Napi::Value tmpSubsampling = size.Get("subsampling");
+    if (!tmpSubsampling.IsUndefined())
+    {
+      if (!tmpSubsampling.IsNumber())
+      {
+        throw Napi::TypeError::New(info.Env(), "Invalid subsampling");
+      }
+      target.subsampling = tmpSubsampling.As<Napi::Number>().Int32Value();
+    }
+    switch (target.subsampling)
+    {
+    case TJSAMP_444:
+    case TJSAMP_422:
+    case TJSAMP_420:
+    case TJSAMP_GRAY:
+    case TJSAMP_440:
+      break;
+    default:
+      throw Napi::TypeError::New(info.Env(), "Invalid subsampling");
+    }
+  }
+
+  props.handle = OpenDecompressHandle(srcBuffer.Data(), srcBuffer.ByteLength());
+
+  if (async)
+  {
+    auto* wk = new GenerateSizesWorker(info.Env(), srcBuffer, std::move(props));
+    wk->Queue();
+    return wk->GetPromise();
+  }
+  else
+  {
+    DoGenerateSizes(props);
+    return GenerateSizesResult(info.Env(), props);
+  }
+}
+
+Napi::Value GenerateSizesAsync(Napi::CallbackInfo const& info)
+{
+  try {
+    return GenerateSizesInner(info, true);
+  } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(info.Env())
+}
+
+Napi::Value GenerateSizesSync(Napi::CallbackInfo const& info)
+{
+  try {
+    return GenerateSizesInner(info, false);
+  } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(info.Env())
+}
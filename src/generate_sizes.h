@@ -0,0 +1,9 @@
+#ifndef NODE_JPEGTURBO_GENERATE_SIZES_H
+#define NODE_JPEGTURBO_GENERATE_SIZES_H
+
+#include "util.h"
+
+Napi::Value GenerateSizesAsync(const Napi::CallbackInfo &info);
+Napi::Value GenerateSizesSync(const Napi::CallbackInfo &info);
+
+#endif
@@ -0,0 +1,252 @@
+#include "image_stats.h"
+#include <algorithm>
+
+namespace
+{
+  // BT.601 luma in 16-bit fixed point, the weights used by libjpeg
+  constexpr uint32_t LUMA_R = 19595;
+  constexpr uint32_t LUMA_G = 38470;
+  constexpr uint32_t LUMA_B = 7471;
+
+  // The loops below are kept free of branches and of calls, with the pixel
+  // size known at compile time, so that the compiler can vectorize them
+
+  template <int BPP>
+  uint32_t RowSum(uint8_t const* row, int width, int offset)
+  {
+    // A row has at most 131070 pixels (65535 decoded at scale 2), so this
+    // can't overflow
+    uint32_t sum = 0;
+    for (int x = 0; x < width; x++)
+    {
+      sum += row[x * BPP + offset];
+    }
+    return sum;
+  }
+
+  template <int BPP>
+  void RowMinMax(uint8_t const* row, int width, int offset, uint8_t& min, uint8_t& max)
+  {
+    uint8_t lo = min;
+    uint8_t hi = max;
+    for (int x = 0; x < width; x++)
+    {
+      uint8_t value = row[x * BPP + offset];
+      lo = value < lo ? value : lo;
+      hi = value > hi ? value : hi;
+    }
+    min = lo;
+    max = hi;
+  }
+
+  // Counted into four tables, so that runs of equal values (which are common)
+  // don't each wait for the previous increment of the same counter
+  template <int BPP>
+  void RowHistogram(uint8_t const* row, int width, int const* offsets, int channels, uint64_t (*counts)[ImageStats::BINS])
+  {
+    uint8_t luma[256];
+    for (int start = 0; start < width; start += 256)
+    {
+      int n = std::min(256, width - start);
+      uint8_t const* pixels = row + static_cast<std::size_t>(start) * BPP;
+      if (channels == 1)
+      {
+        for (int x = 0; x < n; x++)
+        {
+          luma[x] = pixels[x * BPP + offsets[0]];
+        }
+      }
+      else
+      {
+        int r = offsets[0];
+        int g = offsets[1];
+        int b = offsets[2];
+        for (int x = 0; x < n; x++)
+        {
+          uint8_t const* p = pixels + x * BPP;
+          luma[x] = static_cast<uint8_t>((LUMA_R * p[r] + LUMA_G * p[g] + LUMA_B * p[b] + 32768) >> 16);
+        }
+      }
+
+      int x = 0;
+      for (; x + 4 <= n; x += 4)
+      {
+        counts[0][luma[x]]++;
+        counts[1][luma[x + 1]]++;
+        counts[2][luma[x + 2]]++;
+        counts[3][luma[x + 3]]++;
+      }
+      for (; x < n; x++)
+      {
+        counts[0][luma[x]]++;
+      }
+    }
+  }
+}
+
+bool ImageStats::Start(uint32_t format)
+{
+  this->bpp = BytesPerPixel(format);
+  if (this->bpp == 0)
+  {
+    return false;
+  }
+  if (format == TJPF_GRAY)
+  {
+    this->channels = 1;
+    this->offsets = {0, 0, 0};
+  }
+  else
+  {
+    this->channels = 3;
+    this->offsets = {tjRedOffset[format], tjGreenOffset[format], tjBlueOffset[format]};
+  }
+
+  this->pixels = 0;
+  this->sums.fill(0);
+  this->mins.fill(255);
+  this->maxs.fill(0);
+  this->bins.fill(0);
+  return true;
+}
+
+template <int BPP>
+void ImageStats::AddRowsOf(uint8_t const* data, std::size_t pitch, int width, int rows)
+{
+  // One call can cover a whole image, which has more than 2^32 pixels at
+  // the largest scaled sizes
+  uint64_t counts[4][BINS];
+  if (this->histogram)
+  {
+    std::fill(&counts[0][0], &counts[0][0] + 4 * BINS, 0);
+  }
+
+  for (int y = 0; y < rows; y++)
+  {
+    uint8_t const* row = data + y * pitch;
+    for (int c = 0; c < this->channels; c++)
+    {
+      if (this->mean)
+      {
+        this->sums[c] += RowSum<BPP>(row, width, this->offsets[c]);
+      }
+      if (this->minmax)
+      {
+        RowMinMax<BPP>(row, width, this->offsets[c], this->mins[c], this->maxs[c]);
+      }
+    }
+    if (this->histogram)
+    {
+      RowHistogram<BPP>(row, width, this->offsets.data(), this->channels, counts);
+    }
+  }
+
+  if (this->histogram)
+  {
+    for (int i = 0; i < BINS; i++)
+    {
+      this->bins[i] += counts[0][i] + counts[1][i] + counts[2][i] + counts[3][i];
+    }
+  }
+  this->pixels += static_cast<uint64_t>(width) * rows;
+}
+
+void ImageStats::AddRows(uint8_t const* data, std::size_t pitch, int width, int rows)
+{
+  // The loops need to know the pixel size at compile time
+  switch (this->bpp)
+  {
+  case 1:
+    this->AddRowsOf<1>(data, pitch, width, rows);
+    break;
+  case 3:
+    this->AddRowsOf<3>(data, pitch, width, rows);
+    break;
+  case 4:
+    this->AddRowsOf<4>(data, pitch, width, rows);
+    break;
+  }
+}
+
+Napi::Object ImageStats::ToJS(Napi::Env const& env) const
+{
+  Napi::Object res = Napi::Object::New(env);
+  res.Set("pixels", static_cast<double>(this->pixels));
+
+  // With no pixels (e.g. a tolerant decode that got nowhere) there is no mean,
+  // minimum or maximum
+  bool any = this->pixels > 0;
+  if (this->mean)
+  {
+    Napi::Array mean = Napi::Array::New(env, this->channels);
+    for (int c = 0; c < this->channels; c++)
+    {
+      mean.Set(c, any ? static_cast<double>(this->sums[c]) / this->pixels : 0.0);
+    }
+    res.Set("mean", mean);
+  }
+  if (this->minmax)
+  {
+    Napi::Array min = Napi::Array::New(env, this->channels);
+    Napi::Array max = Napi::Array::New(env, this->channels);
+    for (int c = 0; c < this->channels; c++)
+    {
+      min.Set(c, any ? this->mins[c] : 0);
+      max.Set(c, any ? this->maxs[c] : 0);
+    }
+    res.Set("min", min);
+    res.Set("max", max);
+  }
+  if (this->histogram)
+  {
+    // Counts can pass 2^32 for the largest scaled images
+    Napi::Float64Array histogram = Napi::Float64Array::New(env, BINS);
+    for (int i = 0; i < BINS; i++)
+    {
+      histogram[i] = static_cast<double>(this->bins[i]);
+    }
+    res.Set("histogram", histogram);
+  }
+
+  return res;
+}
+
+ImageStats ParseImageStats(Napi::Env const& env, Napi::Object const& options)
+{
+  ImageStats stats;
+
+  Napi::Value tmpStats = options.Get("stats");
+  if (tmpStats.IsUndefined())
+  {
+    return stats;
+  }
+  if (!tmpStats.IsArray())
+  {
+    throw Napi::TypeError::New(env, "Invalid stats");
+  }
+
+  Napi::Array names = tmpStats.As<Napi::Array>();
+  for (uint32_t i = 0; i < names.Length(); i++)
+  {
+    Napi::Value name = names.Get(i);
+    std::string value = name.IsString() ? name.As<Napi::String>().Utf8Value() : "";
+    if (value == "mean")
+    {
+      stats.mean = true;
+    }
+    else if (value == "histogram")
+    {
+      stats.histogram = true;
+    }
+    else if (value == "minmax")
+    {
+      stats.minmax = true;
+    }
+    else
+    {
+      throw Napi::TypeError::New(env, "Invalid stats");
+    }
+  }
+
+  return stats;
+}
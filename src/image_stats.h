@@ -0,0 +1,52 @@
+#ifndef NODE_JPEGTURBO_IMAGE_STATS_H
+#define NODE_JPEGTURBO_IMAGE_STATS_H
+
+#include "util.h"
+#include <array>
+
+// Statistics of decoded 8-bit pixels, accumulated a few rows at a time while
+// the rows are still in cache. Alpha and padding channels are skipped.
+class ImageStats
+{
+public:
+  static constexpr int MAX_CHANNELS = 3;
+  static constexpr int BINS = 256;
+
+  // What to compute. Nothing is computed if none is set.
+  bool mean = false;
+  bool histogram = false;
+  bool minmax = false;
+
+  bool Requested() const { return this->mean || this->histogram || this->minmax; }
+
+  // Set up for pixels of a TJPF_* format. Returns false if the format has no
+  // channels to compute statistics of.
+  bool Start(uint32_t format);
+
+  // Add `rows` rows of `width` pixels, `pitch` bytes apart
+  void AddRows(uint8_t const* data, std::size_t pitch, int width, int rows);
+
+  // {pixels, mean, min, max, histogram}, with one mean/min/max entry per
+  // channel (R, G, B or gray) and a histogram of the luminance
+  Napi::Object ToJS(Napi::Env const& env) const;
+
+private:
+  template <int BPP>
+  void AddRowsOf(uint8_t const* data, std::size_t pitch, int width, int rows);
+
+  int bpp = 0;
+  int channels = 0;
+  std::array<int, MAX_CHANNELS> offsets{};
+  // Scaled decodes can have more than 2^32 pixels
+  uint64_t pixels = 0;
+  std::array<uint64_t, MAX_CHANNELS> sums{};
+  std::array<uint8_t, MAX_CHANNELS> mins{};
+  std::array<uint8_t, MAX_CHANNELS> maxs{};
+  std::array<uint64_t, BINS> bins{};
+};
+
+// Parse options.stats, an array of 'mean', 'histogram' and 'minmax'. Throws a
+// Napi::TypeError if it is invalid.
+ImageStats ParseImageStats(Napi::Env const& env, Napi::Object const& options);
+
+#endif
@@ -0,0 +1,208 @@
+#include "jpeg_decoder.h"
+
+namespace
+{
+  class DecodeWorker : public Napi::AsyncWorker
+  {
+  public:
+    DecodeWorker(
+        Napi::Env const& env,
+        JpegDecoder* decoder,
+        Napi::Object self,
+        Napi::Buffer<uint8_t>& srcBuffer,
+        DecompressProps& props)
+        : AsyncWorker(env),
+          deferred(Napi::Promise::Deferred::New(env)),
+          decoder(decoder),
+          self(Napi::Persistent(self)),
+          srcBuffer(Napi::Reference<Napi::Buffer<uint8_t>>::New(srcBuffer, 1)),
+          props(props)
+    {
+    }
+
+    ~DecodeWorker()
+    {
+      this->self.Reset();
+      this->srcBuffer.Reset();
+    }
+
+    void Execute()
+    {
+      std::string err = this->decoder->Decode(this->props);
+      if (!err.empty())
+      {
+        SetError(err);
+      }
+    }
+
+    void OnOK()
+    {
+      this->decoder->Release();
+      deferred.Resolve(DecompressResult(Env(), this->decoder->OutBuffer(), this->props));
+    }
+
+    void OnError(Napi::Error const& error)
+    {
+      this->decoder->Release();
+      deferred.Reject(error.Value());
+    }
+
+    Napi::Promise GetPromise() const
+    {
+      return deferred.Promise();
+    }
+
+  private:
+    Napi::Promise::Deferred deferred;
+    JpegDecoder* decoder;
+    // Keeps the decoder (and so its output buffer) alive
+    Napi::ObjectReference self;
+    Napi::Reference<Napi::Buffer<uint8_t>> srcBuffer;
+    DecompressProps props;
+  };
+}
+
+Napi::Function JpegDecoder::Init(Napi::Env env)
+{
+  return DefineClass(env, "JpegDecoder", {
+    InstanceMethod("decode", &JpegDecoder::DecodeAsync),
+    InstanceMethod("decodeSync", &JpegDecoder::DecodeSync),
+  });
+}
+
+JpegDecoder::JpegDecoder(Napi::CallbackInfo const& info)
+    : Napi::ObjectWrap<JpegDecoder>(info),
+      handle(nullptr),
+      options(),
+      busy(false)
+{
+  Napi::Env env = info.Env();
+
+  Napi::Object opts;
+  if (info.Length() >= 1 && !info[0].IsUndefined())
+  {
+    if (!info[0].IsObject())
+    {
+      Napi::TypeError::New(env, "Invalid options").ThrowAsJavaScriptException();
+      return;
+    }
+    opts = info[0].As<Napi::Object>();
+  }
+  if (!ParseDecompressOptions(env, opts, this->options))
+  {
+    return;
+  }
+
+  this->handle = tj3Init(TJINIT_DECOMPRESS);
+  if (this->handle == nullptr)
+  {
+    Napi::TypeError::New(env, tj3GetErrorStr(nullptr)).ThrowAsJavaScriptException();
+    return;
+  }
+}
+
+JpegDecoder::~JpegDecoder()
+{
+  if (this->handle != nullptr)
+  {
+    tj3Destroy(this->handle);
+  }
+  this->outBuffer.Reset();
+}
+
+std::string JpegDecoder::Decode(DecompressProps& props)
+{
+  return props.tolerant
+    ? DoDecompressTolerant(props)
+    : DoDecompress(props);
+}
+
+void JpegDecoder::Release()
+{
+  this->busy = false;
+}
+
+Napi::TypedArray JpegDecoder::OutBuffer() const
+{
+  return this->outBuffer.Value();
+}
+
+bool JpegDecoder::Prepare(Napi::CallbackInfo const& info, DecompressProps& props)
+{
+  Napi::Env env = info.Env();
+
+  if (this->busy)
+  {
+    Napi::Error::New(env, "Decoder is busy").ThrowAsJavaScriptException();
+    return false;
+  }
+
+  if (info.Length() < 1 || !info[0].IsBuffer())
+  {
+    Napi::TypeError::New(env, "Invalid source buffer").ThrowAsJavaScriptException();
+    return false;
+  }
+  Napi::Buffer<uint8_t> srcBuffer = info[0].As<Napi::Buffer<uint8_t>>();
+
+  props = this->options;
+  props.srcData = srcBuffer.Data();
+  props.srcLength = srcBuffer.Length();
+  props.handle = this->handle;
+  if (!ReadDecompressHeader(env, props))
+  {
+    return false;
+  }
+
+  // Grow the output buffer when an image doesn't fit, or needs the other
+  // sample size. The old one may still be referenced by an earlier result.
+  bool wideSamples = props.precision > 8;
+  props.pitch = static_cast<std::size_t>(props.resWidth) * props.bpp;
+  props.resSize = props.pitch * props.resHeight;
+  if (this->outBuffer.IsEmpty()
+    || this->outBuffer.Value().ElementLength() < props.resSize
+    || wideSamples != (this->outBuffer.Value().TypedArrayType() == napi_uint16_array))
+  {
+    Napi::TypedArray buffer = wideSamples
+      ? Napi::TypedArray(Napi::Uint16Array::New(env, props.resSize))
+      : Napi::TypedArray(Napi::Buffer<uint8_t>::New(env, props.resSize));
+    this->outBuffer.Reset(buffer, 1);
+  }
+  Napi::TypedArray dstBuffer = this->outBuffer.Value();
+  props.resData = static_cast<uint8_t *>(dstBuffer.ArrayBuffer().Data()) + dstBuffer.ByteOffset();
+
+  this->busy = true;
+  return true;
+}
+
+Napi::Value JpegDecoder::DecodeAsync(Napi::CallbackInfo const& info)
+{
+  DecompressProps props;
+  if (!this->Prepare(info, props))
+  {
+    return info.Env().Null();
+  }
+
+  Napi::Buffer<uint8_t> srcBuffer = info[0].As<Napi::Buffer<uint8_t>>();
+  auto* wk = new DecodeWorker(info.Env(), this, info.This().As<Napi::Object>(), srcBuffer, props);
+  wk->Queue();
+  return wk->GetPromise();
+}
+
+Napi::Value JpegDecoder::DecodeSync(Napi::CallbackInfo const& info)
+{
+  DecompressProps props;
+  if (!this->Prepare(info, props))
+  {
+    return info.Env().Null();
+  }
+
+  std::string errStr = this->Decode(props);
+  this->Release();
+  if (!errStr.empty())
+  {
+    Napi::TypeError::New(info.Env(), errStr).ThrowAsJavaScriptException();
+    return info.Env().Null();
+  }
+
+  return DecompressResult(info.Env(), this->OutBuffer(), props);
+}
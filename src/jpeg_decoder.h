@@ -0,0 +1,47 @@
+#ifndef NODE_JPEGTURBO_JPEG_DECODER_H
+#define NODE_JPEGTURBO_JPEG_DECODER_H
+
+#include "decompress.h"
+
+// A decoder with the options of decompress parsed once, and a TurboJPEG
+// decompressor and output buffer that are reused between images.
+//
+// new JpegDecoder(options)
+// decode(image) -> Promise<result>, decodeSync(image) -> result
+//
+// The result is the same as for decompress. Its data is the decoder's own
+// buffer, which the next decode overwrites (or replaces, if it's too small).
+// Only one decode can be in flight at a time.
+class JpegDecoder : public Napi::ObjectWrap<JpegDecoder>
+{
+public:
+  static Napi::Function Init(Napi::Env env);
+
+  JpegDecoder(Napi::CallbackInfo const& info);
+  ~JpegDecoder();
+
+  // Decode with the props of one call. Runs on the worker thread for decode().
+  std::string Decode(DecompressProps& props);
+
+  // Called when a call to decode() finishes
+  void Release();
+
+  Napi::TypedArray OutBuffer() const;
+
+private:
+  Napi::Value DecodeAsync(Napi::CallbackInfo const& info);
+  Napi::Value DecodeSync(Napi::CallbackInfo const& info);
+
+  // Read the header of the image of a decode call, and make sure the output
+  // buffer can hold it. Returns false and throws a JS exception if the image
+  // is invalid or the decoder is busy.
+  bool Prepare(Napi::CallbackInfo const& info, DecompressProps& props);
+
+  tjhandle handle;
+  DecompressProps options;
+  Napi::Reference<Napi::TypedArray> outBuffer;
+  // A decode() is in flight, and the handle belongs to the worker thread
+  bool busy;
+};
+
+#endif
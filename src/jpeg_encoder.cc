@@ -0,0 +1,225 @@
+#include "jpeg_encoder.h"
+
+namespace
+{
+  class EncodeWorker : public Napi::AsyncWorker
+  {
+  public:
+    EncodeWorker(
+        Napi::Env const& env,
+        JpegEncoder* encoder,
+        Napi::Object self,
+        Napi::TypedArray& srcBuffer,
+        Napi::Buffer<uint8_t>& dstBuffer,
+        CompressProps& props)
+        : AsyncWorker(env),
+          deferred(Napi::Promise::Deferred::New(env)),
+          encoder(encoder),
+          self(Napi::Persistent(self)),
+          srcBuffer(Napi::Reference<Napi::TypedArray>::New(srcBuffer, 1)),
+          dstBuffer(Napi::Reference<Napi::Buffer<uint8_t>>::New(dstBuffer, 1)),
+          props(props)
+    {
+    }
+
+    ~EncodeWorker()
+    {
+      this->self.Reset();
+      this->srcBuffer.Reset();
+      this->dstBuffer.Reset();
+    }
+
+    void Execute()
+    {
+      std::string err = this->encoder->Encode(this->props);
+      if (!err.empty())
+      {
+        SetError(err);
+      }
+    }
+
+    void OnOK()
+    {
+      this->encoder->Release();
+      deferred.Resolve(CompressResult(Env(), this->dstBuffer.Value(), this->props));
+    }
+
+    void OnError(Napi::Error const& error)
+    {
+      this->encoder->Release();
+      deferred.Reject(error.Value());
+    }
+
+    Napi::Promise GetPromise() const
+    {
+      return deferred.Promise();
+    }
+
+  private:
+    Napi::Promise::Deferred deferred;
+    JpegEncoder* encoder;
+    Napi::ObjectReference self;
+    Napi::Reference<Napi::TypedArray> srcBuffer;
+    Napi::Reference<Napi::Buffer<uint8_t>> dstBuffer;
+    CompressProps props;
+  };
+}
+
+Napi::Function JpegEncoder::Init(Napi::Env env)
+{
+  return DefineClass(env, "JpegEncoder", {
+    InstanceMethod("encode", &JpegEncoder::EncodeAsync),
+    InstanceMethod("encodeSync", &JpegEncoder::EncodeSync),
+  });
+}
+
+JpegEncoder::JpegEncoder(Napi::CallbackInfo const& info)
+    : Napi::ObjectWrap<JpegEncoder>(info),
+      handle(nullptr),
+      options(),
+      busy(false)
+{
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsObject())
+  {
+    Napi::TypeError::New(env, "Invalid options").ThrowAsJavaScriptException();
+    return;
+  }
+  if (!ParseCompressOptions(env, info[0].As<Napi::Object>(), this->options))
+  {
+    return;
+  }
+
+  // Rate control makes its own handles
+  if (this->options.targetBytes == 0)
+  {
+    this->handle = tj3Init(TJINIT_COMPRESS);
+    if (this->handle == nullptr)
+    {
+      Napi::TypeError::New(env, tj3GetErrorStr(nullptr)).ThrowAsJavaScriptException();
+      return;
+    }
+    SetCompressParams(this->handle, this->options);
+  }
+
+  this->outBuffer = Napi::Reference<Napi::Buffer<uint8_t>>::New(
+    Napi::Buffer<uint8_t>::New(env, this->options.bufferSize), 1);
+}
+
+JpegEncoder::~JpegEncoder()
+{
+  if (this->handle != nullptr)
+  {
+    tj3Destroy(this->handle);
+  }
+  this->outBuffer.Reset();
+}
+
+std::string JpegEncoder::Encode(CompressProps& props)
+{
+  return props.targetBytes != 0
+    ? DoCompressToTarget(props)
+    : CompressWithHandle(this->handle, props);
+}
+
+void JpegEncoder::Release()
+{
+  this->busy = false;
+}
+
+bool JpegEncoder::Prepare(Napi::CallbackInfo const& info, CompressProps& props, Napi::Buffer<uint8_t>& dstBuffer)
+{
+  Napi::Env env = info.Env();
+
+  if (this->busy)
+  {
+    Napi::Error::New(env, "Encoder is busy").ThrowAsJavaScriptException();
+    return false;
+  }
+
+  // A Buffer, or a Uint16Array for precision 12 and 16
+  bool wideSamples = this->options.precision != 8;
+  if (info.Length() < 1 || !(wideSamples
+    ? info[0].IsTypedArray() && info[0].As<Napi::TypedArray>().TypedArrayType() == napi_uint16_array
+    : info[0].IsBuffer()))
+  {
+    Napi::TypeError::New(env, "Invalid source buffer").ThrowAsJavaScriptException();
+    return false;
+  }
+  Napi::TypedArray srcBuffer = info[0].As<Napi::TypedArray>();
+
+  props = this->options;
+  if (srcBuffer.ElementLength() < static_cast<uint64_t>(props.stride) * props.height * props.bpp)
+  {
+    Napi::TypeError::New(env, "Source data is not long enough").ThrowAsJavaScriptException();
+    return false;
+  }
+  props.srcData = static_cast<uint8_t *>(srcBuffer.ArrayBuffer().Data()) + srcBuffer.ByteOffset();
+
+  if (props.precision != 8 && !SamplesFitPrecision(static_cast<uint16_t const *>(props.srcData),
+    props.width * props.bpp, props.height, props.stride * props.bpp, props.precision))
+  {
+    Napi::TypeError::New(env, "Sample out of range for precision").ThrowAsJavaScriptException();
+    return false;
+  }
+
+  if (info.Length() >= 2 && !info[1].IsUndefined())
+  {
+    if (!info[1].IsBuffer())
+    {
+      Napi::TypeError::New(env, "Invalid destination buffer").ThrowAsJavaScriptException();
+      return false;
+    }
+    dstBuffer = info[1].As<Napi::Buffer<uint8_t>>();
+    if (dstBuffer.Length() < props.bufferSize)
+    {
+      Napi::TypeError::New(env, "Insufficient output buffer").ThrowAsJavaScriptException();
+      return false;
+    }
+  }
+  else
+  {
+    dstBuffer = this->outBuffer.Value();
+  }
+  props.resSize = dstBuffer.Length();
+  props.resData = dstBuffer.Data();
+
+  this->busy = true;
+  return true;
+}
+
+Napi::Value JpegEncoder::EncodeAsync(Napi::CallbackInfo const& info)
+{
+  CompressProps props;
+  Napi::Buffer<uint8_t> dstBuffer;
+  if (!this->Prepare(info, props, dstBuffer))
+  {
+    return info.Env().Null();
+  }
+
+  Napi::TypedArray srcBuffer = info[0].As<Napi::TypedArray>();
+  auto* wk = new EncodeWorker(info.Env(), this, info.This().As<Napi::Object>(), srcBuffer, dstBuffer, props);
+  wk->Queue();
+  return wk->GetPromise();
+}
+
+Napi::Value JpegEncoder::EncodeSync(Napi::CallbackInfo const& info)
+{
+  CompressProps props;
+  Napi::Buffer<uint8_t> dstBuffer;
+  if (!this->Prepare(info, props, dstBuffer))
+  {
+    return info.Env().Null();
+  }
+
+  std::string errStr = this->Encode(props);
+  this->Release();
+  if (!errStr.empty())
+  {
+    Napi::TypeError::New(info.Env(), errStr).ThrowAsJavaScriptException();
+    return info.Env().Null();
+  }
+
+  return CompressResult(info.Env(), dstBuffer, props);
+}
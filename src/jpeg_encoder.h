@@ -0,0 +1,45 @@
+#ifndef NODE_JPEGTURBO_JPEG_ENCODER_H
+#define NODE_JPEGTURBO_JPEG_ENCODER_H
+
+#include "compress.h"
+
+// An encoder with the options of compress parsed once, and a TurboJPEG
+// compressor and output buffer that are reused between images.
+//
+// new JpegEncoder(options)
+// encode(raw[, out]) -> Promise<{data, size, quality?}>
+// encodeSync(raw[, out]) -> {data, size, quality?}
+//
+// Without out, data is the encoder's own buffer, which the next encode
+// overwrites. Only one encode can be in flight at a time.
+class JpegEncoder : public Napi::ObjectWrap<JpegEncoder>
+{
+public:
+  static Napi::Function Init(Napi::Env env);
+
+  JpegEncoder(Napi::CallbackInfo const& info);
+  ~JpegEncoder();
+
+  // Encode with the props of one call. Runs on the worker thread for encode().
+  std::string Encode(CompressProps& props);
+
+  // Called when a call to encode() finishes
+  void Release();
+
+private:
+  Napi::Value EncodeAsync(Napi::CallbackInfo const& info);
+  Napi::Value EncodeSync(Napi::CallbackInfo const& info);
+
+  // Check the arguments of an encode call and fill in the props and output
+  // buffer for it. Returns false and throws a JS exception if they are
+  // invalid or the encoder is busy.
+  bool Prepare(Napi::CallbackInfo const& info, CompressProps& props, Napi::Buffer<uint8_t>& dstBuffer);
+
+  tjhandle handle;
+  CompressProps options;
+  Napi::Reference<Napi::Buffer<uint8_t>> outBuffer;
+  // An encode() is in flight, and the handle belongs to the worker thread
+  bool busy;
+};
+
+#endif
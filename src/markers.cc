@@ -0,0 +1,250 @@
+#include "markers.h"
+#include <algorithm>
+#include <cstring>
+extern "C" {
+  #include <jerror.h>
+}
+
+namespace
+{
+  // APP0 and APP14 are left to libjpeg, which needs them to determine the
+  // color space
+  bool IsRecordedMarker(int marker)
+  {
+    return marker == JPEG_COM
+      || (marker > JPEG_APP0 && marker <= JPEG_APP0 + 15 && marker != JPEG_APP0 + 14);
+  }
+
+  // Marker processor that notes where the payload is and skips over it,
+  // instead of copying it like jpeg_save_markers does
+  boolean RecordMarker(j_decompress_ptr cinfo)
+  {
+    auto* recorder = static_cast<MarkerRecorder*>(cinfo->client_data);
+    jpeg_source_mgr* src = cinfo->src;
+
+    // Only meaningful while the source still points into the buffer
+    bool inBuffer = src->next_input_byte >= recorder->base
+      && src->next_input_byte <= recorder->base + recorder->length;
+    std::size_t start = inBuffer ? static_cast<std::size_t>(src->next_input_byte - recorder->base) : 0;
+
+    // Read the length through the source manager, like libjpeg's own marker
+    // readers. At the end of the data jpeg_mem_src warns and supplies a fake
+    // EOI marker.
+    std::size_t length = 0;
+    for (int i = 0; i < 2; i++)
+    {
+      if (src->bytes_in_buffer == 0 && !(*src->fill_input_buffer)(cinfo))
+      {
+        return FALSE;
+      }
+      length = (length << 8) + *src->next_input_byte++;
+      src->bytes_in_buffer--;
+    }
+    if (length < 2)
+    {
+      ERREXIT(cinfo, JERR_BAD_LENGTH);
+    }
+
+    // A truncated segment only records what is actually there
+    if (inBuffer && start + 2 <= recorder->length)
+    {
+      MarkerLocation location;
+      location.marker = cinfo->unread_marker;
+      location.offset = start + 2;
+      location.length = std::min(length - 2, recorder->length - location.offset);
+      recorder->markers.push_back(location);
+    }
+
+    if (length > 2)
+    {
+      (*src->skip_input_data)(cinfo, static_cast<long>(length - 2));
+    }
+    return TRUE;
+  }
+}
+
+void RecordMarkerLocations(j_decompress_ptr cinfo, MarkerRecorder& recorder)
+{
+  cinfo->client_data = &recorder;
+
+  for (int marker = JPEG_APP0; marker <= JPEG_COM; marker++)
+  {
+    if (IsRecordedMarker(marker))
+    {
+      jpeg_set_marker_processor(cinfo, marker, RecordMarker);
+    }
+  }
+}
+
+void ReadMarkerLocations(uint8_t const* data, std::size_t length, std::vector<MarkerLocation>& markers)
+{
+  constexpr int SOS = 0xDA;
+  constexpr int EOI = 0xD9;
+  constexpr int RST0 = 0xD0;
+  constexpr int RST7 = 0xD7;
+  constexpr int TEM = 0x01;
+
+  markers.clear();
+  std::size_t pos = 2;
+  while (pos + 2 <= length && data[pos] == 0xFF)
+  {
+    int marker = data[pos + 1];
+    if (marker == 0xFF)
+    {
+      // Fill byte
+      pos++;
+      continue;
+    }
+    if (marker == TEM || (marker >= RST0 && marker <= RST7))
+    {
+      pos += 2;
+      continue;
+    }
+    if (marker == SOS || marker == EOI || pos + 4 > length)
+    {
+      break;
+    }
+
+    std::size_t segmentLength = (static_cast<std::size_t>(data[pos + 2]) << 8) + data[pos + 3];
+    if (segmentLength < 2)
+    {
+      break;
+    }
+    if (IsRecordedMarker(marker))
+    {
+      MarkerLocation location;
+      location.marker = marker;
+      location.offset = pos + 4;
+      location.length = std::min(segmentLength - 2, length - location.offset);
+      markers.push_back(location);
+    }
+    pos += 2 + segmentLength;
+  }
+}
+
+Napi::Array MarkerLocationsResult(Napi::Env const& env, std::vector<MarkerLocation> const& markers)
+{
+  auto res = Napi::Array::New(env, markers.size());
+  for (std::size_t i = 0; i < markers.size(); i++)
+  {
+    auto marker = Napi::Object::New(env);
+    marker.Set("marker", markers[i].marker);
+    marker.Set("offset", markers[i].offset);
+    marker.Set("length", markers[i].length);
+    res[i] = marker;
+  }
+  return res;
+}
+
+bool ParseMarkers(Napi::Env const& env, Napi::Value value, std::vector<uint8_t>& segments)
+{
+  if (!value.IsArray())
+  {
+    Napi::TypeError::New(env, "Invalid markers").ThrowAsJavaScriptException();
+    return false;
+  }
+  auto markers = value.As<Napi::Array>();
+
+  segments.clear();
+  for (uint32_t i = 0; i < markers.Length(); i++)
+  {
+    Napi::Value tmpMarker = markers.Get(i);
+    if (!tmpMarker.IsObject())
+    {
+      Napi::TypeError::New(env, "Invalid markers").ThrowAsJavaScriptException();
+      return false;
+    }
+    auto marker = tmpMarker.As<Napi::Object>();
+
+    Napi::Value tmpCode = marker.Get("marker");
+    if (!tmpCode.IsNumber())
+    {
+      Napi::TypeError::New(env, "Invalid marker").ThrowAsJavaScriptException();
+      return false;
+    }
+    uint32_t code = tmpCode.As<Napi::Number>().Uint32Value();
+    if (code != JPEG_COM && (code < JPEG_APP0 || code > JPEG_APP0 + 15))
+    {
+      Napi::TypeError::New(env, "Invalid marker").ThrowAsJavaScriptException();
+      return false;
+    }
+
+    Napi::Value tmpData = marker.Get("data");
+    if (!tmpData.IsTypedArray() || tmpData.As<Napi::TypedArray>().TypedArrayType() != napi_uint8_array)
+    {
+      Napi::TypeError::New(env, "Invalid marker data").ThrowAsJavaScriptException();
+      return false;
+    }
+    auto data = tmpData.As<Napi::Uint8Array>();
+    if (data.ElementLength() > 65533)
+    {
+      Napi::TypeError::New(env, "Marker data is too long").ThrowAsJavaScriptException();
+      return false;
+    }
+
+    std::size_t length = data.ElementLength() + 2;
+    segments.push_back(0xFF);
+    segments.push_back(static_cast<uint8_t>(code));
+    segments.push_back(static_cast<uint8_t>(length >> 8));
+    segments.push_back(static_cast<uint8_t>(length & 0xFF));
+    segments.insert(segments.end(), data.Data(), data.Data() + data.ElementLength());
+  }
+
+  return true;
+}
+
+std::size_t MarkerInsertionPoint(uint8_t const* data, std::size_t length)
+{
+  std::size_t point = 2;
+  if (length >= point + 4 && data[point] == 0xFF && data[point + 1] == JPEG_APP0)
+  {
+    std::size_t segmentLength = (static_cast<std::size_t>(data[point + 2]) << 8) + data[point + 3];
+    if (point + 2 + segmentLength <= length)
+    {
+      point += 2 + segmentLength;
+    }
+  }
+  return point;
+}
+
+std::size_t StripTableSegments(uint8_t* data, std::size_t length, std::vector<uint8_t>* tables)
+{
+  constexpr int DHT = 0xC4;
+  constexpr int DQT = 0xDB;
+  constexpr int SOS = 0xDA;
+  constexpr int EOI = 0xD9;
+
+  // Compact the header in one pass, then move the scan data once
+  std::size_t in = 2;
+  std::size_t out = 2;
+  while (in + 4 <= length && data[in] == 0xFF)
+  {
+    int marker = data[in + 1];
+    if (marker == SOS || marker == EOI)
+    {
+      break;
+    }
+    std::size_t segmentLength = 2 + (static_cast<std::size_t>(data[in + 2]) << 8) + data[in + 3];
+    if (in + segmentLength > length)
+    {
+      break;
+    }
+
+    if (marker == DHT || marker == DQT)
+    {
+      if (tables != nullptr)
+      {
+        tables->insert(tables->end(), data + in, data + in + segmentLength);
+      }
+    }
+    else
+    {
+      memmove(data + out, data + in, segmentLength);
+      out += segmentLength;
+    }
+    in += segmentLength;
+  }
+
+  memmove(data + out, data + in, length - in);
+  return length - (in - out);
+}
@@ -0,0 +1,51 @@
+#ifndef NODE_JPEGTURBO_MARKERS_H
+#define NODE_JPEGTURBO_MARKERS_H
+
+#include "util.h"
+#include <vector>
+
+// Where a marker's payload lives in the source buffer
+struct MarkerLocation
+{
+  int marker;
+  std::size_t offset;
+  std::size_t length;
+};
+
+// Records the APPn (other than APP0 and APP14, which libjpeg needs to parse
+// itself to determine the color space) and COM markers of a JPEG without
+// copying their payloads. The recorder is stored in cinfo->client_data.
+struct MarkerRecorder
+{
+  uint8_t const* base;
+  std::size_t length;
+  std::vector<MarkerLocation> markers;
+};
+
+// Install the marker processors. Must be called before jpeg_read_header, and
+// the source must be a jpeg_mem_src over recorder.base and recorder.length.
+void RecordMarkerLocations(j_decompress_ptr cinfo, MarkerRecorder& recorder);
+
+// Find the same markers as RecordMarkerLocations by walking the segments in
+// front of the first scan, for callers whose header is parsed by TurboJPEG.
+// Nothing is validated; malformed data just ends the walk, and is reported
+// when the header is actually read.
+void ReadMarkerLocations(uint8_t const* data, std::size_t length, std::vector<MarkerLocation>& markers);
+
+// Convert marker locations to [{marker, offset, length}]
+Napi::Array MarkerLocationsResult(Napi::Env const& env, std::vector<MarkerLocation> const& markers);
+
+// Serialize [{marker, data}] into complete marker segments. Returns false and
+// throws a JS exception if the input is invalid.
+bool ParseMarkers(Napi::Env const& env, Napi::Value value, std::vector<uint8_t>& segments);
+
+// The number of bytes at the start of a JPEG that have to stay in front of any
+// inserted markers: the SOI marker, and the JFIF APP0 segment if there is one.
+std::size_t MarkerInsertionPoint(uint8_t const* data, std::size_t length);
+
+// Remove the DQT and DHT segments in front of the first scan of a JPEG, in
+// place, turning it into an abbreviated image. The removed segments are
+// appended to tables if it isn't null. Returns the new length.
+std::size_t StripTableSegments(uint8_t* data, std::size_t length, std::vector<uint8_t>* tables);
+
+#endif
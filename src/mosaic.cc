@@ -0,0 +1,334 @@
+#include "mosaic.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+struct MosaicTile
+{
+  JDecompressHandle handle;
+  // In pixels, on MCU boundaries
+  int x;
+  int y;
+};
+
+struct MosaicProps
+{
+  std::vector<MosaicTile> tiles;
+  int width;
+  int height;
+  bool optimizeCoding;
+  JMemDestination dest;
+};
+
+namespace
+{
+  int CeilDiv(int a, int b)
+  {
+    return (a + b - 1) / b;
+  }
+
+  // Whether two tiles can share one set of block arrays: the same components,
+  // sampling and quantization tables
+  void CheckCompatible(j_decompress_ptr first, j_decompress_ptr tile)
+  {
+    if (tile->num_components != first->num_components || tile->jpeg_color_space != first->jpeg_color_space)
+    {
+      throw std::runtime_error("Tiles have different color spaces");
+    }
+    for (int ci = 0; ci < first->num_components; ++ci)
+    {
+      auto const& a = first->comp_info[ci];
+      auto const& b = tile->comp_info[ci];
+      if (a.h_samp_factor != b.h_samp_factor || a.v_samp_factor != b.v_samp_factor)
+      {
+        throw std::runtime_error("Tiles have different subsampling");
+      }
+
+      JQUANT_TBL const* qa = first->quant_tbl_ptrs[a.quant_tbl_no];
+      JQUANT_TBL const* qb = tile->quant_tbl_ptrs[b.quant_tbl_no];
+      if (qa == nullptr || qb == nullptr
+        || memcmp(qa->quantval, qb->quantval, sizeof(qa->quantval)) != 0)
+      {
+        throw std::runtime_error("Tiles have different quantization tables");
+      }
+    }
+  }
+}
+
+// Copy the coefficient blocks of every tile into block arrays for the whole
+// canvas, and entropy code them once. Blocks that no tile covers stay zero,
+// which decodes to mid-gray. Later tiles overwrite earlier ones.
+void DoMosaic(MosaicProps& props)
+{
+  j_decompress_ptr first = props.tiles[0].handle.cinfo();
+
+  JCompressHandle dstHandle = CreateCompressHandle();
+  auto& dstinfo = *dstHandle.cinfo();
+  jpeg_mem_dest(&dstinfo, &props.dest.data, &props.dest.size);
+  // Only needs the header, and the tables it defined
+  jpeg_copy_critical_parameters(first, &dstinfo);
+  dstinfo.image_width = props.width;
+  dstinfo.image_height = props.height;
+  if (props.optimizeCoding)
+  {
+    dstinfo.optimize_coding = true;
+  }
+
+  // One block array per component, padded to whole MCUs the same way the
+  // coefficient controllers do
+  int maxH = first->max_h_samp_factor;
+  int maxV = first->max_v_samp_factor;
+  std::array<jvirt_barray_ptr, MAX_COMPONENTS> dstCoeffs{};
+  std::array<JDIMENSION, MAX_COMPONENTS> dstWidths{};
+  std::array<JDIMENSION, MAX_COMPONENTS> dstHeights{};
+  for (int ci = 0; ci < first->num_components; ++ci)
+  {
+    auto const& comp = first->comp_info[ci];
+    dstWidths[ci] = CeilDiv(CeilDiv(props.width * comp.h_samp_factor, maxH), DCTSIZE);
+    dstHeights[ci] = CeilDiv(CeilDiv(props.height * comp.v_samp_factor, maxV), DCTSIZE);
+    dstCoeffs[ci] = (*dstinfo.mem->request_virt_barray)(asJCommon(&dstinfo), JPOOL_IMAGE, true,
+      CeilDiv(dstWidths[ci], comp.h_samp_factor) * comp.h_samp_factor,
+      CeilDiv(dstHeights[ci], comp.v_samp_factor) * comp.v_samp_factor,
+      comp.v_samp_factor);
+  }
+
+  // This realizes (and zeroes) the block arrays; nothing is emitted before
+  // jpeg_finish_compress
+  jpeg_write_coefficients(&dstinfo, dstCoeffs.data());
+
+  for (auto& tile : props.tiles)
+  {
+    j_decompress_ptr srcinfo = tile.handle.cinfo();
+    jvirt_barray_ptr* srcCoeffs = jpeg_read_coefficients(srcinfo);
+
+    for (int ci = 0; ci < srcinfo->num_components; ++ci)
+    {
+      auto const& comp = srcinfo->comp_info[ci];
+
+      // Tables can be redefined between scans, so check the ones the
+      // coefficients were actually quantized with
+      JQUANT_TBL const* dstTable = dstinfo.quant_tbl_ptrs[dstinfo.comp_info[ci].quant_tbl_no];
+      if (comp.quant_table == nullptr || dstTable == nullptr
+        || memcmp(comp.quant_table->quantval, dstTable->quantval, sizeof(dstTable->quantval)) != 0)
+      {
+        throw std::runtime_error("Tiles have different quantization tables");
+      }
+
+      JDIMENSION left = tile.x / (maxH * DCTSIZE) * comp.h_samp_factor;
+      JDIMENSION top = tile.y / (maxV * DCTSIZE) * comp.v_samp_factor;
+      JDIMENSION cols = std::min(comp.width_in_blocks, dstWidths[ci] - left);
+      JDIMENSION rows = std::min(comp.height_in_blocks, dstHeights[ci] - top);
+
+      for (JDIMENSION row = 0; row < rows; ++row)
+      {
+        JBLOCKROW srcRow = *(*srcinfo->mem->access_virt_barray)(asJCommon(srcinfo),
+          srcCoeffs[ci], row, 1, false);
+        JBLOCKROW dstRow = *(*dstinfo.mem->access_virt_barray)(asJCommon(&dstinfo),
+          dstCoeffs[ci], top + row, 1, true);
+        memcpy(dstRow + left, srcRow, cols * sizeof(JBLOCK));
+      }
+    }
+
+    // Free the tile's coefficients before reading the next one
+    jpeg_finish_decompress(srcinfo);
+    tile.handle = JDecompressHandle();
+  }
+
+  jpeg_finish_compress(&dstinfo);
+}
+
+class MosaicWorker : public Napi::AsyncWorker
+{
+public:
+  MosaicWorker(
+      Napi::Env const& env,
+      BufferReferences&& references,
+      MosaicProps&& props)
+      : AsyncWorker(env),
+        deferred(Napi::Promise::Deferred::New(env)),
+        references(std::move(references)),
+        props(std::move(props))
+  {
+  }
+
+  void Execute()
+  {
+    try {
+      DoMosaic(this->props);
+    } catch (JPEGLibError const& e) {
+      // JS values can't be created on this thread, so keep the code and
+      // warnings for OnError
+      this->jpegError.reset(new JPEGLibError(e));
+      SetError(e.what());
+    } catch (std::exception const& e) {
+      SetError(e.what());
+    }
+  }
+
+  void OnOK()
+  {
+    try {
+      deferred.Resolve(TakeBuffer(Env(), this->props.dest));
+    } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(Env())
+  }
+
+  void OnError(Napi::Error const& error)
+  {
+    if (this->jpegError)
+    {
+      deferred.Reject(JPEGLibErrorToJS(Env(), *this->jpegError).Value());
+      return;
+    }
+    deferred.Reject(error.Value());
+  }
+
+  Napi::Promise GetPromise() const
+  {
+    return deferred.Promise();
+  }
+
+private:
+  Napi::Promise::Deferred deferred;
+  BufferReferences references;
+  MosaicProps props;
+  std::unique_ptr<JPEGLibError> jpegError;
+};
+
+int ParseCanvasDimension(Napi::Env const& env, Napi::Object const& options, char const* name)
+{
+  Napi::Value value = options.Get(name);
+  if (!value.IsNumber() || value.As<Napi::Number>().Int64Value() <= 0
+    || value.As<Napi::Number>().Int64Value() > JPEG_MAX_DIMENSION)
+  {
+    throw Napi::TypeError::New(env, std::string("Invalid ") + name);
+  }
+  return value.As<Napi::Number>().Int32Value();
+}
+
+Napi::Value MosaicInner(Napi::CallbackInfo const& info, bool async)
+{
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 2)
+  {
+    throw Napi::TypeError::New(env, "Not enough arguments");
+  }
+
+  if (!info[0].IsArray() || info[0].As<Napi::Array>().Length() == 0)
+  {
+    throw Napi::TypeError::New(env, "Invalid tiles");
+  }
+  Napi::Array tiles = info[0].As<Napi::Array>();
+
+  if (!info[1].IsObject())
+  {
+    throw Napi::TypeError::New(env, "Invalid options");
+  }
+  Napi::Object options = info[1].As<Napi::Object>();
+
+  MosaicProps props = {};
+  props.width = ParseCanvasDimension(env, options, "width");
+  props.height = ParseCanvasDimension(env, options, "height");
+
+  Napi::Value tmpOptimize = options.Get("optimizeHuffman");
+  if (!tmpOptimize.IsUndefined())
+  {
+    if (!tmpOptimize.IsBoolean())
+    {
+      throw Napi::TypeError::New(env, "Invalid optimizeHuffman");
+    }
+    props.optimizeCoding = tmpOptimize.As<Napi::Boolean>().Value();
+  }
+
+  // The tiles' decompressors read their images on the worker
+  BufferReferences references;
+  for (uint32_t i = 0; i < tiles.Length(); ++i)
+  {
+    Napi::Value tmpTile = tiles.Get(i);
+    if (!tmpTile.IsObject())
+    {
+      throw Napi::TypeError::New(env, "Invalid tiles");
+    }
+    Napi::Object tile = tmpTile.As<Napi::Object>();
+
+    Napi::Value tmpImage = tile.Get("image");
+    Napi::Value tmpX = tile.Get("x");
+    Napi::Value tmpY = tile.Get("y");
+    if (!tmpImage.IsBuffer() || !tmpX.IsNumber() || !tmpY.IsNumber()
+      || tmpX.As<Napi::Number>().Int64Value() < 0 || tmpY.As<Napi::Number>().Int64Value() < 0
+      || tmpX.As<Napi::Number>().Int64Value() >= props.width || tmpY.As<Napi::Number>().Int64Value() >= props.height)
+    {
+      throw Napi::TypeError::New(env, "Invalid tiles");
+    }
+    Napi::Buffer<uint8_t> image = tmpImage.As<Napi::Buffer<uint8_t>>();
+    references.Add(image);
+
+    MosaicTile source;
+    source.handle = OpenDecompressHandle(image.Data(), image.ByteLength());
+    source.x = tmpX.As<Napi::Number>().Int32Value();
+    source.y = tmpY.As<Napi::Number>().Int32Value();
+    j_decompress_ptr cinfo = source.handle.cinfo();
+
+    if (cinfo->data_precision != 8)
+    {
+      throw Napi::TypeError::New(env, "Only 8-bit tiles are supported");
+    }
+    if (!props.tiles.empty())
+    {
+      try
+      {
+        CheckCompatible(props.tiles[0].handle.cinfo(), cinfo);
+      }
+      catch (std::exception const& e)
+      {
+        throw Napi::TypeError::New(env, e.what());
+      }
+    }
+
+    // Blocks can only be moved by whole MCUs, and a partial MCU (whose
+    // padding would show) may only be at the right or bottom of the canvas
+    int mcuWidth = cinfo->max_h_samp_factor * DCTSIZE;
+    int mcuHeight = cinfo->max_v_samp_factor * DCTSIZE;
+    if (source.x % mcuWidth != 0 || source.y % mcuHeight != 0)
+    {
+      throw Napi::TypeError::New(env, "Tiles must be placed on MCU boundaries ("
+        + std::to_string(mcuWidth) + "x" + std::to_string(mcuHeight) + " pixels)");
+    }
+    bool partialColumn = cinfo->image_width % mcuWidth != 0
+      && source.x + static_cast<int64_t>(cinfo->image_width) < props.width;
+    bool partialRow = cinfo->image_height % mcuHeight != 0
+      && source.y + static_cast<int64_t>(cinfo->image_height) < props.height;
+    if (partialColumn || partialRow)
+    {
+      throw Napi::TypeError::New(env, "Tiles must be whole MCUs, except at the right and bottom edges");
+    }
+
+    props.tiles.push_back(std::move(source));
+  }
+
+  if (async)
+  {
+    auto* wk = new MosaicWorker(env, std::move(references), std::move(props));
+    wk->Queue();
+    return wk->GetPromise();
+  }
+  else
+  {
+    DoMosaic(props);
+    return TakeBuffer(env, props.dest);
+  }
+}
+
+Napi::Value MosaicAsync(Napi::CallbackInfo const& info)
+{
+  try {
+    return MosaicInner(info, true);
+  } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(info.Env())
+}
+
+Napi::Value MosaicSync(Napi::CallbackInfo const& info)
+{
+  try {
+    return MosaicInner(info, false);
+  } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(info.Env())
+}
@@ -0,0 +1,9 @@
+#ifndef NODE_JPEGTURBO_MOSAIC_H
+#define NODE_JPEGTURBO_MOSAIC_H
+
+#include "util.h"
+
+Napi::Value MosaicAsync(const Napi::CallbackInfo &info);
+Napi::Value MosaicSync(const Napi::CallbackInfo &info);
+
+#endif
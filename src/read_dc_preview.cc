@@ -0,0 +1,209 @@
+#include "read_dc_preview.h"
+#include <cstdint>
+
+struct ReadDCPreviewProps
+{
+  JDecompressHandle handle;
+  uint32_t format;
+  int bpp;
+  int resWidth;
+  int resHeight;
+  std::size_t resSize;
+  uint8_t* resData;
+};
+
+void DoReadDCPreview(ReadDCPreviewProps& props)
+{
+  auto& cinfo = *props.handle.cinfo();
+  jpeg_start_decompress(&cinfo);
+
+  std::size_t pitch = static_cast<std::size_t>(props.resWidth) * props.bpp;
+  while (cinfo.output_scanline < cinfo.output_height)
+  {
+    JSAMPROW row = props.resData + cinfo.output_scanline * pitch;
+    jpeg_read_scanlines(&cinfo, &row, 1);
+  }
+
+  jpeg_finish_decompress(&cinfo);
+}
+
+Napi::Object ReadDCPreviewResult(Napi::Env const& env, Napi::Buffer<uint8_t> const& dstBuffer, ReadDCPreviewProps const& props)
+{
+  Napi::Object res = Napi::Object::New(env);
+  res.Set("data", dstBuffer);
+  res.Set("size", props.resSize);
+  res.Set("width", props.resWidth);
+  res.Set("height", props.resHeight);
+  res.Set("format", props.format);
+
+  return res;
+}
+
+class ReadDCPreviewWorker : public Napi::AsyncWorker
+{
+public:
+  ReadDCPreviewWorker(
+      Napi::Env const& env,
+      Napi::Buffer<uint8_t>& srcBuffer,
+      Napi::Buffer<uint8_t>& dstBuffer,
+      ReadDCPreviewProps&& props)
+      : AsyncWorker(env),
+        deferred(Napi::Promise::Deferred::New(env)),
+        srcBuffer(Napi::Reference<Napi::Buffer<uint8_t>>::New(srcBuffer, 1)),
+        dstBuffer(Napi::Reference<Napi::Buffer<uint8_t>>::New(dstBuffer, 1)),
+        props(std::move(props))
+  {
+  }
+
+  ~ReadDCPreviewWorker()
+  {
+    this->srcBuffer.Reset();
+    this->dstBuffer.Reset();
+  }
+
+  void Execute()
+  {
+    try {
+      DoReadDCPreview(this->props);
+    } catch (JPEGLibError const& e) {
+      // JS values can't be created on this thread, so keep the code and
+      // warnings for OnError
+      this->jpegError.reset(new JPEGLibError(e));
+      SetError(e.what());
+    } catch (std::exception const& e) {
+      SetError(e.what());
+    }
+  }
+
+  void OnOK()
+  {
+    try {
+      deferred.Resolve(ReadDCPreviewResult(Env(), this->dstBuffer.Value(), this->props));
+    } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(Env())
+  }
+
+  void OnError(Napi::Error const& error)
+  {
+    if (this->jpegError)
+    {
+      deferred.Reject(JPEGLibErrorToJS(Env(), *this->jpegError).Value());
+      return;
+    }
+    deferred.Reject(error.Value());
+  }
+
+  Napi::Promise GetPromise() const
+  {
+    return deferred.Promise();
+  }
+
+private:
+  Napi::Promise::Deferred deferred;
+  Napi::Reference<Napi::Buffer<uint8_t>> srcBuffer;
+  Napi::Reference<Napi::Buffer<uint8_t>> dstBuffer;
+  ReadDCPreviewProps props;
+  std::unique_ptr<JPEGLibError> jpegError;
+};
+
+Napi::Value ReadDCPreviewInner(Napi::CallbackInfo const& info, bool async)
+{
+  if (info.Length() < 1)
+  {
+    throw Napi::TypeError::New(info.Env(), "Not enough arguments");
+  }
+
+  if (!info[0].IsBuffer())
+  {
+    throw Napi::TypeError::New(info.Env(), "Invalid source buffer");
+  }
+  Napi::Buffer<uint8_t> srcBuffer = info[0].As<Napi::Buffer<uint8_t>>();
+
+  unsigned int offset = 0;
+  Napi::Buffer<uint8_t> dstBuffer;
+  if (info.Length() > 1 && info[1].IsBuffer())
+  {
+    dstBuffer = info[1].As<Napi::Buffer<uint8_t>>();
+    offset++;
+    if (dstBuffer.Length() == 0)
+    {
+      throw Napi::TypeError::New(info.Env(), "Invalid destination buffer");
+    }
+  }
+
+  ReadDCPreviewProps props = {};
+  props.format = NJT_DEFAULT_FORMAT;
+
+  if (info.Length() >= offset + 2 && !info[offset + 1].IsUndefined())
+  {
+    if (!info[offset + 1].IsObject())
+    {
+      throw Napi::TypeError::New(info.Env(), "Invalid options");
+    }
+    Napi::Object options = info[offset + 1].As<Napi::Object>();
+
+    Napi::Value tmpFormat = options.Get("format");
+    if (!tmpFormat.IsUndefined())
+    {
+      if (!tmpFormat.IsNumber())
+      {
+        throw Napi::TypeError::New(info.Env(), "Invalid format");
+      }
+      props.format = tmpFormat.As<Napi::Number>().Uint32Value();
+    }
+  }
+
+  props.bpp = BytesPerPixel(props.format);
+  if (props.bpp == 0)
+  {
+    throw Napi::TypeError::New(info.Env(), "Invalid output format");
+  }
+
+  // At 1/8 scale libjpeg only needs the DC coefficient of each block. The
+  // entropy decoder still has to parse the AC coefficients, but discards them
+  // rather than storing them, and the IDCT of a block is its scaled DC term.
+  props.handle = OpenDecompressHandle(srcBuffer.Data(), srcBuffer.ByteLength());
+  j_decompress_ptr cinfo = props.handle.cinfo();
+  cinfo->scale_num = 1;
+  cinfo->scale_denom = 8;
+  cinfo->out_color_space = FormatColorSpace(props.format);
+  jpeg_calc_output_dimensions(cinfo);
+  props.resWidth = static_cast<int>(cinfo->output_width);
+  props.resHeight = static_cast<int>(cinfo->output_height);
+  props.resSize = static_cast<std::size_t>(props.resWidth) * props.resHeight * props.bpp;
+
+  if (dstBuffer.IsEmpty())
+  {
+    dstBuffer = Napi::Buffer<uint8_t>::New(info.Env(), props.resSize);
+  }
+  else if (dstBuffer.Length() < props.resSize)
+  {
+    throw Napi::TypeError::New(info.Env(), "Insufficient output buffer");
+  }
+  props.resData = dstBuffer.Data();
+
+  if (async)
+  {
+    auto* wk = new ReadDCPreviewWorker(info.Env(), srcBuffer, dstBuffer, std::move(props));
+    wk->Queue();
+    return wk->GetPromise();
+  }
+  else
+  {
+    DoReadDCPreview(props);
+    return ReadDCPreviewResult(info.Env(), dstBuffer, props);
+  }
+}
+
+Napi::Value ReadDCPreviewAsync(Napi::CallbackInfo const& info)
+{
+  try {
+    return ReadDCPreviewInner(info, true);
+  } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(info.Env())
+}
+
+Napi::Value ReadDCPreviewSync(Napi::CallbackInfo const& info)
+{
+  try {
+    return ReadDCPreviewInner(info, false);
+  } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(info.Env())
+}
@@ -0,0 +1,9 @@
+#ifndef NODE_JPEGTURBO_READ_DC_PREVIEW_H
+#define NODE_JPEGTURBO_READ_DC_PREVIEW_H
+
+#include "util.h"
+
+Napi::Value ReadDCPreviewAsync(const Napi::CallbackInfo &info);
+Napi::Value ReadDCPreviewSync(const Napi::CallbackInfo &info);
+
+#endif
@@ -77,6 +77,7 @@ ReadDCTProps const& props)
     quants[i] = quant;
   }
   res.Set("qts", quants);
+  SetWarnings(env, res, props.handle.jerr()->warnings);
 
   return res;
 }
@@ -159,7 +160,14 @@ public:
   {
     try {
       DoReadDCT(this->props);
-    } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(Env())
+    }
+    catch (JPEGLibError const& e)
+    {
+      // JS values can't be created on this thread, so keep the code and
+      // warnings for OnError
+      this->jpegError.reset(new JPEGLibError(e));
+      SetError(e.what());
+    }
   }
 
   void OnOK()
@@ -171,6 +179,11 @@ public:
 
   void OnError(Napi::Error const& error)
   {
+    if (this->jpegError)
+    {
+      deferred.Reject(JPEGLibErrorToJS(Env(), *this->jpegError).Value());
+      return;
+    }
     deferred.Reject(error.Value());
   }
 
@@ -184,6 +197,7 @@ private:
   Napi::Reference<Napi::Buffer<uint8_t>> srcBuffer;
   Napi::Reference<Napi::Buffer<uint8_t>> dstBuffer;
   ReadDCTProps props;
+  std::unique_ptr<JPEGLibError> jpegError;
 };
 
 Napi::Value ReadDCTInner(Napi::CallbackInfo const& info, bool async)
@@ -201,14 +215,22 @@ Napi::Value ReadDCTInner(Napi::CallbackInfo const& info, bool async)
 
   bool bufferProvided = ((info.Length() > 1) && (info[1].IsBuffer()));
 
-  JDecompressHandle handle{};
-  SetupThrowingErrorManager(handle.jerr());
-  handle.cinfo()->err = handle.jerr();
-
-  jpeg_create_decompress(handle.cinfo());
+  WarningMode warningMode = WarningMode::Collect;
+  DecodeLimits limits;
+  std::size_t optionsIndex = bufferProvided ? 2 : 1;
+  if (info.Length() > optionsIndex && !info[optionsIndex].IsUndefined())
+  {
+    if (!info[optionsIndex].IsObject())
+    {
+      throw Napi::TypeError::New(info.Env(), "Invalid options");
+    }
+    Napi::Object options = info[optionsIndex].As<Napi::Object>();
+    warningMode = ParseWarningMode(info.Env(), options);
+    limits = ParseDecodeLimits(info.Env(), options);
+  }
 
-  jpeg_mem_src(handle.cinfo(), srcBuffer.Data(), srcBuffer.ByteLength());
-  jpeg_read_header(handle.cinfo(), true);
+  JDecompressHandle handle = OpenDecompressHandle(srcBuffer.Data(), srcBuffer.ByteLength(), warningMode);
+  ApplyDecodeLimits(handle, limits);
 
   ReadDCTProps props = {};
 
@@ -223,7 +245,7 @@ Napi::Value ReadDCTInner(Napi::CallbackInfo const& info, bool async)
     comp.width = compInfo.width_in_blocks;
     comp.height = compInfo.height_in_blocks;
     comp.dataOffsetBytes = bufLengthBytes;
-    comp.dataLengthElements = comp.height * comp.width * DCTSIZE2;
+    comp.dataLengthElements = static_cast<std::size_t>(comp.height) * comp.width * DCTSIZE2;
 
     bufLengthBytes += comp.dataLengthElements * sizeof(JCOEF);
   }
@@ -0,0 +1,108 @@
+#include "read_header.h"
+#include "markers.h"
+
+namespace
+{
+  // The TJSAMP_* value matching the sampling factors of the image
+  int HeaderSubsampling(j_decompress_ptr cinfo)
+  {
+    if (cinfo->num_components == 1)
+    {
+      return TJSAMP_GRAY;
+    }
+    if (cinfo->num_components != 3)
+    {
+      return TJSAMP_UNKNOWN;
+    }
+
+    jpeg_component_info const* comps = cinfo->comp_info;
+    for (int i = 1; i < 3; i++)
+    {
+      if (comps[i].h_samp_factor != 1 || comps[i].v_samp_factor != 1)
+      {
+        return TJSAMP_UNKNOWN;
+      }
+    }
+
+    int h = comps[0].h_samp_factor;
+    int v = comps[0].v_samp_factor;
+    if (h == 1 && v == 1) return TJSAMP_444;
+    if (h == 2 && v == 1) return TJSAMP_422;
+    if (h == 2 && v == 2) return TJSAMP_420;
+    if (h == 1 && v == 2) return TJSAMP_440;
+    if (h == 4 && v == 1) return TJSAMP_411;
+    if (h == 1 && v == 4) return TJSAMP_441;
+    return TJSAMP_UNKNOWN;
+  }
+}
+
+Napi::Value ReadHeader(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+
+  try
+  {
+    if (info.Length() < 1)
+    {
+      throw Napi::TypeError::New(env, "Not enough arguments");
+    }
+
+    if (!info[0].IsBuffer())
+    {
+      throw Napi::TypeError::New(env, "Invalid source buffer");
+    }
+    Napi::Buffer<uint8_t> srcBuffer = info[0].As<Napi::Buffer<uint8_t>>();
+
+    bool withMarkers = false;
+    WarningMode warningMode = WarningMode::Collect;
+    if (info.Length() >= 2 && !info[1].IsUndefined())
+    {
+      if (!info[1].IsObject())
+      {
+        throw Napi::TypeError::New(env, "Invalid options");
+      }
+      Napi::Object options = info[1].As<Napi::Object>();
+
+      Napi::Value tmpMarkers = options.Get("markers");
+      if (!tmpMarkers.IsUndefined())
+      {
+        if (!tmpMarkers.IsBoolean())
+        {
+          throw Napi::TypeError::New(env, "Invalid markers");
+        }
+        withMarkers = tmpMarkers.As<Napi::Boolean>().Value();
+      }
+
+      warningMode = ParseWarningMode(env, options);
+    }
+
+    MarkerRecorder recorder = {};
+    recorder.base = srcBuffer.Data();
+    recorder.length = srcBuffer.Length();
+
+    JDecompressHandle handle = CreateDecompressHandle(warningMode);
+    j_decompress_ptr cinfo = handle.cinfo();
+    jpeg_mem_src(cinfo, srcBuffer.Data(), srcBuffer.Length());
+    if (withMarkers)
+    {
+      RecordMarkerLocations(cinfo, recorder);
+    }
+    jpeg_read_header(cinfo, true);
+
+    Napi::Object res = Napi::Object::New(env);
+    res.Set("width", cinfo->image_width);
+    res.Set("height", cinfo->image_height);
+    res.Set("components", cinfo->num_components);
+    res.Set("subsampling", HeaderSubsampling(cinfo));
+    res.Set("progressive", static_cast<bool>(cinfo->progressive_mode));
+    res.Set("precision", cinfo->data_precision);
+    if (withMarkers)
+    {
+      res.Set("markers", MarkerLocationsResult(env, recorder.markers));
+    }
+    SetWarnings(env, res, handle.jerr()->warnings);
+
+    return res;
+  }
+  RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(env)
+}
@@ -0,0 +1,8 @@
+#ifndef NODE_JPEGTURBO_READ_HEADER_H
+#define NODE_JPEGTURBO_READ_HEADER_H
+
+#include "util.h"
+
+Napi::Value ReadHeader(const Napi::CallbackInfo &info);
+
+#endif
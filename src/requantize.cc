@@ -0,0 +1,339 @@
+#include "requantize.h"
+#include <algorithm>
+#include <cstdint>
+
+struct RequantizeProps
+{
+  JDecompressHandle handle;
+  RequantizeOptions options;
+  JMemDestination dest;
+};
+
+void WriteRequantized(j_decompress_ptr srcinfo, jvirt_barray_ptr* srcCoeffs,
+  RequantizeOptions const& options, JMemDestination& dest)
+{
+  JCompressHandle dstHandle = CreateCompressHandle();
+  auto& dstinfo = *dstHandle.cinfo();
+
+  jpeg_mem_dest(&dstinfo, &dest.data, &dest.size);
+  jpeg_copy_critical_parameters(srcinfo, &dstinfo);
+
+  if (options.quality > 0)
+  {
+    // jpeg_set_quality only fills in tables 0 (luma) and 1 (chroma)
+    jpeg_set_quality(&dstinfo, options.quality, true);
+    for (int ci = 0; ci < dstinfo.num_components; ++ci)
+    {
+      auto& compptr = dstinfo.comp_info[ci];
+      compptr.quant_tbl_no = std::min(compptr.quant_tbl_no, 1);
+    }
+  }
+  else
+  {
+    for (int i = 0; i < NUM_QUANT_TBLS; ++i)
+    {
+      if (options.tableProvided[i])
+      {
+        jpeg_add_quant_table(&dstinfo, i, options.tables[i].data(), 100, true);
+      }
+    }
+  }
+
+  // The coefficients can't be represented more precisely than they already
+  // are, so a finer table would only cost bytes
+  for (int ci = 0; ci < dstinfo.num_components; ++ci)
+  {
+    JQUANT_TBL* srcTable = srcinfo->comp_info[ci].quant_table;
+    JQUANT_TBL* dstTable = dstinfo.quant_tbl_ptrs[dstinfo.comp_info[ci].quant_tbl_no];
+    if (srcTable == nullptr || dstTable == nullptr)
+    {
+      throw std::runtime_error("Missing quantization table");
+    }
+
+    for (int k = 0; k < DCTSIZE2; ++k)
+    {
+      dstTable->quantval[k] = std::max(dstTable->quantval[k], srcTable->quantval[k]);
+    }
+  }
+
+  if (options.optimizeCoding)
+  {
+    dstinfo.optimize_coding = true;
+  }
+
+  // Request one block array per component, padded to whole MCUs the same way
+  // the coefficient controllers do
+  std::array<jvirt_barray_ptr, MAX_COMPONENTS> dstCoeffs{};
+  for (int ci = 0; ci < dstinfo.num_components; ++ci)
+  {
+    auto const& srcComp = srcinfo->comp_info[ci];
+    JDIMENSION width = (srcComp.width_in_blocks + srcComp.h_samp_factor - 1)
+      / srcComp.h_samp_factor * srcComp.h_samp_factor;
+    JDIMENSION height = (srcComp.height_in_blocks + srcComp.v_samp_factor - 1)
+      / srcComp.v_samp_factor * srcComp.v_samp_factor;
+
+    dstCoeffs[ci] = (*dstinfo.mem->request_virt_barray)(asJCommon(&dstinfo),
+      JPOOL_IMAGE, true, width, height, srcComp.v_samp_factor);
+  }
+
+  // This realizes the block arrays; nothing is emitted before jpeg_finish_compress
+  jpeg_write_coefficients(&dstinfo, dstCoeffs.data());
+
+  for (int ci = 0; ci < dstinfo.num_components; ++ci)
+  {
+    auto const& srcComp = srcinfo->comp_info[ci];
+    UINT16 const* oldQ = srcComp.quant_table->quantval;
+    UINT16 const* newQ = dstinfo.quant_tbl_ptrs[dstinfo.comp_info[ci].quant_tbl_no]->quantval;
+
+    for (JDIMENSION row = 0; row < srcComp.height_in_blocks; ++row)
+    {
+      JBLOCKROW srcRow = *(*srcinfo->mem->access_virt_barray)(asJCommon(srcinfo),
+        srcCoeffs[ci], row, 1, false);
+      JBLOCKROW dstRow = *(*dstinfo.mem->access_virt_barray)(asJCommon(&dstinfo),
+        dstCoeffs[ci], row, 1, true);
+
+      for (JDIMENSION col = 0; col < srcComp.width_in_blocks; ++col)
+      {
+        JCOEF const* in = srcRow[col];
+        JCOEF* out = dstRow[col];
+        for (int k = 0; k < DCTSIZE2; ++k)
+        {
+          // Dequantize, then quantize again rounding half away from zero
+          int32_t value = static_cast<int32_t>(in[k]) * oldQ[k];
+          int32_t q = newQ[k];
+          out[k] = static_cast<JCOEF>(value >= 0 ? (value + q / 2) / q : -((-value + q / 2) / q));
+        }
+      }
+    }
+  }
+
+  jpeg_finish_compress(&dstinfo);
+}
+
+void DoRequantize(RequantizeProps& props)
+{
+  auto& cinfo = *props.handle.cinfo();
+  jvirt_barray_ptr* coeffs = jpeg_read_coefficients(&cinfo);
+
+  WriteRequantized(&cinfo, coeffs, props.options, props.dest);
+
+  jpeg_finish_decompress(&cinfo);
+}
+
+class RequantizeWorker : public Napi::AsyncWorker
+{
+public:
+  RequantizeWorker(
+      Napi::Env const& env,
+      Napi::Buffer<uint8_t>& srcBuffer,
+      RequantizeProps&& props)
+      : AsyncWorker(env),
+        deferred(Napi::Promise::Deferred::New(env)),
+        srcBuffer(Napi::Reference<Napi::Buffer<uint8_t>>::New(srcBuffer, 1)),
+        props(std::move(props))
+  {
+  }
+
+  ~RequantizeWorker()
+  {
+    this->srcBuffer.Reset();
+  }
+
+  void Execute()
+  {
+    try {
+      DoRequantize(this->props);
+    } catch (JPEGLibError const& e) {
+      // JS values can't be created on this thread, so keep the code and
+      // warnings for OnError
+      this->jpegError.reset(new JPEGLibError(e));
+      SetError(e.what());
+    } catch (std::exception const& e) {
+      SetError(e.what());
+    }
+  }
+
+  void OnOK()
+  {
+    try {
+      deferred.Resolve(TakeBuffer(Env(), this->props.dest));
+    } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(Env())
+  }
+
+  void OnError(Napi::Error const& error)
+  {
+    if (this->jpegError)
+    {
+      deferred.Reject(JPEGLibErrorToJS(Env(), *this->jpegError).Value());
+      return;
+    }
+    deferred.Reject(error.Value());
+  }
+
+  Napi::Promise GetPromise() const
+  {
+    return deferred.Promise();
+  }
+
+private:
+  Napi::Promise::Deferred deferred;
+  Napi::Reference<Napi::Buffer<uint8_t>> srcBuffer;
+  RequantizeProps props;
+  std::unique_ptr<JPEGLibError> jpegError;
+};
+
+void ParseQuantTable(Napi::Env const& env, Napi::Value const& value, std::array<unsigned int, DCTSIZE2>& table)
+{
+  if (value.IsTypedArray())
+  {
+    auto typed = value.As<Napi::TypedArray>();
+    if (typed.TypedArrayType() != napi_uint16_array || typed.ElementLength() != DCTSIZE2)
+    {
+      throw Napi::TypeError::New(env, "Invalid quantization table");
+    }
+    auto values = value.As<Napi::Uint16Array>();
+    for (int k = 0; k < DCTSIZE2; ++k)
+    {
+      table[k] = values[k];
+    }
+  }
+  else if (value.IsArray())
+  {
+    auto values = value.As<Napi::Array>();
+    if (values.Length() != DCTSIZE2)
+    {
+      throw Napi::TypeError::New(env, "Invalid quantization table");
+    }
+    for (uint32_t k = 0; k < DCTSIZE2; ++k)
+    {
+      Napi::Value entry = values.Get(k);
+      if (!entry.IsNumber())
+      {
+        throw Napi::TypeError::New(env, "Invalid quantization table");
+      }
+      table[k] = entry.As<Napi::Number>().Uint32Value();
+    }
+  }
+  else
+  {
+    throw Napi::TypeError::New(env, "Invalid quantization table");
+  }
+
+  for (int k = 0; k < DCTSIZE2; ++k)
+  {
+    if (table[k] == 0 || table[k] > 255)
+    {
+      throw Napi::TypeError::New(env, "Invalid quantization table");
+    }
+  }
+}
+
+Napi::Value RequantizeInner(Napi::CallbackInfo const& info, bool async)
+{
+  if (info.Length() < 2)
+  {
+    throw Napi::TypeError::New(info.Env(), "Not enough arguments");
+  }
+
+  if (!info[0].IsBuffer())
+  {
+    throw Napi::TypeError::New(info.Env(), "Invalid source buffer");
+  }
+  Napi::Buffer<uint8_t> srcBuffer = info[0].As<Napi::Buffer<uint8_t>>();
+
+  if (!info[1].IsObject())
+  {
+    throw Napi::TypeError::New(info.Env(), "Invalid options");
+  }
+  Napi::Object options = info[1].As<Napi::Object>();
+
+  RequantizeProps props = {};
+
+  Napi::Value tmpQuality = options.Get("quality");
+  Napi::Value tmpQuantTables = options.Get("quantTables");
+  if (!tmpQuality.IsUndefined())
+  {
+    if (!tmpQuality.IsNumber() || !tmpQuantTables.IsUndefined())
+    {
+      throw Napi::TypeError::New(info.Env(), "Invalid quality");
+    }
+    props.options.quality = tmpQuality.As<Napi::Number>().Int32Value();
+    if (props.options.quality <= 0 || props.options.quality > 100)
+    {
+      throw Napi::TypeError::New(info.Env(), "Invalid quality");
+    }
+  }
+  else
+  {
+    if (!tmpQuantTables.IsArray())
+    {
+      throw Napi::TypeError::New(info.Env(), "Invalid quantTables");
+    }
+    Napi::Array quantTables = tmpQuantTables.As<Napi::Array>();
+    if (quantTables.Length() == 0 || quantTables.Length() > NUM_QUANT_TBLS)
+    {
+      throw Napi::TypeError::New(info.Env(), "Invalid quantTables");
+    }
+
+    for (uint32_t i = 0; i < quantTables.Length(); ++i)
+    {
+      Napi::Value table = quantTables.Get(i);
+      if (table.IsNull() || table.IsUndefined())
+      {
+        continue;
+      }
+      ParseQuantTable(info.Env(), table, props.options.tables[i]);
+      props.options.tableProvided[i] = true;
+    }
+  }
+
+  Napi::Value tmpOptimize = options.Get("optimizeHuffman");
+  if (!tmpOptimize.IsUndefined())
+  {
+    if (!tmpOptimize.IsBoolean())
+    {
+      throw Napi::TypeError::New(info.Env(), "Invalid optimizeHuffman");
+    }
+    props.options.optimizeCoding = tmpOptimize.As<Napi::Boolean>().Value();
+  }
+
+  props.handle = OpenDecompressHandle(srcBuffer.Data(), srcBuffer.ByteLength());
+
+  // Every component needs a table to be quantized with
+  if (props.options.quality == 0)
+  {
+    for (int ci = 0; ci < props.handle.cinfo()->num_components; ++ci)
+    {
+      if (!props.options.tableProvided[props.handle.cinfo()->comp_info[ci].quant_tbl_no])
+      {
+        throw Napi::TypeError::New(info.Env(), "Missing quantization table");
+      }
+    }
+  }
+
+  if (async)
+  {
+    auto* wk = new RequantizeWorker(info.Env(), srcBuffer, std::move(props));
+    wk->Queue();
+    return wk->GetPromise();
+  }
+  else
+  {
+    DoRequantize(props);
+    return TakeBuffer(info.Env(), props.dest);
+  }
+}
+
+Napi::Value RequantizeAsync(Napi::CallbackInfo const& info)
+{
+  try {
+    return RequantizeInner(info, true);
+  } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(info.Env())
+}
+
+Napi::Value RequantizeSync(Napi::CallbackInfo const& info)
+{
+  try {
+    return RequantizeInner(info, false);
+  } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(info.Env())
+}
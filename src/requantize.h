@@ -0,0 +1,26 @@
+#ifndef NODE_JPEGTURBO_REQUANTIZE_H
+#define NODE_JPEGTURBO_REQUANTIZE_H
+
+#include "util.h"
+#include <array>
+
+struct RequantizeOptions
+{
+  // Standard tables scaled to this quality, or 0 to use the tables below
+  int quality;
+  std::array<std::array<unsigned int, DCTSIZE2>, NUM_QUANT_TBLS> tables;
+  std::array<bool, NUM_QUANT_TBLS> tableProvided;
+  bool optimizeCoding;
+};
+
+// Entropy-code the coefficients of a decompressor (as returned by
+// jpeg_read_coefficients) into a new JPEG, rescaled to new quantization
+// tables. The source coefficients are left untouched. Tables are never made
+// finer than the ones the coefficients were quantized with.
+void WriteRequantized(j_decompress_ptr srcinfo, jvirt_barray_ptr* srcCoeffs,
+  RequantizeOptions const& options, JMemDestination& dest);
+
+Napi::Value RequantizeAsync(const Napi::CallbackInfo &info);
+Napi::Value RequantizeSync(const Napi::CallbackInfo &info);
+
+#endif
@@ -0,0 +1,129 @@
+#include "resample.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+  struct Contribution
+  {
+    int first;
+    std::vector<float> weights;
+  };
+
+  // For every output sample, work out which input samples it covers and by
+  // how much. The weights of each output sample add up to 1.
+  std::vector<Contribution> AreaContributions(int srcSize, int dstSize)
+  {
+    std::vector<Contribution> res(dstSize);
+    double scale = static_cast<double>(srcSize) / dstSize;
+
+    for (int i = 0; i < dstSize; ++i)
+    {
+      double start = i * scale;
+      double end = std::min<double>((i + 1) * scale, srcSize);
+      int first = static_cast<int>(std::floor(start));
+      int last = std::min(static_cast<int>(std::ceil(end)), srcSize);
+
+      Contribution& c = res[i];
+      c.first = first;
+      for (int j = first; j < last; ++j)
+      {
+        double overlap = std::min<double>(j + 1, end) - std::max<double>(j, start);
+        c.weights.push_back(static_cast<float>(overlap / scale));
+      }
+    }
+
+    return res;
+  }
+}
+
+void DownsampleArea(
+  uint8_t const* src, int srcWidth, int srcHeight, std::size_t srcPitch,
+  uint8_t* dst, int dstWidth, int dstHeight, std::size_t dstPitch,
+  int channels)
+{
+  if (dstWidth == srcWidth && dstHeight == srcHeight)
+  {
+    for (int y = 0; y < dstHeight; ++y)
+    {
+      memcpy(dst + y * dstPitch, src + y * srcPitch, static_cast<std::size_t>(dstWidth) * channels);
+    }
+    return;
+  }
+
+  std::vector<Contribution> rows = AreaContributions(srcHeight, dstHeight);
+  std::vector<Contribution> cols = AreaContributions(srcWidth, dstWidth);
+
+  // Filter vertically into a single row of accumulators, then horizontally
+  // into the destination row, so only one source-width row of floats is live.
+  std::vector<float> acc(static_cast<std::size_t>(srcWidth) * channels);
+
+  for (int y = 0; y < dstHeight; ++y)
+  {
+    std::fill(acc.begin(), acc.end(), 0.0f);
+
+    Contribution const& row = rows[y];
+    for (std::size_t k = 0; k < row.weights.size(); ++k)
+    {
+      uint8_t const* in = src + (row.first + k) * srcPitch;
+      float w = row.weights[k];
+      for (std::size_t i = 0; i < acc.size(); ++i)
+      {
+        acc[i] += in[i] * w;
+      }
+    }
+
+    uint8_t* out = dst + y * dstPitch;
+    for (int x = 0; x < dstWidth; ++x)
+    {
+      Contribution const& col = cols[x];
+      for (int ch = 0; ch < channels; ++ch)
+      {
+        float sum = 0.0f;
+        for (std::size_t k = 0; k < col.weights.size(); ++k)
+        {
+          sum += acc[(col.first + k) * channels + ch] * col.weights[k];
+        }
+        out[x * channels + ch] = static_cast<uint8_t>(std::min(255.0f, sum + 0.5f));
+      }
+    }
+  }
+}
+
+void ResampleArea(
+  float const* src, int srcWidth, int srcHeight,
+  float* dst, int dstWidth, int dstHeight)
+{
+  std::vector<Contribution> rows = AreaContributions(srcHeight, dstHeight);
+  std::vector<Contribution> cols = AreaContributions(srcWidth, dstWidth);
+  std::vector<float> acc(srcWidth);
+
+  for (int y = 0; y < dstHeight; ++y)
+  {
+    std::fill(acc.begin(), acc.end(), 0.0f);
+
+    Contribution const& row = rows[y];
+    for (std::size_t k = 0; k < row.weights.size(); ++k)
+    {
+      float const* in = src + (row.first + k) * srcWidth;
+      float w = row.weights[k];
+      for (int i = 0; i < srcWidth; ++i)
+      {
+        acc[i] += in[i] * w;
+      }
+    }
+
+    for (int x = 0; x < dstWidth; ++x)
+    {
+      Contribution const& col = cols[x];
+      float sum = 0.0f;
+      for (std::size_t k = 0; k < col.weights.size(); ++k)
+      {
+        sum += acc[col.first + k] * col.weights[k];
+      }
+      dst[y * dstWidth + x] = sum;
+    }
+  }
+}
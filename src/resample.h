@@ -0,0 +1,21 @@
+#ifndef NODE_JPEGTURBO_RESAMPLE_H
+#define NODE_JPEGTURBO_RESAMPLE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Shrink an interleaved 8-bit image using an area-averaging (box) filter.
+// The destination must not be larger than the source in either dimension.
+// Pitches are in bytes.
+void DownsampleArea(
+  uint8_t const* src, int srcWidth, int srcHeight, std::size_t srcPitch,
+  uint8_t* dst, int dstWidth, int dstHeight, std::size_t dstPitch,
+  int channels);
+
+// Resize a single-channel float image by averaging the area of the source
+// covered by each destination sample. Works for both shrinking and enlarging.
+void ResampleArea(
+  float const* src, int srcWidth, int srcHeight,
+  float* dst, int dstWidth, int dstHeight);
+
+#endif
@@ -1,8 +1,11 @@
 #include "util.h"
+#include <algorithm>
+#include <limits>
 #include <type_traits>
 
 extern "C" {
   #include <jpegint.h> // CSTATE_START, DSTATE_START
+  #include <jerror.h>
 }
 
 BufferSizeOptions ParseBufferSizeOptions(const Napi::Env &env, const Napi::Object &options)
@@ -48,7 +51,190 @@ BufferSizeOptions ParseBufferSizeOptions(const Napi::Env &env, const Napi::Objec
     return BufferSizeOptions{false};
   }
 
-  return BufferSizeOptions{true, width, height, subsampling};
+  Napi::Value tmpLossless = options.Get("lossless");
+  bool lossless = !tmpLossless.IsUndefined() && tmpLossless.ToBoolean().Value();
+
+  int precision = 8;
+  Napi::Value tmpPrecision = options.Get("precision");
+  if (!tmpPrecision.IsUndefined())
+  {
+    if (!tmpPrecision.IsNumber())
+    {
+      Napi::TypeError::New(env, "Invalid precision").ThrowAsJavaScriptException();
+      return BufferSizeOptions{false};
+    }
+    precision = tmpPrecision.As<Napi::Number>().Int32Value();
+  }
+
+  // TurboJPEG only supports 16-bit data for lossless JPEG
+  if ((precision != 8 && precision != 12 && precision != 16) || (precision == 16 && !lossless))
+  {
+    Napi::TypeError::New(env, "Invalid precision").ThrowAsJavaScriptException();
+    return BufferSizeOptions{false};
+  }
+
+  return BufferSizeOptions{true, width, height, subsampling, precision, lossless};
+}
+
+std::size_t JPEGBufferSize(BufferSizeOptions const& options)
+{
+  if (options.precision == 8 && !options.lossless)
+  {
+    return tjBufSize(options.width, options.height, options.subsampling);
+  }
+
+  // A Huffman code (at most 16 bits) and the extra bits of a coefficient or
+  // sample difference (at most 16) take at most 4 bytes per sample. Byte
+  // stuffing can then add a 0x00 after every one of those bytes. 2048 bytes
+  // covers the headers: 16-bit quantization tables and four full Huffman
+  // tables.
+  std::size_t samples = static_cast<std::size_t>((options.width + 15) & ~15u)
+    * ((options.height + 15) & ~15u)
+    * (options.subsampling == TJSAMP_GRAY ? 1 : 3);
+  return samples * 4 * 2 + 2048;
+}
+
+bool SamplesFitPrecision(uint16_t const* data, uint32_t width, uint32_t height, uint32_t pitch, int precision)
+{
+  if (precision >= 16)
+  {
+    return true;
+  }
+
+  uint16_t maxSample = static_cast<uint16_t>((1u << precision) - 1);
+  for (uint32_t y = 0; y < height; y++)
+  {
+    uint16_t const* row = data + static_cast<std::size_t>(y) * pitch;
+    uint16_t rowMax = 0;
+    for (uint32_t x = 0; x < width; x++)
+    {
+      rowMax = std::max(rowMax, row[x]);
+    }
+    if (rowMax > maxSample)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+int BytesPerPixel(uint32_t format)
+{
+  switch (format)
+  {
+  case TJPF_GRAY:
+    return 1;
+  case TJPF_RGB:
+  case TJPF_BGR:
+    return 3;
+  case TJPF_RGBX:
+  case TJPF_BGRX:
+  case TJPF_XRGB:
+  case TJPF_XBGR:
+  case TJPF_RGBA:
+  case TJPF_BGRA:
+  case TJPF_ABGR:
+  case TJPF_ARGB:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+J_COLOR_SPACE FormatColorSpace(uint32_t format)
+{
+  switch (format)
+  {
+  case TJPF_GRAY:
+    return JCS_GRAYSCALE;
+  case TJPF_RGB:
+    return JCS_EXT_RGB;
+  case TJPF_BGR:
+    return JCS_EXT_BGR;
+  case TJPF_RGBX:
+    return JCS_EXT_RGBX;
+  case TJPF_BGRX:
+    return JCS_EXT_BGRX;
+  case TJPF_XRGB:
+    return JCS_EXT_XRGB;
+  case TJPF_XBGR:
+    return JCS_EXT_XBGR;
+  case TJPF_RGBA:
+    return JCS_EXT_RGBA;
+  case TJPF_BGRA:
+    return JCS_EXT_BGRA;
+  case TJPF_ABGR:
+    return JCS_EXT_ABGR;
+  case TJPF_ARGB:
+    return JCS_EXT_ARGB;
+  default:
+    return JCS_UNKNOWN;
+  }
+}
+
+WarningMode ParseWarningMode(Napi::Env const& env, Napi::Object const& options)
+{
+  Napi::Value tmpWarnings = options.Get("warnings");
+  if (tmpWarnings.IsUndefined())
+  {
+    return WarningMode::Collect;
+  }
+
+  if (tmpWarnings.IsString())
+  {
+    std::string mode = tmpWarnings.As<Napi::String>().Utf8Value();
+    if (mode == "collect")
+    {
+      return WarningMode::Collect;
+    }
+    if (mode == "ignore")
+    {
+      return WarningMode::Ignore;
+    }
+    if (mode == "fatal")
+    {
+      return WarningMode::Fatal;
+    }
+  }
+
+  throw Napi::TypeError::New(env, "Invalid warnings");
+}
+
+void SetWarnings(Napi::Env const& env, Napi::Object& obj, JWarnings const& warnings)
+{
+  auto messages = Napi::Array::New(env, warnings.messages.size());
+  for (std::size_t i = 0; i < warnings.messages.size(); i++)
+  {
+    messages[i] = Napi::String::New(env, warnings.messages[i]);
+  }
+  obj.Set("warnings", messages);
+  obj.Set("warningCount", warnings.count);
+}
+
+JPEGLibError::JPEGLibError(std::string const& message, char const* code, JWarnings warnings)
+  : std::runtime_error(message), codeName(code), priorWarnings(std::move(warnings))
+{}
+
+Napi::Error JPEGLibErrorToJS(Napi::Env const& env, JPEGLibError const& e)
+{
+  Napi::Error error = Napi::Error::New(env, e.what());
+  Napi::Object obj = error.Value();
+  obj.Set("code", e.code());
+  SetWarnings(env, obj, e.warnings());
+  return error;
+}
+
+// The names of libjpeg's message codes, in the same order as J_MESSAGE_CODE
+static char const* const jpegMessageCodeNames[] = {
+#define JMESSAGE(code, string) #code ,
+#include <jerror.h>
+  nullptr
+};
+
+static char const* JPEGMessageCodeName(int code)
+{
+  constexpr int numCodes = sizeof(jpegMessageCodeNames) / sizeof(jpegMessageCodeNames[0]) - 1;
+  return (code >= 0 && code < numCodes) ? jpegMessageCodeNames[code] : "JERR_UNKNOWN";
 }
 
 #define ADDITIONAL_MESSAGE "jpeglib exited with an error: "
@@ -56,19 +242,136 @@ static constexpr std::size_t ADDITIONAL_MESSAGE_LENGTH = sizeof(ADDITIONAL_MESSA
 
 NAPI_NO_RETURN void ErrorExitThrow(j_common_ptr cinfo)
 {
+  auto* err = static_cast<JErrorManager*>(cinfo->err);
+
   char buffer[ADDITIONAL_MESSAGE_LENGTH + JMSG_LENGTH_MAX] = ADDITIONAL_MESSAGE;
-  (*cinfo->err->format_message) (cinfo, buffer + ADDITIONAL_MESSAGE_LENGTH);
-  fprintf(stderr, "%s\n", buffer + ADDITIONAL_MESSAGE_LENGTH);
+  (*err->format_message) (cinfo, buffer + ADDITIONAL_MESSAGE_LENGTH);
+  JPEGLibError error{buffer, JPEGMessageCodeName(err->msg_code), std::move(err->warnings)};
 
   abortAndDestroy(cinfo);
 
-  throw JPEGLibError{buffer};
+  throw error;
 }
 
-void SetupThrowingErrorManager(jpeg_error_mgr * err)
+// Replaces libjpeg's emit_message, which writes warnings to stderr. Trace
+// messages (msg_level >= 0) are dropped.
+void EmitMessageCollect(j_common_ptr cinfo, int msg_level)
+{
+  if (msg_level >= 0)
+  {
+    return;
+  }
+
+  auto* err = static_cast<JErrorManager*>(cinfo->err);
+  if (err->msg_code == JWRN_JPEG_EOF)
+  {
+    err->endOfInput = true;
+  }
+
+  if (err->warningMode == WarningMode::Fatal)
+  {
+    (*err->error_exit) (cinfo);
+  }
+
+  err->num_warnings++;
+  err->warnings.count++;
+  if (err->warningMode == WarningMode::Collect
+    && err->warnings.messages.size() < JWarnings::MAX_MESSAGES)
+  {
+    char buffer[JMSG_LENGTH_MAX];
+    (*err->format_message) (cinfo, buffer);
+    err->warnings.messages.emplace_back(buffer);
+  }
+}
+
+void SetupThrowingErrorManager(JErrorManager * err)
 {
   jpeg_std_error(err);
   err->error_exit = ErrorExitThrow;
+  err->emit_message = EmitMessageCollect;
+}
+
+namespace
+{
+  // Reads limits.<name>, a non-negative integer, into value
+  void ParseLimit(Napi::Env const& env, Napi::Object const& limits, char const* name, uint64_t& value)
+  {
+    Napi::Value tmp = limits.Get(name);
+    if (tmp.IsUndefined())
+    {
+      return;
+    }
+    if (!tmp.IsNumber())
+    {
+      throw Napi::TypeError::New(env, "Invalid limits");
+    }
+
+    // Anything from 2^53 up isn't an exact integer anyway
+    double number = tmp.As<Napi::Number>().DoubleValue();
+    if (!(number >= 0 && number < 9007199254740992.0) || number != static_cast<double>(static_cast<uint64_t>(number)))
+    {
+      throw Napi::TypeError::New(env, "Invalid limits");
+    }
+    value = static_cast<uint64_t>(number);
+  }
+
+  // libjpeg calls this between passes, and for every scan while it buffers a
+  // multi-scan image, so a file made of many tiny scans is caught early
+  void ProgressLimitScans(j_common_ptr cinfo)
+  {
+    auto* err = static_cast<JErrorManager*>(cinfo->err);
+    if (cinfo->is_decompressor
+      && reinterpret_cast<j_decompress_ptr>(cinfo)->input_scan_number > err->maxScans)
+    {
+      throw JPEGLibError("Image has more than " + std::to_string(err->maxScans) + " scans",
+        LIMIT_EXCEEDED_CODE, err->warnings);
+    }
+  }
+}
+
+DecodeLimits ParseDecodeLimits(Napi::Env const& env, Napi::Object const& options)
+{
+  DecodeLimits limits;
+
+  Napi::Value tmpLimits = options.Get("limits");
+  if (tmpLimits.IsUndefined())
+  {
+    return limits;
+  }
+  if (!tmpLimits.IsObject())
+  {
+    throw Napi::TypeError::New(env, "Invalid limits");
+  }
+  Napi::Object object = tmpLimits.As<Napi::Object>();
+
+  uint64_t maxScans = 0;
+  ParseLimit(env, object, "maxPixels", limits.maxPixels);
+  ParseLimit(env, object, "maxDimension", limits.maxDimension);
+  ParseLimit(env, object, "maxScans", maxScans);
+  ParseLimit(env, object, "maxMemory", limits.maxMemory);
+  if (maxScans > INT32_MAX)
+  {
+    throw Napi::TypeError::New(env, "Invalid limits");
+  }
+  limits.maxScans = static_cast<int>(maxScans);
+
+  return limits;
+}
+
+void CheckImageLimits(DecodeLimits const& limits, uint64_t width, uint64_t height)
+{
+  if (limits.maxDimension > 0 && (width > limits.maxDimension || height > limits.maxDimension))
+  {
+    throw JPEGLibError("Image dimensions " + std::to_string(width) + "x" + std::to_string(height)
+      + " exceed maxDimension", LIMIT_EXCEEDED_CODE, JWarnings{});
+  }
+
+  // Both are at most 65535 (JPEG_MAX_DIMENSION), so this can't overflow
+  if (limits.maxPixels > 0 && width * height > limits.maxPixels)
+  {
+    throw JPEGLibError("Image has " + std::to_string(width * height) + " pixels, more than maxPixels",
+      LIMIT_EXCEEDED_CODE, JWarnings{});
+  }
 }
 
 namespace internal
@@ -102,13 +405,13 @@ namespace internal
   }
 
   template<typename C_OR_D>
-  jpeg_error_mgr * JHandle<C_OR_D>::jerr()
+  JErrorManager * JHandle<C_OR_D>::jerr()
   {
     return &this->data->jerr;
   }
 
   template<typename C_OR_D>
-  jpeg_error_mgr const * JHandle<C_OR_D>::jerr() const
+  JErrorManager const * JHandle<C_OR_D>::jerr() const
   {
     return &this->data->jerr;
   }
@@ -118,6 +421,113 @@ namespace internal
   template class JHandle<jpeg_decompress_struct>;
 } // namespace internal
 
+JCompressHandle CreateCompressHandle()
+{
+  JCompressHandle handle{};
+  SetupThrowingErrorManager(handle.jerr());
+  handle.cinfo()->err = handle.jerr();
+
+  jpeg_create_compress(handle.cinfo());
+
+  return handle;
+}
+
+JMemDestination::~JMemDestination()
+{
+  free(this->data);
+}
+
+JMemDestination::JMemDestination(JMemDestination&& other)
+  : data(other.data), size(other.size)
+{
+  other.data = nullptr;
+  other.size = 0;
+}
+
+JMemDestination& JMemDestination::operator=(JMemDestination&& other)
+{
+  std::swap(this->data, other.data);
+  std::swap(this->size, other.size);
+  return *this;
+}
+
+Napi::Buffer<uint8_t> TakeBuffer(Napi::Env const& env, JMemDestination& dest)
+{
+  auto res = Napi::Buffer<uint8_t>::New(env, dest.data, dest.size,
+    [](Napi::Env, uint8_t* data) { free(data); });
+  dest.data = nullptr;
+  dest.size = 0;
+  return res;
+}
+
+BufferReferences::~BufferReferences()
+{
+  for (auto& reference : this->references)
+  {
+    reference.Reset();
+  }
+}
+
+void BufferReferences::Add(Napi::Value const& buffer)
+{
+  this->references.push_back(Napi::Reference<Napi::Value>::New(buffer, 1));
+}
+
+JDecompressHandle CreateDecompressHandle(WarningMode warningMode)
+{
+  JDecompressHandle handle{};
+  SetupThrowingErrorManager(handle.jerr());
+  handle.jerr()->warningMode = warningMode;
+  handle.cinfo()->err = handle.jerr();
+
+  jpeg_create_decompress(handle.cinfo());
+
+  return handle;
+}
+
+JDecompressHandle OpenDecompressHandle(uint8_t const* data, std::size_t length,
+  WarningMode warningMode, uint8_t const* tables, std::size_t tablesLength)
+{
+  JDecompressHandle handle = CreateDecompressHandle(warningMode);
+
+  // The tables stay loaded until the handle is destroyed. A complete image
+  // has to be aborted to get back to the start state.
+  if (tables != nullptr)
+  {
+    jpeg_mem_src(handle.cinfo(), tables, tablesLength);
+    if (jpeg_read_header(handle.cinfo(), false) == JPEG_HEADER_OK)
+    {
+      jpeg_abort_decompress(handle.cinfo());
+    }
+  }
+
+  jpeg_mem_src(handle.cinfo(), data, length);
+  jpeg_read_header(handle.cinfo(), true);
+
+  return handle;
+}
+
+void ApplyDecodeLimits(JDecompressHandle& handle, DecodeLimits const& limits)
+{
+  j_decompress_ptr cinfo = handle.cinfo();
+  CheckImageLimits(limits, cinfo->image_width, cinfo->image_height);
+
+  if (limits.maxMemory > 0)
+  {
+    cinfo->mem->max_memory_to_use = static_cast<long>(
+      std::min<uint64_t>(limits.maxMemory, std::numeric_limits<long>::max()));
+  }
+
+  if (limits.maxScans > 0)
+  {
+    JErrorManager* jerr = handle.jerr();
+    jerr->maxScans = limits.maxScans;
+    jerr->progress = {};
+    jerr->progress.progress_monitor = ProgressLimitScans;
+    cinfo->progress = &jerr->progress;
+  }
+}
+
 void abortAndDestroy(j_common_ptr cinfo)
 {
     // If cinfo has already been destroyed, return
@@ -3,6 +3,8 @@
 
 #include <napi.h>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 #include <turbojpeg.h>
 extern "C" {
@@ -18,19 +20,111 @@ struct BufferSizeOptions
   uint32_t width;
   uint32_t height;
   uint32_t subsampling;
+  int precision;
+  bool lossless;
 };
 
 BufferSizeOptions ParseBufferSizeOptions(const Napi::Env &env, const Napi::Object &obj);
 
+// Worst case size of a JPEG image encoded with the given options
+std::size_t JPEGBufferSize(BufferSizeOptions const& options);
+
+// Whether every sample of a width x height region (in samples, with rows pitch
+// samples apart) is below 2^precision. TurboJPEG doesn't check, and indexes
+// its tables with the samples.
+bool SamplesFitPrecision(uint16_t const* data, uint32_t width, uint32_t height, uint32_t pitch, int precision);
+
+// Bytes per pixel of a TJPF_* format, or 0 if the format isn't supported
+int BytesPerPixel(uint32_t format);
+
+// The libjpeg output color space for a TJPF_* format, or JCS_UNKNOWN if the
+// format isn't supported
+J_COLOR_SPACE FormatColorSpace(uint32_t format);
+
+// What to do with libjpeg warnings (e.g. corrupt data that could be skipped)
+enum class WarningMode
+{
+  Collect,
+  Ignore,
+  Fatal,
+};
+
+// Parse options.warnings ('collect', 'ignore' or 'fatal'). Throws a
+// Napi::TypeError if it is invalid.
+WarningMode ParseWarningMode(Napi::Env const& env, Napi::Object const& options);
+
+// The warnings of one libjpeg call. A corrupt image can produce any number of
+// warnings, so only the first few messages are kept.
+struct JWarnings
+{
+  static constexpr std::size_t MAX_MESSAGES = 16;
+
+  std::vector<std::string> messages;
+  unsigned long count = 0;
+};
+
+// Add warnings and warningCount properties to a result
+void SetWarnings(Napi::Env const& env, Napi::Object& obj, JWarnings const& warnings);
+
+// libjpeg error manager that collects warnings instead of writing them to
+// stderr, and throws a JPEGLibError on errors
+struct JErrorManager : jpeg_error_mgr
+{
+  WarningMode warningMode = WarningMode::Collect;
+  JWarnings warnings;
+  // Set when the data ran out (JWRN_JPEG_EOF). libjpeg then makes up the
+  // rest of the image.
+  bool endOfInput = false;
+  // Progress monitor enforcing DecodeLimits::maxScans, see ApplyDecodeLimits
+  jpeg_progress_mgr progress;
+  int maxScans = 0;
+};
+
 #ifndef NAPI_CPP_EXCEPTIONS
 #error "NAPI C++ exception support must be enabled"
 #endif
 class JPEGLibError : public std::runtime_error
 {
-  using std::runtime_error::runtime_error;
+public:
+  JPEGLibError(std::string const& message, char const* code, JWarnings warnings);
+
+  // Name of the libjpeg message code, e.g. "JERR_BAD_HUFF_TABLE"
+  char const* code() const { return this->codeName; }
+  // Warnings emitted before the error
+  JWarnings const& warnings() const { return this->priorWarnings; }
+
+private:
+  char const* codeName;
+  JWarnings priorWarnings;
+};
+
+// A JS Error with the message of e, and code, warnings and warningCount
+// properties
+Napi::Error JPEGLibErrorToJS(Napi::Env const& env, JPEGLibError const& e);
+
+void SetupThrowingErrorManager(JErrorManager * err);
+
+// Limits on what a single decode may use, to guard against decompression
+// bombs. 0 means no limit.
+struct DecodeLimits
+{
+  uint64_t maxPixels = 0;
+  uint64_t maxDimension = 0;
+  int maxScans = 0;
+  // Bytes that libjpeg may allocate (max_memory_to_use)
+  uint64_t maxMemory = 0;
 };
 
-void SetupThrowingErrorManager(jpeg_error_mgr * err);
+// The code of the errors thrown when a limit is exceeded
+constexpr char const* LIMIT_EXCEEDED_CODE = "LIMIT_EXCEEDED";
+
+// Parse options.limits ({maxPixels, maxDimension, maxScans, maxMemory}).
+// Throws a Napi::TypeError if it is invalid.
+DecodeLimits ParseDecodeLimits(Napi::Env const& env, Napi::Object const& options);
+
+// Check the dimensions from an image's header, before anything is allocated
+// for it. Throws a JPEGLibError with LIMIT_EXCEEDED_CODE.
+void CheckImageLimits(DecodeLimits const& limits, uint64_t width, uint64_t height);
 
 // A catch block that rethrows non-Napi excceptions as Napi exceptions
 #define RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(Env)      \
@@ -38,6 +132,10 @@ void SetupThrowingErrorManager(jpeg_error_mgr * err);
   {                                                   \
     throw;                                            \
   }                                                   \
+  catch (JPEGLibError const& e)                       \
+  {                                                   \
+    throw JPEGLibErrorToJS(Env, e);                   \
+  }                                                   \
   catch(std::exception const& e)                      \
   {                                                   \
     throw Napi::Error::New(Env, e.what());            \
@@ -51,7 +149,7 @@ namespace internal
     struct DataHolder
     {
       COMPRESS_OR_DECOMPRESS_STRUCT cinfo;
-      jpeg_error_mgr jerr;
+      JErrorManager jerr;
 
       DataHolder();
       ~DataHolder();
@@ -71,19 +169,86 @@ namespace internal
 
     COMPRESS_OR_DECOMPRESS_STRUCT * cinfo();
     COMPRESS_OR_DECOMPRESS_STRUCT const * cinfo() const;
-    jpeg_error_mgr * jerr();
-    jpeg_error_mgr const * jerr() const;
+    JErrorManager * jerr();
+    JErrorManager const * jerr() const;
   };
 }
 
 // Call jpeg_abort and jpeg_destroy on cinfo, if they have not already been called
 void abortAndDestroy(j_common_ptr cinfo);
 
-// Hold a unique_ptr to a jpeg_(de)compress_struct and jpeg_error_mgr.
+// Hold a unique_ptr to a jpeg_(de)compress_struct and JErrorManager.
 // These templates are explicitly instantiated in util.cc
 using JCompressHandle = internal::JHandle<jpeg_compress_struct>;
 using JDecompressHandle = internal::JHandle<jpeg_decompress_struct>;
 
+// Create a compressor using the throwing error manager.
+JCompressHandle CreateCompressHandle();
+
+// Output of jpeg_mem_dest. libjpeg allocates (and grows) the data with malloc,
+// so it is freed here unless ownership is passed on with TakeBuffer. libjpeg
+// keeps pointers to the members, so don't move it while compressing.
+struct JMemDestination
+{
+  unsigned char * data = nullptr;
+  unsigned long size = 0;
+
+  JMemDestination() = default;
+  ~JMemDestination();
+
+  JMemDestination(JMemDestination&& other);
+  JMemDestination& operator=(JMemDestination&& other);
+  JMemDestination(JMemDestination const&) = delete;
+  JMemDestination& operator=(JMemDestination const&) = delete;
+};
+
+// Hand the data of a JMemDestination over to a Buffer, without copying
+Napi::Buffer<uint8_t> TakeBuffer(Napi::Env const& env, JMemDestination& dest);
+
+// Deleter for std::unique_ptr of data that TurboJPEG allocated
+struct TJFreeDeleter
+{
+  void operator()(unsigned char* data) const
+  {
+    tj3Free(data);
+  }
+};
+
+// Keeps the Buffers (or other TypedArrays) that an AsyncWorker reads on the
+// thread pool alive until the worker is destroyed. A Reference to the Array
+// or Object they came in isn't enough: the caller may replace its elements
+// after the call, and the Buffers could then be collected mid-read.
+class BufferReferences
+{
+public:
+  BufferReferences() = default;
+  ~BufferReferences();
+
+  BufferReferences(BufferReferences&&) = default;
+  BufferReferences& operator=(BufferReferences&&) = default;
+  BufferReferences(BufferReferences const&) = delete;
+  BufferReferences& operator=(BufferReferences const&) = delete;
+
+  void Add(Napi::Value const& buffer);
+
+private:
+  std::vector<Napi::Reference<Napi::Value>> references;
+};
+
+// Create a decompressor using the throwing error manager.
+JDecompressHandle CreateDecompressHandle(WarningMode warningMode = WarningMode::Collect);
+
+// Create a decompressor using the throwing error manager, point it at the
+// given memory buffer and read the JPEG header. For abbreviated images, the
+// tables are first loaded from a tables-only datastream (or any JPEG).
+JDecompressHandle OpenDecompressHandle(uint8_t const* data, std::size_t length,
+  WarningMode warningMode = WarningMode::Collect,
+  uint8_t const* tables = nullptr, std::size_t tablesLength = 0);
+
+// Check the header read by an open decompressor against the limits, and have
+// libjpeg enforce the scan and memory limits while it decodes
+void ApplyDecodeLimits(JDecompressHandle& handle, DecodeLimits const& limits);
+
 inline jpeg_common_struct * asJCommon(jpeg_compress_struct * in) {
   return reinterpret_cast<jpeg_common_struct *>(in);
 }
@@ -0,0 +1,757 @@
+#include "validate.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+enum class ValidationLevel
+{
+  // Marker structure, segment lengths and SOF/SOS consistency. The
+  // entropy-coded data is only skipped over.
+  Markers,
+  // Also decode the entropy-coded data of every scan, without IDCT,
+  // upsampling or color conversion
+  Entropy,
+};
+
+struct ValidateImage
+{
+  uint8_t const* srcData;
+  std::size_t srcLength;
+
+  std::string error;
+  // libjpeg message code of the error, e.g. "JERR_BAD_HUFF_TABLE"
+  char const* code;
+  JWarnings warnings;
+};
+
+struct ValidateProps
+{
+  ValidationLevel level;
+  WarningMode warningMode;
+  DecodeLimits limits;
+  // Tables-only datastream for abbreviated images
+  std::vector<uint8_t> tables;
+  bool batch;
+  std::vector<ValidateImage> images;
+};
+
+namespace
+{
+  enum JPEGMarker
+  {
+    M_SOF0 = 0xC0,
+    M_SOF1 = 0xC1,
+    M_SOF2 = 0xC2,
+    M_SOF3 = 0xC3,
+    M_DHT = 0xC4,
+    M_SOF9 = 0xC9,
+    M_SOF10 = 0xCA,
+    M_SOF11 = 0xCB,
+    M_RST0 = 0xD0,
+    M_RST7 = 0xD7,
+    M_SOI = 0xD8,
+    M_EOI = 0xD9,
+    M_SOS = 0xDA,
+    M_DQT = 0xDB,
+    M_DNL = 0xDC,
+    M_DRI = 0xDD,
+    M_APP0 = 0xE0,
+    M_APP15 = 0xEF,
+    M_COM = 0xFE,
+    M_TEM = 0x01,
+  };
+
+  std::string Hex(int value)
+  {
+    char buffer[8];
+    std::snprintf(buffer, sizeof(buffer), "0x%02x", value);
+    return buffer;
+  }
+
+  // Walks the markers of a JPEG the way libjpeg's marker reader does, and
+  // fails with the same message codes, but never looks inside the scans.
+  // Quantization tables carry over from a tables-only datastream.
+  class MarkerScanner
+  {
+  public:
+    MarkerScanner(WarningMode warningMode, DecodeLimits const& limits)
+      : warningMode(warningMode), limits(limits)
+    {
+    }
+
+    // Read a tables-only datastream (or the tables of any JPEG)
+    void ScanTables(uint8_t const* data, std::size_t length)
+    {
+      this->Scan(data, length, true);
+    }
+
+    void ScanImage(uint8_t const* data, std::size_t length)
+    {
+      this->Scan(data, length, false);
+    }
+
+    JWarnings const& Warnings() const
+    {
+      return this->warnings;
+    }
+
+    // Whether the data ran out before the EOI marker
+    bool Truncated() const
+    {
+      return this->truncated;
+    }
+
+  private:
+    // Errors read the same as the ones libjpeg reports
+    NAPI_NO_RETURN void Fail(char const* code, std::string const& message)
+    {
+      throw JPEGLibError("jpeglib exited with an error: " + message, code, this->warnings);
+    }
+
+    void Warn(char const* code, std::string const& message)
+    {
+      if (this->warningMode == WarningMode::Fatal)
+      {
+        this->Fail(code, message);
+      }
+
+      this->warnings.count++;
+      if (this->warningMode == WarningMode::Collect
+        && this->warnings.messages.size() < JWarnings::MAX_MESSAGES)
+      {
+        this->warnings.messages.push_back(message);
+      }
+    }
+
+    // Thrown to stop scanning where the data runs out
+    struct EndOfData
+    {
+    };
+
+    // Running out of data is only a warning to libjpeg, which then acts as if
+    // an EOI marker followed
+    NAPI_NO_RETURN void PrematureEOF()
+    {
+      this->truncated = true;
+      this->Warn("JWRN_JPEG_EOF", "Premature end of JPEG file");
+      throw EndOfData();
+    }
+
+    void Scan(uint8_t const* data, std::size_t length, bool tablesOnly)
+    {
+      try
+      {
+        this->ScanMarkers(data, length, tablesOnly);
+      }
+      catch (EndOfData const&)
+      {
+        this->EndOfImage(tablesOnly);
+      }
+    }
+
+    void EndOfImage(bool tablesOnly)
+    {
+      if (!tablesOnly && this->scans == 0)
+      {
+        this->Fail("JERR_NO_IMAGE", "JPEG datastream contains no image");
+      }
+    }
+
+    void ScanMarkers(uint8_t const* data, std::size_t length, bool tablesOnly)
+    {
+      if (length == 0)
+      {
+        this->Fail("JERR_INPUT_EMPTY", "Empty input file");
+      }
+      if (length < 2 || data[0] != 0xFF || data[1] != M_SOI)
+      {
+        this->Fail("JERR_NO_SOI", "Not a JPEG file: starts with " + Hex(data[0])
+          + " " + Hex(length < 2 ? 0 : data[1]));
+      }
+
+      std::size_t pos = 2;
+      for (;;)
+      {
+        int marker = this->NextMarker(data, length, pos);
+        switch (marker)
+        {
+        case M_SOI:
+          this->Fail("JERR_SOI_DUPLICATE", "Invalid JPEG file structure: two SOI markers");
+
+        case M_EOI:
+          this->EndOfImage(tablesOnly);
+          // Anything after the EOI is ignored, like libjpeg does
+          return;
+
+        case M_RST0 + 0: case M_RST0 + 1: case M_RST0 + 2: case M_RST0 + 3:
+        case M_RST0 + 4: case M_RST0 + 5: case M_RST0 + 6: case M_RST7:
+        case M_TEM:
+          // No parameters
+          continue;
+
+        default:
+          break;
+        }
+
+        if (pos + 2 > length)
+        {
+          this->PrematureEOF();
+        }
+        std::size_t segmentLength = (static_cast<std::size_t>(data[pos]) << 8) + data[pos + 1];
+        if (segmentLength < 2)
+        {
+          this->Fail("JERR_BAD_LENGTH", "Bogus marker length");
+        }
+        if (segmentLength > length - pos)
+        {
+          this->PrematureEOF();
+        }
+        uint8_t const* payload = data + pos + 2;
+        std::size_t payloadLength = segmentLength - 2;
+        pos += segmentLength;
+
+        switch (marker)
+        {
+        case M_SOF0: case M_SOF1: case M_SOF2: case M_SOF3:
+        case M_SOF9: case M_SOF10: case M_SOF11:
+          if (!tablesOnly)
+          {
+            this->ReadSOF(marker, payload, payloadLength);
+          }
+          break;
+
+        case M_SOS:
+          if (tablesOnly)
+          {
+            return;
+          }
+          this->ReadSOS(payload, payloadLength);
+          this->SkipEntropyCodedData(data, length, pos);
+          break;
+
+        case M_DQT:
+          this->ReadDQT(payload, payloadLength);
+          break;
+
+        case M_DHT:
+          this->ReadDHT(payload, payloadLength);
+          break;
+
+        case M_DRI:
+          if (payloadLength != 2)
+          {
+            this->Fail("JERR_BAD_LENGTH", "Bogus marker length");
+          }
+          break;
+
+        case 0xC5: case 0xC6: case 0xC7: case 0xC8:
+        case 0xCD: case 0xCE: case 0xCF:
+          this->Fail("JERR_SOF_UNSUPPORTED", "Unsupported JPEG process: SOF type " + Hex(marker));
+
+        case 0xCC: // DAC, arithmetic coding conditioning
+        case M_DNL:
+        case M_COM:
+          break;
+
+        default:
+          if (marker < M_APP0 || marker > M_APP15)
+          {
+            this->Fail("JERR_UNKNOWN_MARKER", "Unsupported marker type " + Hex(marker));
+          }
+          break;
+        }
+      }
+    }
+
+    // Find the next marker at or after pos and return its code, with pos just
+    // past it. libjpeg skips garbage in front of a marker with a warning.
+    int NextMarker(uint8_t const* data, std::size_t length, std::size_t& pos)
+    {
+      std::size_t discarded = 0;
+      int marker;
+      for (;;)
+      {
+        while (pos < length && data[pos] != 0xFF)
+        {
+          ++pos;
+          ++discarded;
+        }
+        // Any number of 0xFF fill bytes may precede the marker code
+        while (pos < length && data[pos] == 0xFF)
+        {
+          ++pos;
+        }
+        if (pos >= length)
+        {
+          this->PrematureEOF();
+        }
+
+        marker = data[pos++];
+        if (marker != 0)
+        {
+          break;
+        }
+        discarded += 2;
+      }
+
+      if (discarded != 0)
+      {
+        this->Warn("JWRN_EXTRANEOUS_DATA", "Corrupt JPEG data: " + std::to_string(discarded)
+          + " extraneous bytes before marker " + Hex(marker));
+      }
+      return marker;
+    }
+
+    // Move pos to the marker that ends a scan. Stuffed zero bytes and restart
+    // markers are part of the entropy-coded data.
+    void SkipEntropyCodedData(uint8_t const* data, std::size_t length, std::size_t& pos)
+    {
+      for (;;)
+      {
+        auto* next = static_cast<uint8_t const*>(std::memchr(data + pos, 0xFF, length - pos));
+        if (next == nullptr || next + 1 >= data + length)
+        {
+          this->PrematureEOF();
+        }
+        pos = static_cast<std::size_t>(next - data);
+
+        uint8_t code = next[1];
+        if (code == 0xFF)
+        {
+          // Fill byte
+          ++pos;
+        }
+        else if (code == 0 || (code >= M_RST0 && code <= M_RST7))
+        {
+          pos += 2;
+        }
+        else
+        {
+          return;
+        }
+      }
+    }
+
+    void ReadSOF(int marker, uint8_t const* payload, std::size_t length)
+    {
+      if (this->frame)
+      {
+        this->Fail("JERR_SOF_DUPLICATE", "Invalid JPEG file structure: two SOF markers");
+      }
+      if (length < 6)
+      {
+        this->Fail("JERR_BAD_LENGTH", "Bogus marker length");
+      }
+
+      this->frame = true;
+      this->progressive = marker == M_SOF2 || marker == M_SOF10;
+      this->lossless = marker == M_SOF3 || marker == M_SOF11;
+
+      int precision = payload[0];
+      unsigned height = (payload[1] << 8) + payload[2];
+      unsigned width = (payload[3] << 8) + payload[4];
+      int numComponents = payload[5];
+
+      if (height == 0 || width == 0 || numComponents == 0)
+      {
+        this->Fail("JERR_EMPTY_IMAGE", "Empty JPEG image (DNL not supported)");
+      }
+      if (length != 6 + static_cast<std::size_t>(numComponents) * 3)
+      {
+        this->Fail("JERR_BAD_LENGTH", "Bogus marker length");
+      }
+      if (numComponents > MAX_COMPONENTS)
+      {
+        this->Fail("JERR_COMPONENT_COUNT", "Too many color components: " + std::to_string(numComponents)
+          + ", max " + std::to_string(MAX_COMPONENTS));
+      }
+      if (this->lossless ? precision < 2 || precision > 16 : precision != 8 && precision != 12)
+      {
+        this->Fail("JERR_BAD_PRECISION", "Unsupported JPEG data precision " + std::to_string(precision));
+      }
+
+      this->numComponents = numComponents;
+      for (int ci = 0; ci < numComponents; ++ci)
+      {
+        uint8_t const* component = payload + 6 + ci * 3;
+        int h = component[1] >> 4;
+        int v = component[1] & 0x0F;
+        if (h < 1 || h > 4 || v < 1 || v > 4)
+        {
+          this->Fail("JERR_BAD_SAMPLING", "Bogus sampling factors");
+        }
+        this->componentIds[ci] = component[0];
+        this->quantTableIndex[ci] = component[2];
+      }
+
+      CheckImageLimits(this->limits, width, height);
+    }
+
+    void ReadSOS(uint8_t const* payload, std::size_t length)
+    {
+      if (!this->frame)
+      {
+        this->Fail("JERR_SOS_NO_SOF", "Invalid JPEG file structure: SOS before SOF");
+      }
+
+      int numComponents = length > 0 ? payload[0] : 0;
+      if (length != 4 + static_cast<std::size_t>(numComponents) * 2
+        || numComponents < 1 || numComponents > MAX_COMPS_IN_SCAN)
+      {
+        this->Fail("JERR_BAD_LENGTH", "Bogus marker length");
+      }
+
+      for (int i = 0; i < numComponents; ++i)
+      {
+        int id = payload[1 + i * 2];
+        int ci = 0;
+        while (ci < this->numComponents && this->componentIds[ci] != id)
+        {
+          ++ci;
+        }
+        if (ci == this->numComponents)
+        {
+          this->Fail("JERR_BAD_COMPONENT_ID", "Invalid component ID " + std::to_string(id) + " in SOS");
+        }
+
+        // Lossless images aren't quantized
+        int table = this->quantTableIndex[ci];
+        if (!this->lossless && (table >= NUM_QUANT_TBLS || !this->quantTables[table]))
+        {
+          this->Fail("JERR_NO_QUANT_TABLE", "Quantization table " + Hex(table) + " was not defined");
+        }
+      }
+
+      uint8_t const* params = payload + 1 + numComponents * 2;
+      int ss = params[0];
+      int se = params[1];
+      int ah = params[2] >> 4;
+      int al = params[2] & 0x0F;
+      if (this->progressive)
+      {
+        // DC scans are interleaved or not, AC scans cover one component
+        if (ss > se || se > DCTSIZE2 - 1 || ah > 13 || al > 13
+          || (ss == 0 && se != 0) || (ss != 0 && numComponents != 1))
+        {
+          this->Fail("JERR_BAD_PROGRESSION", "Invalid progressive parameters Ss=" + std::to_string(ss)
+            + " Se=" + std::to_string(se) + " Ah=" + std::to_string(ah) + " Al=" + std::to_string(al));
+        }
+      }
+      else if (!this->lossless && (ss != 0 || se != DCTSIZE2 - 1 || ah != 0 || al != 0))
+      {
+        this->Warn("JWRN_NOT_SEQUENTIAL", "Invalid SOS parameters for sequential JPEG");
+      }
+
+      ++this->scans;
+      if (this->limits.maxScans > 0 && this->scans > this->limits.maxScans)
+      {
+        throw JPEGLibError("Image has more than " + std::to_string(this->limits.maxScans) + " scans",
+          LIMIT_EXCEEDED_CODE, this->warnings);
+      }
+    }
+
+    void ReadDQT(uint8_t const* payload, std::size_t length)
+    {
+      while (length > 0)
+      {
+        int table = payload[0] & 0x0F;
+        std::size_t size = (payload[0] >> 4) ? 128 : 64;
+        if (table >= NUM_QUANT_TBLS)
+        {
+          this->Fail("JERR_DQT_INDEX", "Bogus DQT index " + std::to_string(table));
+        }
+        if (length < 1 + size)
+        {
+          this->Fail("JERR_BAD_LENGTH", "Bogus marker length");
+        }
+        this->quantTables[table] = true;
+        payload += 1 + size;
+        length -= 1 + size;
+      }
+    }
+
+    void ReadDHT(uint8_t const* payload, std::size_t length)
+    {
+      while (length > 16)
+      {
+        int index = payload[0];
+        std::size_t count = 0;
+        for (int i = 1; i <= 16; ++i)
+        {
+          count += payload[i];
+        }
+        if (count > 256 || count > length - 17)
+        {
+          this->Fail("JERR_BAD_HUFF_TABLE", "Bogus Huffman table definition");
+        }
+        if ((index & ~0x10) >= NUM_HUFF_TBLS)
+        {
+          this->Fail("JERR_DHT_INDEX", "Bogus DHT index " + std::to_string(index & ~0x10));
+        }
+        payload += 17 + count;
+        length -= 17 + count;
+      }
+      if (length != 0)
+      {
+        this->Fail("JERR_BAD_LENGTH", "Bogus marker length");
+      }
+    }
+
+    WarningMode warningMode;
+    DecodeLimits limits;
+    JWarnings warnings;
+
+    bool quantTables[NUM_QUANT_TBLS] = {};
+    bool frame = false;
+    bool progressive = false;
+    bool lossless = false;
+    int numComponents = 0;
+    int componentIds[MAX_COMPONENTS] = {};
+    int quantTableIndex[MAX_COMPONENTS] = {};
+    int scans = 0;
+    bool truncated = false;
+  };
+}
+
+void DoValidateImage(ValidateImage& image, ValidateProps const& props)
+{
+  // libjpeg reports the same warnings again while decoding the scans
+  MarkerScanner scanner(
+    props.level == ValidationLevel::Entropy ? WarningMode::Ignore : props.warningMode,
+    props.limits);
+  if (!props.tables.empty())
+  {
+    scanner.ScanTables(props.tables.data(), props.tables.size());
+  }
+  try
+  {
+    scanner.ScanImage(image.srcData, image.srcLength);
+  }
+  catch (JPEGLibError const&)
+  {
+    // libjpeg reads on past the end of a truncated image (as if an EOI marker
+    // followed), so its own error is the one to report
+    if (props.level == ValidationLevel::Markers || !scanner.Truncated())
+    {
+      throw;
+    }
+  }
+
+  if (props.level == ValidationLevel::Markers)
+  {
+    image.warnings = scanner.Warnings();
+    return;
+  }
+
+  // Reading the coefficients runs the entropy decoder over every scan, and
+  // stops short of the IDCT
+  JDecompressHandle handle = OpenDecompressHandle(image.srcData, image.srcLength, props.warningMode,
+    props.tables.empty() ? nullptr : props.tables.data(), props.tables.size());
+  ApplyDecodeLimits(handle, props.limits);
+  jpeg_read_coefficients(handle.cinfo());
+  jpeg_finish_decompress(handle.cinfo());
+  image.warnings = handle.jerr()->warnings;
+}
+
+void DoValidate(ValidateProps& props)
+{
+  // An invalid image is a result, not an error, so one bad image in a batch
+  // doesn't fail the others
+  for (auto& image : props.images)
+  {
+    try {
+      DoValidateImage(image, props);
+    } catch (JPEGLibError const& e) {
+      image.error = e.what();
+      image.code = e.code();
+      image.warnings = e.warnings();
+    } catch (std::exception const& e) {
+      image.error = e.what();
+    }
+  }
+}
+
+Napi::Object ValidateImageResult(Napi::Env const& env, ValidateImage const& image, WarningMode warningMode)
+{
+  Napi::Object res = Napi::Object::New(env);
+  res.Set("valid", image.error.empty()
+    && (warningMode == WarningMode::Ignore || image.warnings.count == 0));
+  if (!image.error.empty())
+  {
+    res.Set("error", image.error);
+    if (image.code != nullptr)
+    {
+      res.Set("code", image.code);
+    }
+  }
+  SetWarnings(env, res, image.warnings);
+  return res;
+}
+
+Napi::Value ValidateResult(Napi::Env const& env, ValidateProps const& props)
+{
+  if (!props.batch)
+  {
+    return ValidateImageResult(env, props.images[0], props.warningMode);
+  }
+
+  auto res = Napi::Array::New(env, props.images.size());
+  for (std::size_t i = 0; i < props.images.size(); ++i)
+  {
+    res[i] = ValidateImageResult(env, props.images[i], props.warningMode);
+  }
+  return res;
+}
+
+class ValidateWorker : public Napi::AsyncWorker
+{
+public:
+  ValidateWorker(
+      Napi::Env const& env,
+      BufferReferences&& references,
+      ValidateProps&& props)
+      : AsyncWorker(env),
+        deferred(Napi::Promise::Deferred::New(env)),
+        references(std::move(references)),
+        props(std::move(props))
+  {
+  }
+
+  void Execute()
+  {
+    DoValidate(this->props);
+  }
+
+  void OnOK()
+  {
+    try {
+      deferred.Resolve(ValidateResult(Env(), this->props));
+    } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(Env())
+  }
+
+  void OnError(Napi::Error const& error)
+  {
+    deferred.Reject(error.Value());
+  }
+
+  Napi::Promise GetPromise() const
+  {
+    return deferred.Promise();
+  }
+
+private:
+  Napi::Promise::Deferred deferred;
+  BufferReferences references;
+  ValidateProps props;
+};
+
+Napi::Value ValidateInner(Napi::CallbackInfo const& info, bool async)
+{
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1)
+  {
+    throw Napi::TypeError::New(env, "Not enough arguments");
+  }
+
+  ValidateProps props = {};
+  props.batch = info[0].IsArray();
+
+  BufferReferences references;
+  if (props.batch)
+  {
+    Napi::Array sources = info[0].As<Napi::Array>();
+    for (uint32_t i = 0; i < sources.Length(); ++i)
+    {
+      Napi::Value source = sources.Get(i);
+      if (!source.IsBuffer())
+      {
+        throw Napi::TypeError::New(env, "Invalid source buffer");
+      }
+      auto buffer = source.As<Napi::Buffer<uint8_t>>();
+      references.Add(buffer);
+      props.images.push_back(ValidateImage{buffer.Data(), buffer.ByteLength()});
+    }
+  }
+  else
+  {
+    if (!info[0].IsBuffer())
+    {
+      throw Napi::TypeError::New(env, "Invalid source buffer");
+    }
+    auto buffer = info[0].As<Napi::Buffer<uint8_t>>();
+    references.Add(buffer);
+    props.images.push_back(ValidateImage{buffer.Data(), buffer.ByteLength()});
+  }
+
+  props.level = ValidationLevel::Entropy;
+  props.warningMode = WarningMode::Collect;
+
+  if (info.Length() > 1 && !info[1].IsUndefined())
+  {
+    if (!info[1].IsObject())
+    {
+      throw Napi::TypeError::New(env, "Invalid options");
+    }
+    Napi::Object options = info[1].As<Napi::Object>();
+
+    Napi::Value tmpLevel = options.Get("level");
+    if (!tmpLevel.IsUndefined())
+    {
+      std::string level = tmpLevel.IsString() ? tmpLevel.As<Napi::String>().Utf8Value() : "";
+      if (level == "markers")
+      {
+        props.level = ValidationLevel::Markers;
+      }
+      else if (level == "entropy")
+      {
+        props.level = ValidationLevel::Entropy;
+      }
+      else
+      {
+        throw Napi::TypeError::New(env, "Invalid level");
+      }
+    }
+
+    props.warningMode = ParseWarningMode(env, options);
+    props.limits = ParseDecodeLimits(env, options);
+
+    Napi::Value tmpTables = options.Get("tables");
+    if (!tmpTables.IsUndefined())
+    {
+      if (!tmpTables.IsBuffer() || tmpTables.As<Napi::Buffer<uint8_t>>().Length() == 0)
+      {
+        throw Napi::TypeError::New(env, "Invalid tables");
+      }
+      Napi::Buffer<uint8_t> tables = tmpTables.As<Napi::Buffer<uint8_t>>();
+      props.tables.assign(tables.Data(), tables.Data() + tables.Length());
+    }
+  }
+
+  if (async)
+  {
+    auto* wk = new ValidateWorker(env, std::move(references), std::move(props));
+    wk->Queue();
+    return wk->GetPromise();
+  }
+  else
+  {
+    DoValidate(props);
+    return ValidateResult(env, props);
+  }
+}
+
+Napi::Value ValidateAsync(Napi::CallbackInfo const& info)
+{
+  try {
+    return ValidateInner(info, true);
+  } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(info.Env())
+}
+
+Napi::Value ValidateSync(Napi::CallbackInfo const& info)
+{
+  try {
+    return ValidateInner(info, false);
+  } RETHROW_EXCEPTIONS_AS_JS_EXCEPTIONS(info.Env())
+}
@@ -0,0 +1,9 @@
+#ifndef NODE_JPEGTURBO_VALIDATE_H
+#define NODE_JPEGTURBO_VALIDATE_H
+
+#include "util.h"
+
+Napi::Value ValidateAsync(const Napi::CallbackInfo &info);
+Napi::Value ValidateSync(const Napi::CallbackInfo &info);
+
+#endif
@@ -126,4 +126,15 @@ describe("buffersize", () => {
     expect(size4).toBeGreaterThan(size1);
     expect(size4).toBeLessThan(50000);
   });
+
+  test("check options: precision", () => {
+    expect(() => bufferSize({ width: 10, height: 10, precision: 9 })).toThrow('Invalid precision');
+    expect(() => bufferSize({ width: 10, height: 10, precision: 16 })).toThrow('Invalid precision');
+
+    const size8 = bufferSize({ width: 100, height: 100 });
+    expect(bufferSize({ width: 100, height: 100, precision: 8 })).toEqual(size8);
+    expect(bufferSize({ width: 100, height: 100, precision: 12 })).toBeGreaterThan(size8);
+    expect(bufferSize({ width: 100, height: 100, lossless: true })).toBeGreaterThan(size8);
+    expect(bufferSize({ width: 100, height: 100, precision: 16, lossless: true })).toBeGreaterThanOrEqual(100 * 100 * 3 * 2);
+  });
 });
@@ -0,0 +1,126 @@
+const { compareSync, compare, compressSync, compress, decompressSync, FORMAT_RGB, FORMAT_RGBA, FORMAT_GRAY, JpegEncoder } = require("..");
+const { readFileSync } = require("fs");
+const path = require("path");
+
+const sampleJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg"));
+const corruptedJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg.corrupted"));
+
+describe("compare", () => {
+  const raw = decompressSync(sampleJpeg1, { format: FORMAT_RGB });
+  const rawOptions = { format: FORMAT_RGB, width: raw.width, height: raw.height };
+  // Raw pixels against a JPG of them
+  const jpegOptions = { ...rawOptions, jpeg: ['image'] };
+
+  test("check compareSync parameters", () => {
+    expect(() => compareSync()).toThrow('Not enough arguments');
+    expect(() => compareSync(raw.data)).toThrow('Not enough arguments');
+    expect(() => compareSync(null, raw.data, rawOptions)).toThrow('Invalid source buffer');
+    expect(() => compareSync([[raw.data]], rawOptions)).toThrow('Invalid pairs');
+    expect(() => compareSync(raw.data, raw.data, 1)).toThrow('Invalid options');
+    expect(() => compareSync(raw.data, raw.data, {})).toThrow('Invalid format');
+    expect(() => compareSync(raw.data, raw.data, { ...rawOptions, width: 0 })).toThrow('Invalid width');
+    expect(() => compareSync(raw.data, raw.data, { format: FORMAT_RGB, width: 10 })).toThrow('Invalid height');
+    expect(() => compareSync(raw.data, raw.data, { ...rawOptions, metrics: [] })).toThrow('Invalid metrics');
+    expect(() => compareSync(raw.data, raw.data, { ...rawOptions, metrics: ['vmaf'] })).toThrow('Invalid metrics');
+    expect(() => compareSync(raw.data, raw.data, { format: FORMAT_RGB })).toThrow('Invalid width');
+    expect(() => compareSync(raw.data, raw.data.subarray(1), rawOptions)).toThrow('Source data is not long enough');
+    expect(() => compareSync(raw.data, raw.data, { ...rawOptions, jpeg: 'image' })).toThrow('Invalid jpeg');
+    expect(() => compareSync(raw.data, raw.data, { ...rawOptions, jpeg: ['raw'] })).toThrow('Invalid jpeg');
+    expect(() => compareSync(sampleJpeg1, raw.data, { ...rawOptions, width: 100, jpeg: ['reference'] })).toThrow('Images have different dimensions');
+    expect(() => compareSync(sampleJpeg1, raw.data, { ...rawOptions, width: 100 })).toThrow('Source data is not long enough');
+  });
+
+  test("check identical images", async () => {
+    const res = compareSync(raw.data, raw.data, { ...rawOptions, metrics: ['psnr', 'ssim', 'msssim'] });
+    expect(res.width).toEqual(raw.width);
+    expect(res.height).toEqual(raw.height);
+    expect(res.psnr).toEqual(Infinity);
+    expect(res.ssim).toBeCloseTo(1, 6);
+    expect(res.msssim).toBeCloseTo(1, 6);
+    expect(res.channels.psnr).toEqual([Infinity, Infinity, Infinity]);
+    expect(res.channels.ssim.length).toEqual(3);
+
+    // A JPG is decoded the same way decompress does
+    const res2 = await compare(sampleJpeg1, raw.data, { format: FORMAT_RGB });
+    expect(res2.psnr).toEqual(Infinity);
+  });
+
+  test("check quality ordering", () => {
+    const options = { ...jpegOptions, metrics: ['psnr', 'ssim', 'msssim'] };
+    const low = compareSync(raw.data, compressSync(raw.data, { ...rawOptions, quality: 20 }), options);
+    const high = compareSync(raw.data, compressSync(raw.data, { ...rawOptions, quality: 90 }), options);
+    expect(low.psnr).toBeLessThan(high.psnr);
+    expect(low.ssim).toBeLessThan(high.ssim);
+    expect(low.msssim).toBeLessThan(high.msssim);
+    expect(high.ssim).toBeLessThanOrEqual(1);
+    expect(Object.keys(low.channels)).toEqual(['psnr', 'ssim', 'msssim']);
+  });
+
+  test("check formats", () => {
+    const rgba = decompressSync(sampleJpeg1, { format: FORMAT_RGBA });
+    const jpeg = compressSync(raw.data, { ...rawOptions, quality: 50 });
+    const rgb = compareSync(raw.data, jpeg, jpegOptions);
+    const res = compareSync(rgba.data, jpeg, { format: FORMAT_RGBA });
+    expect(res.psnr).toBeCloseTo(rgb.psnr, 6);
+
+    const gray = compareSync(sampleJpeg1, jpeg, { format: FORMAT_GRAY, metrics: ['psnr'] });
+    expect(Object.keys(gray)).toEqual(['width', 'height', 'psnr', 'channels']);
+    expect(gray.channels.psnr.length).toEqual(1);
+  });
+
+  test("check batch", async () => {
+    const jpeg = compressSync(raw.data, { ...rawOptions, quality: 50 });
+    const single = compareSync(raw.data, jpeg, jpegOptions);
+    const res = await compare([[raw.data, jpeg], [corruptedJpeg1, jpeg], [raw.data, jpeg]], { format: FORMAT_RGB });
+    expect(res.length).toEqual(3);
+    expect(res[0]).toEqual(single);
+    expect(res[1]).toEqual({ error: 'jpeglib exited with an error: Bogus Huffman table definition' });
+    expect(res[2]).toEqual(single);
+  });
+
+  test("check libjpeg errors keep their code", async () => {
+    const jpeg = compressSync(raw.data, { ...rawOptions, quality: 50 });
+    expect(() => compareSync(corruptedJpeg1, jpeg, { format: FORMAT_RGB })).toThrow('Bogus Huffman table definition');
+    await expect(compare(corruptedJpeg1, jpeg, { format: FORMAT_RGB })).rejects.toMatchObject({
+      message: 'jpeglib exited with an error: Bogus Huffman table definition',
+      code: 'JERR_BAD_HUFF_TABLE',
+    });
+  });
+
+  test("check raw pixels that start like a JPG", () => {
+    // The first pixel is FF D8 FF, the start of a JPG
+    const pixels = Buffer.from(raw.data);
+    pixels.set([0xff, 0xd8, 0xff]);
+    const res = compareSync(pixels, pixels, rawOptions);
+    expect(res.psnr).toEqual(Infinity);
+  });
+
+  test("check batch keeps its inputs alive", async () => {
+    const jpeg = compressSync(raw.data, { ...rawOptions, quality: 50 });
+    const single = compareSync(raw.data, jpeg, jpegOptions);
+    const pairs = [[Buffer.from(raw.data), Buffer.from(jpeg)], [Buffer.from(raw.data), Buffer.from(jpeg)]];
+    const promise = compare(pairs, jpegOptions);
+    // The worker holds its own references to the Buffers
+    pairs.length = 0;
+    expect(await promise).toEqual([single, single]);
+  });
+
+  test("check compress reportPsnr", async () => {
+    const options = { ...rawOptions, quality: 70 };
+    expect(() => compressSync(raw.data, { ...options, reportPsnr: 1 })).toThrow('Invalid reportPsnr');
+    expect(() => compressSync(raw.data, { ...options, abbreviated: true, reportPsnr: true }))
+      .toThrow("reportPsnr is only supported for 8-bit images that aren't abbreviated");
+
+    const res = compressSync(raw.data, { ...options, reportPsnr: true });
+    expect(res.data).toEqual(compressSync(raw.data, options));
+    expect(res.quality).toBeUndefined();
+    expect(res.psnr).toBeCloseTo(compareSync(raw.data, res.data, jpegOptions).psnr, 6);
+
+    const target = await compress(raw.data, { ...options, targetBytes: 20000, reportPsnr: true });
+    expect(target.quality).toBeGreaterThan(0);
+    expect(target.psnr).toBeCloseTo(compareSync(raw.data, target.data, jpegOptions).psnr, 6);
+
+    const encoder = new JpegEncoder({ ...options, reportPsnr: true });
+    expect(encoder.encodeSync(raw.data).psnr).toBeCloseTo(res.psnr, 6);
+  });
+});
@@ -1,4 +1,4 @@
-const { compressSync, compress, bufferSize, SAMP_444, FORMAT_BGR, FORMAT_BGRA, FORMAT_GRAY } = require("..");
+const { compressSync, compress, compressTables, decompressSync, decompress, bufferSize, JpegEncoder, JpegDecoder, SAMP_444, SAMP_GRAY, FORMAT_BGR, FORMAT_BGRA, FORMAT_GRAY } = require("..");
 
 
 describe("compress", () => {
@@ -270,4 +270,183 @@ describe("compress", () => {
     const res4 = await compress(source1, options);
     expect(res4.length).toEqual(res1.length);
   });
+
+  test("check targetBytes options", () => {
+    const source = generateRandomData(30000);
+    const options = {
+      width: 50,
+      height: 200,
+      format: FORMAT_BGR
+    };
+    expect(() => compressSync(source, { ...options, targetBytes: 0 })).toThrow('Invalid targetBytes');
+    expect(() => compressSync(source, { ...options, targetBytes: "abc" })).toThrow('Invalid targetBytes');
+    expect(() => compressSync(source, { ...options, targetBytes: 1000, minQuality: 0 })).toThrow('Invalid minQuality');
+    expect(() => compressSync(source, { ...options, targetBytes: 1000, maxQuality: 101 })).toThrow('Invalid maxQuality');
+    expect(() => compressSync(source, { ...options, targetBytes: 1000, minQuality: 50, maxQuality: 40 })).toThrow('Invalid maxQuality');
+  });
+
+  test("check targetBytes result", async () => {
+    const source = generateRandomData(30000);
+    const options = {
+      width: 50,
+      height: 200,
+      format: FORMAT_BGR
+    };
+    const unlimited = compressSync(source, { ...options, quality: 90 });
+
+    const res1 = compressSync(source, { ...options, targetBytes: unlimited.length / 2, maxQuality: 90 });
+    expect(res1.data.length).toBeLessThanOrEqual(unlimited.length / 2);
+    expect(res1.quality).toBeGreaterThanOrEqual(1);
+    expect(res1.quality).toBeLessThan(90);
+    expect(res1.fitted).toBe(true);
+
+    // One step up in quality must not fit
+    const above = compressSync(source, { ...options, targetBytes: unlimited.length / 2, minQuality: res1.quality + 1, maxQuality: res1.quality + 1 });
+    expect(above.data.length).toBeGreaterThan(unlimited.length / 2);
+
+    const res2 = await compress(source, Buffer.alloc(bufferSize(options)), { ...options, targetBytes: unlimited.length / 2, maxQuality: 90 });
+    expect(res2.quality).toEqual(res1.quality);
+    expect(res2.data.toString('base64')).toEqual(res1.data.toString('base64'));
+
+    // Falls back to the smallest output if nothing fits
+    const res3 = compressSync(source, { ...options, targetBytes: 10, minQuality: 5 });
+    expect(res3.quality).toEqual(5);
+    expect(res3.fitted).toBe(false);
+    expect(res3.data.length).toBeGreaterThan(10);
+  });
+});
+
+describe("compress precision", () => {
+  const width = 40;
+  const height = 24;
+  const gray = { width: width, height: height, format: FORMAT_GRAY, subsampling: SAMP_GRAY };
+
+  function ramp(array, max) {
+    for (let i = 0; i < array.length; i++) {
+      array[i] = (i * 37) % (max + 1);
+    }
+    return array;
+  }
+
+  test("check precision options", () => {
+    const source12 = new Uint16Array(width * height);
+    const source8 = Buffer.alloc(width * height);
+
+    expect(() => compressSync(source8, { ...gray, precision: 10 })).toThrow('Invalid precision');
+    expect(() => compressSync(source8, { ...gray, precision: "12" })).toThrow('Invalid precision');
+    expect(() => compressSync(new Uint16Array(width * height), { ...gray, precision: 16 })).toThrow('Invalid precision');
+    expect(() => compressSync(source8, { ...gray, precision: 12 })).toThrow('Invalid source buffer');
+    expect(() => compressSync(source12, gray)).toThrow('Invalid source buffer');
+    expect(() => compressSync(new Uint16Array(10), { ...gray, precision: 12 })).toThrow('Source data is not long enough');
+    expect(() => compressSync(new Uint16Array(width * height).fill(4096, 5, 6), { ...gray, precision: 12 })).toThrow('Sample out of range for precision');
+    expect(() => compressSync(new Uint16Array(width * height).fill(4096, 5, 6), { ...gray, precision: 12, lossless: true })).toThrow('Sample out of range for precision');
+    expect(() => compressSync(new Uint16Array(width * height).fill(4095), { ...gray, precision: 12 })).not.toThrow();
+    // Padding between rows isn't encoded, so it isn't checked
+    const padded = new Uint16Array((width + 8) * height);
+    for (let y = 0; y < height; y++) {
+      padded.fill(65535, y * (width + 8) + width, (y + 1) * (width + 8));
+    }
+    expect(() => compressSync(padded, { ...gray, precision: 12, stride: width + 8 })).not.toThrow();
+
+    expect(() => compressSync(source8, { ...gray, lossless: { predictor: 0 } })).toThrow('Invalid predictor');
+    expect(() => compressSync(source8, { ...gray, lossless: { predictor: 8 } })).toThrow('Invalid predictor');
+    expect(() => compressSync(source8, { ...gray, lossless: { pointTransform: 8 } })).toThrow('Invalid pointTransform');
+    expect(() => compressSync(source12, { ...gray, precision: 12, lossless: { pointTransform: 11 } })).not.toThrow();
+    expect(() => compressSync(source8, { ...gray, lossless: true, targetBytes: 1000 })).toThrow('targetBytes is only supported for 8-bit lossy images');
+  });
+
+  test("check 8-bit lossless", () => {
+    const source = ramp(Buffer.alloc(width * height), 255);
+    for (let predictor = 1; predictor <= 7; predictor++) {
+      const image = compressSync(source, { ...gray, lossless: { predictor: predictor } });
+      const out = decompressSync(image, { format: FORMAT_GRAY });
+      expect(out.precision).toBe(8);
+      expect(out.data.equals(source)).toBe(true);
+    }
+  });
+
+  test("check 12-bit lossy", () => {
+    const source = ramp(new Uint16Array(width * height), 4095).fill(2048, 0, width * 8);
+    const image = compressSync(source, { ...gray, precision: 12, quality: 95 });
+    const out = decompressSync(image, { format: FORMAT_GRAY });
+    expect(out.precision).toBe(12);
+    expect(out.data).toBeInstanceOf(Uint16Array);
+    expect(out.data.length).toBe(width * height);
+    // The flat band survives lossy compression
+    for (let i = 0; i < width * 8; i++) {
+      expect(Math.abs(out.data[i] - 2048)).toBeLessThanOrEqual(8);
+    }
+    expect(() => decompressSync(image, Buffer.alloc(width * height * 2), { format: FORMAT_GRAY })).toThrow('Invalid destination buffer');
+    expect(() => decompressSync(image, { format: FORMAT_GRAY, tolerant: true })).toThrow('Tolerant decoding only supports 8-bit images');
+  });
+
+  test("check 12-bit and 16-bit lossless", async () => {
+    for (const precision of [12, 16]) {
+      const source = ramp(new Uint16Array(width * height), (1 << precision) - 1);
+      const image = compressSync(source, { ...gray, precision: precision, lossless: true });
+      const out = decompressSync(image, new Uint16Array(width * height), { format: FORMAT_GRAY });
+      expect(out.precision).toBe(precision);
+      expect(Array.from(out.data)).toEqual(Array.from(source));
+    }
+  });
+
+  test("check point transform", () => {
+    const source = ramp(Buffer.alloc(width * height), 255);
+    const image = compressSync(source, { ...gray, lossless: { pointTransform: 2 } });
+    const out = decompressSync(image, { format: FORMAT_GRAY });
+    for (let i = 0; i < source.length; i++) {
+      expect(out.data[i]).toBe(source[i] & ~3);
+    }
+  });
+});
+
+describe("compress abbreviated", () => {
+  const width = 320;
+  const height = 240;
+  const raw = Buffer.alloc(width * height * 3);
+  for (let i = 0; i < raw.length; i++) {
+    raw[i] = (i * 7) % 251;
+  }
+  const options = { format: FORMAT_BGR, width: width, height: height, quality: 70 };
+
+  test("check abbreviated options", () => {
+    expect(() => compressSync(raw, { ...options, abbreviated: 1 })).toThrow('Invalid abbreviated');
+    expect(() => compressSync(raw, { ...options, abbreviated: true, targetBytes: 1000 })).toThrow('abbreviated is only supported');
+    expect(() => compressSync(raw, { ...options, abbreviated: true, lossless: true })).toThrow('abbreviated is only supported');
+    expect(() => compressTables({ ...options, precision: 12 })).toThrow('abbreviated is only supported');
+    expect(() => compressTables()).toThrow('Invalid options');
+    expect(() => decompressSync(raw, { format: FORMAT_BGR, tables: "tables" })).toThrow('Invalid tables');
+  });
+
+  test("check abbreviated images", async () => {
+    const full = compressSync(raw, options);
+    const frame = compressSync(raw, { ...options, abbreviated: true });
+    const tables = compressTables(options);
+
+    // The tables-only datastream is SOI, the tables and EOI, and the frame is
+    // the full image without them
+    expect(tables.subarray(0, 2)).toEqual(Buffer.from([0xff, 0xd8]));
+    expect(tables.subarray(-2)).toEqual(Buffer.from([0xff, 0xd9]));
+    expect(frame.length + tables.length - 4).toBe(full.length);
+
+    const expected = decompressSync(full, { format: FORMAT_BGR }).data;
+    expect(() => decompressSync(frame, { format: FORMAT_BGR })).toThrow('not defined');
+    expect(decompressSync(frame, { format: FORMAT_BGR, tables: tables }).data.equals(expected)).toBe(true);
+    expect((await decompress(frame, { format: FORMAT_BGR, tables: tables })).data.equals(expected)).toBe(true);
+    expect(decompressSync(frame, { format: FORMAT_BGR, tables: tables, tolerant: true }).data.equals(expected)).toBe(true);
+
+    // Frames from an encoder decode with a decoder primed with the tables
+    const encoder = new JpegEncoder({ ...options, abbreviated: true });
+    const decoder = new JpegDecoder({ format: FORMAT_BGR, tables: tables });
+    const encoded = Buffer.from(encoder.encodeSync(raw));
+    expect(encoded.equals(frame)).toBe(true);
+    expect(decoder.decodeSync(encoded).data.equals(expected)).toBe(true);
+
+    // Grayscale images only have the luminance tables
+    const grayOptions = { format: FORMAT_GRAY, width: 64, height: 64, subsampling: SAMP_GRAY, abbreviated: true };
+    const gray = compressSync(raw.subarray(0, 64 * 64), grayOptions);
+    const grayTables = compressTables(grayOptions);
+    expect(grayTables.length).toBeLessThan(tables.length);
+    expect(decompressSync(gray, { format: FORMAT_GRAY, tables: grayTables }).width).toBe(64);
+  });
 });
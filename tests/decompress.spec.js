@@ -1,10 +1,11 @@
-const { decompressSync, decompress, SAMP_444, FORMAT_BGR, FORMAT_BGRA, FORMAT_GRAY } = require("..");
+const { decompressSync, decompress, decompressTiles, compressSync, configureCache, cacheStats, clearCache, SAMP_444, SAMP_GRAY, FORMAT_RGB, FORMAT_BGR, FORMAT_BGRA, FORMAT_GRAY } = require("..");
 const { readFileSync } = require("fs");
 const path = require("path");
 
 
 const sampleJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg"));
 const sampleJpeg1Pixels = 560 * 560;
+const corruptedJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg.corrupted"));
 
 describe("decompress", () => {
   test("check decompressSync parameters", () => {
@@ -96,4 +97,290 @@ describe("decompress", () => {
     expect(res5.size).toEqual(target);
     expect(res5.data.length).toEqual(target);
   });
+
+  test("check warnings", async () => {
+    const res = decompressSync(sampleJpeg1, { format: FORMAT_BGR });
+    expect(res.warnings).toEqual([]);
+    expect(res.warningCount).toBe(0);
+
+    // A baseline image cut off halfway through the scan
+    const width = 64;
+    const height = 64;
+    const raw = Buffer.alloc(width * height * 3);
+    for (let i = 0; i < raw.length; i++) {
+      raw[i] = (i * 7) % 251;
+    }
+    const encoded = compressSync(raw, { format: FORMAT_RGB, width: width, height: height });
+    const truncated = encoded.subarray(0, Math.floor(encoded.length / 2));
+
+    const collected = decompressSync(truncated, { format: FORMAT_RGB });
+    expect(collected.warningCount).toBe(1);
+    expect(collected.warnings.length).toBe(1);
+
+    const ignored = await decompress(truncated, { format: FORMAT_RGB, warnings: 'ignore' });
+    expect(ignored.warningCount).toBe(1);
+    expect(ignored.warnings).toEqual([]);
+
+    expect(() => decompressSync(truncated, { format: FORMAT_RGB, warnings: 'fatal' })).toThrow();
+    await expect(decompress(truncated, { format: FORMAT_RGB, warnings: 'fatal' })).rejects.toThrow();
+    expect(() => decompressSync(sampleJpeg1, { format: FORMAT_RGB, warnings: true })).toThrow('Invalid warnings');
+  });
+
+  test("check tolerant decoding", async () => {
+    const width = 64;
+    const height = 64;
+    const raw = Buffer.alloc(width * height * 3);
+    for (let i = 0; i < raw.length; i++) {
+      raw[i] = (i * 7) % 251;
+    }
+    const encoded = compressSync(raw, { format: FORMAT_RGB, width: width, height: height });
+    const truncated = encoded.subarray(0, Math.floor(encoded.length / 2));
+
+    // Complete images decode as usual
+    const complete = decompressSync(encoded, { format: FORMAT_RGB, tolerant: true });
+    expect(complete.rowsDecoded).toBe(height);
+    expect(complete.truncated).toBe(false);
+    expect(complete.data.equals(decompressSync(encoded, { format: FORMAT_RGB }).data)).toBe(true);
+
+    for (let res of [
+      decompressSync(truncated, { format: FORMAT_RGB, tolerant: true, fill: 255 }),
+      await decompress(truncated, { format: FORMAT_RGB, tolerant: true, fill: 255 }),
+    ]) {
+      expect(res.truncated).toBe(true);
+      expect(res.rowsDecoded).toBeGreaterThan(0);
+      expect(res.rowsDecoded).toBeLessThan(height);
+      expect(res.warningCount).toBeGreaterThan(0);
+      expect(res.data.subarray(0, res.rowsDecoded * width * 3).equals(
+        complete.data.subarray(0, res.rowsDecoded * width * 3))).toBe(true);
+      expect(res.data.subarray(res.rowsDecoded * width * 3).every((v) => v === 255)).toBe(true);
+    }
+
+    // Without fill, rows that weren't decoded are left alone
+    const out = Buffer.alloc(width * height * 3, 1);
+    const res = decompressSync(encoded.subarray(0, 700), out, { format: FORMAT_RGB, tolerant: true });
+    expect(res.data.subarray((res.rowsDecoded + 16) * width * 3).every((v) => v === 1)).toBe(true);
+
+    // The corrupted fixture is cut off in its Huffman tables, before any
+    // image data, so there is nothing to return
+    expect(() => decompressSync(corruptedJpeg1, { format: FORMAT_RGB, tolerant: true })).toThrow('Bogus Huffman table definition');
+
+    expect(() => decompressSync(encoded, { format: FORMAT_RGB, tolerant: 1 })).toThrow('Invalid tolerant');
+    expect(() => decompressSync(encoded, { format: FORMAT_RGB, tolerant: true, fill: 256 })).toThrow('Invalid fill');
+  });
+
+  test("check pitch and dstOffset", async () => {
+    const options = { format: FORMAT_RGB };
+    const complete = decompressSync(sampleJpeg1, options);
+    const rowSize = 560 * 3;
+    const pitch = 600 * 3;
+
+    expect(() => decompressSync(sampleJpeg1, { ...options, pitch: "600" })).toThrow('Invalid pitch');
+    expect(() => decompressSync(sampleJpeg1, { ...options, pitch: rowSize - 1 })).toThrow('Invalid pitch');
+    expect(() => decompressSync(sampleJpeg1, { ...options, dstOffset: -1 })).toThrow('Invalid dstOffset');
+    expect(() => decompressSync(sampleJpeg1, { ...options, dstOffset: { x: 1 } })).toThrow('Invalid dstOffset');
+    expect(() => decompressSync(sampleJpeg1, { ...options, dstOffset: "0" })).toThrow('Invalid dstOffset');
+    expect(() => decompressSync(sampleJpeg1, { ...options, pitch: pitch, dstOffset: { x: 41, y: 0 } })).toThrow('dstOffset is out of bounds');
+    expect(() => decompressSync(sampleJpeg1, Buffer.alloc(pitch * 570), { ...options, pitch: pitch, dstOffset: { x: 0, y: 11 } })).toThrow('Insufficient output buffer');
+    expect(() => decompressSync(sampleJpeg1, Buffer.alloc(pitch * 570), { ...options, pitch: pitch, dstOffset: { x: 0, y: 2 ** 60 } })).toThrow('Insufficient output buffer');
+    expect(() => decompressSync(sampleJpeg1, Buffer.alloc(pitch * 570), { ...options, pitch: pitch, dstOffset: Number.MAX_SAFE_INTEGER })).toThrow('Insufficient output buffer');
+
+    const canvas = Buffer.alloc(pitch * 570, 7);
+    const res = decompressSync(sampleJpeg1, canvas, { ...options, pitch: pitch, dstOffset: { x: 40, y: 10 } });
+    expect(res.data.buffer).toBe(canvas.buffer);
+    expect(res.data.length).toBe(10 * pitch + 40 * 3 + 559 * pitch + rowSize);
+    for (let y = 0; y < 560; y++) {
+      const start = (y + 10) * pitch + 40 * 3;
+      expect(canvas.subarray(start, start + rowSize).equals(complete.data.subarray(y * rowSize, (y + 1) * rowSize))).toBe(true);
+      expect(canvas.subarray(start - 40 * 3, start).every((v) => v === 7)).toBe(true);
+    }
+    expect(canvas.subarray(0, 10 * pitch).every((v) => v === 7)).toBe(true);
+
+    // A numeric offset is in bytes
+    const same = Buffer.alloc(pitch * 570, 7);
+    await decompress(sampleJpeg1, same, { ...options, pitch: pitch, dstOffset: 10 * pitch + 40 * 3 });
+    expect(same.equals(canvas)).toBe(true);
+  });
+
+  test("check decompressTiles", async () => {
+    const width = 32;
+    const height = 16;
+    const tile = (value) => compressSync(Buffer.alloc(width * height, value), { format: FORMAT_GRAY, width: width, height: height, subsampling: SAMP_GRAY });
+    const pitch = width * 2;
+    const canvas = Buffer.alloc(pitch * height * 2);
+
+    const results = await decompressTiles(canvas, [
+      { image: tile(10), x: 0, y: 0 },
+      { image: tile(20), x: width, y: 0 },
+      { image: tile(30), x: 0, y: height },
+      { image: tile(40), dstOffset: height * pitch + width },
+    ], { format: FORMAT_GRAY, pitch: pitch });
+    expect(results.length).toBe(4);
+
+    for (let y = 0; y < height * 2; y++) {
+      for (let x = 0; x < width * 2; x++) {
+        const expected = 10 + (x >= width ? 10 : 0) + (y >= height ? 20 : 0);
+        expect(Math.abs(canvas[y * pitch + x] - expected)).toBeLessThanOrEqual(1);
+      }
+    }
+
+    await expect(decompressTiles(canvas, [{ image: tile(0), x: width + 1, y: 0 }], { format: FORMAT_GRAY, pitch: pitch })).rejects.toThrow('dstOffset is out of bounds');
+    await expect(decompressTiles(canvas, [{ image: tile(0), x: 0, y: height + 1 }], { format: FORMAT_GRAY, pitch: pitch })).rejects.toThrow('Insufficient output buffer');
+    await expect(decompressTiles(canvas, [], { format: FORMAT_GRAY })).rejects.toThrow('Invalid pitch');
+    await expect(decompressTiles(canvas, null, { format: FORMAT_GRAY, pitch: pitch })).rejects.toThrow('Invalid tiles');
+  });
+
+  test("check limits", () => {
+    const options = { format: FORMAT_RGB };
+    expect(() => decompressSync(sampleJpeg1, { ...options, limits: "none" })).toThrow('Invalid limits');
+    expect(() => decompressSync(sampleJpeg1, { ...options, limits: { maxDimension: "1" } })).toThrow('Invalid limits');
+
+    decompressSync(sampleJpeg1, { ...options, limits: { maxPixels: sampleJpeg1Pixels, maxDimension: 560, maxScans: 10 } });
+
+    // Nothing is allocated for the image when the header is over a limit
+    const out = Buffer.alloc(sampleJpeg1Pixels * 3, 1);
+    expect(() => decompressSync(sampleJpeg1, out, { ...options, limits: { maxPixels: 1000 } })).toThrow('more than maxPixels');
+    expect(out.every((v) => v === 1)).toBe(true);
+    let error;
+    try {
+      decompressSync(sampleJpeg1, { ...options, limits: { maxDimension: 100 } });
+    } catch (e) {
+      error = e;
+    }
+    expect(error.code).toBe('LIMIT_EXCEEDED');
+    expect(() => decompressSync(sampleJpeg1, { ...options, limits: { maxScans: 3 } })).toThrow('scans');
+    expect(() => decompressSync(sampleJpeg1, { ...options, limits: { maxMemory: 1 } })).toThrow();
+    expect(() => decompressSync(sampleJpeg1, { ...options, tolerant: true, limits: { maxScans: 3 } })).toThrow('Image has more than 3 scans');
+  });
+
+  test("check stats", async () => {
+    const options = { format: FORMAT_BGRA };
+    expect(() => decompressSync(sampleJpeg1, { ...options, stats: "mean" })).toThrow('Invalid stats');
+    expect(() => decompressSync(sampleJpeg1, { ...options, stats: ["median"] })).toThrow('Invalid stats');
+    expect(decompressSync(sampleJpeg1, options).stats).toBeUndefined();
+
+    // Compared with the same statistics computed in JS
+    const res = await decompress(sampleJpeg1, { ...options, stats: ["mean", "histogram", "minmax"] });
+    const sums = [0, 0, 0];
+    const min = [255, 255, 255];
+    const max = [0, 0, 0];
+    const histogram = new Float64Array(256);
+    for (let i = 0; i < res.data.length; i += 4) {
+      const rgb = [res.data[i + 2], res.data[i + 1], res.data[i]];
+      for (let c = 0; c < 3; c++) {
+        sums[c] += rgb[c];
+        min[c] = Math.min(min[c], rgb[c]);
+        max[c] = Math.max(max[c], rgb[c]);
+      }
+      histogram[(19595 * rgb[0] + 38470 * rgb[1] + 7471 * rgb[2] + 32768) >> 16]++;
+    }
+    expect(res.stats.pixels).toBe(sampleJpeg1Pixels);
+    expect(res.stats.mean).toEqual(sums.map((sum) => sum / sampleJpeg1Pixels));
+    expect(res.stats.min).toEqual(min);
+    expect(res.stats.max).toEqual(max);
+    expect(res.stats.histogram).toEqual(histogram);
+
+    // Only what was asked for
+    const gray = compressSync(Buffer.alloc(64 * 8, 200), { format: FORMAT_GRAY, width: 64, height: 8, subsampling: SAMP_GRAY });
+    const grayStats = decompressSync(gray, { format: FORMAT_GRAY, stats: ["minmax"] }).stats;
+    expect(grayStats).toEqual({ pixels: 64 * 8, min: [200], max: [200] });
+
+    // Tolerant decoding only counts the rows that were decoded
+    const noise = Buffer.alloc(64 * 64);
+    for (let i = 0; i < noise.length; i++) {
+      noise[i] = 50 + (i * 7) % 151;
+    }
+    const encoded = compressSync(noise, { format: FORMAT_GRAY, width: 64, height: 64, subsampling: SAMP_GRAY });
+    const partial = decompressSync(encoded.subarray(0, Math.floor(encoded.length / 2)), { format: FORMAT_GRAY, tolerant: true, fill: 0, stats: ["histogram"] });
+    expect(partial.truncated).toBe(true);
+    expect(partial.stats.pixels).toBe(partial.rowsDecoded * 64);
+    expect(partial.stats.histogram.reduce((a, b) => a + b)).toBe(partial.stats.pixels);
+  });
+
+  test("check scale", async () => {
+    const options = { format: FORMAT_RGB };
+    expect(() => decompressSync(sampleJpeg1, { ...options, scale: 0.5 })).toThrow('Invalid scale');
+    expect(() => decompressSync(sampleJpeg1, { ...options, scale: { num: 1 } })).toThrow('Invalid scale');
+    expect(() => decompressSync(sampleJpeg1, { ...options, scale: { num: 3, denom: 7 } })).toThrow('Invalid scale');
+    expect(() => decompressSync(sampleJpeg1, { ...options, scale: { num: 0, denom: 8 } })).toThrow('Invalid scale');
+
+    // Equivalent fractions are the same factor
+    const half = decompressSync(sampleJpeg1, { ...options, scale: { num: 1, denom: 2 } });
+    expect(half.width).toBe(280);
+    expect(half.height).toBe(280);
+    expect(half.data.length).toBe(280 * 280 * 3);
+    expect(decompressSync(sampleJpeg1, { ...options, scale: { num: 4, denom: 8 } }).data.equals(half.data)).toBe(true);
+    expect((await decompress(sampleJpeg1, { ...options, scale: { num: 1, denom: 2 } })).data.equals(half.data)).toBe(true);
+    expect(decompressSync(sampleJpeg1, { ...options, tolerant: true, scale: { num: 1, denom: 2 } }).data.equals(half.data)).toBe(true);
+
+    // Rounded up, and with the luma-only path
+    const eighth = decompressSync(sampleJpeg1, { format: FORMAT_GRAY, scale: { num: 1, denom: 8 } });
+    expect(eighth.width).toBe(70);
+    expect(eighth.data.length).toBe(70 * 70);
+    const odd = compressSync(Buffer.alloc(13 * 9), { format: FORMAT_GRAY, width: 13, height: 9, subsampling: SAMP_GRAY });
+    const oddScaled = decompressSync(odd, { format: FORMAT_GRAY, scale: { num: 1, denom: 4 } });
+    expect([oddScaled.width, oddScaled.height]).toEqual([4, 3]);
+
+    const lossless = compressSync(Buffer.alloc(16 * 16), { format: FORMAT_GRAY, width: 16, height: 16, subsampling: SAMP_GRAY, lossless: true });
+    expect(() => decompressSync(lossless, { format: FORMAT_GRAY, scale: { num: 1, denom: 2 } })).toThrow("Lossless images can't be scaled");
+  });
+
+  test("check cache", async () => {
+    const options = { format: FORMAT_RGB, cache: true };
+    expect(() => decompressSync(sampleJpeg1, { ...options, cache: 1 })).toThrow('Invalid cache');
+    expect(() => decompressSync(sampleJpeg1, Buffer.alloc(sampleJpeg1Pixels * 3), options))
+      .toThrow("cache can't be used with an output buffer, pitch, dstOffset or tolerant");
+    expect(() => decompressSync(sampleJpeg1, { ...options, tolerant: true }))
+      .toThrow("cache can't be used with an output buffer, pitch, dstOffset or tolerant");
+    expect(() => configureCache({ maxBytes: -1 })).toThrow('Invalid maxBytes');
+
+    configureCache({ maxBytes: 64 * 1024 * 1024 });
+    clearCache();
+    const plain = decompressSync(sampleJpeg1, { format: FORMAT_RGB });
+    expect(plain.cacheHit).toBeUndefined();
+
+    const miss = decompressSync(sampleJpeg1, options);
+    expect(miss.cacheHit).toBe(false);
+    expect(miss.data.equals(plain.data)).toBe(true);
+    const hit = await decompress(sampleJpeg1, options);
+    expect(hit.cacheHit).toBe(true);
+    expect(hit.width).toBe(560);
+    expect(hit.data.equals(plain.data)).toBe(true);
+
+    // Results are copies, so writing to one doesn't change the cached image
+    hit.data.fill(0);
+    miss.data.fill(0);
+    const again = decompressSync(sampleJpeg1, options);
+    expect(again.cacheHit).toBe(true);
+    expect(again.data.equals(plain.data)).toBe(true);
+
+    // A copy of the source hits too, other options don't
+    expect(decompressSync(Buffer.from(sampleJpeg1), options).cacheHit).toBe(true);
+    expect(decompressSync(sampleJpeg1, { ...options, format: FORMAT_BGR }).cacheHit).toBe(false);
+    const half = decompressSync(sampleJpeg1, { ...options, scale: { num: 1, denom: 2 } });
+    expect(half.cacheHit).toBe(false);
+    expect(half.data.length).toBe(280 * 280 * 3);
+
+    let stats = cacheStats();
+    expect(stats.entries).toBe(3);
+    expect(stats.hits).toBe(3);
+    expect(stats.misses).toBe(3);
+    expect(stats.bytes).toBeGreaterThan(sampleJpeg1Pixels * 3);
+
+    // Shrinking the budget evicts the least recently used images
+    configureCache({ maxBytes: stats.bytes - 1 });
+    stats = cacheStats();
+    expect(stats.evictions).toBe(1);
+    expect(decompressSync(sampleJpeg1, { ...options, scale: { num: 1, denom: 2 } }).cacheHit).toBe(true);
+    expect(decompressSync(sampleJpeg1, options).cacheHit).toBe(false);
+
+    // Results outlive their cache entries
+    clearCache();
+    expect(cacheStats()).toEqual({ entries: 0, bytes: 0, maxBytes: stats.maxBytes, hits: 0, misses: 0, evictions: 0 });
+    expect(again.data.equals(plain.data)).toBe(true);
+
+    configureCache({ maxBytes: 0 });
+    expect(decompressSync(sampleJpeg1, options).cacheHit).toBe(false);
+    expect(cacheStats().entries).toBe(0);
+    configureCache({ maxBytes: 128 * 1024 * 1024 });
+  });
 });
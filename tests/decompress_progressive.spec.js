@@ -0,0 +1,84 @@
+const { decompressProgressive, decompressProgressiveSync, decompressSync, compressSync, FORMAT_RGB, SAMP_420 } = require("..");
+const { readFileSync } = require("fs");
+const path = require("path");
+
+// Progressive, with 10 scans
+const sampleJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg"));
+const corruptJpeg = readFileSync(path.join(__dirname, "github_logo.jpg.corrupted"));
+
+describe("decompressProgressive", () => {
+  test("check decompressProgressive parameters", async () => {
+    const noop = () => {};
+    expect(() => decompressProgressiveSync(sampleJpeg1, { format: FORMAT_RGB })).toThrow('Invalid callback');
+    expect(() => decompressProgressiveSync(null, {}, noop)).toThrow('Invalid source buffer');
+    expect(() => decompressProgressiveSync(sampleJpeg1, 1, noop)).toThrow('Invalid options');
+    expect(() => decompressProgressiveSync(sampleJpeg1, { format: "rgb" }, noop)).toThrow('Invalid format');
+    expect(() => decompressProgressiveSync(sampleJpeg1, { format: 1000 }, noop)).toThrow('Invalid output format');
+    expect(() => decompressProgressiveSync(sampleJpeg1, { scans: 1 }, noop)).toThrow('Invalid scans');
+    expect(() => decompressProgressiveSync(sampleJpeg1, { scans: [0] }, noop)).toThrow('Invalid scans');
+    expect(() => decompressProgressiveSync(corruptJpeg, {}, noop)).toThrow('Bogus Huffman table definition');
+    await expect(decompressProgressive(sampleJpeg1, {}, null)).rejects.toThrow('Invalid callback');
+  });
+
+  test("produces every scan and then the final image", async () => {
+    const complete = decompressSync(sampleJpeg1, { format: FORMAT_RGB });
+    const scans = [];
+    let last;
+    const res = decompressProgressiveSync(sampleJpeg1, { format: FORMAT_RGB }, (pass) => {
+      expect(pass.data.length).toBe(complete.data.length);
+      scans.push(pass.scan);
+      last = Buffer.from(pass.data);
+      expect(pass.final).toBe(pass.scan === 10);
+    });
+    expect(scans).toEqual([1, 2, 3, 4, 5, 6, 7, 8, 9, 10]);
+    expect(res).toEqual({ width: 560, height: 560, progressive: true, stopped: false, warnings: [], warningCount: 0 });
+    expect(last.equals(complete.data)).toBe(true);
+  });
+
+  test("produces the requested scans", async () => {
+    const first = [];
+    const buffers = new Set();
+    await decompressProgressive(sampleJpeg1, { format: FORMAT_RGB, scans: [1] }, async (pass) => {
+      first.push([pass.scan, pass.final]);
+      buffers.add(pass.data.buffer);
+      await new Promise((resolve) => setImmediate(resolve));
+    });
+    expect(first).toEqual([[1, false], [10, true]]);
+    expect(buffers.size).toBe(1);
+
+    // The last scan isn't produced twice
+    const last = [];
+    decompressProgressiveSync(sampleJpeg1, { scans: [10] }, (pass) => { last.push(pass.scan); });
+    expect(last).toEqual([10]);
+    const final = [];
+    decompressProgressiveSync(sampleJpeg1, { scans: [] }, (pass) => { final.push(pass.scan); });
+    expect(final).toEqual([10]);
+  });
+
+  test("stops early", async () => {
+    const scans = [];
+    const res = await decompressProgressive(sampleJpeg1, { scans: [1, 2] }, (pass) => {
+      scans.push(pass.scan);
+      return Promise.resolve(false);
+    });
+    expect(scans).toEqual([1]);
+    expect(res.stopped).toBe(true);
+  });
+
+  test("baseline images produce only the final image", () => {
+    const image = compressSync(Buffer.alloc(100 * 70 * 3, 90), { format: FORMAT_RGB, width: 100, height: 70, subsampling: SAMP_420 });
+    const complete = decompressSync(image, { format: FORMAT_RGB });
+    const passes = [];
+    const res = decompressProgressiveSync(image, { format: FORMAT_RGB, scans: [1] }, (pass) => {
+      passes.push(pass.scan);
+      expect(pass.final).toBe(true);
+      expect(pass.data.equals(complete.data)).toBe(true);
+    });
+    expect(passes).toEqual([1]);
+    expect(res.progressive).toBe(false);
+  });
+
+  test("check limits", () => {
+    expect(() => decompressProgressiveSync(sampleJpeg1, { limits: { maxScans: 3 } }, () => {})).toThrow('Image has more than 3 scans');
+  });
+});
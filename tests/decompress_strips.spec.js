@@ -0,0 +1,83 @@
+const { decompressStrips, decompressStripsSync, decompressSync, compressSync, FORMAT_RGB, FORMAT_GRAY, SAMP_420 } = require("..");
+const { readFileSync } = require("fs");
+const path = require("path");
+
+const sampleJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg"));
+const corruptJpeg = readFileSync(path.join(__dirname, "github_logo.jpg.corrupted"));
+
+describe("decompressStrips", () => {
+  test("check decompressStrips parameters", async () => {
+    const noop = () => {};
+    expect(() => decompressStripsSync(sampleJpeg1, { format: FORMAT_RGB })).toThrow('Invalid callback');
+    expect(() => decompressStripsSync(null, {}, noop)).toThrow('Invalid source buffer');
+    expect(() => decompressStripsSync(sampleJpeg1, 1, noop)).toThrow('Invalid options');
+    expect(() => decompressStripsSync(sampleJpeg1, { format: "rgb" }, noop)).toThrow('Invalid format');
+    expect(() => decompressStripsSync(sampleJpeg1, { format: 1000 }, noop)).toThrow('Invalid output format');
+    expect(() => decompressStripsSync(sampleJpeg1, { rowsPerStrip: 0 }, noop)).toThrow('Invalid rowsPerStrip');
+    expect(() => decompressStripsSync(sampleJpeg1, { rowsPerStrip: -1 }, noop)).toThrow('Invalid rowsPerStrip');
+    expect(() => decompressStripsSync(corruptJpeg, {}, noop)).toThrow('Bogus Huffman table definition');
+    await expect(decompressStrips(sampleJpeg1, {}, null)).rejects.toThrow('Invalid callback');
+  });
+
+  test("matches decompress", async () => {
+    for (const image of [
+      sampleJpeg1,
+      compressSync(Buffer.alloc(100 * 70 * 3, 90), { format: FORMAT_RGB, width: 100, height: 70, subsampling: SAMP_420 }),
+    ]) {
+      const complete = decompressSync(image, { format: FORMAT_RGB });
+      for (const rowsPerStrip of [1, 16, 37, complete.height]) {
+        const rowSize = complete.width * 3;
+        const collected = [];
+        let rows = 0;
+        const onStrip = (strip) => {
+          expect(strip.y).toBe(rows);
+          expect(strip.rows).toBe(Math.min(rowsPerStrip, complete.height - strip.y));
+          expect(strip.data.length).toBe(strip.rows * rowSize);
+          // The strip buffer is reused, so keep a copy
+          collected.push(Buffer.from(strip.data));
+          rows += strip.rows;
+        };
+
+        const sync = decompressStripsSync(image, { format: FORMAT_RGB, rowsPerStrip: rowsPerStrip }, onStrip);
+        expect(sync.width).toBe(complete.width);
+        expect(sync.height).toBe(complete.height);
+        expect(sync.warningCount).toBe(0);
+        expect(Buffer.concat(collected).equals(complete.data)).toBe(true);
+
+        collected.length = 0;
+        rows = 0;
+        const async = await decompressStrips(image, { format: FORMAT_RGB, rowsPerStrip: rowsPerStrip }, async (strip) => {
+          onStrip(strip);
+          await new Promise((resolve) => setImmediate(resolve));
+        });
+        expect(async.height).toBe(complete.height);
+        expect(Buffer.concat(collected).equals(complete.data)).toBe(true);
+      }
+    }
+  });
+
+  test("clamps rowsPerStrip to the height", () => {
+    const strips = [];
+    decompressStripsSync(sampleJpeg1, { format: FORMAT_GRAY, rowsPerStrip: 10000 }, (strip) => {
+      strips.push({ y: strip.y, rows: strip.rows, length: strip.data.length });
+    });
+    expect(strips).toEqual([{ y: 0, rows: 560, length: 560 * 560 }]);
+  });
+
+  test("reuses one strip buffer", () => {
+    const buffers = new Set();
+    decompressStripsSync(sampleJpeg1, { format: FORMAT_GRAY, rowsPerStrip: 100 }, (strip) => {
+      buffers.add(strip.data.buffer);
+    });
+    expect(buffers.size).toBe(1);
+  });
+
+  test("stops on errors from onStrip", async () => {
+    let calls = 0;
+    await expect(decompressStrips(sampleJpeg1, {}, () => {
+      calls++;
+      throw new Error("stop");
+    })).rejects.toThrow("stop");
+    expect(calls).toBe(1);
+  });
+});
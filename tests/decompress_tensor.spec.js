@@ -0,0 +1,85 @@
+const { decompressToTensor, decompressToTensorSync, decompressSync, FORMAT_RGB, FORMAT_BGR, FORMAT_GRAY, FORMAT_RGBA } = require("..");
+const { readFileSync } = require("fs");
+const path = require("path");
+
+// 560x560
+const sampleJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg"));
+const corruptedJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg.corrupted"));
+
+describe("decompressToTensor", () => {
+  test("check decompressToTensorSync parameters", async () => {
+    expect(() => decompressToTensorSync()).toThrow('Not enough arguments');
+    expect(() => decompressToTensorSync(null)).toThrow('Invalid source buffer');
+    expect(() => decompressToTensorSync(sampleJpeg1, 1)).toThrow('Invalid options');
+    expect(() => decompressToTensorSync(sampleJpeg1, { format: FORMAT_RGBA })).toThrow('Invalid format');
+    expect(() => decompressToTensorSync(sampleJpeg1, { layout: 'CHW' })).toThrow('Invalid layout');
+    expect(() => decompressToTensorSync(sampleJpeg1, { mean: [0.5] })).toThrow('Invalid mean');
+    expect(() => decompressToTensorSync(sampleJpeg1, { std: [1, 0, 1] })).toThrow('Invalid std');
+    expect(() => decompressToTensorSync(sampleJpeg1, { scale: { num: 3, denom: 7 } })).toThrow('Invalid scale');
+    expect(() => decompressToTensorSync(sampleJpeg1, { size: { width: 0, height: 10 } })).toThrow('Invalid size');
+    expect(() => decompressToTensorSync(sampleJpeg1, { dstOffset: 4 })).toThrow('Invalid dstOffset');
+    expect(() => decompressToTensorSync(sampleJpeg1, new Float32Array(10))).toThrow('Insufficient output buffer');
+    expect(() => decompressToTensorSync(corruptedJpeg1)).toThrow('Bogus Huffman table definition');
+    expect(() => decompressToTensorSync([sampleJpeg1], {})).toThrow('Invalid size');
+    await expect(decompressToTensor([sampleJpeg1], {})).rejects.toThrow('Invalid size');
+  });
+
+  test("check layouts and normalization", async () => {
+    const raw = decompressSync(sampleJpeg1, { format: FORMAT_RGB }).data;
+    const plane = 560 * 560;
+
+    const nchw = decompressToTensorSync(sampleJpeg1);
+    expect(nchw.shape).toEqual([1, 3, 560, 560]);
+    expect(nchw.data.length).toBe(3 * plane);
+    for (const i of [0, 1000, 150000, plane - 1]) {
+      for (let c = 0; c < 3; c++) {
+        expect(nchw.data[c * plane + i]).toBeCloseTo(raw[i * 3 + c] / 255, 6);
+      }
+    }
+
+    const options = { layout: 'NHWC', format: FORMAT_BGR, mean: [0.4, 0.5, 0.6], std: [0.2, 0.25, 0.3] };
+    const nhwc = await decompressToTensor(sampleJpeg1, options);
+    expect(nhwc.shape).toEqual([1, 560, 560, 3]);
+    for (const i of [0, 1000, 150000, plane - 1]) {
+      for (let c = 0; c < 3; c++) {
+        expect(nhwc.data[i * 3 + c]).toBeCloseTo((raw[i * 3 + 2 - c] / 255 - options.mean[c]) / options.std[c], 5);
+      }
+    }
+
+    const gray = decompressToTensorSync(sampleJpeg1, { format: FORMAT_GRAY });
+    expect(gray.shape).toEqual([1, 1, 560, 560]);
+  });
+
+  test("check scale and size", () => {
+    const half = decompressToTensorSync(sampleJpeg1, { scale: { num: 1, denom: 2 } });
+    expect(half.shape).toEqual([1, 3, 280, 280]);
+
+    const sized = decompressToTensorSync(sampleJpeg1, { size: { width: 224, height: 200 }, layout: 'NHWC' });
+    expect(sized.shape).toEqual([1, 200, 224, 3]);
+    expect([sized.width, sized.height]).toEqual([224, 200]);
+    // Resampling keeps the mean
+    const mean = (data) => data.reduce((sum, v) => sum + v, 0) / data.length;
+    expect(mean(sized.data)).toBeCloseTo(mean(decompressToTensorSync(sampleJpeg1).data), 2);
+  });
+
+  test("check out and batch", async () => {
+    const single = decompressToTensorSync(sampleJpeg1, { size: { width: 64, height: 64 } });
+    const imageSize = 3 * 64 * 64;
+
+    const out = new Float32Array(imageSize + 10).fill(-1);
+    const res = decompressToTensorSync(sampleJpeg1, out, { size: { width: 64, height: 64 }, dstOffset: 10 });
+    expect(res.data.buffer).toBe(out.buffer);
+    expect(res.data).toEqual(single.data);
+    expect(out[9]).toBe(-1);
+
+    const batch = await decompressToTensor([sampleJpeg1, sampleJpeg1, sampleJpeg1], { size: { width: 64, height: 64 } });
+    expect(batch.shape).toEqual([3, 3, 64, 64]);
+    expect(batch.data.length).toBe(3 * imageSize);
+    expect(batch.data.subarray(2 * imageSize)).toEqual(single.data);
+    expect(decompressToTensorSync([sampleJpeg1, sampleJpeg1], { size: { width: 64, height: 64 } }).data)
+      .toEqual(batch.data.subarray(0, 2 * imageSize));
+
+    await expect(decompressToTensor([sampleJpeg1, corruptedJpeg1], { size: { width: 64, height: 64 } }))
+      .rejects.toThrow('Bogus Huffman table definition');
+  });
+});
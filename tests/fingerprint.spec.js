@@ -0,0 +1,74 @@
+const { fingerprintSync, fingerprint, generateSizesSync } = require("..");
+const { readFileSync } = require("fs");
+const path = require("path");
+
+const sampleJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg"));
+const corruptedJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg.corrupted"));
+
+const hammingDistance = (a, b) => {
+  let res = 0;
+  for (let i = 0; i < a.length; i++) {
+    for (let x = a[i] ^ b[i]; x; x >>= 1) {
+      res += x & 1;
+    }
+  }
+  return res;
+};
+
+describe("fingerprint", () => {
+  test("check fingerprintSync parameters", () => {
+    expect(() => fingerprintSync()).toThrow('Not enough arguments');
+    expect(() => fingerprintSync(null)).toThrow('Invalid source buffer');
+    expect(() => fingerprintSync([sampleJpeg1, null])).toThrow('Invalid source buffer');
+    expect(() => fingerprintSync(sampleJpeg1, 1)).toThrow('Invalid options');
+    expect(() => fingerprintSync(sampleJpeg1, { algorithms: [] })).toThrow('Invalid algorithms');
+    expect(() => fingerprintSync(sampleJpeg1, { algorithms: ['md5'] })).toThrow('Invalid algorithms');
+    expect(() => fingerprintSync(sampleJpeg1, { bits: 32 })).toThrow('Invalid bits');
+  });
+
+  test("check result", async () => {
+    const res1 = fingerprintSync(sampleJpeg1);
+    expect(res1.phash.length).toEqual(8);
+    expect(res1.dhash.length).toEqual(8);
+    expect(res1.dcmean.length).toEqual(8);
+
+    const res2 = await fingerprint(sampleJpeg1);
+    expect(res2).toEqual(res1);
+
+    const res3 = fingerprintSync(sampleJpeg1, { algorithms: ['dhash'], bits: 256 });
+    expect(Object.keys(res3)).toEqual(['dhash']);
+    expect(res3.dhash.length).toEqual(32);
+  });
+
+  test("check similar images have similar hashes", () => {
+    const [resized] = generateSizesSync(sampleJpeg1, [{ maxDim: 300, quality: 40 }]);
+    const a = fingerprintSync(sampleJpeg1);
+    const b = fingerprintSync(resized);
+    expect(hammingDistance(a.phash, b.phash)).toBeLessThanOrEqual(10);
+    expect(hammingDistance(a.dhash, b.dhash)).toBeLessThanOrEqual(10);
+    expect(hammingDistance(a.dcmean, b.dcmean)).toBeLessThanOrEqual(10);
+  });
+
+  test("check batch", async () => {
+    const single = fingerprintSync(sampleJpeg1);
+    const res = await fingerprint([sampleJpeg1, corruptedJpeg1, sampleJpeg1]);
+    expect(res.length).toEqual(3);
+    expect(res[0]).toEqual(single);
+    expect(res[1]).toEqual({ error: 'jpeglib exited with an error: Bogus Huffman table definition' });
+    expect(res[2]).toEqual(single);
+  });
+
+  test("check batch keeps its inputs alive", async () => {
+    const single = fingerprintSync(sampleJpeg1);
+    const images = [Buffer.from(sampleJpeg1), Buffer.from(sampleJpeg1)];
+    const promise = fingerprint(images);
+    // The worker holds its own references to the Buffers
+    images.length = 0;
+    expect(await promise).toEqual([single, single]);
+  });
+
+  test("check libjpeg errors throw", async () => {
+    expect(() => fingerprintSync(Buffer.alloc(100))).toThrow('jpeglib exited with an error: Not a JPEG file: starts with 0x00 0x00');
+    await expect(fingerprint(corruptedJpeg1)).rejects.toMatchObject({ message: 'jpeglib exited with an error: Bogus Huffman table definition', code: 'JERR_BAD_HUFF_TABLE' });
+  });
+});
@@ -0,0 +1,47 @@
+const { generateSizesSync, generateSizes, compressSync, decompressSync, FORMAT_RGB } = require("..");
+const { readFileSync } = require("fs");
+const path = require("path");
+
+const sampleJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg"));
+
+// A baseline image whose scan uses an undefined Huffman table. Its header
+// reads fine, so the error only comes up while decoding, on the worker.
+const noHuffmanTable = Buffer.from(compressSync(Buffer.alloc(64 * 48 * 3, 0x80), { format: FORMAT_RGB, width: 64, height: 48 }));
+noHuffmanTable[noHuffmanTable.indexOf(Buffer.from([0xff, 0xda])) + 6] = 0x33;
+
+describe("generate_sizes", () => {
+  test("check generateSizesSync parameters", () => {
+    expect(() => generateSizesSync()).toThrow('Not enough arguments');
+    expect(() => generateSizesSync(null, [{ maxDim: 64 }])).toThrow('Invalid source buffer');
+    expect(() => generateSizesSync(sampleJpeg1, null)).toThrow('Invalid sizes');
+    expect(() => generateSizesSync(sampleJpeg1, [])).toThrow('Invalid sizes');
+    expect(() => generateSizesSync(sampleJpeg1, [1])).toThrow('Invalid sizes');
+    expect(() => generateSizesSync(sampleJpeg1, [{}])).toThrow('Invalid maxDim');
+    expect(() => generateSizesSync(sampleJpeg1, [{ maxDim: 0 }])).toThrow('Invalid maxDim');
+    expect(() => generateSizesSync(sampleJpeg1, [{ maxDim: 64, quality: 101 }])).toThrow('Invalid quality');
+    expect(() => generateSizesSync(sampleJpeg1, [{ maxDim: 64, subsampling: -1 }])).toThrow('Invalid subsampling');
+  });
+
+  test("check result sizes", async () => {
+    const sizes = [{ maxDim: 64 }, { maxDim: 1000 }, { maxDim: 280, quality: 90 }, { maxDim: 100 }];
+    const expected = [64, 560, 280, 100];
+
+    const res1 = generateSizesSync(sampleJpeg1, sizes);
+    expect(res1.length).toEqual(sizes.length);
+    res1.forEach((buf, i) => {
+      const decoded = decompressSync(buf, { format: FORMAT_RGB });
+      expect(decoded.width).toEqual(expected[i]);
+      expect(decoded.height).toEqual(expected[i]);
+    });
+
+    const res2 = await generateSizes(sampleJpeg1, sizes);
+    expect(res2.map((buf) => buf.toString('base64'))).toEqual(res1.map((buf) => buf.toString('base64')));
+  });
+
+  test("check libjpeg errors throw", async () => {
+    expect(() => generateSizesSync(Buffer.alloc(100), [{ maxDim: 64 }])).toThrow('jpeglib exited with an error: Not a JPEG file: starts with 0x00 0x00');
+    // Errors on the worker keep their code and warnings, like the sync ones
+    expect(() => generateSizesSync(noHuffmanTable, [{ maxDim: 32 }])).toThrow('Huffman table 0x03 was not defined');
+    await expect(generateSizes(noHuffmanTable, [{ maxDim: 32 }])).rejects.toMatchObject({ message: 'jpeglib exited with an error: Huffman table 0x03 was not defined', code: 'JERR_NO_HUFF_TABLE', warnings: [], warningCount: 0 });
+  });
+});
@@ -0,0 +1,100 @@
+const { JpegEncoder, JpegDecoder, compressSync, decompressSync, FORMAT_RGB, FORMAT_GRAY, SAMP_444 } = require("..");
+const { readFileSync } = require("fs");
+const path = require("path");
+
+const sampleJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg"));
+
+function generateImage(width, height, seed) {
+  const data = Buffer.alloc(width * height * 3);
+  for (let i = 0; i < data.length; i++) {
+    data[i] = (i * 7 + seed * 31) % 256;
+  }
+  return data;
+}
+
+describe("JpegEncoder", () => {
+  const options = { format: FORMAT_RGB, width: 40, height: 30, quality: 85 };
+
+  test("check JpegEncoder parameters", () => {
+    expect(() => new JpegEncoder()).toThrow('Invalid options');
+    expect(() => new JpegEncoder({ ...options, format: "rgb" })).toThrow('Invalid format');
+    expect(() => new JpegEncoder({ ...options, quality: 0 })).toThrow('Invalid quality');
+
+    const encoder = new JpegEncoder(options);
+    expect(() => encoder.encodeSync()).toThrow('Invalid source buffer');
+    expect(() => encoder.encodeSync(new Uint16Array(40 * 30 * 3))).toThrow('Invalid source buffer');
+    expect(() => encoder.encodeSync(Buffer.alloc(10))).toThrow('Source data is not long enough');
+    expect(() => encoder.encodeSync(generateImage(40, 30, 0), Buffer.alloc(10))).toThrow('Insufficient output buffer');
+
+    const encoder12 = new JpegEncoder({ ...options, precision: 12 });
+    expect(() => encoder12.encodeSync(new Uint16Array(40 * 30 * 3).fill(4096, 7, 8))).toThrow('Sample out of range for precision');
+    expect(() => encoder12.encodeSync(new Uint16Array(40 * 30 * 3).fill(4095))).not.toThrow();
+  });
+
+  test("matches compress", async () => {
+    const encoder = new JpegEncoder(options);
+    for (let seed = 0; seed < 3; seed++) {
+      const raw = generateImage(40, 30, seed);
+      const expected = compressSync(raw, options);
+      expect(encoder.encodeSync(raw).equals(expected)).toBe(true);
+      expect((await encoder.encode(raw)).equals(expected)).toBe(true);
+    }
+
+    const target = new JpegEncoder({ ...options, targetBytes: 1000 });
+    const raw = generateImage(40, 30, 1);
+    const res = target.encodeSync(raw);
+    expect(res.data.equals(compressSync(raw, { ...options, targetBytes: 1000 }).data)).toBe(true);
+  });
+
+  test("reuses its output buffer", () => {
+    const encoder = new JpegEncoder(options);
+    const first = encoder.encodeSync(generateImage(40, 30, 0));
+    const second = encoder.encodeSync(generateImage(40, 30, 1));
+    expect(first.buffer).toBe(second.buffer);
+
+    const out = Buffer.alloc(100000);
+    expect(encoder.encodeSync(generateImage(40, 30, 0), out).buffer).toBe(out.buffer);
+  });
+
+  test("allows one encode at a time", async () => {
+    const encoder = new JpegEncoder(options);
+    const raw = generateImage(40, 30, 0);
+    const pending = encoder.encode(raw);
+    expect(() => encoder.encodeSync(raw)).toThrow('Encoder is busy');
+    await pending;
+    encoder.encodeSync(raw);
+  });
+});
+
+describe("JpegDecoder", () => {
+  test("check JpegDecoder parameters", () => {
+    expect(() => new JpegDecoder(1)).toThrow('Invalid options');
+    expect(() => new JpegDecoder({ format: 1000 })).toThrow('Invalid output format');
+
+    const decoder = new JpegDecoder({ format: FORMAT_RGB });
+    expect(() => decoder.decodeSync()).toThrow('Invalid source buffer');
+    expect(() => decoder.decodeSync(Buffer.alloc(10))).toThrow();
+  });
+
+  test("matches decompress", async () => {
+    const decoder = new JpegDecoder({ format: FORMAT_RGB, markers: true });
+    const small = compressSync(generateImage(40, 30, 0), { format: FORMAT_RGB, width: 40, height: 30, subsampling: SAMP_444 });
+    for (const image of [small, sampleJpeg1, small]) {
+      const expected = decompressSync(image, { format: FORMAT_RGB, markers: true });
+      for (const out of [decoder.decodeSync(image), await decoder.decode(image)]) {
+        expect(out.width).toBe(expected.width);
+        expect(out.height).toBe(expected.height);
+        expect(out.data.equals(expected.data)).toBe(true);
+        expect(out.markers.length).toBe(expected.markers.length);
+      }
+    }
+  });
+
+  test("allows one decode at a time", async () => {
+    const decoder = new JpegDecoder({ format: FORMAT_GRAY });
+    const pending = decoder.decode(sampleJpeg1);
+    expect(() => decoder.decodeSync(sampleJpeg1)).toThrow('Decoder is busy');
+    await pending;
+    decoder.decodeSync(sampleJpeg1);
+  });
+});
@@ -0,0 +1,105 @@
+const { mosaic, mosaicSync, compressSync, decompressSync, readHeader, FORMAT_RGB, SAMP_420, SAMP_444 } = require("..");
+const { readFileSync } = require("fs");
+const path = require("path");
+
+// 560x560
+const sampleJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg"));
+const raw = decompressSync(sampleJpeg1, { format: FORMAT_RGB }).data;
+
+// Encode the region of the sample image at (x, y) on its own
+const encodeTile = (x, y, width, height, options) =>
+  compressSync(raw.subarray((y * 560 + x) * 3), {
+    format: FORMAT_RGB, width, height, stride: 560, quality: 90, subsampling: SAMP_420, ...options,
+  });
+
+describe("mosaic", () => {
+  const tiles = [];
+  for (const y of [0, 288]) {
+    for (const x of [0, 288]) {
+      tiles.push({ image: encodeTile(x, y, x === 0 ? 288 : 272, y === 0 ? 288 : 272), x, y });
+    }
+  }
+
+  test("check mosaicSync parameters", () => {
+    const options = { width: 560, height: 560 };
+    expect(() => mosaicSync()).toThrow('Not enough arguments');
+    expect(() => mosaicSync([], options)).toThrow('Invalid tiles');
+    expect(() => mosaicSync(tiles, 1)).toThrow('Invalid options');
+    expect(() => mosaicSync(tiles, { width: 0, height: 560 })).toThrow('Invalid width');
+    expect(() => mosaicSync(tiles, { width: 560 })).toThrow('Invalid height');
+    expect(() => mosaicSync([{ image: tiles[0].image, x: 0 }], options)).toThrow('Invalid tiles');
+    expect(() => mosaicSync([{ image: tiles[0].image, x: 560, y: 0 }], options)).toThrow('Invalid tiles');
+    expect(() => mosaicSync(tiles, { ...options, optimizeHuffman: 1 })).toThrow('Invalid optimizeHuffman');
+  });
+
+  test("check incompatible tiles", async () => {
+    const options = { width: 560, height: 560 };
+    expect(() => mosaicSync([{ image: tiles[0].image, x: 8, y: 0 }], options))
+      .toThrow('Tiles must be placed on MCU boundaries (16x16 pixels)');
+    expect(() => mosaicSync([{ image: encodeTile(0, 0, 100, 100), x: 0, y: 0 }], options))
+      .toThrow('Tiles must be whole MCUs, except at the right and bottom edges');
+    expect(() => mosaicSync([tiles[0], { image: encodeTile(288, 0, 272, 288, { quality: 50 }), x: 288, y: 0 }], options))
+      .toThrow('Tiles have different quantization tables');
+    expect(() => mosaicSync([tiles[0], { image: encodeTile(288, 0, 272, 288, { subsampling: SAMP_444 }), x: 288, y: 0 }], options))
+      .toThrow('Tiles have different subsampling');
+    await expect(mosaic([{ image: tiles[0].image, x: 8, y: 0 }], options)).rejects.toThrow('MCU boundaries');
+  });
+
+  test("check libjpeg errors keep their code", async () => {
+    // The scan uses an undefined Huffman table. The header reads fine, so the
+    // error only comes up while reading the coefficients, on the worker.
+    const image = Buffer.from(tiles[0].image);
+    image[image.indexOf(Buffer.from([0xff, 0xda])) + 6] = 0x33;
+    const options = { width: 288, height: 288 };
+    expect(() => mosaicSync([{ image, x: 0, y: 0 }], options)).toThrow('Huffman table 0x03 was not defined');
+    await expect(mosaic([{ image, x: 0, y: 0 }], options)).rejects.toMatchObject({
+      message: 'jpeglib exited with an error: Huffman table 0x03 was not defined',
+      code: 'JERR_NO_HUFF_TABLE',
+    });
+  });
+
+  test("check tiles are copied losslessly", async () => {
+    const image = mosaicSync(tiles, { width: 560, height: 560 });
+    const header = readHeader(image);
+    expect([header.width, header.height]).toEqual([560, 560]);
+    expect(header.subsampling).toBe(SAMP_420);
+
+    // Away from the seams, where chroma upsampling mixes in the neighbours,
+    // every pixel is what the tile decodes to on its own
+    const res = decompressSync(image, { format: FORMAT_RGB }).data;
+    for (const tile of tiles) {
+      const own = decompressSync(tile.image, { format: FORMAT_RGB });
+      for (let y = 8; y < own.height - 8; y += 7) {
+        const start = 8 * 3;
+        const end = (own.width - 8) * 3;
+        const row = own.data.subarray(y * own.width * 3 + start, y * own.width * 3 + end);
+        const offset = ((tile.y + y) * 560 + tile.x) * 3;
+        expect(res.subarray(offset + start, offset + end)).toEqual(row);
+      }
+    }
+
+    const optimized = await mosaic(tiles, { width: 560, height: 560, optimizeHuffman: true });
+    expect(optimized.length).toBeLessThan(image.length);
+    expect(decompressSync(optimized, { format: FORMAT_RGB }).data).toEqual(res);
+  });
+
+  test("check async keeps its tiles alive", async () => {
+    const expected = mosaicSync(tiles, { width: 560, height: 560 });
+    const copies = tiles.map((tile) => ({ ...tile, image: Buffer.from(tile.image) }));
+    const promise = mosaic(copies, { width: 560, height: 560 });
+    // The worker holds its own references to the Buffers
+    for (const tile of copies) {
+      delete tile.image;
+    }
+    copies.length = 0;
+    expect((await promise).equals(expected)).toBe(true);
+  });
+
+  test("check cropping and uncovered areas", () => {
+    const image = mosaicSync([tiles[0]], { width: 300, height: 200 });
+    const res = decompressSync(image, { format: FORMAT_RGB });
+    expect([res.width, res.height]).toEqual([300, 200]);
+    // Mid-gray past the tile
+    expect([...res.data.subarray((100 * 300 + 299) * 3, (100 * 300 + 300) * 3)]).toEqual([128, 128, 128]);
+  });
+});
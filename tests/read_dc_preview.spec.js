@@ -0,0 +1,66 @@
+const { readDCPreviewSync, readDCPreview, compressSync, decompressSync, FORMAT_RGB, FORMAT_RGBA, FORMAT_GRAY } = require("..");
+const { readFileSync } = require("fs");
+const path = require("path");
+
+const sampleJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg"));
+const corruptedJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg.corrupted"));
+
+// A baseline image whose scan uses an undefined Huffman table. Its header
+// reads fine, so the error only comes up while decoding, on the worker.
+const noHuffmanTable = Buffer.from(compressSync(Buffer.alloc(64 * 48 * 3, 0x80), { format: FORMAT_RGB, width: 64, height: 48 }));
+noHuffmanTable[noHuffmanTable.indexOf(Buffer.from([0xff, 0xda])) + 6] = 0x33;
+const previewPixels = 70 * 70;
+
+describe("read_dc_preview", () => {
+  test("check readDCPreviewSync parameters", () => {
+    expect(() => readDCPreviewSync()).toThrow('Not enough arguments');
+    expect(() => readDCPreviewSync(null)).toThrow('Invalid source buffer');
+    expect(() => readDCPreviewSync(sampleJpeg1, 1)).toThrow('Invalid options');
+    expect(() => readDCPreviewSync(sampleJpeg1, { format: "abc" })).toThrow('Invalid format');
+    expect(() => readDCPreviewSync(sampleJpeg1, { format: 50 })).toThrow('Invalid output format');
+    expect(() => readDCPreviewSync(sampleJpeg1, Buffer.alloc(0), { format: FORMAT_RGB })).toThrow('Invalid destination buffer');
+    expect(() => readDCPreviewSync(sampleJpeg1, Buffer.alloc(previewPixels * 3 - 1), { format: FORMAT_RGB })).toThrow('Insufficient output buffer');
+  });
+
+  test("check result", async () => {
+    const res1 = readDCPreviewSync(sampleJpeg1, { format: FORMAT_RGB });
+    expect(res1.width).toEqual(70);
+    expect(res1.height).toEqual(70);
+    expect(res1.format).toEqual(FORMAT_RGB);
+    expect(res1.data.length).toEqual(previewPixels * 3);
+
+    const res2 = await readDCPreview(sampleJpeg1, Buffer.alloc(previewPixels * 4), { format: FORMAT_RGB });
+    expect(res2.data.toString('base64')).toEqual(res1.data.toString('base64'));
+
+    const res3 = readDCPreviewSync(sampleJpeg1);
+    expect(res3.format).toEqual(FORMAT_RGBA);
+    expect(res3.data.length).toEqual(previewPixels * 4);
+
+    const res4 = readDCPreviewSync(sampleJpeg1, { format: FORMAT_GRAY });
+    expect(res4.data.length).toEqual(previewPixels);
+  });
+
+  test("check result matches the mean of the blocks", () => {
+    const full = decompressSync(sampleJpeg1, { format: FORMAT_GRAY });
+    const preview = readDCPreviewSync(sampleJpeg1, { format: FORMAT_GRAY });
+
+    const mean = (data) => data.reduce((a, b) => a + b, 0) / data.length;
+    expect(Math.abs(mean(preview.data) - mean(full.data))).toBeLessThan(2);
+
+    // Top left block is plain background
+    let sum = 0;
+    for (let y = 0; y < 8; y++) {
+      for (let x = 0; x < 8; x++) {
+        sum += full.data[y * 560 + x];
+      }
+    }
+    expect(Math.abs(preview.data[0] - sum / 64)).toBeLessThan(2);
+  });
+
+  test("check libjpeg errors throw", async () => {
+    expect(() => readDCPreviewSync(Buffer.alloc(100))).toThrow('jpeglib exited with an error: Not a JPEG file: starts with 0x00 0x00');
+    await expect(async () => { await readDCPreview(corruptedJpeg1) }).rejects.toThrow('jpeglib exited with an error: Bogus Huffman table definition');
+    // Errors on the worker keep their code and warnings, like the sync ones
+    await expect(readDCPreview(noHuffmanTable)).rejects.toMatchObject({ message: 'jpeglib exited with an error: Huffman table 0x03 was not defined', code: 'JERR_NO_HUFF_TABLE', warnings: [], warningCount: 0 });
+  });
+});
@@ -87,4 +87,47 @@ describe("read_dct", () => {
     await expect(async () => { await readDCT(Buffer.alloc(100)) }).rejects.toThrow('jpeglib exited with an error: Not a JPEG file: starts with 0x00 0x00');
     await expect(async () => { await readDCT(corruptedJpeg1) }).rejects.toThrow('jpeglib exited with an error: Bogus Huffman table definition');
   });
+
+  test("check readDCT errors carry code and warnings", async () => {
+    const check = (e) => {
+      expect(e.code).toBe('JERR_BAD_HUFF_TABLE');
+      expect(e.warningCount).toBe(1);
+      expect(e.warnings).toEqual(['Premature end of JPEG file']);
+    };
+
+    expect.assertions(6);
+    try {
+      readDCTSync(corruptedJpeg1);
+    } catch (e) {
+      check(e);
+    }
+    await readDCT(corruptedJpeg1).catch(check);
+  });
+
+  test("check readDCT warnings option", async () => {
+    const out = readDCTSync(sampleJpeg1, { warnings: 'fatal' });
+    expect(out.warnings).toEqual([]);
+    expect(out.warningCount).toBe(0);
+
+    expect(() => readDCTSync(sampleJpeg1, { warnings: 'loud' })).toThrow('Invalid warnings');
+    expect(() => readDCTSync(sampleJpeg1, 1)).toThrow('Invalid options');
+    expect(() => readDCTSync(corruptedJpeg1, { warnings: 'fatal' })).toThrow('Premature end of JPEG file');
+    await expect(readDCT(corruptedJpeg1, { warnings: 'fatal' })).rejects.toMatchObject({ code: 'JWRN_JPEG_EOF' });
+    await expect(readDCT(corruptedJpeg1, { warnings: 'ignore' })).rejects.toMatchObject({ warnings: [], warningCount: 1 });
+  });
+
+  test("check readDCT limits", async () => {
+    expect(() => readDCTSync(sampleJpeg1, { limits: 1 })).toThrow('Invalid limits');
+    expect(() => readDCTSync(sampleJpeg1, { limits: { maxPixels: -1 } })).toThrow('Invalid limits');
+    expect(() => readDCTSync(sampleJpeg1, { limits: { maxScans: 1.5 } })).toThrow('Invalid limits');
+
+    // The sample is a 560x560 progressive image with 10 scans
+    readDCTSync(sampleJpeg1, { limits: { maxPixels: 560 * 560, maxDimension: 560, maxScans: 10, maxMemory: 64 * 1024 * 1024 } });
+    expect(() => readDCTSync(sampleJpeg1, { limits: { maxPixels: 560 * 560 - 1 } })).toThrow('more than maxPixels');
+    expect(() => readDCTSync(sampleJpeg1, { limits: { maxDimension: 559 } })).toThrow('exceed maxDimension');
+    expect(() => readDCTSync(sampleJpeg1, { limits: { maxScans: 9 } })).toThrow('Image has more than 9 scans');
+    await expect(readDCT(sampleJpeg1, { limits: { maxScans: 9 } })).rejects.toMatchObject({ code: 'LIMIT_EXCEEDED' });
+    // The coefficients alone take more than this
+    await expect(readDCT(sampleJpeg1, { limits: { maxMemory: 100000 } })).rejects.toThrow();
+  });
 });
@@ -0,0 +1,107 @@
+const { readHeader, compressSync, decompressSync, decompress, FORMAT_RGB, SAMP_444, SAMP_420 } = require("..");
+const { readFileSync } = require("fs");
+const path = require("path");
+
+const sampleJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg"));
+const corruptJpeg = readFileSync(path.join(__dirname, "github_logo.jpg.corrupted"));
+
+describe("readHeader", () => {
+  test("check readHeader parameters", () => {
+    readHeader(sampleJpeg1);
+    readHeader(sampleJpeg1, {});
+    readHeader(sampleJpeg1, { markers: true });
+
+    expect(() => readHeader()).toThrow('Not enough arguments');
+    expect(() => readHeader(null)).toThrow('Invalid source buffer');
+    expect(() => readHeader({})).toThrow('Invalid source buffer');
+    expect(() => readHeader(sampleJpeg1, 1)).toThrow('Invalid options');
+    expect(() => readHeader(sampleJpeg1, { markers: 1 })).toThrow('Invalid markers');
+    expect(() => readHeader(corruptJpeg)).toThrow('Bogus Huffman table definition');
+  });
+
+  test("reads the header", () => {
+    const header = readHeader(sampleJpeg1);
+    expect(header.width).toBe(560);
+    expect(header.height).toBe(560);
+    expect(header.components).toBe(3);
+    expect(header.subsampling).toBe(SAMP_444);
+    expect(header.progressive).toBe(true);
+    expect(header.precision).toBe(8);
+    expect(header.markers).toBeUndefined();
+    expect(header.warningCount).toBe(0);
+  });
+
+  test("check readHeader warnings", () => {
+    expect(() => readHeader(sampleJpeg1, { warnings: 'none' })).toThrow('Invalid warnings');
+    expect(() => readHeader(corruptJpeg, { warnings: 'fatal' })).toThrow('Premature end of JPEG file');
+    try {
+      readHeader(corruptJpeg);
+    } catch (e) {
+      expect(e.code).toBe('JERR_BAD_HUFF_TABLE');
+      expect(e.warningCount).toBe(1);
+    }
+  });
+
+  test("markers are views into the source", () => {
+    const { markers } = readHeader(sampleJpeg1, { markers: true });
+    expect(markers.length).toBe(1);
+    expect(markers[0].marker).toBe(0xe1);
+    expect(markers[0].type).toBe("exif");
+    expect(markers[0].data.length).toBe(5268);
+    expect(markers[0].data.buffer).toBe(sampleJpeg1.buffer);
+    expect(markers[0].data.byteOffset).toBe(sampleJpeg1.byteOffset + 24);
+  });
+
+  test("decompress returns markers", async () => {
+    const options = { format: FORMAT_RGB, markers: true };
+    const sync = decompressSync(sampleJpeg1, options);
+    const async = await decompress(sampleJpeg1, options);
+    for (let out of [sync, async]) {
+      expect(out.markers.length).toBe(1);
+      expect(out.markers[0].type).toBe("exif");
+    }
+    expect(decompressSync(sampleJpeg1, { format: FORMAT_RGB }).markers).toBeUndefined();
+    expect(() => decompressSync(sampleJpeg1, { format: FORMAT_RGB, markers: "yes" })).toThrow('Invalid markers');
+  });
+});
+
+describe("compress markers", () => {
+  const width = 48;
+  const height = 32;
+  const raw = Buffer.alloc(width * height * 3, 128);
+  const options = { format: FORMAT_RGB, width: width, height: height, subsampling: SAMP_420 };
+
+  test("check markers option", () => {
+    expect(() => compressSync(raw, { ...options, markers: 1 })).toThrow('Invalid markers');
+    expect(() => compressSync(raw, { ...options, markers: [1] })).toThrow('Invalid markers');
+    expect(() => compressSync(raw, { ...options, markers: [{ marker: 0xd8, data: Buffer.alloc(1) }] })).toThrow('Invalid marker');
+    expect(() => compressSync(raw, { ...options, markers: [{ marker: 0xe1 }] })).toThrow('Invalid marker data');
+    expect(() => compressSync(raw, { ...options, markers: [{ marker: 0xe1, data: Buffer.alloc(65534) }] })).toThrow('Marker data is too long');
+  });
+
+  test("preserves markers", () => {
+    const source = readHeader(sampleJpeg1, { markers: true }).markers;
+    const comment = { marker: 0xfe, data: Buffer.from("hello") };
+    const markers = source.concat([comment]);
+
+    const plain = compressSync(raw, options);
+    const encoded = compressSync(raw, { ...options, markers: markers });
+    expect(encoded.length).toBe(plain.length + 4 + 5268 + 4 + 5);
+
+    const read = readHeader(encoded, { markers: true }).markers;
+    expect(read.map((m) => m.type)).toEqual(["exif", "comment"]);
+    expect(read[0].data.equals(source[0].data)).toBe(true);
+    expect(read[1].data.toString()).toBe("hello");
+
+    const decoded = decompressSync(encoded, { format: FORMAT_RGB });
+    expect(decoded.data.equals(decompressSync(plain, { format: FORMAT_RGB }).data)).toBe(true);
+  });
+
+  test("preserves markers with targetBytes", () => {
+    const comment = { marker: 0xfe, data: Buffer.from("hello") };
+    const out = compressSync(raw, { ...options, targetBytes: 2000, markers: [comment] });
+    const read = readHeader(out.data, { markers: true }).markers;
+    expect(read.length).toBe(1);
+    expect(read[0].data.toString()).toBe("hello");
+  });
+});
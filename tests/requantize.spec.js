@@ -0,0 +1,66 @@
+const { requantizeSync, requantize, readDCTSync, compressSync, decompressSync, FORMAT_RGB } = require("..");
+const { readFileSync } = require("fs");
+const path = require("path");
+
+const sampleJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg"));
+const corruptedJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg.corrupted"));
+
+// A baseline image whose scan uses an undefined Huffman table. Its header
+// reads fine, so the error only comes up while decoding, on the worker.
+const noHuffmanTable = Buffer.from(compressSync(Buffer.alloc(64 * 48 * 3, 0x80), { format: FORMAT_RGB, width: 64, height: 48 }));
+noHuffmanTable[noHuffmanTable.indexOf(Buffer.from([0xff, 0xda])) + 6] = 0x33;
+
+describe("requantize", () => {
+  test("check requantizeSync parameters", () => {
+    expect(() => requantizeSync()).toThrow('Not enough arguments');
+    expect(() => requantizeSync(null, { quality: 50 })).toThrow('Invalid source buffer');
+    expect(() => requantizeSync(sampleJpeg1, null)).toThrow('Invalid options');
+    expect(() => requantizeSync(sampleJpeg1, {})).toThrow('Invalid quantTables');
+    expect(() => requantizeSync(sampleJpeg1, { quality: 0 })).toThrow('Invalid quality');
+    expect(() => requantizeSync(sampleJpeg1, { quality: 101 })).toThrow('Invalid quality');
+    expect(() => requantizeSync(sampleJpeg1, { quality: 50, quantTables: [] })).toThrow('Invalid quality');
+    expect(() => requantizeSync(sampleJpeg1, { quantTables: [] })).toThrow('Invalid quantTables');
+    expect(() => requantizeSync(sampleJpeg1, { quantTables: [[1, 2, 3]] })).toThrow('Invalid quantization table');
+    expect(() => requantizeSync(sampleJpeg1, { quantTables: [new Uint16Array(64)] })).toThrow('Invalid quantization table');
+    expect(() => requantizeSync(sampleJpeg1, { quantTables: [new Uint16Array(64).fill(2)] })).toThrow('Missing quantization table');
+    expect(() => requantizeSync(sampleJpeg1, { quality: 50, optimizeHuffman: 1 })).toThrow('Invalid optimizeHuffman');
+  });
+
+  test("check result", async () => {
+    const res1 = requantizeSync(sampleJpeg1, { quality: 50 });
+    expect(res1.length).toBeLessThan(sampleJpeg1.length);
+
+    const decoded = decompressSync(res1, { format: FORMAT_RGB });
+    expect(decoded.width).toEqual(560);
+    expect(decoded.height).toEqual(560);
+
+    const res2 = requantizeSync(sampleJpeg1, { quality: 50, optimizeHuffman: true });
+    expect(res2.length).toBeLessThan(res1.length);
+
+    const res3 = await requantize(sampleJpeg1, { quality: 50 });
+    expect(res3.toString('base64')).toEqual(res1.toString('base64'));
+  });
+
+  test("check quantization tables", () => {
+    const original = readDCTSync(sampleJpeg1);
+
+    // Requantizing with the existing tables keeps the coefficients as they are
+    const same = readDCTSync(requantizeSync(sampleJpeg1, { quantTables: original.qts }));
+    expect(same.Y.data.data).toEqual(original.Y.data.data);
+
+    // Tables are never made finer than the original ones
+    const finer = readDCTSync(requantizeSync(sampleJpeg1, { quality: 100 }));
+    for (let i = 0; i < original.qts.length; i++) {
+      if (original.qts[i]) {
+        expect(finer.qts[i].data).toEqual(original.qts[i].data);
+      }
+    }
+  });
+
+  test("check libjpeg errors throw", async () => {
+    expect(() => requantizeSync(Buffer.alloc(100), { quality: 50 })).toThrow('jpeglib exited with an error: Not a JPEG file: starts with 0x00 0x00');
+    await expect(async () => { await requantize(corruptedJpeg1, { quality: 50 }) }).rejects.toThrow('jpeglib exited with an error: Bogus Huffman table definition');
+    // Errors on the worker keep their code and warnings, like the sync ones
+    await expect(requantize(noHuffmanTable, { quality: 50 })).rejects.toMatchObject({ message: 'jpeglib exited with an error: Huffman table 0x03 was not defined', code: 'JERR_NO_HUFF_TABLE', warnings: [], warningCount: 0 });
+  });
+});
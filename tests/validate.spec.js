@@ -0,0 +1,132 @@
+const { validateSync, validate, compressSync, compressTables, FORMAT_RGB } = require("..");
+const { readFileSync } = require("fs");
+const path = require("path");
+
+const sampleJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg"));
+const corruptedJpeg1 = readFileSync(path.join(__dirname, "github_logo.jpg.corrupted"));
+
+const valid = { valid: true, warnings: [], warningCount: 0 };
+
+// The sample image with some of its scan data scrambled
+const scrambled = Buffer.from(sampleJpeg1);
+for (let i = scrambled.length >> 1; i < (scrambled.length >> 1) + 40; i++) {
+  scrambled[i] = scrambled[i] === 0xff ? 0x12 : scrambled[i] ^ 0x5a;
+}
+
+describe("validate", () => {
+  test("check validateSync parameters", () => {
+    expect(() => validateSync()).toThrow('Not enough arguments');
+    expect(() => validateSync(null)).toThrow('Invalid source buffer');
+    expect(() => validateSync([sampleJpeg1, null])).toThrow('Invalid source buffer');
+    expect(() => validateSync(sampleJpeg1, 1)).toThrow('Invalid options');
+    expect(() => validateSync(sampleJpeg1, { level: 'full' })).toThrow('Invalid level');
+    expect(() => validateSync(sampleJpeg1, { warnings: 'loud' })).toThrow('Invalid warnings');
+    expect(() => validateSync(sampleJpeg1, { limits: 1 })).toThrow('Invalid limits');
+    expect(() => validateSync(sampleJpeg1, { tables: "tables" })).toThrow('Invalid tables');
+  });
+
+  test("check valid images", async () => {
+    expect(validateSync(sampleJpeg1)).toEqual(valid);
+    expect(validateSync(sampleJpeg1, { level: 'markers' })).toEqual(valid);
+    expect(await validate(sampleJpeg1)).toEqual(valid);
+
+    // The sample is progressive, this one is baseline
+    const raw = Buffer.alloc(64 * 48 * 3, 0x80);
+    const options = { format: FORMAT_RGB, width: 64, height: 48 };
+    expect(validateSync(compressSync(raw, options))).toEqual(valid);
+    // Anything after the EOI is ignored
+    expect(validateSync(Buffer.concat([sampleJpeg1, Buffer.from("trailer")]))).toEqual(valid);
+
+    const frame = compressSync(raw, { ...options, abbreviated: true });
+    const tables = compressTables(options);
+    expect(validateSync(frame, { level: 'markers' })).toMatchObject({ valid: false, code: 'JERR_NO_QUANT_TABLE' });
+    expect(validateSync(frame, { level: 'markers', tables })).toEqual(valid);
+    expect(validateSync(frame, { tables })).toEqual(valid);
+  });
+
+  test("check broken structure", () => {
+    // The corrupted sample runs out in a DHT segment, before the first scan.
+    // libjpeg reads on as if an EOI marker followed, and fails on the table.
+    expect(validateSync(corruptedJpeg1, { level: 'markers' })).toEqual({
+      valid: false,
+      error: 'jpeglib exited with an error: JPEG datastream contains no image',
+      code: 'JERR_NO_IMAGE',
+      warnings: ['Premature end of JPEG file'],
+      warningCount: 1,
+    });
+    expect(validateSync(corruptedJpeg1)).toEqual({
+      valid: false,
+      error: 'jpeglib exited with an error: Bogus Huffman table definition',
+      code: 'JERR_BAD_HUFF_TABLE',
+      warnings: ['Premature end of JPEG file'],
+      warningCount: 1,
+    });
+
+    for (const level of ['markers', 'entropy']) {
+      // A missing EOI is only a warning, like it is for decompress
+      const truncated = sampleJpeg1.subarray(0, -2);
+      expect(validateSync(truncated, { level })).toEqual({
+        valid: false,
+        warnings: ['Premature end of JPEG file'],
+        warningCount: 1,
+      });
+      expect(validateSync(truncated, { level, warnings: 'ignore' })).toMatchObject({ valid: true });
+      expect(validateSync(truncated, { level, warnings: 'fatal' })).toMatchObject({ valid: false, code: 'JWRN_JPEG_EOF' });
+      expect(validateSync(corruptedJpeg1, { level, warnings: 'fatal' })).toMatchObject({ valid: false, code: 'JWRN_JPEG_EOF' });
+      expect(validateSync(Buffer.alloc(0), { level })).toMatchObject({ valid: false, code: 'JERR_INPUT_EMPTY' });
+      expect(validateSync(Buffer.from("GIF89a"), { level })).toMatchObject({ valid: false, code: 'JERR_NO_SOI' });
+      expect(validateSync(sampleJpeg1, { level, limits: { maxDimension: 100 } }))
+        .toMatchObject({ valid: false, code: 'LIMIT_EXCEEDED' });
+    }
+
+    // A bad segment length
+    const badLength = Buffer.from(sampleJpeg1);
+    badLength.writeUInt16BE(1, 4);
+    expect(validateSync(badLength, { level: 'markers' })).toMatchObject({ valid: false, code: 'JERR_BAD_LENGTH' });
+
+    // Garbage between segments is only a warning
+    const garbage = Buffer.concat([sampleJpeg1.subarray(0, 2), Buffer.from([1, 2, 3]), sampleJpeg1.subarray(2)]);
+    expect(validateSync(garbage, { level: 'markers' })).toEqual({
+      valid: false,
+      warnings: ['Corrupt JPEG data: 3 extraneous bytes before marker 0xe0'],
+      warningCount: 1,
+    });
+    expect(validateSync(garbage, { level: 'markers', warnings: 'ignore' })).toMatchObject({ valid: true });
+    expect(validateSync(garbage, { level: 'markers', warnings: 'fatal' })).toMatchObject({ valid: false, code: 'JWRN_EXTRANEOUS_DATA' });
+  });
+
+  test("check broken scan data", () => {
+    // The markers are intact, so only decoding the scans finds the damage
+    expect(validateSync(scrambled, { level: 'markers' })).toEqual(valid);
+
+    const res = validateSync(scrambled);
+    expect(res.valid).toBe(false);
+    expect(res.warningCount).toBeGreaterThan(0);
+    expect(res.warnings[0]).toMatch('Corrupt JPEG data');
+
+    expect(validateSync(scrambled, { warnings: 'ignore' }).valid).toBe(true);
+    expect(validateSync(scrambled, { warnings: 'fatal' })).toMatchObject({ valid: false, code: 'JWRN_HUFF_BAD_CODE' });
+  });
+
+  test("check batch", async () => {
+    const res = await validate([sampleJpeg1, corruptedJpeg1, scrambled, sampleJpeg1]);
+    expect(res.length).toEqual(4);
+    expect(res[0]).toEqual(valid);
+    expect(res[1]).toMatchObject({ valid: false, code: 'JERR_BAD_HUFF_TABLE' });
+    expect(res[2].valid).toBe(false);
+    expect(res[3]).toEqual(valid);
+
+    expect(validateSync([sampleJpeg1, corruptedJpeg1, scrambled], { level: 'markers' }).map((r) => r.valid))
+      .toEqual([true, false, true]);
+  });
+
+  test("check batch keeps its inputs alive", async () => {
+    const images = [Buffer.from(sampleJpeg1), Buffer.from(scrambled)];
+    const promise = validate(images);
+    // The worker holds its own references to the Buffers
+    images.length = 0;
+    const res = await promise;
+    expect(res[0]).toEqual(valid);
+    expect(res[1].valid).toBe(false);
+  });
+});